@@ -164,6 +164,41 @@
 //#define TCA0_DUTY_CYCLE_ADJUST(_dc_) (_dc_)
 //#define TCB_DUTY_CYCLE_ADJUST(_dc_) (_dc_)
 
+// If non-zero, transmitted UART data is copied into a queue of this many
+// bytes and sent from the data-register-empty interrupt, so that
+// uart_transmit_block() (and by extension serial_printf() and friends) only
+// has to wait when the queue is full
+// Each UART port gets its own queue
+// Must be 0 or a power of 2 <= 128
+#ifndef UART_TX_BUFFER_BYTES
+# define UART_TX_BUFFER_BYTES 0U
+#endif
+
+// If non-zero, 8-bit SPI transfers are moved by the SPI interrupt while the
+// CPU sits in idle sleep instead of being polled
+// The cost of an interrupt per byte means this saves power but loses
+// throughput when the SPI clock is near the maximum; it's most useful for
+// long transfers at slow clocks such as while initializing an SD card
+// Transfers started with interrupts disabled are always polled
+// It's off by default because whether it helps depends on the SPI clock: at
+// the fastest clock (CPU/2) a byte is 16 CPU cycles on the wire, fewer than
+// entering and leaving the ISR, so the CPU never gets to sleep and the
+// transfer is slower, and the ISR costs flash on parts that have little of it
+// The SPI benchmark in the test program reports active cycles per byte next
+// to throughput to check where it pays off
+#ifndef uHAL_USE_SPI_IRQ
+# define uHAL_USE_SPI_IRQ 0
+#endif
+
+// If non-zero, count the SPI interrupts and wake-ups during interrupt-driven
+// transfers and time how long the CPU spends asleep; see spi_get_irq_stats()
+// This is meant for benchmarking, reading the micro-second counter in the ISR
+// makes it slower
+// Requires uHAL_USE_SPI_IRQ and uHAL_USE_USCOUNTER
+#ifndef ENABLE_SPI_IRQ_STATS
+# define ENABLE_SPI_IRQ_STATS 0
+#endif
+
 // If non-zero, use RTC emulation code
 // There's no other RTC option for this platform
 #ifndef uHAL_USE_RTC_EMULATION
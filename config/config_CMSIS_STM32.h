@@ -145,6 +145,85 @@
 # define SLEEP_ALARM_TIMER 0
 #endif
 
+// If non-zero, uart_transmit_async() is available to hand UART transmissions
+// off to the DMA controller
+// The DMA stream used is fixed by the hardware for each UART and can't be
+// used by anything else while a transmission is in progress
+#ifndef uHAL_USE_UART_TX_DMA
+# define uHAL_USE_UART_TX_DMA 0
+#endif
+//
+// If non-zero, UART reception while listening is handled by the DMA controller
+// writing to the RX buffer in circular mode instead of by an interrupt for
+// every byte; the RX interrupt hook is instead called when the line goes
+// idle after receiving something
+// UART_INPUT_BUFFER_BYTES must be > 0, and the buffer must be read at least
+// once in the time it takes to fill it or data will be lost
+// RTS flow control can't be used with this because the buffer is overwritten
+// regardless of how full it is; ports configured with an RTS pin return
+// ERR_NOTSUP
+#ifndef uHAL_USE_UART_RX_DMA
+# define uHAL_USE_UART_RX_DMA 0
+#endif
+//
+// If non-zero, SPI block transfers are handled by the DMA controller and
+// spi_transmit_block_async() and spi_receive_block_async() are available
+// The DMA streams used are fixed by the hardware and are only claimed for
+// the duration of a transfer; if something else has them, the blocking
+// functions fall back to handling each byte themselves
+// They also fall back when called with interrupts masked or from an ISR,
+// since nothing would be able to tell them the transfer is done
+#ifndef uHAL_USE_SPI_DMA
+# define uHAL_USE_SPI_DMA 0
+#endif
+//
+// Blocking SPI transfers shorter than this are handled without DMA even when
+// uHAL_USE_SPI_DMA is set because setting up the streams takes longer than
+// sending a few bytes
+#ifndef SPI_DMA_MIN_BYTES
+# define SPI_DMA_MIN_BYTES 16U
+#endif
+//
+// If non-zero, spi_queue_submit() is available to queue transactions that are
+// worked through in order in the background
+// Requires uHAL_USE_SPI_DMA
+#ifndef uHAL_USE_SPI_QUEUE
+# define uHAL_USE_SPI_QUEUE 0
+#endif
+//
+// The number of transactions that can be queued at once on each SPI port
+// Must be a power of 2 <= 128
+#ifndef SPI_QUEUE_LENGTH
+# define SPI_QUEUE_LENGTH 8U
+#endif
+//
+// If non-zero, I2C transfers are driven by the peripheral's event and error
+// interrupts and i2c_transmit_block_async() and i2c_receive_block_async()
+// are available
+// The blocking transfer functions sleep while the transfer is in progress
+// unless interrupts are disabled, in which case they fall back to polling
+#ifndef uHAL_USE_I2C_IRQ
+# define uHAL_USE_I2C_IRQ 0
+#endif
+//
+// If non-zero, the data phase of longer I2C transfers is handled by the DMA
+// controller, both for the interrupt-driven transfers and for
+// i2c_transmit_block_continue()
+// The DMA streams are claimed only for the duration of a transfer; if
+// something else has them, each byte is handled by the CPU instead
+// Requires uHAL_USE_I2C_IRQ
+#ifndef uHAL_USE_I2C_DMA
+# define uHAL_USE_I2C_DMA 0
+#endif
+//
+// I2C transfers shorter than this are handled without DMA even when
+// uHAL_USE_I2C_DMA is set
+// Must be >= 2; single-byte receptions have to NACK before the address
+// phase is finished, which DMA can't do
+#ifndef I2C_DMA_MIN_BYTES
+# define I2C_DMA_MIN_BYTES 16U
+#endif
+
 
 /*
 //
@@ -215,7 +294,8 @@
 #define UART_COMM_TX_PIN PINID_UART1_TX
 #define UART_COMM_RX_PIN PINID_UART1_RX
 //
-// SPI pins
+// Default SPI port pins
+// Other ports are set up with spi_init_port()
 #define SPI_SS_PIN    PINID_SPI1_NSS
 #define SPI_SCK_PIN   PINID_SPI1_SCK
 #define SPI_MISO_PIN  PINID_SPI1_MISO
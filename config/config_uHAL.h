@@ -148,10 +148,48 @@
 // The number of buffered input bytes per interface
 // Any bytes received on the interface while uart_listen_on() has been called
 // will be discarded if this is 0
+// Must be 0 or a power of 2
 #ifndef UART_INPUT_BUFFER_BYTES
 # define UART_INPUT_BUFFER_BYTES 1U
 #endif
 //
+// If non-zero, UART ports can be configured with RTS and CTS pins for
+// hardware flow control
+// RTS flow control requires ENABLE_UART_LISTENING and UART_INPUT_BUFFER_BYTES
+// > 0 because it's driven by the fill level of the RX buffer, and isn't
+// available with uHAL_USE_UART_RX_DMA on platforms that have it
+#ifndef ENABLE_UART_FLOW_CONTROL
+# define ENABLE_UART_FLOW_CONTROL 0
+#endif
+//
+// When flow control is enabled, RTS is de-asserted to ask the other end to
+// stop sending once this many bytes are waiting in the RX buffer...
+#ifndef UART_RTS_HIGH_WATER
+# define UART_RTS_HIGH_WATER (UART_INPUT_BUFFER_BYTES - (UART_INPUT_BUFFER_BYTES / 4U))
+#endif
+//
+// ...and asserted again once it's been read down to this many
+// The gap between the two marks needs to be large enough that a reader
+// taking a few bytes at a time doesn't toggle RTS on every read
+#ifndef UART_RTS_LOW_WATER
+# define UART_RTS_LOW_WATER (UART_INPUT_BUFFER_BYTES / 2U)
+#endif
+//
+// If non-zero, the RX interrupt can be told to watch for line delimiters with
+// uart_rx_set_delimiters() so that uart_rx_irq_hook() is only called once a
+// complete line has been received
+// Requires ENABLE_UART_LISTENING and UART_INPUT_BUFFER_BYTES > 0
+#ifndef ENABLE_UART_LINE_MODE
+# define ENABLE_UART_LINE_MODE 0
+#endif
+//
+// If non-zero, keep per-port traffic and error counters which can be read
+// with uart_get_stats()
+// This adds some work to the RX interrupt so it's off by default
+#ifndef ENABLE_UART_STATS
+# define ENABLE_UART_STATS 0
+#endif
+//
 // Enable output to a UART serial console
 #ifndef uHAL_USE_UART_COMM
 # define uHAL_USE_UART_COMM uHAL_USE_SUBSYSTEM_DEFAULT
@@ -179,6 +217,15 @@
 #ifndef UART_COMM_BAUDRATE
 # define UART_COMM_BAUDRATE 9600UL
 #endif
+//
+// The serial console RTS and CTS pins, or 0 if unused
+// Requires ENABLE_UART_FLOW_CONTROL
+#ifndef UART_COMM_RTS_PIN
+# define UART_COMM_RTS_PIN 0
+#endif
+#ifndef UART_COMM_CTS_PIN
+# define UART_COMM_CTS_PIN 0
+#endif
 
 //
 // Terminal configuraiton options
@@ -206,6 +253,13 @@
 # define TERMINAL_TIMEROUT_S 3600U // 1 Hour
 #endif
 //
+// When ENABLE_UART_LINE_MODE and uHAL_USE_HIBERNATE are set, the terminal
+// sleeps for this many milliseconds at a time while waiting for a line
+// rather than polling the serial port
+#ifndef TERMINAL_LINE_WAIT_MS
+# define TERMINAL_LINE_WAIT_MS 50U
+#endif
+//
 // Size of the input buffer
 #ifndef TERMINAL_BUFFER_BYTES
 # define TERMINAL_BUFFER_BYTES 64U
@@ -230,6 +284,29 @@
 #ifndef SPI_FREQUENCY_HZ
 # define SPI_FREQUENCY_HZ 100000UL
 #endif
+//
+// If non-zero, record the start and end time of each device transaction in a
+// ring buffer which can be summarized with spi_trace_histogram() or the
+// terminal's 'spi_trace' command
+// Requires uHAL_USE_USCOUNTER; the counter must be running for the times to
+// mean anything
+#ifndef ENABLE_SPI_TRACE
+# define ENABLE_SPI_TRACE 0
+#endif
+//
+// The number of transactions kept in the trace; once it's full the oldest is
+// discarded
+// Each entry takes 12 bytes (10 on AVR)
+// Must be a power of 2 <= 128
+#ifndef SPI_TRACE_LENGTH
+# define SPI_TRACE_LENGTH 16U
+#endif
+//
+// The number of bins in a trace histogram; the last one counts anything
+// taking 2^(SPI_TRACE_HISTOGRAM_BINS-1)us or more
+#ifndef SPI_TRACE_HISTOGRAM_BINS
+# define SPI_TRACE_HISTOGRAM_BINS 20U
+#endif
 
 //
 // I2C configuration options
@@ -240,9 +317,16 @@
 #endif
 //
 // Target speed of the I2C bus
+// This is the speed set by i2c_init(), it can be changed later with
+// i2c_set_frequency()
 #ifndef I2C_FREQUENCY_HZ
 # define I2C_FREQUENCY_HZ 50000UL
 #endif
+//
+// Timeout used by devices on the I2C bus which don't set their own
+#ifndef I2C_DEVICE_TIMEOUT_MS
+# define I2C_DEVICE_TIMEOUT_MS 100U
+#endif
 
 //
 // PWM configuration options
@@ -291,6 +375,28 @@
 #ifndef uHAL_USE_FATFS_SD
 # define uHAL_USE_FATFS_SD uHAL_USE_FATFS
 #endif
+//
+// The highest SPI bus speed used with the SD card once it's been initialized
+// The card's own limit is used instead if it's lower; initialization is always
+// done at 400KHz or less
+#ifndef FATFS_SD_MAX_FREQUENCY_HZ
+# define FATFS_SD_MAX_FREQUENCY_HZ 25000000UL
+#endif
+//
+// If non-zero, have the SD card check the CRC of commands and data (CMD59) and
+// check the CRC of data it sends back
+// This is worth enabling when the wiring is long or noisy, but on STM32 the
+// data blocks then go through the hardware CRC unit with polled 16-bit frames
+// instead of DMA, which costs throughput
+#ifndef FATFS_SD_USE_CRC
+# define FATFS_SD_USE_CRC 0
+#endif
+//
+// The number of times a failed sector read or write is retried before giving
+// up
+#ifndef FATFS_SD_RETRIES
+# define FATFS_SD_RETRIES 2U
+#endif
 
 //
 // Real-time clock configuration
@@ -350,6 +456,12 @@
 # define SSD1306_INIT_COMMANDS_COUNT 0
 #endif
 //
+// The highest I2C bus speed to use with the device
+// The SSD1306 can handle up to 400KHz; if 0, I2C_FREQUENCY_HZ is used
+#ifndef SSD1306_I2C_FREQUENCY_HZ
+# define SSD1306_I2C_FREQUENCY_HZ 0
+#endif
+//
 // Support font scaling by way of the scale_x and scale_y members of ssd1306_font_t
 #ifndef SSD1306_FONT_AUTOSCALE
 # define SSD1306_FONT_AUTOSCALE 1
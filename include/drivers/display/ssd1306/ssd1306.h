@@ -95,6 +95,7 @@ typedef struct {
 	uint8_t flags;    ///< Status flags, see the @c SSD1306_STATUS_FLAG_* macros
 	uint8_t contrast; ///< Screen contrast
 	const ssd1306_cfg_t *cfg; ///< Device configuration, saved from @c ssd1306_init()
+	i2c_device_t i2c; ///< The I2C device, set up by @c ssd1306_init()
 } ssd1306_handle_t;
 //
 // Status flags
@@ -44,6 +44,23 @@ err_t i2c_off(void);
 /// @retval false if turned off.
 bool i2c_is_on(void);
 
+///
+/// Change the speed of the I2C bus.
+///
+/// The fastest speed the hardware supports that doesn't exceed @c hz is used,
+/// or the slowest if they're all too fast. The speed is limited by the bus
+/// mode the hardware supports: 400KHz for fast mode on STM32 and 1MHz for fast
+/// mode plus on AVR_XMEGA3. It stays in effect until changed again or until
+/// @c i2c_init() is called.
+///
+/// Must not be called in the middle of a transaction.
+///
+/// @param hz The desired bus speed.
+///  Must be > 0.
+///
+/// @returns The speed actually set, or 0 if it couldn't be changed.
+uint32_t i2c_set_frequency(uint32_t hz);
+
 ///
 /// Receive a data block in one transaction.
 ///
@@ -59,6 +76,59 @@ bool i2c_is_on(void);
 ///  the nature of the problem encountered.
 err_t i2c_receive_block(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, utime_t timeout);
 
+///
+/// Transmit a data block and then receive one in a single transaction.
+///
+/// The reception starts with a repeated start condition rather than a stop
+/// followed by a start, so no other master can take the bus in between. This
+/// is the usual way to read a device's registers.
+///
+/// @param addr The address of the device to send data to and then request
+///  data from.
+/// @param tx_buffer The bytes to send, such as a register address.
+///  Must not be NULL.
+/// @param tx_size The number of bytes in @c tx_buffer.
+///  Must be > 0.
+/// @param rx_buffer The bytes received.
+///  Must not be NULL.
+/// @param rx_size The number of bytes to receive.
+///  Must be > 0.
+/// @param timeout Abort if the operation takes more than this many milliseconds.
+///  Must be > 0.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t i2c_write_read(uint8_t addr, const uint8_t *tx_buffer, txsize_t tx_size, uint8_t *rx_buffer, txsize_t rx_size, utime_t timeout);
+
+///
+/// A single transaction run by @c i2c_write_read_batch().
+typedef struct {
+	uint8_t addr; ///< The address of the device.
+	const uint8_t *tx_buffer; ///< The bytes to send.
+	txsize_t tx_size; ///< The number of bytes in @c tx_buffer.
+	uint8_t *rx_buffer; ///< The bytes received.
+	txsize_t rx_size; ///< The number of bytes to receive.
+	err_t status; ///< Set to the result of the transaction.
+} i2c_write_read_t;
+
+///
+/// Run a list of transactions with @c i2c_write_read().
+///
+/// Each transaction is ended with a stop condition before the next is
+/// started. A failed transaction doesn't stop the rest from being run.
+///
+/// @param reads The transactions to run. The @c status field of each is set
+///  to the result.
+///  Must not be NULL.
+/// @param count The number of transactions in @c reads.
+/// @param timeout Abort a transaction if it takes more than this many
+///  milliseconds.
+///  Must be > 0.
+///
+/// @returns ERR_OK if every transaction was successful, otherwise the error
+///  code of the first one that wasn't.
+err_t i2c_write_read_batch(i2c_write_read_t *reads, uint_fast8_t count, utime_t timeout);
+
 ///
 /// Begin reception of a data block in multiple transactions.
 ///
@@ -148,3 +218,168 @@ err_t i2c_transmit_block_continue(const uint8_t *tx_buffer, txsize_t tx_size, ut
 /// @returns ERR_OK if successful, otherwise an error code indicating
 ///  the nature of the problem encountered.
 err_t i2c_transmit_block_end(void);
+
+///
+/// @name I2C Device Interface
+/// @{
+//
+///
+/// How a device's timeout is applied when a transaction is retried.
+typedef enum {
+	///
+	/// Each attempt gets the full timeout.
+	I2C_TIMEOUT_PER_ATTEMPT = 0,
+	///
+	/// The timeout covers all of the attempts together.
+	I2C_TIMEOUT_TOTAL,
+} i2c_timeout_policy_t;
+///
+/// Describe a device attached to the I2C bus.
+///
+/// The device functions lock the bus for as long as they need it, which lets
+/// several drivers share the bus from a cooperative main loop without
+/// turning it off and on or changing its speed between every transaction.
+/// None of them may be called from an interrupt.
+typedef struct i2c_device_t {
+	///
+	/// The highest clock speed the device can handle.
+	/// If 0, I2C_FREQUENCY_HZ is used.
+	uint32_t max_hz;
+	///
+	/// Abort if an operation takes more than this many milliseconds.
+	/// If 0, I2C_DEVICE_TIMEOUT_MS is used.
+	utime_t timeout;
+	///
+	/// The address of the device.
+	uint8_t addr;
+	///
+	/// The number of times to retry a transaction after a NACK or lost
+	/// arbitration.
+	uint8_t retries;
+	///
+	/// How @c timeout is applied when a transaction is retried.
+	i2c_timeout_policy_t timeout_policy;
+} i2c_device_t;
+///
+/// Lock the bus for a device.
+///
+/// The bus is turned on if needed and set to the device's speed if it isn't
+/// already. It's left on when unlocked.
+///
+/// A device can lock the bus more than once, in which case it's released when
+/// it has been unlocked as many times.
+///
+/// @param dev The device to lock the bus for.
+///  Must not be NULL.
+///
+/// @retval ERR_OK if the bus is locked for the device.
+/// @retval ERR_RETRY if the bus is locked for another device or is in use
+///  outside of the device interface; try again later.
+/// @returns Otherwise an error code indicating the nature of the problem
+///  encountered.
+err_t i2c_device_lock(const i2c_device_t *dev);
+///
+/// Unlock the bus.
+///
+/// @param dev The device passed to @c i2c_device_lock().
+///  Must not be NULL.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t i2c_device_unlock(const i2c_device_t *dev);
+///
+/// Check if the bus is locked for a device.
+///
+/// @retval true if locked.
+/// @retval false if not locked.
+bool i2c_bus_is_locked(void);
+///
+/// Transmit a data block to a device.
+///
+/// The bus is locked for the duration of the transaction.
+///
+/// @param dev The device to transmit to.
+///  Must not be NULL.
+/// @param tx_buffer The bytes to transmit.
+///  Must not be NULL.
+/// @param tx_size The number of bytes to transmit.
+///  Must be > 0.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t i2c_device_transmit(const i2c_device_t *dev, const uint8_t *tx_buffer, txsize_t tx_size);
+///
+/// Receive a data block from a device.
+///
+/// The bus is locked for the duration of the transaction.
+///
+/// @param dev The device to receive from.
+///  Must not be NULL.
+/// @param rx_buffer The bytes received.
+///  Must not be NULL.
+/// @param rx_size The number of bytes to receive.
+///  Must be > 0.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t i2c_device_receive(const i2c_device_t *dev, uint8_t *rx_buffer, txsize_t rx_size);
+///
+/// Transmit a data block to a device and then receive one with
+/// @c i2c_write_read().
+///
+/// The bus is locked for the duration of the transaction.
+///
+/// @param dev The device to transmit to and receive from.
+///  Must not be NULL.
+/// @param tx_buffer The bytes to send, such as a register address.
+///  Must not be NULL.
+/// @param tx_size The number of bytes in @c tx_buffer.
+///  Must be > 0.
+/// @param rx_buffer The bytes received.
+///  Must not be NULL.
+/// @param rx_size The number of bytes to receive.
+///  Must be > 0.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t i2c_device_write_read(const i2c_device_t *dev, const uint8_t *tx_buffer, txsize_t tx_size, uint8_t *rx_buffer, txsize_t rx_size);
+///
+/// Begin transmission of a data block to a device in multiple transactions.
+///
+/// The bus is locked until @c i2c_device_transmit_end() is called. Only the
+/// address phase is retried.
+///
+/// @param dev The device to transmit to.
+///  Must not be NULL.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t i2c_device_transmit_begin(const i2c_device_t *dev);
+///
+/// Continue transmission of a data block to a device in multiple transactions.
+///
+/// Must call @c i2c_device_transmit_begin() before this.
+///
+/// @param dev The device passed to @c i2c_device_transmit_begin().
+///  Must not be NULL.
+/// @param tx_buffer The bytes to transmit.
+///  Must not be NULL.
+/// @param tx_size The number of bytes to transmit.
+///  Must be > 0.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t i2c_device_transmit_continue(const i2c_device_t *dev, const uint8_t *tx_buffer, txsize_t tx_size);
+///
+/// End transmission of a data block to a device in multiple transactions and
+/// unlock the bus.
+///
+/// It's safe to call this after @c i2c_device_transmit_begin() has failed.
+///
+/// @param dev The device passed to @c i2c_device_transmit_begin().
+///  Must not be NULL.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t i2c_device_transmit_end(const i2c_device_t *dev);
+/// @}
@@ -59,3 +59,57 @@ void set_RTT_calibration(uint_fast16_t cal);
 uint_fast16_t get_RTT_calibration(void);
 /// @}
 #endif // uHAL_USE_HIBERNATE
+
+#if uHAL_USE_UART || __HAVE_DOXYGEN__
+///
+/// Check if a UART port is transmitting.
+///
+/// @note
+/// When @c UART_TX_BUFFER_BYTES is set, @c uart_transmit_block() returns as
+/// soon as the data has been queued and the transmission continues in the
+/// background. Otherwise this always returns false.
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+///
+/// @retval true if there's queued data or the last byte is still being
+///  shifted out.
+/// @retval false if the port is idle.
+bool uart_tx_is_busy(const uart_port_t *port);
+#endif // uHAL_USE_UART
+
+#if (uHAL_USE_SPI && uHAL_USE_SPI_IRQ && ENABLE_SPI_IRQ_STATS) || __HAVE_DOXYGEN__
+///
+/// @name SPI Interrupt Statistics
+///
+/// Counters kept by interrupt-driven SPI transfers, used to work out how much
+/// of a transfer the CPU spends awake.
+///
+/// @note
+/// These are only available when uHAL_USE_SPI_IRQ and ENABLE_SPI_IRQ_STATS
+/// are set.
+/// @{
+//
+///
+/// Counters for interrupt-driven SPI transfers since they were last cleared.
+typedef struct {
+	/// The number of times the SPI ISR ran.
+	uint_fast32_t isr_entries;
+	/// The number of times the CPU woke up while waiting for a transfer,
+	/// whatever interrupt woke it.
+	uint_fast32_t wakeups;
+	/// The approximate number of micro-seconds spent asleep. Only counted
+	/// while the micro-second counter is running.
+	uint_fast32_t slept_us;
+} spi_irq_stats_t;
+///
+/// Get the current counters.
+///
+/// @param stats The structure to copy the counters into. Must not be NULL.
+void spi_get_irq_stats(spi_irq_stats_t *stats);
+///
+/// Reset all counters to 0.
+void spi_clear_irq_stats(void);
+/// @}
+#endif // uHAL_USE_SPI && uHAL_USE_SPI_IRQ && ENABLE_SPI_IRQ_STATS
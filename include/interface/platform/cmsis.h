@@ -65,3 +65,349 @@ err_t tim5_oscillator_calibration(osc_calib_t mode, uint32_t *LS_cycles, uint32_
 ///  the nature of the problem encountered.
 err_t calibrate_RTC_clock(void);
 /// @}
+
+#if (uHAL_USE_UART && uHAL_USE_UART_TX_DMA) || __HAVE_DOXYGEN__
+///
+/// @name Asynchronous UART Transmission
+///
+/// @note
+/// These are only available when @c uHAL_USE_UART_TX_DMA is set.
+/// @{
+//
+#if __HAVE_DOXYGEN__
+///
+/// The type of function called when an asynchronous transmission finishes.
+///
+/// @note
+/// This is called from an ISR.
+///
+/// @param port The port the transmission was made on.
+/// @param status ERR_OK if the whole buffer was sent, otherwise an error code
+///  indicating the nature of the problem encountered.
+typedef void (*uart_tx_callback_t)(uart_port_t *port, err_t status);
+#endif
+///
+/// Transmit a block of data using DMA and return immediately.
+///
+/// @attention
+/// @c buffer must remain valid and unmodified until the transmission is
+/// finished.
+/// @note
+/// The callback is called once the last byte has been handed to the UART,
+/// which may still be shifting it out; use @c uart_tx_is_busy() to check
+/// whether the line is idle.
+/// @note
+/// The DMA stream used by each UART is fixed by the hardware. It's claimed
+/// by the first asynchronous transmission and released when the port is
+/// turned off, until then other peripherals sharing it can't use it.
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+/// @param buffer The buffer holding the data to send.
+///  Must not be NULL.
+/// @param size The number of bytes to send from @c buffer.
+///  Must be > 0 and <= 0xFFFF.
+/// @param callback The function to call when the transmission is finished.
+///  May be NULL.
+///
+/// @returns ERR_OK if the transmission was started, ERR_RETRY if a previous
+///  transmission is still in progress, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t uart_transmit_async(uart_port_t *port, const uint8_t *buffer, txsize_t size, uart_tx_callback_t callback);
+///
+/// Transmit several blocks of data using DMA and return immediately.
+///
+/// The segments are sent back-to-back as with @c uart_transmit_iov(), the
+/// next one being started from the DMA interrupt while the UART is still
+/// shifting out the end of the previous one.
+///
+/// @attention
+/// @c iov and the buffers it points to must remain valid and unmodified until
+/// the transmission is finished.
+/// @note
+/// The callback is called once, after the last segment or the first error.
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+/// @param iov The segments to send, in order. Empty segments are skipped.
+///  Must not be NULL. Each segment must be <= 0xFFFF bytes.
+/// @param iovcnt The number of segments in @c iov.
+/// @param callback The function to call when the transmission is finished.
+///  May be NULL.
+///
+/// @returns ERR_OK if the transmission was started, ERR_RETRY if a previous
+///  transmission is still in progress, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t uart_transmit_iov_async(uart_port_t *port, const uart_iovec_t *iov, uint_fast8_t iovcnt, uart_tx_callback_t callback);
+///
+/// Check if a UART port is transmitting.
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+///
+/// @retval true if an asynchronous transmission is in progress or the last
+///  byte is still being shifted out.
+/// @retval false if the port is idle.
+bool uart_tx_is_busy(const uart_port_t *port);
+/// @}
+#endif
+
+#if (uHAL_USE_SPI && uHAL_USE_SPI_DMA) || __HAVE_DOXYGEN__
+///
+/// @name Asynchronous SPI Transfers
+///
+/// @note
+/// These are only available when @c uHAL_USE_SPI_DMA is set.
+/// @note
+/// While an asynchronous transfer is in progress, the blocking SPI functions
+/// wait for it to finish before starting. Each port has its own transfer, so
+/// transfers on different ports can run at the same time.
+/// @{
+//
+#if __HAVE_DOXYGEN__
+///
+/// The type of function called when an asynchronous transfer finishes.
+///
+/// @note
+/// This is called from an ISR.
+///
+/// @param port The port the transfer was made on.
+/// @param status ERR_OK if the whole block was transferred, otherwise an
+///  error code indicating the nature of the problem encountered.
+typedef void (*spi_callback_t)(spi_port_t *port, err_t status);
+#endif
+///
+/// Transmit a data block using DMA and return immediately.
+///
+/// @attention
+/// @c tx_buffer must remain valid and unmodified until the transfer is
+/// finished.
+/// @note
+/// The DMA streams used are fixed by the hardware and are claimed only for
+/// the duration of the transfer. Turning the SPI peripheral off cancels the
+/// transfer without calling the callback.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+/// @param tx_buffer The bytes to send.
+///  Must not be NULL.
+/// @param tx_size The number of bytes in @c tx_buffer.
+///  Must be > 0 and <= 0xFFFF.
+/// @param callback The function to call when the transfer is finished.
+///  May be NULL.
+///
+/// @returns ERR_OK if the transfer was started, ERR_RETRY if a previous
+///  transfer is still in progress, ERR_INUSE if the DMA streams are in use
+///  by another peripheral, otherwise an error code indicating the nature of
+///  the problem encountered.
+err_t spi_transmit_block_async(spi_port_t *port, const uint8_t *tx_buffer, txsize_t tx_size, spi_callback_t callback);
+///
+/// Receive a data block using DMA and return immediately.
+///
+/// @attention
+/// @c rx_buffer must remain valid and must not be accessed until the
+/// transfer is finished.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+/// @param rx_buffer The bytes received.
+///  Must not be NULL.
+/// @param rx_size The number of bytes to receive.
+///  Must be > 0 and <= 0xFFFF.
+/// @param tx The byte to transmit in parallel with each byte received.
+/// @param callback The function to call when the transfer is finished.
+///  May be NULL.
+///
+/// @returns ERR_OK if the transfer was started, ERR_RETRY if a previous
+///  transfer is still in progress, ERR_INUSE if the DMA streams are in use
+///  by another peripheral, otherwise an error code indicating the nature of
+///  the problem encountered.
+err_t spi_receive_block_async(spi_port_t *port, uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, spi_callback_t callback);
+///
+/// Check if an asynchronous SPI transfer is in progress.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+///
+/// @retval true if a transfer is in progress.
+/// @retval false if the bus is idle.
+bool spi_is_busy(const spi_port_t *port);
+/// @}
+#endif
+
+#if (uHAL_USE_SPI && uHAL_USE_SPI_QUEUE) || __HAVE_DOXYGEN__
+///
+/// @name SPI Transaction Queue
+///
+/// @note
+/// These are only available when @c uHAL_USE_SPI_QUEUE is set, which
+/// requires @c uHAL_USE_SPI_DMA.
+/// @note
+/// Queued transactions are transferred in order by DMA, with each device's
+/// bus settings and chip-select handled between them. The blocking SPI
+/// functions wait until the queue is empty before starting. Nothing is
+/// started from the queue between @c spi_device_begin() and
+/// @c spi_device_end(); anything submitted in that time waits for
+/// @c spi_device_end(). Blocking transfers made without a device handle get
+/// no such protection and may be interfered with by transactions submitted
+/// from an ISR.
+/// @note
+/// A transaction which can't be started because the DMA streams are in use
+/// by another peripheral stays queued until the queue is next started by
+/// @c spi_queue_submit(), @c spi_device_end(), or a queued transaction
+/// finishing.
+/// @note
+/// Each port has its own queue.
+/// @{
+//
+#if __HAVE_DOXYGEN__
+///
+/// The type of function called when a queued transaction finishes.
+///
+/// @note
+/// This is called from an ISR, or from @c spi_queue_submit() if the
+/// transaction couldn't be started. It may submit more transactions.
+///
+/// @param transaction The transaction that finished.
+/// @param status ERR_OK if the whole block was transferred, otherwise an
+///  error code indicating the nature of the problem encountered.
+typedef void (*spi_transaction_callback_t)(spi_transaction_t *transaction, err_t status);
+///
+/// A queued SPI transaction.
+typedef struct {
+	///
+	/// The device to talk to; it's selected for the duration of the transfer.
+	/// If NULL, the bus is used as-is and chip-select is left to the caller.
+	const spi_device_t *dev;
+	///
+	/// The bytes to send. If NULL, 0xFF is sent for each byte received.
+	const uint8_t *tx_buffer;
+	///
+	/// The bytes received. If NULL, they're discarded.
+	/// May be the same as @c tx_buffer but not both NULL.
+	uint8_t *rx_buffer;
+	///
+	/// The number of bytes to transfer. Must be > 0 and <= 0xFFFF.
+	txsize_t size;
+	///
+	/// The function to call when the transaction is finished. May be NULL.
+	spi_transaction_callback_t callback;
+	///
+	/// Not used by the queue, for use by the callback.
+	void *callback_arg;
+} spi_transaction_t;
+#endif
+///
+/// Add a transaction to the queue.
+///
+/// The queue is started if it isn't already running. Safe to call from an
+/// ISR.
+///
+/// @attention
+/// The transaction and its buffers must remain valid and must not be
+/// modified until its callback is called.
+/// @note
+/// Turning the SPI peripheral off empties the queue without calling any
+/// callbacks.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+/// @param transaction The transaction to queue.
+///  Must not be NULL. If it has a device, the device must be on @c port.
+///
+/// @returns ERR_OK if the transaction was queued, ERR_RETRY if the queue is
+///  full, otherwise an error code indicating the nature of the problem
+///  encountered.
+err_t spi_queue_submit(spi_port_t *port, spi_transaction_t *transaction);
+///
+/// Get the number of transactions waiting in the queue, including the one
+/// being transferred.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+///
+/// @returns The number of unfinished transactions.
+uint_fast8_t spi_queue_pending(const spi_port_t *port);
+/// @}
+#endif
+
+#if (uHAL_USE_I2C && uHAL_USE_I2C_IRQ) || __HAVE_DOXYGEN__
+///
+/// @name Asynchronous I2C Transfers
+///
+/// @note
+/// These are only available when @c uHAL_USE_I2C_IRQ is set.
+/// @note
+/// While an asynchronous transfer is in progress, the blocking I2C functions
+/// wait for it to finish before starting. When interrupts are enabled, the
+/// blocking transfer functions are themselves handled by the interrupts and
+/// sleep until the transfer is finished.
+/// @note
+/// When @c uHAL_USE_I2C_DMA is also set, the data phase of transfers of at
+/// least @c I2C_DMA_MIN_BYTES bytes is handled by the DMA controller, as is
+/// the data passed to i2c_transmit_block_continue().
+/// @{
+//
+#if __HAVE_DOXYGEN__
+///
+/// The type of function called when an asynchronous transfer finishes.
+///
+/// @note
+/// This is called from an ISR.
+///
+/// @param status ERR_OK if the whole block was transferred, otherwise an
+///  error code indicating the nature of the problem encountered.
+typedef void (*i2c_callback_t)(err_t status);
+#endif
+///
+/// Transmit a data block in one transaction and return immediately.
+///
+/// @attention
+/// @c tx_buffer must remain valid and unmodified until the transfer is
+/// finished.
+/// @note
+/// Turning the I2C peripheral off cancels the transfer without calling the
+/// callback.
+///
+/// @param addr The address of the device to send the data to.
+/// @param tx_buffer The bytes to send.
+///  Must not be NULL.
+/// @param tx_size The number of bytes in @c tx_buffer.
+///  Must be > 0.
+/// @param callback The function to call when the transfer is finished.
+///  May be NULL.
+///
+/// @returns ERR_OK if the transfer was started, ERR_RETRY if a previous
+///  transfer is still in progress or the bus is busy, otherwise an error
+///  code indicating the nature of the problem encountered.
+err_t i2c_transmit_block_async(uint8_t addr, const uint8_t *tx_buffer, txsize_t tx_size, i2c_callback_t callback);
+///
+/// Receive a data block in one transaction and return immediately.
+///
+/// @attention
+/// @c rx_buffer must remain valid and must not be accessed until the
+/// transfer is finished.
+///
+/// @param addr The address of the device to request the data from.
+/// @param rx_buffer The bytes received.
+///  Must not be NULL.
+/// @param rx_size The number of bytes to receive.
+///  Must be > 0.
+/// @param callback The function to call when the transfer is finished.
+///  May be NULL.
+///
+/// @returns ERR_OK if the transfer was started, ERR_RETRY if a previous
+///  transfer is still in progress or the bus is busy, otherwise an error
+///  code indicating the nature of the problem encountered.
+err_t i2c_receive_block_async(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, i2c_callback_t callback);
+///
+/// Check if an asynchronous I2C transfer is in progress.
+///
+/// @retval true if a transfer is in progress.
+/// @retval false if the last transfer is finished.
+bool i2c_is_busy(void);
+/// @}
+#endif
@@ -23,30 +23,105 @@
 ///    This file should only be included by interface.h.
 ///
 
+//
+// This is defined in the device platform.h, it's included here for
+// documentation purposes.
+#if __HAVE_DOXYGEN__
 ///
-/// Turn on the SPI peripheral.
+/// The handle used manage SPI ports.
+typedef struct spi_port_t spi_port_t;
+#endif
+
+///
+/// The structure used to specify SPI port configuration.
+///
+/// The peripheral is determined by the pins; they must all belong to the
+/// same one.
+typedef struct {
+	gpio_pin_t sck_pin;  ///< The clock pin.
+	gpio_pin_t miso_pin; ///< The input pin.
+	gpio_pin_t mosi_pin; ///< The output pin.
+} spi_port_cfg_t;
+
+///
+/// The port using the SPI_SCK_PIN, SPI_MISO_PIN, and SPI_MOSI_PIN pins.
+///
+/// This is initialized automatically at startup.
+extern spi_port_t uHAL_spi_default_port;
+///
+/// The port using the SPI_SCK_PIN, SPI_MISO_PIN, and SPI_MOSI_PIN pins.
+#define SPI_DEFAULT_PORT (&uHAL_spi_default_port)
+
+///
+/// Initialize an SPI peripheral.
+///
+/// The bus is set to master mode 0 at @c SPI_FREQUENCY_HZ and left off.
+///
+/// @note
+/// Each port uses its own peripheral and can transfer at the same time as
+/// the others. Initializing two ports with the same peripheral isn't
+/// supported.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+/// @param conf A @c spi_port_cfg_t structure describing the interface.
+///  Must not be NULL.
+///
+/// @returns ERR_OK if successful, ERR_NOTSUP if the pins don't belong to a
+///  single SPI peripheral, otherwise an error code indicating the nature of
+///  the problem encountered.
+err_t spi_init_port(spi_port_t *port, const spi_port_cfg_t *conf);
+
+///
+/// Turn on an SPI peripheral.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
 ///
 /// @returns ERR_OK if successful, otherwise an error code indicating
 ///  the nature of the problem encountered.
-err_t spi_on(void);
+err_t spi_on(spi_port_t *port);
 
 ///
-/// Turn off the SPI peripheral.
+/// Turn off an SPI peripheral.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
 ///
 /// @returns ERR_OK if successful, otherwise an error code indicating
 ///  the nature of the problem encountered.
-err_t spi_off(void);
+err_t spi_off(spi_port_t *port);
 
 ///
-/// Check if the SPI peripheral is turned on
+/// Check if an SPI peripheral is turned on
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
 ///
 /// @retval true if turned on.
 /// @retval false if turned off.
-bool spi_is_on(void);
+bool spi_is_on(const spi_port_t *port);
+
+///
+/// Change the speed of the SPI bus.
+///
+/// The fastest speed the hardware supports that doesn't exceed @c hz is used,
+/// or the slowest if they're all too fast. It stays in effect until changed
+/// again, either by this or by @c spi_device_begin().
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+/// @param hz The desired bus speed.
+///  Must be > 0.
+///
+/// @returns The speed actually set, or 0 if it couldn't be changed.
+uint32_t spi_set_frequency(spi_port_t *port, uint32_t hz);
 
 ///
 /// Exchange a byte.
 ///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
 /// @param tx The byte to transmit.
 /// @param rx The byte received.
 ///  Must not be NULL.
@@ -55,11 +130,35 @@ bool spi_is_on(void);
 ///
 /// @returns ERR_OK if successful, otherwise an error code indicating
 ///  the nature of the problem encountered.
-err_t spi_exchange_byte(uint8_t tx, uint8_t *rx, utime_t timeout);
+err_t spi_exchange_byte(spi_port_t *port, uint8_t tx, uint8_t *rx, utime_t timeout);
+
+///
+/// Exchange a data block.
+///
+/// Each byte of @c tx_buffer is sent while the corresponding byte of
+/// @c rx_buffer is received. The next byte is queued while the current one
+/// is being shifted so that there's no gap between frames.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+/// @param tx_buffer The bytes to send.
+///  Must not be NULL.
+/// @param rx_buffer The bytes received.
+///  Must not be NULL. May be the same as @c tx_buffer.
+/// @param size The number of bytes to exchange.
+///  Must be > 0.
+/// @param timeout Abort if the operation takes more than this many milliseconds.
+///  Must be > 0.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t spi_exchange_block(spi_port_t *port, const uint8_t *tx_buffer, uint8_t *rx_buffer, txsize_t size, utime_t timeout);
 
 ///
 /// Receive a data block
 ///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
 /// @param rx_buffer The bytes received.
 ///  Must not be NULL.
 /// @param rx_size The number of bytes to receive.
@@ -71,18 +170,274 @@ err_t spi_exchange_byte(uint8_t tx, uint8_t *rx, utime_t timeout);
 ///
 /// @returns ERR_OK if successful, otherwise an error code indicating
 ///  the nature of the problem encountered.
-err_t spi_receive_block(uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, utime_t timeout);
+err_t spi_receive_block(spi_port_t *port, uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, utime_t timeout);
 
 ///
 /// Transmit a data block
 ///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+/// @param tx_buffer The bytes to send.
+///  Must not be NULL.
+/// @param tx_size The number of bytes in @c tx_buffer.
+///  Must be > 0.
+/// @param timeout Abort if the operation takes more than this many milliseconds.
+///  Must be > 0.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t spi_transmit_block(spi_port_t *port, const uint8_t *tx_buffer, txsize_t tx_size, utime_t timeout);
+
+///
+/// @name 16-bit Transfers
+/// These work like their 8-bit counterparts but move one 16-bit word per
+/// frame. Words are held in native byte order in the buffers and are sent
+/// most-significant bit (and so most-significant byte) first, which is what
+/// devices with 16-bit registers generally expect.
+/// @{
+//
+///
+/// Exchange a block of 16-bit words.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+/// @param tx_buffer The words to send.
+///  Must not be NULL.
+/// @param rx_buffer The words received.
+///  Must not be NULL. May be the same as @c tx_buffer.
+/// @param count The number of words to exchange.
+///  Must be > 0.
+/// @param timeout Abort if the operation takes more than this many milliseconds.
+///  Must be > 0.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t spi_exchange_block16(spi_port_t *port, const uint16_t *tx_buffer, uint16_t *rx_buffer, txsize_t count, utime_t timeout);
+///
+/// Receive a block of 16-bit words.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+/// @param rx_buffer The words received.
+///  Must not be NULL.
+/// @param rx_count The number of words to receive.
+///  Must be > 0.
+/// @param tx The word to transmit in parallel with each word received.
+///  Generally safe to use 0xFFFF as that keeps the output line held high.
+/// @param timeout Abort if the operation takes more than this many milliseconds.
+///  Must be > 0.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t spi_receive_block16(spi_port_t *port, uint16_t *rx_buffer, txsize_t rx_count, uint16_t tx, utime_t timeout);
+///
+/// Transmit a block of 16-bit words.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+/// @param tx_buffer The words to send.
+///  Must not be NULL.
+/// @param tx_count The number of words in @c tx_buffer.
+///  Must be > 0.
+/// @param timeout Abort if the operation takes more than this many milliseconds.
+///  Must be > 0.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t spi_transmit_block16(spi_port_t *port, const uint16_t *tx_buffer, txsize_t tx_count, utime_t timeout);
+/// @}
+
+///
+/// @name Checked Transfers
+/// These work like their plain counterparts but also calculate the CRC of
+/// the data transferred. The CRC is CRC-16/XMODEM (the CCITT polynomial
+/// 0x1021 with an initial value of 0), which is what SD cards use for data
+/// blocks. It's calculated by the SPI peripheral where possible.
+/// @{
+//
+///
+/// Receive a data block and calculate its CRC.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
+/// @param rx_buffer The bytes received.
+///  Must not be NULL.
+/// @param rx_size The number of bytes to receive.
+///  Must be > 0.
+/// @param tx The byte to transmit in parallel with each byte received.
+/// @param crc The CRC of the bytes received.
+///  Must not be NULL.
+/// @param timeout Abort if the operation takes more than this many milliseconds.
+///  Must be > 0.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t spi_receive_block_crc16(spi_port_t *port, uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, uint16_t *crc, utime_t timeout);
+///
+/// Transmit a data block and calculate its CRC.
+///
+/// The CRC isn't sent, that's up to the caller.
+///
+/// @param port The handle used to manage the port.
+///  If NULL, @c SPI_DEFAULT_PORT is used.
 /// @param tx_buffer The bytes to send.
 ///  Must not be NULL.
 /// @param tx_size The number of bytes in @c tx_buffer.
 ///  Must be > 0.
+/// @param crc The CRC of the bytes sent.
+///  Must not be NULL.
 /// @param timeout Abort if the operation takes more than this many milliseconds.
 ///  Must be > 0.
 ///
 /// @returns ERR_OK if successful, otherwise an error code indicating
 ///  the nature of the problem encountered.
-err_t spi_transmit_block(const uint8_t *tx_buffer, txsize_t tx_size, utime_t timeout);
+err_t spi_transmit_block_crc16(spi_port_t *port, const uint8_t *tx_buffer, txsize_t tx_size, uint16_t *crc, utime_t timeout);
+/// @}
+
+///
+/// @name SPI Device Interface
+/// @{
+//
+///
+/// The clock polarity and phase used to talk to a device.
+typedef enum {
+	///
+	/// Clock idles low, data is sampled on the rising edge.
+	SPI_MODE_0 = 0x00U,
+	///
+	/// Clock idles low, data is sampled on the falling edge.
+	SPI_MODE_1 = 0x01U,
+	///
+	/// Clock idles high, data is sampled on the falling edge.
+	SPI_MODE_2 = 0x02U,
+	///
+	/// Clock idles high, data is sampled on the rising edge.
+	SPI_MODE_3 = 0x03U,
+} spi_mode_t;
+///
+/// Describe a device attached to an SPI bus.
+typedef struct spi_device_t {
+	///
+	/// The port the device is attached to.
+	/// If NULL, @c SPI_DEFAULT_PORT is used.
+	spi_port_t *port;
+	///
+	/// The highest clock speed the device can handle.
+	/// If 0, SPI_FREQUENCY_HZ is used.
+	uint32_t max_hz;
+	///
+	/// The pin used to select the device. It's driven low during a transaction.
+	/// If 0, chip-select is left up to the caller.
+	/// The pin must already be configured as an output, e.g. with
+	/// @c gpio_set_mode(pin, GPIO_MODE_PP, GPIO_HIGH).
+	gpio_pin_t cs_pin;
+	///
+	/// The clock polarity and phase used by the device.
+	spi_mode_t mode;
+} spi_device_t;
+///
+/// Begin a transaction with a device.
+///
+/// The bus is reconfigured for the device's mode and speed if they differ from
+/// the current settings and then the chip-select pin is driven low.
+///
+/// @param dev The device to talk to.
+///  Must not be NULL.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t spi_device_begin(const spi_device_t *dev);
+///
+/// End a transaction with a device.
+///
+/// The chip-select pin is driven high. The bus settings are left as-is so
+/// that the next transaction with the same device doesn't need to change them.
+///
+/// @param dev The device passed to @c spi_device_begin().
+///  Must not be NULL.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t spi_device_end(const spi_device_t *dev);
+/// @}
+
+#if ENABLE_SPI_TRACE || __HAVE_DOXYGEN__
+///
+/// @name SPI Tracing
+/// @{
+//
+///
+/// A completed device transaction, as recorded by the trace.
+///
+/// A transaction runs from @c spi_device_begin() to @c spi_device_end();
+/// transfers made without selecting a device aren't recorded.
+typedef struct {
+	const spi_device_t *dev; ///< The device selected for the transaction.
+	uint32_t start_us;       ///< The microsecond counter when the device was selected.
+	uint32_t end_us;         ///< The microsecond counter when the device was deselected.
+	///
+	/// How long the port sat idle before the device was selected, or
+	/// @c SPI_TRACE_IDLE_UNKNOWN for the first transaction on the port.
+	uint32_t idle_us;
+} spi_trace_entry_t;
+///
+/// The idle time recorded for the first transaction on a port.
+#define SPI_TRACE_IDLE_UNKNOWN 0xFFFFFFFFUL
+///
+/// A summary of the transactions in the trace.
+///
+/// Bin 0 counts times of 0-1us, bin @c n counts times from 2^n to 2^(n+1)-1us,
+/// and the last bin counts everything longer than that.
+typedef struct {
+	uint_fast16_t count;     ///< The number of transactions summarized.
+	uint32_t min_us;         ///< The shortest transaction.
+	uint32_t max_us;         ///< The longest transaction.
+	uint32_t total_us;       ///< The sum of all transaction times.
+	uint32_t max_idle_us;    ///< The longest the bus sat idle before one of the transactions.
+	uint_fast16_t busy[SPI_TRACE_HISTOGRAM_BINS]; ///< Transaction times.
+	uint_fast16_t idle[SPI_TRACE_HISTOGRAM_BINS]; ///< Time the bus sat idle before each transaction.
+} spi_trace_histogram_t;
+///
+/// Copy the recorded transactions, oldest first.
+///
+/// @note
+/// Only available when @c ENABLE_SPI_TRACE is set.
+/// @note
+/// Timestamps come from @c uscounter_read(); the microsecond counter must be
+/// running for them to mean anything.
+///
+/// @param entries The buffer to copy the transactions to.
+///  Must not be NULL.
+/// @param max The number of entries @c entries can hold.
+///
+/// @returns The number of entries copied.
+uint_fast8_t spi_trace_read(spi_trace_entry_t *entries, uint_fast8_t max);
+///
+/// Find the devices which have transactions in the trace.
+///
+/// @param devs The buffer to copy the device pointers to, in the order they
+///  first appear in the trace.
+///  Must not be NULL.
+/// @param max The number of entries @c devs can hold.
+///
+/// @returns The number of devices found.
+uint_fast8_t spi_trace_devices(const spi_device_t **devs, uint_fast8_t max);
+///
+/// Summarize the recorded transactions with a device.
+///
+/// The idle time for a transaction is measured from the end of the one before
+/// it on the same port, regardless of which device that was with. The first
+/// transaction on each port has no idle time.
+///
+/// @param dev The device to summarize. If NULL, all transactions are summarized.
+/// @param hist The summary.
+///  Must not be NULL.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t spi_trace_histogram(const spi_device_t *dev, spi_trace_histogram_t *hist);
+///
+/// Discard the recorded transactions.
+void spi_trace_clear(void);
+/// @}
+#endif // ENABLE_SPI_TRACE
@@ -30,14 +30,39 @@
 ///
 /// The handle used manage UART ports.
 typedef struct uart_port_t uart_port_t;
+///
+/// A segment of a scatter-gather transmission.
+typedef struct {
+	const uint8_t *data; ///< The data to send.
+	txsize_t size;       ///< The number of bytes to send from @c data.
+} uart_iovec_t;
+///
+/// Traffic and error counters for a UART port.
+///
+/// @note
+/// Counters wrap around when they overflow.
+typedef struct {
+	uint32_t rx_bytes;             ///< Bytes taken from the receiver, including any dropped.
+	uint32_t tx_bytes;             ///< Bytes handed to the transmitter.
+	uint_fast16_t rx_dropped;      ///< Received bytes discarded because the rx buffer was full.
+	uint_fast16_t overrun_errors;  ///< Frames lost because the receiver wasn't read in time.
+	uint_fast16_t framing_errors;  ///< Frames received without a valid stop bit.
+	uint_fast16_t noise_errors;    ///< Frames received with noise detected. Not all platforms detect this.
+	uint_fast16_t rx_peak;         ///< The most bytes ever waiting in the rx buffer.
+	uint32_t tx_stall_ms;          ///< Total milliseconds transmit calls spent blocked.
+} uart_stats_t;
 #endif
 
 ///
 /// The structure used to specify UART port configuration.
 typedef struct {
-	uint32_t baud_rate; ///< The desired BAUD rate.
+	uint32_t baud_rate; ///< The desired BAUD rate. See @c uart_get_baud_rate() for the rate actually used.
 	gpio_pin_t rx_pin;  ///< The RX pin.
 	gpio_pin_t tx_pin;  ///< The TX pin.
+	/// The RTS pin, or 0 if unused. Requires @c ENABLE_UART_FLOW_CONTROL.
+	gpio_pin_t rts_pin;
+	/// The CTS pin, or 0 if unused. Requires @c ENABLE_UART_FLOW_CONTROL.
+	gpio_pin_t cts_pin;
 } uart_port_cfg_t;
 
 #if uHAL_USE_UART_COMM || __HAVE_DOXYGEN__
@@ -55,6 +80,14 @@ extern uart_port_t uHAL_uart_comm_port;
 /// @note
 /// The interface is always configured as 8 data bits with 1 stop bit and no
 /// parity bit.
+/// @note
+/// When @c rts_pin is set, RTS is de-asserted (driven high) while the port is
+/// listening and the rx buffer holds at least @c UART_RTS_HIGH_WATER bytes
+/// and asserted again once it's been read down to @c UART_RTS_LOW_WATER. The
+/// pin doesn't need to be the peripheral's own RTS pin, but RTS can't be used
+/// without the rx buffer or, on platforms which have it, with
+/// @c uHAL_USE_UART_RX_DMA. When @c cts_pin is set, transmission pauses while
+/// CTS is high. Which pins can be used for CTS is platform-dependent.
 ///
 /// @param port The handle used to manage the port.
 ///  If the serial interface is enabled, passing NULL as the port will act on that.
@@ -66,6 +99,20 @@ extern uart_port_t uHAL_uart_comm_port;
 ///  the nature of the problem encountered.
 err_t uart_init_port(uart_port_t *port, const uart_port_cfg_t *conf);
 
+///
+/// Get the baud rate a UART peripheral is actually running at.
+///
+/// The requested rate usually can't be reached exactly with the available
+/// clock dividers, this returns the closest rate that the peripheral was
+/// configured with by @c uart_init_port().
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+///
+/// @returns The baud rate, or 0 if the port isn't configured.
+uint32_t uart_get_baud_rate(const uart_port_t *port);
+
 ///
 /// Turn a UART peripheral on.
 ///
@@ -102,6 +149,10 @@ bool uart_is_on(const uart_port_t *port);
 ///
 /// Receive a block of data
 ///
+/// @note
+/// If the port is listening, data is taken from the RX buffer as the ISR
+/// fills it and the receive interrupt is left enabled.
+///
 /// @param port The handle used to manage the port.
 ///  If the serial interface is enabled, passing NULL as the port will act on that.
 ///  Otherwise this must not be NULL.
@@ -119,6 +170,11 @@ err_t uart_receive_block(uart_port_t *port, uint8_t *buffer, txsize_t size, utim
 ///
 /// Transmit a block of data
 ///
+/// @note
+/// On platforms with a TX queue (e.g. with @c UART_TX_BUFFER_BYTES on
+/// AVR_XMEGA3), this returns once the last of the data has been queued and
+/// the timeout only applies to waiting for room in the queue.
+///
 /// @param port The handle used to manage the port.
 ///  If the serial interface is enabled, passing NULL as the port will act on that.
 ///  Otherwise this must not be NULL.
@@ -133,6 +189,65 @@ err_t uart_receive_block(uart_port_t *port, uint8_t *buffer, txsize_t size, utim
 ///  the nature of the problem encountered.
 err_t uart_transmit_block(uart_port_t *port, const uint8_t *buffer, txsize_t size, utime_t timeout);
 
+///
+/// Transmit several blocks of data as one continuous stream
+///
+/// The segments are sent back-to-back without waiting for the line to go
+/// idle between them, so e.g. a header, payload, and checksum kept in
+/// separate buffers go out the same as if they'd been copied together first.
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+/// @param iov The segments to send, in order. Empty segments are skipped.
+///  Must not be NULL.
+/// @param iovcnt The number of segments in @c iov.
+/// @param timeout Abort if the operation takes more than this many milliseconds.
+///  Must be > 0.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t uart_transmit_iov(uart_port_t *port, const uart_iovec_t *iov, uint_fast8_t iovcnt, utime_t timeout);
+
+#if ENABLE_UART_STATS || __HAVE_DOXYGEN__
+///
+/// Get the traffic and error counters for a UART peripheral.
+///
+/// @note
+/// Only available when @c ENABLE_UART_STATS is set.
+/// @note
+/// Hardware errors are only counted by the receive interrupt, so nothing is
+/// counted while the port isn't listening. When reception is handled by DMA,
+/// errors are only checked when the line goes idle.
+/// @note
+/// The stall time has millisecond resolution, so many short transmissions
+/// may not add up to anything.
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+/// @param stats Set to the current counter values.
+///  Must not be NULL.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t uart_get_stats(const uart_port_t *port, uart_stats_t *stats);
+
+///
+/// Reset the traffic and error counters for a UART peripheral.
+///
+/// @note
+/// This also resets the count returned by @c uart_rx_overrun_count().
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t uart_clear_stats(uart_port_t *port);
+#endif // ENABLE_UART_STATS
+
 #if ENABLE_UART_LISTENING || __HAVE_DOXYGEN__
 ///
 /// Turn the UART receive interrupt on.
@@ -140,6 +255,10 @@ err_t uart_transmit_block(uart_port_t *port, const uint8_t *buffer, txsize_t siz
 /// @note
 /// The interrupt is defined internally so that the received input can be placed
 /// in the rx buffer, but the hook @c uart_rx_irq_hook() is called afterward.
+/// @note
+/// On platforms where reception can be handled by DMA (e.g. with
+/// @c uHAL_USE_UART_RX_DMA on CMSIS_STM32), the port must be on when this is
+/// called and any unread data in the rx buffer is discarded.
 ///
 /// @param port The handle used to manage the port.
 ///  If the serial interface is enabled, passing NULL as the port will act on that.
@@ -182,12 +301,106 @@ bool uart_is_listening(const uart_port_t *port);
 /// @retval false if the UART port doesn't have data waiting for processing.
 bool uart_rx_is_available(const uart_port_t *port);
 
+///
+/// Get the number of received bytes discarded because the RX buffer was full.
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+///
+/// @returns The number of discarded bytes since the port was initialized.
+uint_fast16_t uart_rx_overrun_count(const uart_port_t *port);
+
+///
+/// Get direct access to the received data waiting in the rx buffer.
+///
+/// The data remains in the buffer until it's released with
+/// @c uart_rx_consume(), so it can be scanned in place without copying or
+/// disabling the receive interrupt.
+///
+/// @note
+/// Only a contiguous span is returned. When the waiting data wraps around
+/// the end of the buffer, the rest is returned by the next call after
+/// consuming this span.
+/// @note
+/// If the buffer is filled by DMA, unconsumed data can still be overwritten
+/// once the buffer fills up.
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+/// @param data Set to the location of the oldest unread byte.
+///  Must not be NULL.
+/// @param size Set to the number of bytes readable at @c data, which may be 0.
+///  Must not be NULL.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t uart_rx_peek(uart_port_t *port, const uint8_t **data, txsize_t *size);
+
+///
+/// Release data at the front of the rx buffer.
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+/// @param size The number of bytes to release.
+///  Must not be more than are waiting in the buffer.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t uart_rx_consume(uart_port_t *port, txsize_t size);
+
+#if ENABLE_UART_LINE_MODE || __HAVE_DOXYGEN__
+///
+/// Set the characters that end a line of received input.
+///
+/// Once set, @c uart_rx_irq_hook() is only called when a delimiter is received
+/// rather than for every byte, so that e.g. a command processor can sleep
+/// until there's a complete line to act on.
+///
+/// @note
+/// Only data received after this is called is checked for delimiters.
+/// @note
+/// The delimiters are cleared when the port is initialized.
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+/// @param delims A string of up to two delimiters such as "\r\n"; any
+///  further characters are ignored. If NULL or empty, line mode is turned off.
+///
+/// @returns ERR_OK if successful, otherwise an error code indicating
+///  the nature of the problem encountered.
+err_t uart_rx_set_delimiters(uart_port_t *port, const char *delims);
+
+///
+/// Check if the UART port has received a complete line of input.
+///
+/// @note
+/// If no delimiters are set, this is the same as @c uart_rx_is_available().
+///
+/// @param port The handle used to manage the port.
+///  If the serial interface is enabled, passing NULL as the port will act on that.
+///  Otherwise this must not be NULL.
+///
+/// @retval true if a delimiter is waiting in the rx buffer.
+/// @retval false if there's no complete line waiting in the rx buffer.
+bool uart_rx_line_is_available(const uart_port_t *port);
+#endif // ENABLE_UART_LINE_MODE
+
 ///
 /// Overrideable hook called by UART ISRs when receiving data.
 /// The default function does nothing.
 ///
 /// @note
 /// This function is overrideable.
+/// @note
+/// When reception is handled by DMA, this is called when the line goes idle
+/// after receiving data rather than for every byte.
+/// @note
+/// When line delimiters have been set with @c uart_rx_set_delimiters(), this
+/// is only called after a delimiter is received.
 ///
 /// @param port The handle used to manage the port.
 ///  If the serial interface is enabled, passing NULL as the port will act on that.
@@ -33,6 +33,9 @@ uHAL_flags_t uHAL_status = 0;
 #if uHAL_USE_UART_COMM
 uart_port_t uHAL_uart_comm_port;
 #endif
+#if uHAL_USE_SPI
+spi_port_t uHAL_spi_default_port;
+#endif
 
 //
 // Hooks
@@ -31,7 +31,8 @@
 #define ROWS_PER_PAGE 8U
 #define COLS_PER_PAGE 128U
 #define PAGES_PER_BANK 8U
-#define I2C_TIMEOUT 1000U
+// Retry once in case another master on the bus got in the way
+#define I2C_RETRIES 1U
 
 #if SSD1306_FONT_WIDTH > 0
 typedef union {
@@ -259,7 +260,7 @@ static err_t set_position(const ssd1306_handle_t *handle, uint8_t x_pixel, uint8
 		(handle->cfg->height/ROWS_PER_PAGE)-1,
 	};
 
-	return i2c_transmit_block(handle->cfg->access.address, cmd_pos, sizeof(cmd_pos), I2C_TIMEOUT);
+	return i2c_device_transmit(&handle->i2c, cmd_pos, sizeof(cmd_pos));
 }
 
 err_t ssd1306_init(ssd1306_handle_t *handle, const ssd1306_cfg_t *cfg) {
@@ -327,14 +328,14 @@ err_t ssd1306_init(ssd1306_handle_t *handle, const ssd1306_cfg_t *cfg) {
 	handle->cfg = cfg;
 
 	if (BIT_IS_SET(cfg->flags, SSD1306_CFG_FLAG_I2C)) {
-		uHAL_assert(i2c_is_on());
-#if ! uHAL_SKIP_OTHER_CHECKS
-		if (!i2c_is_on()) {
-			i2c_on();
-		}
-#endif
-
-		if ((res = i2c_transmit_block_begin(cfg->access.address, I2C_TIMEOUT)) != ERR_OK) {
+		// The bus is turned on when the device is first used
+		handle->i2c.addr = cfg->access.address;
+		handle->i2c.max_hz = SSD1306_I2C_FREQUENCY_HZ;
+		handle->i2c.retries = I2C_RETRIES;
+		handle->i2c.timeout = 0;
+		handle->i2c.timeout_policy = I2C_TIMEOUT_PER_ATTEMPT;
+
+		if ((res = i2c_device_transmit_begin(&handle->i2c)) != ERR_OK) {
 			goto I2C_END;
 		}
 
@@ -342,11 +343,11 @@ err_t ssd1306_init(ssd1306_handle_t *handle, const ssd1306_cfg_t *cfg) {
 			SSD1306_CTRL_CMD_BATCH,
 			SSD1306_CMD_PWR_OFF,
 		};
-		if ((res = i2c_transmit_block_continue(cmd_start, sizeof(cmd_start), I2C_TIMEOUT)) != ERR_OK) {
+		if ((res = i2c_device_transmit_continue(&handle->i2c, cmd_start, sizeof(cmd_start))) != ERR_OK) {
 			goto I2C_END;
 		}
 
-		if ((res = i2c_transmit_block_continue(cmd_setup, sizeof(cmd_setup), I2C_TIMEOUT)) != ERR_OK) {
+		if ((res = i2c_device_transmit_continue(&handle->i2c, cmd_setup, sizeof(cmd_setup))) != ERR_OK) {
 			goto I2C_END;
 		}
 
@@ -363,12 +364,12 @@ err_t ssd1306_init(ssd1306_handle_t *handle, const ssd1306_cfg_t *cfg) {
 			cmd_res[3] = SSD1306_CMD_REV_SCAN_ON;
 		}
 
-		if ((res = i2c_transmit_block_continue(cmd_res, sizeof(cmd_res), I2C_TIMEOUT)) != ERR_OK) {
+		if ((res = i2c_device_transmit_continue(&handle->i2c, cmd_res, sizeof(cmd_res))) != ERR_OK) {
 			goto I2C_END;
 		}
 
 #if SSD1306_INIT_COMMANDS_COUNT > 0
-		if ((res = i2c_transmit_block_continue(cfg->init_cmds, SSD1306_INIT_COMMANDS_COUNT, I2C_TIMEOUT)) != ERR_OK) {
+		if ((res = i2c_device_transmit_continue(&handle->i2c, cfg->init_cmds, SSD1306_INIT_COMMANDS_COUNT)) != ERR_OK) {
 			goto I2C_END;
 		}
 #endif
@@ -376,12 +377,12 @@ err_t ssd1306_init(ssd1306_handle_t *handle, const ssd1306_cfg_t *cfg) {
 		const uint8_t cmd_pwr[] = {
 			SSD1306_CMD_PWR_ON,
 		};
-		if ((res = i2c_transmit_block_continue(cmd_pwr, sizeof(cmd_pwr), I2C_TIMEOUT)) != ERR_OK) {
+		if ((res = i2c_device_transmit_continue(&handle->i2c, cmd_pwr, sizeof(cmd_pwr))) != ERR_OK) {
 			goto I2C_END;
 		}
 
 I2C_END:
-		i2c_transmit_block_end();
+		i2c_device_transmit_end(&handle->i2c);
 		if (res != ERR_OK) {
 			goto END;
 		}
@@ -429,24 +430,24 @@ err_t ssd1306_fill_section(const ssd1306_handle_t *handle, uint8_t byte, uint8_t
 		return res;
 	}
 
-	if ((res = i2c_transmit_block_begin(handle->cfg->access.address, I2C_TIMEOUT)) != ERR_OK) {
+	if ((res = i2c_device_transmit_begin(&handle->i2c)) != ERR_OK) {
 		goto I2C_END;
 	}
 
-	if ((res = i2c_transmit_block_continue(&mode, 1, I2C_TIMEOUT)) != ERR_OK) {
+	if ((res = i2c_device_transmit_continue(&handle->i2c, &mode, 1)) != ERR_OK) {
 		goto I2C_END;
 	}
 
 	for (uint8_t y_i = 0; y_i < hp; ++y_i) {
 		for (uint8_t x_i = 0; x_i < wp; ++x_i) {
-			if ((res = i2c_transmit_block_continue(&byte, 1, I2C_TIMEOUT)) != ERR_OK) {
+			if ((res = i2c_device_transmit_continue(&handle->i2c, &byte, 1)) != ERR_OK) {
 				goto I2C_END;
 			}
 		}
 	}
 
 I2C_END:
-	i2c_transmit_block_end();
+	i2c_device_transmit_end(&handle->i2c);
 	return res;
 }
 err_t ssd1306_clear_display(ssd1306_handle_t *handle) {
@@ -468,7 +469,7 @@ err_t ssd1306_toggle_inversion(ssd1306_handle_t *handle) {
 		SET_BIT(handle->flags, SSD1306_STATUS_FLAG_INVERTED);
 	}
 
-	return i2c_transmit_block(handle->cfg->access.address, cmd, 2, I2C_TIMEOUT);
+	return i2c_device_transmit(&handle->i2c, cmd, 2);
 }
 err_t ssd1306_invert_display_on(ssd1306_handle_t *handle) {
 	const uint8_t cmd[] = {
@@ -480,7 +481,7 @@ err_t ssd1306_invert_display_on(ssd1306_handle_t *handle) {
 
 	SET_BIT(handle->flags, SSD1306_STATUS_FLAG_INVERTED);
 
-	return i2c_transmit_block(handle->cfg->access.address, cmd, sizeof(cmd), I2C_TIMEOUT);
+	return i2c_device_transmit(&handle->i2c, cmd, sizeof(cmd));
 }
 err_t ssd1306_invert_display_off(ssd1306_handle_t *handle) {
 	const uint8_t cmd[] = {
@@ -492,7 +493,7 @@ err_t ssd1306_invert_display_off(ssd1306_handle_t *handle) {
 
 	CLEAR_BIT(handle->flags, SSD1306_STATUS_FLAG_INVERTED);
 
-	return i2c_transmit_block(handle->cfg->access.address, cmd, sizeof(cmd), I2C_TIMEOUT);
+	return i2c_device_transmit(&handle->i2c, cmd, sizeof(cmd));
 }
 
 err_t ssd1306_toggle_display(ssd1306_handle_t *handle) {
@@ -510,7 +511,7 @@ err_t ssd1306_toggle_display(ssd1306_handle_t *handle) {
 		SET_BIT(handle->flags, SSD1306_STATUS_FLAG_DISPLAY_ON);
 	}
 
-	return i2c_transmit_block(handle->cfg->access.address, cmd, 2, I2C_TIMEOUT);
+	return i2c_device_transmit(&handle->i2c, cmd, 2);
 }
 err_t ssd1306_display_on(ssd1306_handle_t *handle) {
 	const uint8_t cmd[] = {
@@ -522,7 +523,7 @@ err_t ssd1306_display_on(ssd1306_handle_t *handle) {
 
 	SET_BIT(handle->flags, SSD1306_STATUS_FLAG_DISPLAY_ON);
 
-	return i2c_transmit_block(handle->cfg->access.address, cmd, sizeof(cmd), I2C_TIMEOUT);
+	return i2c_device_transmit(&handle->i2c, cmd, sizeof(cmd));
 }
 err_t ssd1306_display_off(ssd1306_handle_t *handle) {
 	const uint8_t cmd[] = {
@@ -534,7 +535,7 @@ err_t ssd1306_display_off(ssd1306_handle_t *handle) {
 
 	CLEAR_BIT(handle->flags, SSD1306_STATUS_FLAG_DISPLAY_ON);
 
-	return i2c_transmit_block(handle->cfg->access.address, cmd, sizeof(cmd), I2C_TIMEOUT);
+	return i2c_device_transmit(&handle->i2c, cmd, sizeof(cmd));
 }
 
 err_t ssd1306_set_contrast(ssd1306_handle_t *handle, uint8_t level) {
@@ -548,7 +549,7 @@ err_t ssd1306_set_contrast(ssd1306_handle_t *handle, uint8_t level) {
 
 	handle->contrast = level;
 
-	return i2c_transmit_block(handle->cfg->access.address, cmd, sizeof(cmd), I2C_TIMEOUT);
+	return i2c_device_transmit(&handle->i2c, cmd, sizeof(cmd));
 }
 err_t ssd1306_adj_contrast(ssd1306_handle_t *handle, int_t incr) {
 	uint8_t cmd[] = {
@@ -579,7 +580,7 @@ err_t ssd1306_adj_contrast(ssd1306_handle_t *handle, int_t incr) {
 	handle->contrast = (uint8_t )level;
 	cmd[2] = handle->contrast;
 
-	return i2c_transmit_block(handle->cfg->access.address, cmd, sizeof(cmd), I2C_TIMEOUT);
+	return i2c_device_transmit(&handle->i2c, cmd, sizeof(cmd));
 }
 
 static uint8_t stretch_nibble(uint_fast8_t c) {
@@ -628,10 +629,10 @@ static err_t _ssd1306_draw_text_scaled(ssd1306_handle_t *handle, const ssd1306_f
 			return res;
 		}
 
-		if ((res = i2c_transmit_block_begin(handle->cfg->access.address, I2C_TIMEOUT)) != ERR_OK) {
+		if ((res = i2c_device_transmit_begin(&handle->i2c)) != ERR_OK) {
 			goto I2C_END;
 		}
-		if ((res = i2c_transmit_block_continue(cmd, sizeof(cmd), I2C_TIMEOUT)) != ERR_OK) {
+		if ((res = i2c_device_transmit_continue(&handle->i2c, cmd, sizeof(cmd))) != ERR_OK) {
 			goto I2C_END;
 		}
 
@@ -689,18 +690,18 @@ static err_t _ssd1306_draw_text_scaled(ssd1306_handle_t *handle, const ssd1306_f
 				}
 
 				for (uiter_t col = 0; col < scale_x; ++col) {
-					if ((res = i2c_transmit_block_continue(&glyph_line, 1, I2C_TIMEOUT)) != ERR_OK) {
+					if ((res = i2c_device_transmit_continue(&handle->i2c, &glyph_line, 1)) != ERR_OK) {
 						goto I2C_END;
 					}
 				}
 			}
 		}
 
-		i2c_transmit_block_end();
+		i2c_device_transmit_end(&handle->i2c);
 	}
 
 I2C_END:
-	i2c_transmit_block_end();
+	i2c_device_transmit_end(&handle->i2c);
 
 	return res;
 }
@@ -773,10 +774,10 @@ err_t ssd1306_draw_text(ssd1306_handle_t *handle, const ssd1306_font_t *font, ui
 		return res;
 	}
 
-	if ((res = i2c_transmit_block_begin(handle->cfg->access.address, I2C_TIMEOUT)) != ERR_OK) {
+	if ((res = i2c_device_transmit_begin(&handle->i2c)) != ERR_OK) {
 		goto I2C_END;
 	}
-	if ((res = i2c_transmit_block_continue(cmd, sizeof(cmd), I2C_TIMEOUT)) != ERR_OK) {
+	if ((res = i2c_device_transmit_continue(&handle->i2c, cmd, sizeof(cmd))) != ERR_OK) {
 		goto I2C_END;
 	}
 
@@ -789,17 +790,17 @@ err_t ssd1306_draw_text(ssd1306_handle_t *handle, const ssd1306_font_t *font, ui
 			c += font->char_offset;
 		}
 #if SSD1306_FONT_WIDTH <= 0
-		if ((res = i2c_transmit_block_continue(&font->glyphs[c * GLYPH_WIDTH(font)], GLYPH_WIDTH(font), I2C_TIMEOUT)) != ERR_OK) {
+		if ((res = i2c_device_transmit_continue(&handle->i2c, &font->glyphs[c * GLYPH_WIDTH(font)], GLYPH_WIDTH(font))) != ERR_OK) {
 #else
 		font_access_t acc = { .ptr = font->glyphs };
-		if ((res = i2c_transmit_block_continue(acc.arr[c], SSD1306_FONT_WIDTH, I2C_TIMEOUT)) != ERR_OK) {
+		if ((res = i2c_device_transmit_continue(&handle->i2c, acc.arr[c], SSD1306_FONT_WIDTH)) != ERR_OK) {
 #endif
 			goto I2C_END;
 		}
 	}
 
 I2C_END:
-	i2c_transmit_block_end();
+	i2c_device_transmit_end(&handle->i2c);
 
 	return res;
 }
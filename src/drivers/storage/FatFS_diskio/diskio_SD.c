@@ -55,12 +55,15 @@
 #define CMD38	(38)		/* ERASE */
 #define CMD55	(55)		/* APP_CMD */
 #define CMD58	(58)		/* READ_OCR */
+#define CMD59	(59)		/* CRC_ON_OFF */
 
 
 /* Physical drive status */
 static volatile DSTATUS drive_status = STA_NOINIT;
 /* Card type flags */
 static BYTE drive_type;
+/* Set when the card has been told to check CRCs */
+static bool crc_enabled;
 
 
 /*-----------------------------------------------------------------------*/
@@ -68,19 +71,32 @@ static BYTE drive_type;
 /*-----------------------------------------------------------------------*/
 
 
+/* The identification phase has to be done at 400KHz or less */
+#define SD_INIT_FREQUENCY_HZ 400000UL
+
+/* max_hz is raised to the card's rated speed once it's been initialized */
+static spi_device_t sd_device = {
+	.port   = NULL, // The default port
+	.max_hz = SD_INIT_FREQUENCY_HZ,
+	.cs_pin = SPI_CS_SD_PIN,
+	// Per http:// elm-chan.org/docs/mmc/mmc_e.html, this needs to be mode 0
+	// but mode 3 sometimes works too
+	.mode   = SPI_MODE_0,
+};
+
 static void CS_HIGH(void) {
-	gpio_set_state(SPI_CS_SD_PIN, GPIO_HIGH);
-	//output_pin_on(SPI_CS_SD_PIN);
+	spi_device_end(&sd_device);
 	delay_ms(1);
 
 	return;
 }
-static void CS_LOW(void) {
-	gpio_set_state(SPI_CS_SD_PIN, GPIO_LOW);
-	//output_pin_off(SPI_CS_SD_PIN);
+static int CS_LOW(void) {
+	if (spi_device_begin(&sd_device) != ERR_OK) {
+		return 0;
+	}
 	delay_ms(1);
 
-	return;
+	return 1;
 }
 
 
@@ -91,7 +107,7 @@ static void CS_LOW(void) {
 static BYTE xchg_spi (BYTE tx) {
 	BYTE rx;
 
-	spi_exchange_byte(tx, &rx, 100);
+	spi_exchange_byte(sd_device.port, tx, &rx, 100);
 
 	return rx;
 }
@@ -108,7 +124,7 @@ static void rx_spi_multi (BYTE *buf, UINT btr) {
 	/*
 	// Detect and handle blocks that aren't a multiple of 2 bytes
 	if ((btr % 2) != 0) {
-		spi_exchange_byte(0xFF, buf, 100);
+		spi_exchange_byte(sd_device.port, 0xFF, buf, 100);
 		++buf;
 		--btr;
 	}
@@ -116,7 +132,7 @@ static void rx_spi_multi (BYTE *buf, UINT btr) {
 
 	// TODO: Check the return value and propagate errors
 	// SD cards expect MOSI to be held high while they send data
-	spi_receive_block(buf, btr, 0xFF, 1000);
+	spi_receive_block(sd_device.port, buf, btr, 0xFF, 1000);
 
 	return;
 }
@@ -136,14 +152,14 @@ static void tx_spi_multi (const BYTE *buf, UINT btx) {
 	if ((btx % 2) != 0) {
 		uint8_t rx;
 
-		spi_exchange_byte(buf[0], &rx, 100);
+		spi_exchange_byte(sd_device.port, buf[0], &rx, 100);
 		++buf;
 		--btx;
 	}
 	*/
 
 	// FIXME: Check the return value and propagate errors
-	spi_transmit_block(buf, btx, 1000);
+	spi_transmit_block(sd_device.port, buf, btx, 1000);
 
 	return;
 }
@@ -193,7 +209,9 @@ static void deselect_drive (void) {
 * 1:OK, 0:Timeout
 */
 static int select_drive (void) {
-	CS_LOW(); /* Set CS# low */
+	if (!CS_LOW()) { /* Set CS# low */
+		return 0;
+	}
 	xchg_spi(0xFF); /* Dummy clock (force DO enabled) */
 	if (wait_ready(500)) { /* Wait for card ready */
 		return 1;
@@ -227,6 +245,20 @@ static int rx_datablock (BYTE *buf, UINT btr) {
 		return 0;
 	}
 
+#if FATFS_SD_USE_CRC
+	if (crc_enabled) {
+		uint16_t crc, rx_crc;
+
+		if (spi_receive_block_crc16(sd_device.port, buf, btr, 0xFF, &crc, 1000) != ERR_OK) {
+			return 0;
+		}
+		rx_crc = (uint16_t)xchg_spi(0xFF) << 8;
+		rx_crc |= xchg_spi(0xFF);
+
+		return (crc == rx_crc) ? 1 : 0; /* Function fails if the data was corrupted */
+	}
+#endif
+
 	rx_spi_multi(buf, btr); /* Store trailing data to the buffer */
 	xchg_spi(0xFF); xchg_spi(0xFF); /* Discard CRC */
 
@@ -254,10 +286,22 @@ static int tx_datablock (const BYTE *buf, BYTE token) {
 
 	xchg_spi(token); /* Send token */
 	if (token != 0xFD) { /* Send data if token is other than StopTran */
-		tx_spi_multi(buf, 512); /* Data */
-		xchg_spi(0xFF); xchg_spi(0xFF); /* Dummy CRC */
+#if FATFS_SD_USE_CRC
+		if (crc_enabled) {
+			uint16_t crc;
 
-		resp = xchg_spi(0xFF); /* Receive data resp */
+			if (spi_transmit_block_crc16(sd_device.port, buf, 512, &crc, 1000) != ERR_OK) {
+				return 0;
+			}
+			xchg_spi((BYTE)(crc >> 8)); xchg_spi((BYTE)crc); /* CRC */
+		} else
+#endif
+		{
+			tx_spi_multi(buf, 512); /* Data */
+			xchg_spi(0xFF); xchg_spi(0xFF); /* Dummy CRC */
+		}
+
+		resp = xchg_spi(0xFF); /* Receive data resp (0x0B if the CRC didn't match) */
 		if ((resp & 0x1F) != 0x05) { /* Function fails if the data packet was not accepted */
 			return 0;
 		}
@@ -266,6 +310,34 @@ static int tx_datablock (const BYTE *buf, BYTE token) {
 }
 #endif
 
+/*-----------------------------------------------------------------------*/
+/* Calculate the CRC of a command packet                                 */
+/*-----------------------------------------------------------------------*/
+/*
+* Return value: CRC7 + Stop bit
+* buf: Command packet
+* len: Length of the packet, excluding the CRC
+*/
+#if FATFS_SD_USE_CRC
+static BYTE crc7 (const BYTE *buf, UINT len) {
+	BYTE crc = 0, d;
+	UINT i, b;
+
+	for (i = 0; i < len; i++) {
+		d = buf[i];
+		for (b = 0; b < 8; b++) {
+			crc <<= 1;
+			if ((d ^ crc) & 0x80) {
+				crc ^= 0x09;
+			}
+			d <<= 1;
+		}
+	}
+
+	return (BYTE)((crc & 0x7F) << 1) | 0x01;
+}
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Send a command packet to the MMC                                      */
 /*-----------------------------------------------------------------------*/
@@ -275,7 +347,7 @@ static int tx_datablock (const BYTE *buf, BYTE token) {
 * arg: Argument
 */
 static BYTE send_cmd (BYTE cmd, DWORD arg) {
-	BYTE n, res;
+	BYTE n, res, pkt[5];
 
 	/* Send a CMD55 prior to ACMD<n> */
 	if (cmd & 0x80) {
@@ -295,11 +367,18 @@ static BYTE send_cmd (BYTE cmd, DWORD arg) {
 	}
 
 	/* Send command packet */
-	xchg_spi(0x40 | cmd);        /* Start + command index */
-	xchg_spi((BYTE)(arg >> 24)); /* Argument[31..24] */
-	xchg_spi((BYTE)(arg >> 16)); /* Argument[23..16] */
-	xchg_spi((BYTE)(arg >> 8));  /* Argument[15..8] */
-	xchg_spi((BYTE)arg);         /* Argument[7..0] */
+	pkt[0] = 0x40 | cmd;        /* Start + command index */
+	pkt[1] = (BYTE)(arg >> 24); /* Argument[31..24] */
+	pkt[2] = (BYTE)(arg >> 16); /* Argument[23..16] */
+	pkt[3] = (BYTE)(arg >> 8);  /* Argument[15..8] */
+	pkt[4] = (BYTE)arg;         /* Argument[7..0] */
+	for (n = 0; n < 5; n++) {
+		xchg_spi(pkt[n]);
+	}
+#if FATFS_SD_USE_CRC
+	/* Once CMD59 is sent every command needs a valid CRC */
+	n = crc7(pkt, 5);
+#else
 	switch (cmd) {
 	case CMD0:
 		n = 0x95; /* Valid CRC for CMD0(0) */
@@ -311,6 +390,7 @@ static BYTE send_cmd (BYTE cmd, DWORD arg) {
 		n = 0x01; /* Dummy CRC + Stop */
 		break;
 	}
+#endif
 	xchg_spi(n);
 
 	/* Receive command resp */
@@ -328,6 +408,109 @@ static BYTE send_cmd (BYTE cmd, DWORD arg) {
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Get the highest bus speed supported by the card                       */
+/*-----------------------------------------------------------------------*/
+/*
+* Return value: Speed in Hz, 0:Failed to read CSD
+* Decodes the TRAN_SPEED field of the CSD
+*/
+static uint32_t get_max_frequency (void) {
+	/* Time values, times 10 */
+	static const BYTE tv[16] = { 0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80 };
+	/* Transfer rate units in Hz, divided by 10 to go with the time values */
+	static const uint32_t tu[4] = { 10000UL, 100000UL, 1000000UL, 10000000UL };
+	BYTE csd[16];
+
+	if ((send_cmd(CMD9, 0) != 0) || (rx_datablock(csd, 16) == 0)) {
+		return 0;
+	}
+
+	/* Rate units 4-7 are reserved */
+	if ((csd[3] & 0x04) != 0) {
+		return 0;
+	}
+
+	return tv[(csd[3] >> 3) & 0x0F] * tu[csd[3] & 0x03];
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read sector(s) in a single command                                    */
+/*-----------------------------------------------------------------------*/
+/*
+* Return value: Number of sectors not read
+* buf   : Pointer to the data buffer to store read data
+* sect  : Start sector number (LBA)
+* count : Number of sectors to read (1..128)
+*/
+static UINT read_sectors (BYTE *buf, DWORD sect, UINT count) {
+	/* LBA ot BA conversion (byte addressing cards) */
+	if (!(drive_type & CT_BLOCK)) {
+		sect *= 512;
+	}
+
+	if (count == 1) { /* Single sector read */
+		if ((send_cmd(CMD17, sect) == 0) && rx_datablock(buf, 512)) { /* READ_SINGLE_BLOCK */
+			count = 0;
+		}
+	} else { /* Multiple sector read */
+		if (send_cmd(CMD18, sect) == 0) { /* READ_MULTIPLE_BLOCK */
+			do {
+				if (!rx_datablock(buf, 512)) {
+					break;
+				}
+				buf += 512;
+			} while (--count);
+			send_cmd(CMD12, 0); /* STOP_TRANSMISSION */
+		}
+	}
+	deselect_drive();
+
+	return count;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Write sector(s) in a single command                                   */
+/*-----------------------------------------------------------------------*/
+/*
+* Return value: Number of sectors not written
+* buf   : Pointer to the data to write
+* sect  : Start sector number (LBA)
+* count : Number of sectors to write (1..128)
+*/
+#if FF_FS_READONLY == 0
+static UINT write_sectors (const BYTE *buf, DWORD sect, UINT count) {
+	/* LBA ==> BA conversion (byte addressing cards) */
+	if (!(drive_type & CT_BLOCK)) {
+		sect *= 512;
+	}
+
+	if (count == 1) { /* Single sector write */
+		if ((send_cmd(CMD24, sect) == 0) && tx_datablock(buf, 0xFE)) { /* WRITE_BLOCK */
+			count = 0;
+		}
+	} else { /* Multiple sector write */
+		if (drive_type & CT_SDC) send_cmd(ACMD23, count); /* Predefine number of sectors */
+		if (send_cmd(CMD25, sect) == 0) { /* WRITE_MULTIPLE_BLOCK */
+			do {
+				if (!tx_datablock(buf, 0xFC)){
+					break;
+				}
+				buf += 512;
+			} while (--count);
+			if (!tx_datablock(0, 0xFD) && count == 0) { /* STOP_TRAN token */
+				count = 1;
+			}
+		}
+	}
+	deselect_drive();
+
+	return count;
+}
+#endif
+
 /*--------------------------------------------------------------------------
 
    Public Functions
@@ -345,6 +528,8 @@ static BYTE send_cmd (BYTE cmd, DWORD arg) {
 DSTATUS disk_initialize (BYTE lun) {
 	BYTE n, cmd, type, ocr[4];
 	utime_t timeout;
+	spi_device_t bus_cfg;
+	uint32_t hz;
 
 	UNUSED(lun);
 
@@ -363,7 +548,17 @@ DSTATUS disk_initialize (BYTE lun) {
 		return drive_status;
 	}
 
+	/* Start out slow enough for the identification phase */
+	sd_device.max_hz = SD_INIT_FREQUENCY_HZ;
+	crc_enabled = false;
+
 	/* Send 80 dummy clocks */
+	/* CS# has to stay high for these but the bus still needs the card's settings */
+	bus_cfg = sd_device;
+	bus_cfg.cs_pin = 0;
+	if (spi_device_begin(&bus_cfg) != ERR_OK) {
+		return drive_status;
+	}
 	for (n = 10; n; n--) {
 		xchg_spi(0xFF);
 	}
@@ -396,6 +591,20 @@ DSTATUS disk_initialize (BYTE lun) {
 			}
 		}
 	}
+#if FATFS_SD_USE_CRC
+	if (type != 0) { /* Have the card check CRCs, and check the ones it sends */
+		crc_enabled = (send_cmd(CMD59, 1) == 0);
+	}
+#endif
+	if (type != 0) { /* Switch to the fastest speed supported by both sides */
+		hz = get_max_frequency();
+		if (hz == 0) { /* Couldn't tell, stay at the safe speed */
+			hz = SD_INIT_FREQUENCY_HZ;
+		} else if (hz > FATFS_SD_MAX_FREQUENCY_HZ) {
+			hz = FATFS_SD_MAX_FREQUENCY_HZ;
+		}
+		sd_device.max_hz = hz;
+	}
 	drive_type = type; /* Card type */
 	deselect_drive();
 
@@ -439,6 +648,7 @@ DSTATUS disk_status (BYTE lun) {
 */
 DRESULT disk_read (BYTE lun, BYTE *buf, LBA_t sector, UINT count) {
 	DWORD sect = (DWORD)sector;
+	UINT left, done, retries;
 
 	UNUSED(lun);
 
@@ -462,29 +672,16 @@ DRESULT disk_read (BYTE lun, BYTE *buf, LBA_t sector, UINT count) {
 		return RES_NOTRDY;
 	}
 
-	/* LBA ot BA conversion (byte addressing cards) */
-	if (!(drive_type & CT_BLOCK)) {
-		sect *= 512;
+	/* Retry whatever's left after a failure, which is usually a CRC error */
+	retries = FATFS_SD_RETRIES;
+	while ((left = read_sectors(buf, sect, count)) != 0 && retries-- > 0) {
+		done = count - left;
+		buf += done * 512;
+		sect += done;
+		count = left;
 	}
 
-	if (count == 1) { /* Single sector read */
-		if ((send_cmd(CMD17, sect) == 0) && rx_datablock(buf, 512)) { /* READ_SINGLE_BLOCK */
-			count = 0;
-		}
-	} else { /* Multiple sector read */
-		if (send_cmd(CMD18, sect) == 0) { /* READ_MULTIPLE_BLOCK */
-			do {
-				if (!rx_datablock(buf, 512)) {
-					break;
-				}
-				buf += 512;
-			} while (--count);
-			send_cmd(CMD12, 0); /* STOP_TRANSMISSION */
-		}
-	}
-	deselect_drive();
-
-	return count ? RES_ERROR : RES_OK; /* Return result */
+	return left ? RES_ERROR : RES_OK; /* Return result */
 }
 
 /*-----------------------------------------------------------------------*/
@@ -499,6 +696,7 @@ DRESULT disk_read (BYTE lun, BYTE *buf, LBA_t sector, UINT count) {
 #if FF_FS_READONLY == 0
 DRESULT disk_write (BYTE lun, const BYTE *buf, LBA_t sector, UINT count) {
 	DWORD sect = (DWORD)sector;
+	UINT left, done, retries;
 
 	UNUSED(lun);
 
@@ -525,32 +723,16 @@ DRESULT disk_write (BYTE lun, const BYTE *buf, LBA_t sector, UINT count) {
 		return RES_WRPRT;
 	}
 
-	/* LBA ==> BA conversion (byte addressing cards) */
-	if (!(drive_type & CT_BLOCK)) {
-		sect *= 512;
+	/* Retry whatever's left after a failure, which is usually a CRC error */
+	retries = FATFS_SD_RETRIES;
+	while ((left = write_sectors(buf, sect, count)) != 0 && retries-- > 0) {
+		done = count - left;
+		buf += done * 512;
+		sect += done;
+		count = left;
 	}
 
-	if (count == 1) { /* Single sector write */
-		if ((send_cmd(CMD24, sect) == 0) && tx_datablock(buf, 0xFE)) { /* WRITE_BLOCK */
-			count = 0;
-		}
-	} else { /* Multiple sector write */
-		if (drive_type & CT_SDC) send_cmd(ACMD23, count); /* Predefine number of sectors */
-		if (send_cmd(CMD25, sect) == 0) { /* WRITE_MULTIPLE_BLOCK */
-			do {
-				if (!tx_datablock(buf, 0xFC)){
-					break;
-				}
-				buf += 512;
-			} while (--count);
-			if (!tx_datablock(0, 0xFD)) { /* STOP_TRAN token */
-				count = 1;
-			}
-		}
-	}
-	deselect_drive();
-
-	return count ? RES_ERROR : RES_OK; /* Return result */
+	return left ? RES_ERROR : RES_OK; /* Return result */
 }
 #endif
 
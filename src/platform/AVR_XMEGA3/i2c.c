@@ -54,28 +54,90 @@
 // Clear the status flags by writing '1' to them
 #define CLEAR_STATUS() (TWIx.MSTATUS = TWI_BUSERR_bm | TWI_ARBLOST_bm | TWI_CLKHOLD_bm | TWI_WIF_bm | TWI_RIF_bm)
 
-// The formulas for calculating the different possible baud rates are both
-// derived from formulas given in the manual for the ATmega3208
-#define CALC_BAUD_MIN(rise_nS) (((G_freq_TWICLK) / (2U * I2C_FREQUENCY_HZ)) - (5U + ((G_freq_TWICLK/1000000U * rise_nS) / 2000U)))
-#define CALC_BAUD_MAX(min_nS, fall_nS) (((G_freq_TWICLK/1000000U) * (min_nS + fall_nS))/1000U - 5U)
+// Maximum baud for fast mode plus:
+#define FMP_MAX_BAUD (1000000)
 
 #define ADDRESS_OK(_addr_) ((_addr_) <= 0x7FU)
 #define BUFFER_OK(_name_) (_name_ ## _buffer != NULL && _name_ ## _size > 0)
 #define TWIx_INIT_OK(_TWIx_) ((_TWIx_).MBAUD != 0 && BIT_IS_SET((_TWIx_).MCTRLA, TWI_ENABLE_bm) && SELECT_BITS((_TWIx_).MSTATUS, TWI_BUSSTATE_gm) != TWI_BUSSTATE_UNKNOWN_gc)
 
-void i2c_init(void) {
-	uint16_t baud_min, baud_max, baud;
-	uint8_t reg;
+#include "platform/common/i2c_batch.c"
+#include "platform/common/i2c_device.c"
+
+//
+// Configure the baud rate
+// Must be called with the master disabled
+//
+// The reference manual gives the formula for calculating the frequency
+// as:
+//    F_scl == (F_clk_per) / (10 + 2*BAUD + F_clk_per * T_rise)
+// so to calculate BAUD we do:
+//    BAUD = (F_clk_per / (2*F_scl)) - (5 + ((F_clk_per * T_rise) / 2))
+// or to work with nS for the T_rise (and thereby avoid a float):
+//    BAUD = (F_clk_per / (2*F_scl)) - (5 + ((F_clk_per/1000000 * T_rise) / 2000))
+//
+// The electrical characteristics section of the manual lists the maximum
+// T_rise for the internal pullups, which is as good a generic time to use
+// as any. However, there's also a minimum low time (also listed in the
+// electrical characteristics section) so it's helpful to calculate a baud
+// value based on the maximum rise times and then also on the minimum low
+// time and just use the higher of the two (which will give the slower of
+// the two frequencies)
+//
+// Both formulas are derived from formulas given in the manual for the
+// ATmega3208
+//
+// Returns the frequency actually set
+static uint32_t set_frequency(uint32_t hz) {
+	uint32_t clk_MHz;
+	int32_t baud_min, baud_max, baud;
+	uint16_t rise_nS, low_nS, fall_nS;
+
+	clk_MHz = G_freq_TWICLK / 1000000U;
+
+	if (hz > FMP_MAX_BAUD) {
+		hz = FMP_MAX_BAUD;
+	}
+	if (hz >= FMP_MIN_BAUD) {
+		rise_nS = 120;
+		low_nS = 500;
+		fall_nS = 120;
+		SET_BIT(TWIx.CTRLA, TWI_FMPEN_bm);
+	} else {
+		if (hz >= FM_MIN_BAUD) {
+			rise_nS = 300;
+			low_nS = 1300;
+		} else {
+			rise_nS = 1000;
+			low_nS = 4700;
+		}
+		fall_nS = 250;
+		CLEAR_BIT(TWIx.CTRLA, TWI_FMPEN_bm);
+	}
+
+	// Round the first term up so that the frequency is never faster than
+	// asked for
+	baud_min = (int32_t )((G_freq_TWICLK + ((2U * hz) - 1U)) / (2U * hz)) - (int32_t )(5U + ((clk_MHz * rise_nS) / 2000U));
+	baud_max = (int32_t )((clk_MHz * (low_nS + fall_nS)) / 1000U) - 5;
+	baud = MAX(baud_min, baud_max);
+	if (baud > 255) {
+		baud = 255;
+	} else if (baud < 0) {
+		baud = 0;
+	}
+	TWIx.MBAUD = (uint8_t )baud;
+
+	// Make the device interface set the speed again the next time it's used
+	bus_lock.hz = 0;
 
+	return G_freq_TWICLK / (10U + (2U * (uint32_t )baud) + ((clk_MHz * rise_nS) / 1000U));
+}
+
+void i2c_init(void) {
 	// Make sure the slave interface is disabled
 	TWIx.SCTRLA = 0;
 
-#if I2C_FREQUENCY_HZ >= FMP_MIN_BAUD
-	reg = (TWI_SDASETUP_4CYC_gc | HOLD_TIME | TWI_FMPEN_bm);
-#else
-	reg = (TWI_SDASETUP_4CYC_gc | HOLD_TIME);
-#endif
-	TWIx.CTRLA = reg;
+	TWIx.CTRLA = (TWI_SDASETUP_4CYC_gc | HOLD_TIME);
 	// The register description in the manual suggests that the timeout values
 	// are frequency-dependent and the default names are only true for 100KHz
 	// clock rates, but I don't see anything confirming this
@@ -83,36 +145,7 @@ void i2c_init(void) {
 
 	TWIx.MCTRLB = 0;
 
-	// The reference manual gives the formula for calculating the frequency
-	// as:
-	//    F_scl == (F_clk_per) / (10 + 2*BAUD + F_clk_per * T_rise)
-	// so to calculate BAUD we do:
-	//    BAUD = (F_clk_per / (2*F_scl)) - (5 + ((F_clk_per * T_rise) / 2))
-	// or to work with nS for the T_rise (and thereby avoid a float):
-	//    BAUD = (F_clk_per / (2*F_scl)) - (5 + ((F_clk_per/1000000 * T_rise) / 2000))
-	//
-	// The electrical characteristics section of the manual lists the maximum
-	// T_rise for the internal pullups, which is as good a generic time to use
-	// as any. However, there's also a minimum low time (also listed in the
-	// electrical characteristics section) so it's helpful to calculate a baud
-	// value based on the maximum rise times and then also on the minimum low
-	// time and just use the higher of the two (which will give the slower of
-	// the two frequencies)
-#if I2C_FREQUENCY_HZ >= FMP_MIN_BAUD
-	baud_min = CALC_BAUD_MIN(120);
-	baud_max = CALC_BAUD_MAX(500, 120);
-#elif I2C_FREQUENCY_HZ >= FM_MIN_BAUD
-	baud_min = CALC_BAUD_MIN(300);
-	baud_max = CALC_BAUD_MAX(1300, 250);
-#else
-	baud_min = CALC_BAUD_MIN(1000);
-	baud_max = CALC_BAUD_MAX(4700, 250);
-#endif
-	baud = MAX(baud_min, baud_max);
-	if (baud > 255) {
-		baud = 255;
-	}
-	TWIx.MBAUD = baud;
+	set_frequency(I2C_FREQUENCY_HZ);
 
 	CLEAR_STATUS();
 	i2c_off();
@@ -170,27 +203,44 @@ err_t i2c_off(void) {
 bool i2c_is_on(void) {
 	return (BIT_IS_SET(TWIx.MCTRLA, TWI_ENABLE_bm));
 }
+uint32_t i2c_set_frequency(uint32_t hz) {
+	uint32_t achieved;
 
-err_t i2c_receive_block(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, utime_t timeout) {
-	err_t res = ERR_OK;
-	txsize_t i;
-
-	uHAL_assert(ADDRESS_OK(addr));
-	uHAL_assert(BUFFER_OK(rx));
-	uHAL_assert(TWIx_INIT_OK(TWIx));
+	uHAL_assert(hz > 0U);
+	uHAL_assert(i2c_is_on());
 
 #if ! uHAL_SKIP_INIT_CHECKS
-	if (!TWIx_INIT_OK(TWIx)) {
-		return ERR_INIT;
+	if (!i2c_is_on()) {
+		return 0;
 	}
 #endif
 #if ! uHAL_SKIP_INVALID_ARG_CHECKS
-	if (!ADDRESS_OK(addr) || !BUFFER_OK(rx)) {
-		return ERR_BADARG;
+	if (hz == 0U) {
+		return 0;
 	}
 #endif
+	// The baud rate can't be changed in the middle of a transaction
+	if (SELECT_BITS(TWIx.MSTATUS, TWI_BUSSTATE_gm) == TWI_BUSSTATE_OWNER_gc) {
+		return 0;
+	}
 
-	timeout = SET_TIMEOUT_MS(timeout);
+	// MBAUD and FMPEN can only be written with the master disabled
+	CLEAR_BIT(TWIx.MCTRLA, TWI_ENABLE_bm);
+	achieved = set_frequency(hz);
+	CLEAR_STATUS();
+	SET_BIT(TWIx.MCTRLA, TWI_ENABLE_bm);
+	// Same as in i2c_on()
+	MODIFY_BITS(TWIx.MSTATUS, TWI_BUSSTATE_gm, TWI_BUSSTATE_IDLE_gc);
+
+	return achieved;
+}
+
+//
+// If the bus is still held from a transmission, writing the address issues a
+// repeated start
+static err_t _i2c_receive_block(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, utime_t timeout) {
+	err_t res = ERR_OK;
+	txsize_t i;
 
 	// Make sure the bus is ready
 	/*
@@ -224,11 +274,17 @@ err_t i2c_receive_block(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, utim
 		res = ERR_RETRY;
 		goto END;
 	}
-	// RXACK should be cleared after the response is recieved
-	if (BIT_IS_SET(TWIx.MSTATUS, TWI_BUSERR_bm|TWI_RXACK_bm)) {
+	if (BIT_IS_SET(TWIx.MSTATUS, TWI_BUSERR_bm)) {
 		res = ERR_UNKNOWN;
 		goto END;
 	}
+	// RXACK should be cleared after the response is recieved
+	// A NACK means nobody answered, or the device is busy the way EEPROMs are
+	// during a write cycle
+	if (BIT_IS_SET(TWIx.MSTATUS, TWI_RXACK_bm)) {
+		res = ERR_INTERRUPT;
+		goto END;
+	}
 
 	//
 	// Receive the data packets
@@ -268,6 +324,26 @@ END:
 
 	return res;
 }
+err_t i2c_receive_block(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, utime_t timeout) {
+	uHAL_assert(ADDRESS_OK(addr));
+	uHAL_assert(BUFFER_OK(rx));
+	uHAL_assert(TWIx_INIT_OK(TWIx));
+
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!TWIx_INIT_OK(TWIx)) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (!ADDRESS_OK(addr) || !BUFFER_OK(rx)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	timeout = SET_TIMEOUT_MS(timeout);
+
+	return _i2c_receive_block(addr, rx_buffer, rx_size, timeout);
+}
 
 static err_t _i2c_transmit_block_begin(uint8_t addr, utime_t timeout) {
 	err_t res = ERR_OK;
@@ -286,11 +362,17 @@ static err_t _i2c_transmit_block_begin(uint8_t addr, utime_t timeout) {
 		res = ERR_RETRY;
 		goto END;
 	}
-	// RXACK should be cleared after the response is recieved
-	if (BIT_IS_SET(TWIx.MSTATUS, TWI_BUSERR_bm|TWI_RXACK_bm)) {
+	if (BIT_IS_SET(TWIx.MSTATUS, TWI_BUSERR_bm)) {
 		res = ERR_UNKNOWN;
 		goto END;
 	}
+	// RXACK should be cleared after the response is recieved
+	// A NACK means nobody answered, or the device is busy the way EEPROMs are
+	// during a write cycle
+	if (BIT_IS_SET(TWIx.MSTATUS, TWI_RXACK_bm)) {
+		res = ERR_INTERRUPT;
+		goto END;
+	}
 
 END:
 	return res;
@@ -431,5 +513,41 @@ END:
 }
 #endif // uHAL_USE_SMALL_CODE
 
+err_t i2c_write_read(uint8_t addr, const uint8_t *tx_buffer, txsize_t tx_size, uint8_t *rx_buffer, txsize_t rx_size, utime_t timeout) {
+	err_t res = ERR_OK;
+
+	uHAL_assert(ADDRESS_OK(addr));
+	uHAL_assert(BUFFER_OK(tx));
+	uHAL_assert(BUFFER_OK(rx));
+	uHAL_assert(TWIx_INIT_OK(TWIx));
+
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!TWIx_INIT_OK(TWIx)) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (!ADDRESS_OK(addr) || !BUFFER_OK(tx) || !BUFFER_OK(rx)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	timeout = SET_TIMEOUT_MS(timeout);
+
+	if ((res = _i2c_transmit_block_begin(addr, timeout)) != ERR_OK) {
+		goto END;
+	}
+	if ((res = _i2c_transmit_block_continue(tx_buffer, tx_size, timeout)) != ERR_OK) {
+		goto END;
+	}
+
+	// The reception sends the stop condition itself, even on failure
+	return _i2c_receive_block(addr, rx_buffer, rx_size, timeout);
+
+END:
+	_i2c_transmit_block_end();
+	return res;
+}
+
 
 #endif // uHAL_USE_I2C
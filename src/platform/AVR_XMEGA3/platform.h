@@ -75,6 +75,15 @@
 #ifndef uHAL_USE_INTERNAL_LS_OSC
 # define uHAL_USE_INTERNAL_LS_OSC 1
 #endif
+#ifndef UART_TX_BUFFER_BYTES
+# define UART_TX_BUFFER_BYTES 0U
+#endif
+#ifndef uHAL_USE_SPI_IRQ
+# define uHAL_USE_SPI_IRQ 0
+#endif
+#ifndef ENABLE_SPI_IRQ_STATS
+# define ENABLE_SPI_IRQ_STATS 0
+#endif
 
 //
 // Bus clock frequencies
@@ -188,14 +197,53 @@ typedef enum {
 #define GPIO_MODE_RESET_ALIAS GPIO_MODE_RESET_ALIAS
 #define GPIO_MODE_HiZ_ALIAS   GPIO_MODE_HiZ_ALIAS
 
+#include "platform/common/spi_trace.h"
+typedef struct spi_port_t {
+	// There's only one SPI peripheral so all a port needs to keep is its own
+	// state
+	// The last speed requested by spi_device_begin() and the prescaler it maps
+	// to, so that talking to the same device repeatedly doesn't recalculate it
+	uint32_t device_hz;
+	uint8_t device_presc;
+#if ENABLE_SPI_TRACE
+	spi_trace_port_t trace;
+#endif
+} spi_port_t;
+
 #include "platform/common/uart_buf.h"
+#if UART_TX_BUFFER_BYTES > 0
+# if UART_TX_BUFFER_BYTES > 128 || (UART_TX_BUFFER_BYTES & (UART_TX_BUFFER_BYTES - 1U)) != 0
+#  error "UART_TX_BUFFER_BYTES must be a power of 2 <= 128"
+# endif
+# define UART_TX_BUFFER_MASK (UART_TX_BUFFER_BYTES - 1U)
+//
+// The TX queue works like the RX buffer with the roles reversed: only the
+// writer touches 'head' and only the DRE ISR touches 'tail'
+// The indices are free-running 8-bit values so that they can be read in a
+// single instruction
+typedef struct {
+	uint8_t buffer[UART_TX_BUFFER_BYTES];
+	uint8_t head;
+	uint8_t tail;
+} uart_tx_buffer_t;
+#endif
 typedef struct {
 	USART_t *uartx;
 	gpio_pin_t rx_pin;
 	gpio_pin_t tx_pin;
+#if ENABLE_UART_FLOW_CONTROL
+	gpio_pin_t rts_pin;
+	gpio_pin_t cts_pin;
+#endif
 #if UART_INPUT_BUFFER_BYTES > 0 && ENABLE_UART_LISTENING
 	volatile uart_buffer_t rx_buf;
 #endif
+#if ENABLE_UART_STATS
+	volatile uart_stats_t stats;
+#endif
+#if UART_TX_BUFFER_BYTES > 0
+	volatile uart_tx_buffer_t tx_buf;
+#endif
 } uart_port_t;
 
 typedef struct {
@@ -20,6 +20,8 @@
 // spi.c
 // Manage the SPI peripheral
 // NOTES:
+//   There's only the one SPI peripheral, so all ports use it and the port
+//   handles only keep per-port state
 //
 
 #include "spi.h"
@@ -27,10 +29,20 @@
 
 #include <avr/io.h>
 #include <avr/power.h>
+#include <avr/sleep.h>
 
 
 #if uHAL_USE_SPI
 
+#include "platform/common/crc16.h"
+
+#if ENABLE_SPI_TRACE
+#include "platform/common/spi_trace.c"
+#else
+# define spi_trace_begin(_pt_, _dev_) ((void )0U)
+# define spi_trace_end(_pt_, _dev_) ((void )0U)
+#endif
+
 // Don't check the SS pin, that's not used
 #if PINID(SPI_SCK_PIN) == PINID_SPI0_SCK && PINID(SPI_MISO_PIN) == PINID_SPI0_MISO && PINID(SPI_MOSI_PIN) == PINID_SPI0_MOSI
 # define SPIx SPI0
@@ -39,48 +51,133 @@
 #else
 # error "Unsupported SPI device"
 #endif
+#define IS_SPI0_STRUCT(_p_) ( \
+	(PINID((_p_)->sck_pin)  == PINID_SPI0_SCK ) && \
+	(PINID((_p_)->miso_pin) == PINID_SPI0_MISO) && \
+	(PINID((_p_)->mosi_pin) == PINID_SPI0_MOSI))
+
+#define SET_DEFAULT_PORT(_p_) do { if ((_p_) == NULL) (_p_) = SPI_DEFAULT_PORT; } while (0)
 
 #define DORD_MSB_bm 0
 #define DORD_LSB_bm SPI_DORD_bm
 #define DORD_bm DORD_MSB_bm
 
 // Clear the interrupt flags by writing '1' to them
-#define CLEAR_INTERRUPTS() (SPIx.INTFLAGS = SPI_SSIF_bm | SPI_TXCIF_bm | SPI_RXCIF_bm)
+// In buffered mode RXCIF is only cleared by reading the receive buffer, which
+// is handled before each transfer
+#define CLEAR_INTERRUPTS() (SPIx.INTFLAGS = SPI_SSIF_bm | SPI_TXCIF_bm | SPI_BUFOVF_bm)
+
+static uint8_t calculate_prescaler(uint32_t goal);
+static uint8_t calculate_prescaler_max(uint32_t limit);
 
 void spi_init(void) {
+	const spi_port_cfg_t spi_cfg = {
+		.sck_pin  = SPI_SCK_PIN,
+		.miso_pin = SPI_MISO_PIN,
+		.mosi_pin = SPI_MOSI_PIN,
+	};
+
+	// The pins were checked above so this can't fail
+	spi_init_port(SPI_DEFAULT_PORT, &spi_cfg);
+
+	return;
+}
+err_t spi_init_port(spi_port_t *p, const spi_port_cfg_t *conf) {
 	uint8_t reg;
 
-	reg = (DORD_bm | SPI_MASTER_bm);
+	SET_DEFAULT_PORT(p);
 
-	// Allow the SPI frequency to be up to 1/20 (5%) slower than the desired
-	// speed to keep it from instead being way too high
-#if ((G_freq_SPICLK/128) >= (SPI_FREQUENCY_HZ - (SPI_FREQUENCY_HZ/20)))
-	SET_BIT(reg, SPI_PRESC_DIV128_gc);
-#elif ((G_freq_SPICLK/64) >= (SPI_FREQUENCY_HZ - (SPI_FREQUENCY_HZ/20)))
-	SET_BIT(reg, SPI_PRESC_DIV64_gc);
-#elif ((G_freq_SPICLK/32) >= (SPI_FREQUENCY_HZ - (SPI_FREQUENCY_HZ/20)))
-	SET_BIT(reg, SPI_PRESC_DIV64_gc | SPI_CLK2X_bm);
-#elif ((G_freq_SPICLK/16) >= (SPI_FREQUENCY_HZ - (SPI_FREQUENCY_HZ/20)))
-	SET_BIT(reg, SPI_PRESC_DIV16_gc);
-#elif ((G_freq_SPICLK/8) >= (SPI_FREQUENCY_HZ - (SPI_FREQUENCY_HZ/20)))
-	SET_BIT(reg, SPI_PRESC_DIV16_gc | SPI_CLK2X_bm);
-#elif ((G_freq_SPICLK/4) >= (SPI_FREQUENCY_HZ - (SPI_FREQUENCY_HZ/20)))
-	SET_BIT(reg, SPI_PRESC_DIV4_gc);
-//#elif ((G_freq_SPICLK/2) >= (SPI_FREQUENCY_HZ - (SPI_FREQUENCY_HZ/20)))
-#else
-	SET_BIT(reg, SPI_PRESC_DIV4_gc | SPI_CLK2X_bm);
+	uHAL_assert(conf != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (conf == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	if (!IS_SPI0_STRUCT(conf)) {
+		return ERR_NOTSUP;
+	}
+
+	p->device_hz = 0;
+	p->device_presc = 0;
+#if ENABLE_SPI_TRACE
+	p->trace.dev = NULL;
+	p->trace.have_last = false;
 #endif
 
+	reg = (DORD_bm | SPI_MASTER_bm | calculate_prescaler(SPI_FREQUENCY_HZ));
+
 	SPIx.INTCTRL = 0;
 	SPIx.CTRLA = reg;
-	SPIx.CTRLB = (SPI_SSD_bm | SPI_MODE_0_gc);
+	// Buffered mode lets the next frame be loaded while the current one is
+	// being shifted out; BUFWR keeps the first byte written from being
+	// preceded by a dummy frame
+	SPIx.CTRLB = (SPI_BUFEN_bm | SPI_BUFWR_bm | SPI_SSD_bm | SPI_MODE_0_gc);
 
 	CLEAR_INTERRUPTS();
-	spi_off();
+	spi_off(p);
 
-	return;
+	return ERR_OK;
 }
-err_t spi_on(void) {
+static uint8_t calculate_prescaler(uint32_t goal) {
+	uint8_t scaler;
+
+	// Allow the SPI frequency to be up to 1/20 (5%) slower than the desired
+	// speed to keep it from instead being way too high
+	goal -= (goal / 20U);
+
+	if ((G_freq_SPICLK/128U) >= goal) {
+		scaler = SPI_PRESC_DIV128_gc;
+	} else
+	if ((G_freq_SPICLK/64U) >= goal) {
+		scaler = SPI_PRESC_DIV64_gc;
+	} else
+	if ((G_freq_SPICLK/32U) >= goal) {
+		scaler = SPI_PRESC_DIV64_gc | SPI_CLK2X_bm;
+	} else
+	if ((G_freq_SPICLK/16U) >= goal) {
+		scaler = SPI_PRESC_DIV16_gc;
+	} else
+	if ((G_freq_SPICLK/8U) >= goal) {
+		scaler = SPI_PRESC_DIV16_gc | SPI_CLK2X_bm;
+	} else
+	if ((G_freq_SPICLK/4U) >= goal) {
+		scaler = SPI_PRESC_DIV4_gc;
+	} else {
+		scaler = SPI_PRESC_DIV4_gc | SPI_CLK2X_bm;
+	}
+
+	return scaler;
+}
+//
+// Find the fastest speed that doesn't exceed 'limit', falling back to the
+// slowest available if they're all too fast
+static uint8_t calculate_prescaler_max(uint32_t limit) {
+	// Ordered from fastest to slowest
+	static const uint8_t prescs[] = {
+		SPI_PRESC_DIV4_gc  | SPI_CLK2X_bm,
+		SPI_PRESC_DIV4_gc,
+		SPI_PRESC_DIV16_gc | SPI_CLK2X_bm,
+		SPI_PRESC_DIV16_gc,
+		SPI_PRESC_DIV64_gc | SPI_CLK2X_bm,
+		SPI_PRESC_DIV64_gc,
+		SPI_PRESC_DIV128_gc,
+	};
+	uint_fast8_t i;
+
+	// Each entry halves the speed of the one before it, starting at 1/2
+	for (i = 0; i < (SIZEOF_ARRAY(prescs) - 1U); ++i) {
+		if ((G_freq_SPICLK >> (i + 1U)) <= limit) {
+			break;
+		}
+	}
+
+	return prescs[i];
+}
+err_t spi_on(spi_port_t *p) {
+	UNUSED(p);
+
 #if ! uHAL_SKIP_OTHER_CHECKS
 	if (BIT_IS_SET(SPIx.CTRLA, SPI_ENABLE_bm)) {
 		return ERR_OK;
@@ -108,7 +205,9 @@ err_t spi_on(void) {
 
 	return ERR_OK;
 }
-err_t spi_off(void) {
+err_t spi_off(spi_port_t *p) {
+	UNUSED(p);
+
 #if ! uHAL_SKIP_OTHER_CHECKS
 	if (!BIT_IS_SET(SPIx.CTRLA, SPI_ENABLE_bm)) {
 		return ERR_OK;
@@ -126,12 +225,292 @@ err_t spi_off(void) {
 
 	return ERR_OK;
 }
-bool spi_is_on(void) {
+bool spi_is_on(const spi_port_t *p) {
+	UNUSED(p);
+
 	return BIT_IS_SET(SPIx.CTRLA, SPI_ENABLE_bm);
 }
 
-err_t spi_exchange_byte(uint8_t tx, uint8_t *rx, utime_t timeout) {
-	err_t res;
+//
+// Discard anything left in the receive buffer, e.g. by an earlier timed-out
+// transfer
+INLINE void drain_rx(void) {
+	while (BIT_IS_SET(SPIx.INTFLAGS, SPI_RXCIF_bm)) {
+		(void )SPIx.DATA;
+	}
+	SPIx.INTFLAGS = SPI_BUFOVF_bm;
+
+	return;
+}
+//
+// Exchange a block with the transmitter kept ahead of the receiver so that
+// there's no gap between frames
+// In buffered mode there's room for one frame in the shift register and one
+// waiting in the transmit buffer, and the receive buffer holds two, so as
+// long as no more than two frames are outstanding nothing can be lost
+// If 'tx' is NULL, 'fill' is sent instead and if 'rx' is NULL the received
+// bytes are discarded
+static err_t exchange_polled(const uint8_t *tx, uint8_t fill, uint8_t *rx, txsize_t size, utime_t timeout) {
+	txsize_t tx_i, rx_i;
+
+	tx_i = 0;
+	rx_i = 0;
+	while (rx_i < size) {
+		if ((tx_i < size) && ((txsize_t )(tx_i - rx_i) < 2U) && BIT_IS_SET(SPIx.INTFLAGS, SPI_DREIF_bm)) {
+			SPIx.DATA = (tx != NULL) ? tx[tx_i] : fill;
+			++tx_i;
+		}
+		if (BIT_IS_SET(SPIx.INTFLAGS, SPI_RXCIF_bm)) {
+			uint8_t c = SPIx.DATA;
+
+			if (rx != NULL) {
+				rx[rx_i] = c;
+			}
+			++rx_i;
+		} else if (TIMES_UP(timeout)) {
+			return ERR_TIMEOUT;
+		}
+	}
+
+	return ERR_OK;
+}
+#if uHAL_USE_SPI_IRQ
+//
+// The same thing as exchange_polled() but with the frames moved by the ISR
+// while the CPU sleeps
+// The state is only touched by the ISR while a transfer is in progress
+static volatile struct {
+	const uint8_t *tx;
+	uint8_t *rx;
+	txsize_t size;
+	txsize_t tx_i;
+	txsize_t rx_i;
+	uint8_t fill;
+	uint8_t pending;
+} xfer;
+
+#if ENABLE_SPI_IRQ_STATS
+# if ! uHAL_USE_USCOUNTER
+#  error "ENABLE_SPI_IRQ_STATS requires uHAL_USE_USCOUNTER"
+# endif
+//
+// 'sleep_start' is read just before interrupts are disabled to go to sleep
+// so the few cycles between that and sleep_cpu() are counted as asleep; the
+// time is settled by whichever of the SPI ISR or exchange_irq() runs first
+// after waking
+static volatile struct {
+	spi_irq_stats_t counts;
+	uint_fast32_t sleep_start;
+	bool sleeping;
+} irq_stats;
+
+static void settle_sleep_time(void) {
+	if (irq_stats.sleeping) {
+		irq_stats.counts.slept_us += uscounter_read() - irq_stats.sleep_start;
+		irq_stats.sleeping = false;
+	}
+
+	return;
+}
+void spi_get_irq_stats(spi_irq_stats_t *stats) {
+	uint8_t sreg;
+
+	uHAL_assert(stats != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (stats == NULL) {
+		return;
+	}
+#endif
+
+	sreg = SREG;
+	cli();
+	stats->isr_entries = irq_stats.counts.isr_entries;
+	stats->wakeups = irq_stats.counts.wakeups;
+	stats->slept_us = irq_stats.counts.slept_us;
+	SREG = sreg;
+
+	return;
+}
+void spi_clear_irq_stats(void) {
+	uint8_t sreg = SREG;
+
+	cli();
+	irq_stats.counts.isr_entries = 0;
+	irq_stats.counts.wakeups = 0;
+	irq_stats.counts.slept_us = 0;
+	irq_stats.sleeping = false;
+	SREG = sreg;
+
+	return;
+}
+#endif // ENABLE_SPI_IRQ_STATS
+
+ISR(SPI0_INT_vect) {
+	// Work on copies so that the volatile struct is only read and written once
+	const uint8_t *tx = xfer.tx;
+	uint8_t *rx = xfer.rx;
+	txsize_t size = xfer.size, tx_i = xfer.tx_i, rx_i = xfer.rx_i;
+	uint_fast8_t pending = xfer.pending;
+
+#if ENABLE_SPI_IRQ_STATS
+	++irq_stats.counts.isr_entries;
+	settle_sleep_time();
+#endif
+
+	while ((rx_i < size) && BIT_IS_SET(SPIx.INTFLAGS, SPI_RXCIF_bm)) {
+		uint8_t c = SPIx.DATA;
+
+		if (rx != NULL) {
+			rx[rx_i] = c;
+		}
+		++rx_i;
+		--pending;
+	}
+	while ((tx_i < size) && (pending < 2U) && BIT_IS_SET(SPIx.INTFLAGS, SPI_DREIF_bm)) {
+		SPIx.DATA = (tx != NULL) ? tx[tx_i] : xfer.fill;
+		++tx_i;
+		++pending;
+	}
+
+	// DREIF stays set while the transmit buffer is empty so the interrupt has
+	// to be turned off once there's nothing left to send
+	if (tx_i >= size) {
+		CLEAR_BIT(SPIx.INTCTRL, SPI_DREIE_bm);
+	}
+	if (rx_i >= size) {
+		SPIx.INTCTRL = 0;
+	}
+
+	xfer.tx_i = tx_i;
+	xfer.rx_i = rx_i;
+	xfer.pending = pending;
+}
+static err_t exchange_irq(const uint8_t *tx, uint8_t fill, uint8_t *rx, txsize_t size, utime_t timeout) {
+	err_t res = ERR_OK;
+
+	xfer.tx = tx;
+	xfer.rx = rx;
+	xfer.size = size;
+	xfer.tx_i = 0;
+	xfer.rx_i = 0;
+	xfer.fill = fill;
+	xfer.pending = 0;
+
+	// The transmit buffer is empty so the DRE interrupt fires right away and
+	// starts things off
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	SPIx.INTCTRL = SPI_RXCIE_bm | SPI_DREIE_bm;
+	while (true) {
+		// NOW_MS() restores the interrupt state itself so this has to be
+		// checked before they're disabled below
+		if (TIMES_UP(timeout)) {
+			SPIx.INTCTRL = 0;
+			res = ERR_TIMEOUT;
+			break;
+		}
+		// The instruction following sei() is always executed before any
+		// pending interrupt, so there's no window for the last one to slip in
+		// between the check and going to sleep; the systick interrupt wakes us
+		// to check the timeout
+#if ENABLE_SPI_IRQ_STATS
+		irq_stats.sleep_start = uscounter_read();
+#endif
+		cli();
+		if (xfer.rx_i >= size) {
+			sei();
+			break;
+		}
+#if ENABLE_SPI_IRQ_STATS
+		irq_stats.sleeping = true;
+#endif
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+#if ENABLE_SPI_IRQ_STATS
+		// If the SPI ISR didn't settle the time, something else woke us up
+		cli();
+		++irq_stats.counts.wakeups;
+		settle_sleep_time();
+		sei();
+#endif
+	}
+
+	return res;
+}
+#endif
+//
+// Use the interrupt-driven version when possible; it can't be used when
+// interrupts are disabled, such as when called from an ISR
+static err_t exchange(const uint8_t *tx, uint8_t fill, uint8_t *rx, txsize_t size, utime_t timeout) {
+	timeout = SET_TIMEOUT_MS(timeout);
+	drain_rx();
+
+#if uHAL_USE_SPI_IRQ
+	if (BIT_IS_SET(SREG, CPU_I_bm)) {
+		return exchange_irq(tx, fill, rx, size, timeout);
+	}
+#endif
+
+	return exchange_polled(tx, fill, rx, size, timeout);
+}
+//
+// The hardware only supports 8-bit frames so each word is sent as two of them,
+// high byte first to match the MSB-first bit order
+// This is exchange() with each frame counted as half a word; the received
+// high byte is held until the low byte arrives so that 'rx' can overlap 'tx'
+static err_t exchange16(const uint16_t *tx, uint16_t fill, uint16_t *rx, txsize_t count, utime_t timeout) {
+	txsize_t tx_i, rx_i;
+	bool tx_lo, rx_lo;
+	uint_fast8_t pending;
+	uint8_t hi;
+
+	timeout = SET_TIMEOUT_MS(timeout);
+	drain_rx();
+
+	tx_i = 0;
+	rx_i = 0;
+	tx_lo = false;
+	rx_lo = false;
+	pending = 0;
+	hi = 0;
+	while (rx_i < count) {
+		if ((tx_i < count) && (pending < 2U) && BIT_IS_SET(SPIx.INTFLAGS, SPI_DREIF_bm)) {
+			uint16_t w = (tx != NULL) ? tx[tx_i] : fill;
+
+			if (tx_lo) {
+				SPIx.DATA = (uint8_t )w;
+				++tx_i;
+			} else {
+				SPIx.DATA = (uint8_t )(w >> 8);
+			}
+			tx_lo = !tx_lo;
+			++pending;
+		}
+		if (BIT_IS_SET(SPIx.INTFLAGS, SPI_RXCIF_bm)) {
+			uint8_t c = SPIx.DATA;
+
+			if (rx_lo) {
+				if (rx != NULL) {
+					rx[rx_i] = ((uint16_t )hi << 8) | c;
+				}
+				++rx_i;
+			} else {
+				hi = c;
+			}
+			rx_lo = !rx_lo;
+			--pending;
+		} else if (TIMES_UP(timeout)) {
+			return ERR_TIMEOUT;
+		}
+	}
+
+	return ERR_OK;
+}
+
+err_t spi_exchange_byte(spi_port_t *p, uint8_t tx, uint8_t *rx, utime_t timeout) {
+	UNUSED(p);
 
 	uHAL_assert(rx != NULL);
 
@@ -146,29 +525,30 @@ err_t spi_exchange_byte(uint8_t tx, uint8_t *rx, utime_t timeout) {
 	}
 #endif
 
-	res = ERR_OK;
-	timeout = SET_TIMEOUT_MS(timeout);
+	return exchange(&tx, 0, rx, 1, timeout);
+}
+err_t spi_exchange_block(spi_port_t *p, const uint8_t *tx_buffer, uint8_t *rx_buffer, txsize_t size, utime_t timeout) {
+	UNUSED(p);
 
-	// This is just done to clear the IF flag in case it's already set for
-	// some reason (an earlier timed-out transmission perhaps?)
-	if (BIT_IS_SET(SPIx.INTFLAGS, SPI_IF_bm)) {
-		*rx = SPIx.DATA;
-	}
+	uHAL_assert(tx_buffer != NULL);
+	uHAL_assert(rx_buffer != NULL);
+	uHAL_assert(size > 0);
 
-	SPIx.DATA = tx;
-	while (!BIT_IS_SET(SPIx.INTFLAGS, SPI_IF_bm)) {
-		if (TIMES_UP(timeout)) {
-			res = ERR_TIMEOUT;
-			break;
-		}
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!BIT_IS_SET(SPIx.CTRLA, SPI_ENABLE_bm) || !BIT_IS_SET(SPIx.CTRLA, SPI_MASTER_bm)) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((tx_buffer == NULL) || (rx_buffer == NULL) || (size <= 0)) {
+		return ERR_BADARG;
 	}
-	*rx = SPIx.DATA;
+#endif
 
-	return res;
+	return exchange(tx_buffer, 0, rx_buffer, size, timeout);
 }
-err_t spi_receive_block(uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, utime_t timeout) {
-	err_t res;
-	txsize_t i;
+err_t spi_receive_block(spi_port_t *p, uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, utime_t timeout) {
+	UNUSED(p);
 
 	uHAL_assert(rx_buffer != NULL);
 	uHAL_assert(rx_size > 0);
@@ -184,36 +564,72 @@ err_t spi_receive_block(uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, utime_
 	}
 #endif
 
-	// This is just done to clear the IF flag in case it's already set for
-	// some reason (an earlier timed-out transmission perhaps?)
-	if (BIT_IS_SET(SPIx.INTFLAGS, SPI_IF_bm)) {
-		rx_buffer[0] = SPIx.DATA;
+	return exchange(NULL, tx, rx_buffer, rx_size, timeout);
+}
+err_t spi_transmit_block(spi_port_t *p, const uint8_t *tx_buffer, txsize_t tx_size, utime_t timeout) {
+	UNUSED(p);
+
+	uHAL_assert(tx_buffer != NULL);
+	uHAL_assert(tx_size > 0);
+
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!BIT_IS_SET(SPIx.CTRLA, SPI_ENABLE_bm) || !BIT_IS_SET(SPIx.CTRLA, SPI_MASTER_bm)) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((tx_buffer == NULL) || (tx_size <= 0)) {
+		return ERR_BADARG;
 	}
+#endif
 
-	res = ERR_OK;
-	timeout = SET_TIMEOUT_MS(timeout);
+	return exchange(tx_buffer, 0, NULL, tx_size, timeout);
+}
 
-	for (i = 0; i < rx_size; ++i) {
-		SPIx.DATA = tx;
-		while (!BIT_IS_SET(SPIx.INTFLAGS, SPI_IF_bm)) {
-			if (TIMES_UP(timeout)) {
-				res = ERR_TIMEOUT;
-				goto END;
-			}
-		}
-		rx_buffer[i] = SPIx.DATA;
+err_t spi_exchange_block16(spi_port_t *p, const uint16_t *tx_buffer, uint16_t *rx_buffer, txsize_t count, utime_t timeout) {
+	UNUSED(p);
+
+	uHAL_assert(tx_buffer != NULL);
+	uHAL_assert(rx_buffer != NULL);
+	uHAL_assert(count > 0);
+
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!BIT_IS_SET(SPIx.CTRLA, SPI_ENABLE_bm) || !BIT_IS_SET(SPIx.CTRLA, SPI_MASTER_bm)) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((tx_buffer == NULL) || (rx_buffer == NULL) || (count <= 0)) {
+		return ERR_BADARG;
 	}
+#endif
 
-END:
-	return res;
+	return exchange16(tx_buffer, 0, rx_buffer, count, timeout);
 }
-err_t spi_transmit_block(const uint8_t *tx_buffer, txsize_t tx_size, utime_t timeout) {
-	err_t res;
-	uint8_t rx;
-	txsize_t i;
+err_t spi_receive_block16(spi_port_t *p, uint16_t *rx_buffer, txsize_t rx_count, uint16_t tx, utime_t timeout) {
+	UNUSED(p);
+
+	uHAL_assert(rx_buffer != NULL);
+	uHAL_assert(rx_count > 0);
+
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!BIT_IS_SET(SPIx.CTRLA, SPI_ENABLE_bm) || !BIT_IS_SET(SPIx.CTRLA, SPI_MASTER_bm)) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((rx_buffer == NULL) || (rx_count <= 0)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	return exchange16(NULL, tx, rx_buffer, rx_count, timeout);
+}
+err_t spi_transmit_block16(spi_port_t *p, const uint16_t *tx_buffer, txsize_t tx_count, utime_t timeout) {
+	UNUSED(p);
 
 	uHAL_assert(tx_buffer != NULL);
-	uHAL_assert(tx_size > 0);
+	uHAL_assert(tx_count > 0);
 
 #if ! uHAL_SKIP_INIT_CHECKS
 	if (!BIT_IS_SET(SPIx.CTRLA, SPI_ENABLE_bm) || !BIT_IS_SET(SPIx.CTRLA, SPI_MASTER_bm)) {
@@ -221,29 +637,141 @@ err_t spi_transmit_block(const uint8_t *tx_buffer, txsize_t tx_size, utime_t tim
 	}
 #endif
 #if ! uHAL_SKIP_INVALID_ARG_CHECKS
-	if ((tx_buffer == NULL) || (tx_size <= 0)) {
+	if ((tx_buffer == NULL) || (tx_count <= 0)) {
 		return ERR_BADARG;
 	}
 #endif
 
-	res = ERR_OK;
-	timeout = SET_TIMEOUT_MS(timeout);
+	return exchange16(tx_buffer, 0, NULL, tx_count, timeout);
+}
 
-	for (i = 0; i < tx_size; ++i) {
-		SPIx.DATA = tx_buffer[i];
-		while (!BIT_IS_SET(SPIx.INTFLAGS, SPI_IF_bm)) {
-			if (TIMES_UP(timeout)) {
-				res = ERR_TIMEOUT;
-				goto END;
-			}
-		}
-		rx = SPIx.DATA;
+//
+// There's no CRC hardware so it's calculated in software
+err_t spi_receive_block_crc16(spi_port_t *p, uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, uint16_t *crc, utime_t timeout) {
+	err_t res;
+
+	uHAL_assert(crc != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (crc == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	if ((res = spi_receive_block(p, rx_buffer, rx_size, tx, timeout)) == ERR_OK) {
+		*crc = crc16_update(0, rx_buffer, rx_size);
+	}
+
+	return res;
+}
+err_t spi_transmit_block_crc16(spi_port_t *p, const uint8_t *tx_buffer, txsize_t tx_size, uint16_t *crc, utime_t timeout) {
+	err_t res;
+
+	uHAL_assert(crc != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (crc == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	if ((res = spi_transmit_block(p, tx_buffer, tx_size, timeout)) == ERR_OK) {
+		*crc = crc16_update(0, tx_buffer, tx_size);
 	}
-	UNUSED(rx);
 
-END:
 	return res;
 }
+static uint32_t presc_to_hz(uint8_t presc) {
+	static const uint8_t divs[] = { 4U, 16U, 64U, 128U };
+	uint32_t hz;
+
+	hz = G_freq_SPICLK / divs[SELECT_BITS(presc, SPI_PRESC_gm) >> SPI_PRESC_gp];
+	if (BIT_IS_SET(presc, SPI_CLK2X_bm)) {
+		hz *= 2U;
+	}
+
+	return hz;
+}
+//
+// The transfer functions don't return until the last frame has been received,
+// so the bus is always idle here and the clock can be changed freely
+static void set_prescaler(uint8_t presc) {
+	if (SELECT_BITS(SPIx.CTRLA, SPI_PRESC_gm|SPI_CLK2X_bm) != presc) {
+		MODIFY_BITS(SPIx.CTRLA, SPI_PRESC_gm|SPI_CLK2X_bm, presc);
+	}
+
+	return;
+}
+uint32_t spi_set_frequency(spi_port_t *p, uint32_t hz) {
+	uint8_t presc;
+
+	UNUSED(p);
+
+	uHAL_assert(hz > 0U);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (hz == 0U) {
+		return 0;
+	}
+#endif
+
+	presc = calculate_prescaler_max(hz);
+	set_prescaler(presc);
+
+	return presc_to_hz(presc);
+}
+
+//
+// A device with no port set is on the default one
+static spi_port_t* device_port(const spi_device_t *dev) {
+	return (dev->port != NULL) ? dev->port : SPI_DEFAULT_PORT;
+}
+err_t spi_device_begin(const spi_device_t *dev) {
+	spi_port_t *p;
+	uint32_t hz;
+	uint8_t mode;
+
+	uHAL_assert(dev != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (dev == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	p = device_port(dev);
+	hz = (dev->max_hz != 0U) ? dev->max_hz : SPI_FREQUENCY_HZ;
+	if (hz != p->device_hz) {
+		p->device_presc = calculate_prescaler_max(hz);
+		p->device_hz = hz;
+	}
+	set_prescaler(p->device_presc);
+	mode = ((uint8_t )dev->mode << SPI_MODE_gp) & SPI_MODE_gm;
+	if (SELECT_BITS(SPIx.CTRLB, SPI_MODE_gm) != mode) {
+		MODIFY_BITS(SPIx.CTRLB, SPI_MODE_gm, mode);
+	}
+
+	if (dev->cs_pin != 0) {
+		gpio_set_state(dev->cs_pin, GPIO_LOW);
+	}
+	spi_trace_begin(&p->trace, dev);
+
+	return ERR_OK;
+}
+err_t spi_device_end(const spi_device_t *dev) {
+	uHAL_assert(dev != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (dev == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	if (dev->cs_pin != 0) {
+		gpio_set_state(dev->cs_pin, GPIO_HIGH);
+	}
+	spi_trace_end(&device_port(dev)->trace, dev);
+
+	return ERR_OK;
+}
 
 
 #endif // uHAL_USE_SPI
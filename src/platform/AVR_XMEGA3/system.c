@@ -28,6 +28,7 @@
 #include "spi.h"
 #include "time.h"
 #include "i2c.h"
+#include "uart.h"
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
@@ -130,6 +131,8 @@ DEBUG_CPP_MACRO(F_OSC / F_CORE);
 	const uart_port_cfg_t uart_cfg = {
 		.rx_pin = UART_COMM_RX_PIN,
 		.tx_pin = UART_COMM_TX_PIN,
+		.rts_pin = UART_COMM_RTS_PIN,
+		.cts_pin = UART_COMM_CTS_PIN,
 		.baud_rate = UART_COMM_BAUDRATE,
 	};
 	if (uart_init_port(UART_COMM_PORT, &uart_cfg) == ERR_OK) {
@@ -281,6 +284,11 @@ void hibernate_s(utime_t s, sleep_mode_t sleep_mode, uHAL_flags_t flags) {
 	}
 
 	if ((!IRQ_IS_WAITING(flags)) && (s != 0)) {
+		// Queued UART output would be cut off (or stall until wakeup) if we
+		// went to sleep before it was sent
+#if uHAL_USE_UART
+		uart_tx_drain_all();
+#endif
 		//FIXME:
 		// When waking from deep sleep, there's a frame error on the RX side of
 		// transmitted messages without this pause and I can't determine the
@@ -339,6 +347,11 @@ void hibernate(sleep_mode_t sleep_mode, uHAL_flags_t flags) {
 		break;
 	}
 
+	// Queued UART output would be cut off (or stall until wakeup) if we
+	// went to sleep before it was sent
+#if uHAL_USE_UART
+	uart_tx_drain_all();
+#endif
 	//FIXME:
 	// When waking from deep sleep, there's a frame error on the RX side of
 	// transmitted messages without this pause and I can't determine the
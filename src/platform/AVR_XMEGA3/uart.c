@@ -26,25 +26,30 @@
 #if uHAL_USE_UART
 
 #include "system.h"
+#include "uart.h"
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/power.h>
 
-// For memcpy() and memmove()
-#include <string.h>
-
 
 #include "platform/common/uart_buf.c"
 #include "uart_find_periph.h"
 #include "uart_define_irq.h"
 
+// The RX buffer indices are shared with the ISR and need to be readable in
+// a single instruction
+#if ENABLE_UART_LISTENING && UART_INPUT_BUFFER_BYTES > 128
+# error "UART_INPUT_BUFFER_BYTES must be <= 128"
+#endif
+
 #define CONFIG_8N1 (USART_CHSIZE_8BIT_gc | USART_SBMODE_1BIT_gc | USART_PMODE_DISABLED_gc)
 
 // Clear status flags by writing '1' to them
 #define CLEAR_STATUS(uartx) (uartx->STATUS = USART_TXCIF_bm | USART_RXSIF_bm | USART_ISFIF_bm | USART_BDF_bm)
 
 DEBUG_CPP_MACRO(UART_INPUT_BUFFER_BYTES)
+DEBUG_CPP_MACRO(UART_TX_BUFFER_BYTES)
 
 #ifdef UART_COMM_PORT
 # define SET_DEFAULT_PORT(_p_) do { if ((_p_) == NULL) (_p_) = UART_COMM_PORT; } while (0)
@@ -75,6 +80,89 @@ DEBUG_CPP_MACRO(UART_INPUT_BUFFER_BYTES)
 //#define BUFFER_OK(_buf_, _size_) ((_buf_) != NULL && (_size_) > 0)
 #define BUFFER_OK(_buf_, _size_) ((_buf_) != NULL)
 
+#if UART_TX_BUFFER_BYTES > 0
+static bool _uart_tx_is_busy(const uart_port_t *p) {
+	// DREIE is set as long as there's anything queued and TXCIE is set from
+	// then until the last frame has been shifted out
+	return BIT_IS_SET(p->uartx->CTRLA, (USART_DREIE_bm | USART_TXCIE_bm));
+}
+//
+// Nothing is going to service the queue while interrupts are disabled, so
+// in that case the waiting side has to do the ISR's job itself
+static void uart_tx_poll(uart_port_t *p) {
+	uint8_t ctrla, status;
+
+	if (BIT_IS_SET(SREG, CPU_I_bm)) {
+		return;
+	}
+
+	ctrla = p->uartx->CTRLA;
+	status = p->uartx->STATUS;
+	if (BIT_IS_SET(ctrla, USART_DREIE_bm) && BIT_IS_SET(status, USART_DREIF_bm)) {
+		UARTx_DRE_IRQHandler(p);
+	} else if (BIT_IS_SET(ctrla, USART_TXCIE_bm) && BIT_IS_SET(status, USART_TXCIF_bm)) {
+		UARTx_TXC_IRQHandler(p);
+	}
+
+	return;
+}
+static void uart_tx_drain(uart_port_t *p) {
+	while (_uart_tx_is_busy(p)) {
+		uart_tx_poll(p);
+	}
+
+	return;
+}
+void uart_tx_drain_all(void) {
+# if HAVE_UART0
+	if (uart0_port != NULL) {
+		uart_tx_drain(uart0_port);
+	}
+# endif
+# if HAVE_UART1
+	if (uart1_port != NULL) {
+		uart_tx_drain(uart1_port);
+	}
+# endif
+# if HAVE_UART2
+	if (uart2_port != NULL) {
+		uart_tx_drain(uart2_port);
+	}
+# endif
+# if HAVE_UART3
+	if (uart3_port != NULL) {
+		uart_tx_drain(uart3_port);
+	}
+# endif
+
+	return;
+}
+//
+// Copy as much of the buffer into the queue as will fit and return the number
+// of bytes copied
+static txsize_t uart_tx_buffer_write(volatile uart_tx_buffer_t *tx_buf, const uint8_t *buffer, txsize_t size) {
+	uint8_t head, space;
+
+	head = tx_buf->head;
+	space = UART_TX_BUFFER_BYTES - (uint8_t )(head - tx_buf->tail);
+	if (space > size) {
+		space = (uint8_t )size;
+	}
+
+	for (uint8_t i = 0; i < space; ++i) {
+		tx_buf->buffer[(uint8_t )(head + i) & UART_TX_BUFFER_MASK] = buffer[i];
+	}
+	// The bytes must be in place before the ISR can see the new head
+	tx_buf->head = head + space;
+
+	return space;
+}
+#else // UART_TX_BUFFER_BYTES > 0
+void uart_tx_drain_all(void) {
+	return;
+}
+#endif // UART_TX_BUFFER_BYTES > 0
+
 err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 	SET_DEFAULT_PORT(p);
 
@@ -113,8 +201,33 @@ err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 		return ERR_NOTSUP;
 	}
 
+	// There's no flow control in the peripheral so both pins are handled in
+	// software and can be any pin
+	// RTS follows the fill level of the rx buffer and CTS is checked before
+	// each byte is sent, which the TX queue's ISR can't wait on
+#if ENABLE_UART_FLOW_CONTROL
+# if UART_INPUT_BUFFER_BYTES <= 0 || ! ENABLE_UART_LISTENING
+	if (conf->rts_pin != 0) {
+		return ERR_NOTSUP;
+	}
+# endif
+# if UART_TX_BUFFER_BYTES > 0
+	if (conf->cts_pin != 0) {
+		return ERR_NOTSUP;
+	}
+# endif
+#else
+	if ((conf->rts_pin != 0) || (conf->cts_pin != 0)) {
+		return ERR_NOTSUP;
+	}
+#endif
+
 	p->rx_pin = conf->rx_pin;
 	p->tx_pin = conf->tx_pin;
+#if ENABLE_UART_FLOW_CONTROL
+	p->rts_pin = conf->rts_pin;
+	p->cts_pin = conf->cts_pin;
+#endif
 
 	p->uartx->CTRLA = 0;
 	p->uartx->CTRLC = (USART_CMODE_ASYNCHRONOUS_gc | CONFIG_8N1);
@@ -130,6 +243,16 @@ err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 	}
 
 	CLEAR_STATUS(p->uartx);
+#if UART_INPUT_BUFFER_BYTES > 0 && ENABLE_UART_LISTENING
+	uart_buffer_reset(&p->rx_buf);
+#endif
+#if ENABLE_UART_STATS
+	uart_stats_reset(p);
+#endif
+#if UART_TX_BUFFER_BYTES > 0
+	p->tx_buf.head = 0;
+	p->tx_buf.tail = 0;
+#endif
 #if ENABLE_UART_LISTENING
 	uart_listen_off(p);
 #endif
@@ -144,26 +267,76 @@ err_t uart_on(const uart_port_t *p) {
 	CLEAR_STATUS(p->uartx);
 	gpio_set_mode(p->rx_pin, GPIO_MODE_IN, GPIO_FLOAT);
 	gpio_set_mode(p->tx_pin, GPIO_MODE_PP, GPIO_HIGH);
+#if ENABLE_UART_FLOW_CONTROL
+	if (p->cts_pin != 0) {
+		gpio_set_mode(p->cts_pin, GPIO_MODE_IN, GPIO_FLOAT);
+	}
+# if UART_INPUT_BUFFER_BYTES > 0 && ENABLE_UART_LISTENING
+	if (p->rts_pin != 0) {
+		gpio_set_mode(p->rts_pin, GPIO_MODE_PP, uart_rts_state(p));
+	}
+# endif
+#endif
 	SET_BIT(p->uartx->CTRLB, (USART_TXEN_bm | USART_RXEN_bm));
 
 	return ERR_OK;
 }
 err_t uart_off(const uart_port_t *p) {
+	uint8_t sreg;
+
 	SET_DEFAULT_PORT(p);
 	VERIFY_PORT(p);
 
+#if UART_TX_BUFFER_BYTES > 0
+	// Don't lose whatever is still queued, the caller has no way of knowing
+	// it wasn't sent
+	if (BIT_IS_SET(p->uartx->CTRLB, USART_TXEN_bm)) {
+		uart_tx_drain((uart_port_t *)p);
+	}
+#endif
+
 	// There's a bug listed in the errata where disabling the transmitter doesn't
 	// release the TX pin unless the reciever is still enabled
 	//CLEAR_BIT(p->uartx->CTRLB, (USART_TXEN_bm | USART_RXEN_bm | USART_SFDEN_bm));
 	CLEAR_BIT(p->uartx->CTRLB, USART_TXEN_bm | USART_SFDEN_bm);
 	CLEAR_BIT(p->uartx->CTRLB, USART_RXEN_bm);
-	CLEAR_BIT(p->uartx->CTRLA, (USART_RXCIE_bm | USART_RXSIE_bm));
+	DISABLE_INTERRUPTS(sreg);
+	CLEAR_BIT(p->uartx->CTRLA, (USART_RXCIE_bm | USART_RXSIE_bm | USART_DREIE_bm | USART_TXCIE_bm));
+	RESTORE_INTERRUPTS(sreg);
+#if UART_TX_BUFFER_BYTES > 0
+	p->uartx->STATUS = USART_TXCIF_bm;
+	((uart_port_t *)p)->tx_buf.tail = p->tx_buf.head;
+#endif
 
 	gpio_set_mode(p->rx_pin, GPIO_MODE_RESET, GPIO_FLOAT);
 	gpio_set_mode(p->tx_pin, GPIO_MODE_RESET, GPIO_FLOAT);
+#if ENABLE_UART_FLOW_CONTROL
+	if (p->cts_pin != 0) {
+		gpio_set_mode(p->cts_pin, GPIO_MODE_RESET, GPIO_FLOAT);
+	}
+	if (p->rts_pin != 0) {
+		gpio_set_mode(p->rts_pin, GPIO_MODE_RESET, GPIO_FLOAT);
+	}
+#endif
 
 	return ERR_OK;
 }
+uint32_t uart_get_baud_rate(const uart_port_t *p) {
+	uint16_t baud;
+	uint32_t mul;
+
+	SET_DEFAULT_PORT(p);
+	VERIFY_PORT(p);
+
+	baud = read_reg16(&p->uartx->BAUD);
+	if (baud == 0) {
+		return 0;
+	}
+	// The inverse of the calculations in uart_init_port()
+	mul = (SELECT_BITS(p->uartx->CTRLB, USART_RXMODE_gm) == USART_RXMODE_CLK2X_gc) ? 8U : 4U;
+
+	return ((mul * G_freq_UARTCLK) + (baud / 2U)) / baud;
+}
 bool uart_is_on(const uart_port_t *p) {
 	SET_DEFAULT_PORT(p);
 	return BIT_IS_SET(p->uartx->CTRLB, (USART_TXEN_bm | USART_RXEN_bm));
@@ -171,21 +344,30 @@ bool uart_is_on(const uart_port_t *p) {
 
 #if ENABLE_UART_LISTENING
 err_t uart_listen_on(const uart_port_t *p) {
+	uint8_t sreg;
+
 	SET_DEFAULT_PORT(p);
 	VERIFY_PORT(p);
 
 	// We enable the frame start interrupt just so we can wake from deep sleep
 	// via UART input
+	// CTRLA is shared with the TX ISR so it needs to be modified atomically
+	DISABLE_INTERRUPTS(sreg);
 	SET_BIT(p->uartx->CTRLA, (USART_RXCIE_bm | USART_RXSIE_bm));
+	RESTORE_INTERRUPTS(sreg);
 	SET_BIT(p->uartx->CTRLB, (USART_SFDEN_bm));
 
 	return ERR_OK;
 }
 err_t uart_listen_off(const uart_port_t *p) {
+	uint8_t sreg;
+
 	SET_DEFAULT_PORT(p);
 	VERIFY_PORT(p);
 
+	DISABLE_INTERRUPTS(sreg);
 	CLEAR_BIT(p->uartx->CTRLA, (USART_RXCIE_bm | USART_RXSIE_bm));
+	RESTORE_INTERRUPTS(sreg);
 	CLEAR_BIT(p->uartx->CTRLB, (USART_SFDEN_bm));
 
 	return ERR_OK;
@@ -203,29 +385,142 @@ bool uart_rx_is_available(const uart_port_t *p) {
 #if UART_INPUT_BUFFER_BYTES > 0
 	SET_DEFAULT_PORT(p);
 	VERIFY_PORT(p);
-	return (p->rx_buf.bytes != 0);
+	return (uart_buffer_used(&p->rx_buf) != 0);
 #else
 	UNUSED(p);
 	return false;
 #endif
 }
+uint_fast16_t uart_rx_overrun_count(const uart_port_t *p) {
+#if UART_INPUT_BUFFER_BYTES > 0
+	uint_fast16_t overruns;
+
+	SET_DEFAULT_PORT(p);
+	VERIFY_PORT(p);
+
+	READ_VOLATILE(overruns, p->rx_buf.overruns)
+	return overruns;
+#else
+	UNUSED(p);
+	return 0;
+#endif
+}
+err_t uart_rx_peek(uart_port_t *p, const uint8_t **data, txsize_t *size) {
+	SET_DEFAULT_PORT(p);
+	VERIFY_PORT(p);
+
+	uHAL_assert(data != NULL);
+	uHAL_assert(size != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((data == NULL) || (size == NULL)) {
+		return ERR_BADARG;
+	}
+#endif
+
+#if UART_INPUT_BUFFER_BYTES > 0
+	*size = peek_uart_buffer(p, data);
+	return ERR_OK;
+#else
+	*data = NULL;
+	*size = 0;
+	return ERR_NOTSUP;
+#endif
+}
+err_t uart_rx_consume(uart_port_t *p, txsize_t size) {
+	SET_DEFAULT_PORT(p);
+	VERIFY_PORT(p);
+
+#if UART_INPUT_BUFFER_BYTES > 0
+	if (consume_uart_buffer(p, size) != size) {
+		return ERR_BADARG;
+	}
+	return ERR_OK;
+#else
+	UNUSED(size);
+	return ERR_NOTSUP;
+#endif
+}
+#if ENABLE_UART_LINE_MODE
+err_t uart_rx_set_delimiters(uart_port_t *p, const char *delims) {
+	SET_DEFAULT_PORT(p);
+	VERIFY_PORT(p);
+
+	uart_buffer_set_delimiters(&p->rx_buf, delims);
+
+	return ERR_OK;
+}
+bool uart_rx_line_is_available(const uart_port_t *p) {
+	SET_DEFAULT_PORT(p);
+	VERIFY_PORT(p);
+	return uart_buffer_line_is_available(&p->rx_buf, p->rx_buf.head);
+}
+#endif // ENABLE_UART_LINE_MODE
 #endif // ENABLE_UART_LISTENING
 
+#if ENABLE_UART_STATS
+err_t uart_get_stats(const uart_port_t *p, uart_stats_t *stats) {
+	uint8_t sreg;
+
+	SET_DEFAULT_PORT(p);
+	VERIFY_PORT(p);
+
+	uHAL_assert(stats != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (stats == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	// Most of the counters are wider than a byte and could be caught half-way
+	// through an update by the ISR
+	DISABLE_INTERRUPTS(sreg);
+	uart_stats_copy(p, stats);
+	RESTORE_INTERRUPTS(sreg);
+
+	return ERR_OK;
+}
+err_t uart_clear_stats(uart_port_t *p) {
+	uint8_t sreg;
+
+	SET_DEFAULT_PORT(p);
+	VERIFY_PORT(p);
+
+	DISABLE_INTERRUPTS(sreg);
+	uart_stats_reset(p);
+	RESTORE_INTERRUPTS(sreg);
+
+	return ERR_OK;
+}
+#endif // ENABLE_UART_STATS
+
 err_t uart_transmit_block(uart_port_t *p, const uint8_t *buffer, txsize_t size, utime_t timeout) {
+	uart_iovec_t iov = { buffer, size };
+
+	uHAL_assert(BUFFER_OK(buffer, size));
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (!BUFFER_OK(buffer, size)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	return uart_transmit_iov(p, &iov, 1, timeout);
+}
+err_t uart_transmit_iov(uart_port_t *p, const uart_iovec_t *iov, uint_fast8_t iovcnt, utime_t timeout) {
 	err_t res;
 	USART_t *uartx;
-	txsize_t i = 0;
 
 	SET_DEFAULT_PORT(p);
 	VERIFY_PORT(p);
 
-	uHAL_assert(BUFFER_OK(buffer, size));
+	uHAL_assert(iov != NULL);
 #if ! uHAL_SKIP_INVALID_ARG_CHECKS
-	if (!BUFFER_OK(buffer, size)) {
+	if (iov == NULL) {
 		return ERR_BADARG;
 	}
-	if (size == 0) {
-		return ERR_OK;
+	for (uint_fast8_t s = 0; s < iovcnt; ++s) {
+		if ((iov[s].data == NULL) && (iov[s].size != 0)) {
+			return ERR_BADARG;
+		}
 	}
 #endif
 
@@ -233,16 +528,85 @@ err_t uart_transmit_block(uart_port_t *p, const uint8_t *buffer, txsize_t size,
 	res = ERR_OK;
 	timeout = SET_TIMEOUT_MS(timeout);
 
-	for (; i < size; ++i) {
-		while (!BIT_IS_SET(uartx->STATUS, USART_DREIF_bm)) {
-			if (TIMES_UP(timeout)) {
-				res = ERR_TIMEOUT;
-				goto END;
+#if UART_TX_BUFFER_BYTES > 0
+	// The data is queued for the DRE ISR and we only have to wait if there's
+	// more of it than will fit
+	// Segments are queued back-to-back so the ISR sees one continuous stream
+	for (uint_fast8_t s = 0; s < iovcnt; ++s) {
+		const uint8_t *buffer = iov[s].data;
+		txsize_t size = iov[s].size;
+		txsize_t i = 0;
+
+		while (i < size) {
+			uint8_t sreg;
+
+			txsize_t queued = uart_tx_buffer_write(&p->tx_buf, &buffer[i], size - i);
+
+			i += queued;
+			UART_STATS_ADD(p, tx_bytes, queued);
+			DISABLE_INTERRUPTS(sreg);
+			MODIFY_BITS(uartx->CTRLA, (USART_DREIE_bm | USART_TXCIE_bm), USART_DREIE_bm);
+			RESTORE_INTERRUPTS(sreg);
+			if (i == size) {
+				break;
+			}
+
+#if ENABLE_UART_STATS
+			// Only the time spent waiting for room in the queue counts as a
+			// stall, the rest of the time is spent copying
+			utime_t stall_start = NOW_MS();
+#endif
+			while ((uint8_t )(p->tx_buf.head - p->tx_buf.tail) == UART_TX_BUFFER_BYTES) {
+				if (TIMES_UP(timeout)) {
+					res = ERR_TIMEOUT;
+					break;
+				}
+				uart_tx_poll(p);
+			}
+			UART_STATS_ADD(p, tx_stall_ms, NOW_MS() - stall_start);
+			if (res != ERR_OK) {
+				return res;
 			}
 		}
-		uartx->TXDATAL = buffer[i];
 	}
-	while (!BIT_IS_SET(uartx->STATUS, USART_TXCIF_bm) || !BIT_IS_SET(uartx->STATUS, USART_DREIF_bm)) {
+
+	return res;
+
+#else // UART_TX_BUFFER_BYTES > 0
+	bool sent = false;
+#if ENABLE_UART_STATS
+	// The whole call is spent waiting on the peripheral one way or another
+	utime_t stall_start = NOW_MS();
+#endif
+
+	// Only the end of the last segment is waited on so that the data register
+	// is kept full across segment boundaries
+	for (uint_fast8_t s = 0; s < iovcnt; ++s) {
+		const uint8_t *buffer = iov[s].data;
+
+		for (txsize_t i = 0; i < iov[s].size; ++i) {
+			sent = true;
+			while (!BIT_IS_SET(uartx->STATUS, USART_DREIF_bm)) {
+				if (TIMES_UP(timeout)) {
+					res = ERR_TIMEOUT;
+					goto END;
+				}
+			}
+#if ENABLE_UART_FLOW_CONTROL
+			while ((p->cts_pin != 0) && (gpio_get_input_state(p->cts_pin) == GPIO_HIGH)) {
+				if (TIMES_UP(timeout)) {
+					res = ERR_TIMEOUT;
+					goto END;
+				}
+			}
+#endif
+			uartx->TXDATAL = buffer[i];
+			UART_STATS_ADD(p, tx_bytes, 1U);
+			// Any TX complete flag left from an earlier frame is stale now
+			uartx->STATUS = USART_TXCIF_bm;
+		}
+	}
+	while (sent && (!BIT_IS_SET(uartx->STATUS, USART_TXCIF_bm) || !BIT_IS_SET(uartx->STATUS, USART_DREIF_bm))) {
 		if (TIMES_UP(timeout)) {
 			res = ERR_TIMEOUT;
 			break;
@@ -250,7 +614,20 @@ err_t uart_transmit_block(uart_port_t *p, const uint8_t *buffer, txsize_t size,
 	}
 
 END:
+	UART_STATS_ADD(p, tx_stall_ms, NOW_MS() - stall_start);
 	return res;
+#endif // UART_TX_BUFFER_BYTES > 0
+}
+bool uart_tx_is_busy(const uart_port_t *p) {
+	SET_DEFAULT_PORT(p);
+	VERIFY_PORT(p);
+
+#if UART_TX_BUFFER_BYTES > 0
+	return _uart_tx_is_busy(p);
+#else
+	// Blocking transmissions don't return until they're finished
+	return false;
+#endif
 }
 err_t uart_receive_block(uart_port_t *p, uint8_t *buffer, txsize_t size, utime_t timeout) {
 	err_t res;
@@ -273,14 +650,29 @@ err_t uart_receive_block(uart_port_t *p, uint8_t *buffer, txsize_t size, utime_t
 	res = ERR_OK;
 	timeout = SET_TIMEOUT_MS(timeout);
 
-#if ENABLE_UART_LISTENING
+	txsize_t i = eat_uart_buffer(p, buffer, size);
+
+#if ENABLE_UART_LISTENING && UART_INPUT_BUFFER_BYTES > 0
+	// When listening, the ISR owns the data register so all we need to do is
+	// wait for it to fill the buffer
+	if (_uart_is_listening(p)) {
+		while (i < size) {
+			if (TIMES_UP(timeout)) {
+				res = ERR_TIMEOUT;
+				break;
+			}
+			i += eat_uart_buffer(p, &buffer[i], size - i);
+		}
+		return res;
+	}
+#elif ENABLE_UART_LISTENING
 	bool reenable_listen = _uart_is_listening(p);
 	if (reenable_listen) {
 		uart_listen_off(p);
 	}
 #endif
 
-	for (txsize_t i = eat_uart_buffer(p, buffer, size); i < size; ++i) {
+	for (; i < size; ++i) {
 		while (!BIT_IS_SET(uartx->STATUS, USART_RXCIF_bm)) {
 			if (TIMES_UP(timeout)) {
 				res = ERR_TIMEOUT;
@@ -288,10 +680,11 @@ err_t uart_receive_block(uart_port_t *p, uint8_t *buffer, txsize_t size, utime_t
 			}
 		}
 		buffer[i] = uartx->RXDATAL;
+		UART_STATS_ADD(p, rx_bytes, 1U);
 	}
 
 END:
-#if ENABLE_UART_LISTENING
+#if ENABLE_UART_LISTENING && UART_INPUT_BUFFER_BYTES <= 0
 	if (reenable_listen) {
 		uart_listen_on(p);
 	}
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/***********************************************************************
+*                                                                      *
+*                                                                      *
+* Copyright 2021, 2024 svijsv                                          *
+* This program is free software: you can redistribute it and/or modify *
+* it under the terms of the GNU General Public License as published by *
+* the Free Software Foundation, version 3.                             *
+*                                                                      *
+* This program is distributed in the hope that it will be useful, but  *
+* WITHOUT ANY WARRANTY; without even the implied warranty of           *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+* General Public License for more details.                             *
+*                                                                      *
+* You should have received a copy of the GNU General Public License    *
+* along with this program.  If not, see <http:// www.gnu.org/licenses/>.*
+*                                                                      *
+*                                                                      *
+***********************************************************************/
+// uart.h
+// Manage the UART peripheral
+// NOTES:
+//   Prototypes for most of the related functions are in interface.h
+//
+#ifndef _uHAL_PLATFORM_XMEGA3_UART_H
+#define _uHAL_PLATFORM_XMEGA3_UART_H
+
+#include "common.h"
+#if uHAL_USE_UART
+
+
+// Wait for the TX queues of all initialized ports to empty
+// This does nothing unless UART_TX_BUFFER_BYTES is > 0
+void uart_tx_drain_all(void);
+
+
+#endif // uHAL_USE_UART
+#endif // _uHAL_PLATFORM_XMEGA3_UART_H
@@ -1,29 +1,73 @@
 //
-// Generated by tools/xmega3/uart_define_irq.sh on Fri Jul 26 03:53:43 AM EDT 2024
+// Generated by tools/xmega3/uart_define_irq.sh on Fri Oct 16 22:45:01 UTC 2026
 //
 
-#if ENABLE_UART_LISTENING
+#if ENABLE_UART_LISTENING || UART_TX_BUFFER_BYTES > 0
 
 #define ASSIGN_IRQ_PORT(_irqn_, _p_) do { uart ## _irqn_ ## _port = (_p_); } while (0);
 
+#if ENABLE_UART_LISTENING
 static void UARTx_RXC_IRQHandler(uart_port_t *p) {
+#if ENABLE_UART_STATS
+	// The error flags for a frame are in RXDATAH, which must be read before
+	// RXDATAL
+	uint8_t flags = p->uartx->RXDATAH;
+
+	if (BIT_IS_SET(flags, USART_BUFOVF_bm)) {
+		++p->stats.overrun_errors;
+	}
+	if (BIT_IS_SET(flags, USART_FERR_bm)) {
+		++p->stats.framing_errors;
+	}
+#endif
+	// The byte needs to be read even if there's no room for it or else we'll
+	// just immediately re-enter this interrupt
+	uint8_t rx = p->uartx->RXDATAL;
+
+	UART_STATS_ADD(p, rx_bytes, 1U);
 #if UART_INPUT_BUFFER_BYTES > 0
-	if (p->rx_buf.bytes < UART_INPUT_BUFFER_BYTES) {
-		p->rx_buf.buffer[p->rx_buf.bytes] = p->uartx->RXDATAL;
-		++p->rx_buf.bytes;
-	} else
+	uart_buffer_size_t from = p->rx_buf.head;
+
+	uart_buffer_push(&p->rx_buf, rx);
+	uart_buffer_pushed(p, from);
+	if (uart_buffer_hook_is_due(&p->rx_buf)) {
+		uart_rx_irq_hook(p);
+	}
+#else
+	UNUSED(rx);
+	UART_STATS_ADD(p, rx_dropped, 1U);
+	uart_rx_irq_hook(p);
 #endif
-	{
-		// We still need to read the byte or else we'll just immediately re-enter
-		// this interrupt
-		uint8_t rx = p->uartx->RXDATAL;
-		UNUSED(rx);
+
+	return;
+}
+#endif // ENABLE_UART_LISTENING
+
+#if UART_TX_BUFFER_BYTES > 0
+static void UARTx_DRE_IRQHandler(uart_port_t *p) {
+	uint8_t tail = p->tx_buf.tail;
+
+	if (tail != p->tx_buf.head) {
+		p->uartx->TXDATAL = p->tx_buf.buffer[tail & UART_TX_BUFFER_MASK];
+		// The new frame hasn't finished yet so any TX complete flag left over
+		// from an earlier one is stale
+		p->uartx->STATUS = USART_TXCIF_bm;
+		p->tx_buf.tail = tail + 1U;
+	} else {
+		// Nothing left to send, switch to waiting for the last frame to be
+		// shifted out so that uart_tx_is_busy() knows when the line is idle
+		MODIFY_BITS(p->uartx->CTRLA, (USART_DREIE_bm | USART_TXCIE_bm), USART_TXCIE_bm);
 	}
 
-	uart_rx_irq_hook(p);
+	return;
+}
+static void UARTx_TXC_IRQHandler(uart_port_t *p) {
+	p->uartx->STATUS = USART_TXCIF_bm;
+	CLEAR_BIT(p->uartx->CTRLA, USART_TXCIE_bm);
 
 	return;
 }
+#endif // UART_TX_BUFFER_BYTES > 0
 
 //
 // USART0
@@ -31,6 +75,7 @@ static void UARTx_RXC_IRQHandler(uart_port_t *p) {
 #if HAVE_UART0
 static uart_port_t *uart0_port;
 
+#if ENABLE_UART_LISTENING
 ISR(USART0_RXC_vect) {
 	// Set RXSIF bit to '1' to clear it
 	USART0.STATUS = USART_RXSIF_bm | USART_ISFIF_bm;
@@ -40,6 +85,15 @@ ISR(USART0_RXC_vect) {
 	}
 }
 #endif
+#if UART_TX_BUFFER_BYTES > 0
+ISR(USART0_DRE_vect) {
+	UARTx_DRE_IRQHandler(uart0_port);
+}
+ISR(USART0_TXC_vect) {
+	UARTx_TXC_IRQHandler(uart0_port);
+}
+#endif
+#endif
 
 //
 // USART1
@@ -47,6 +101,7 @@ ISR(USART0_RXC_vect) {
 #if HAVE_UART1
 static uart_port_t *uart1_port;
 
+#if ENABLE_UART_LISTENING
 ISR(USART1_RXC_vect) {
 	// Set RXSIF bit to '1' to clear it
 	USART1.STATUS = USART_RXSIF_bm | USART_ISFIF_bm;
@@ -56,6 +111,15 @@ ISR(USART1_RXC_vect) {
 	}
 }
 #endif
+#if UART_TX_BUFFER_BYTES > 0
+ISR(USART1_DRE_vect) {
+	UARTx_DRE_IRQHandler(uart1_port);
+}
+ISR(USART1_TXC_vect) {
+	UARTx_TXC_IRQHandler(uart1_port);
+}
+#endif
+#endif
 
 //
 // USART2
@@ -63,6 +127,7 @@ ISR(USART1_RXC_vect) {
 #if HAVE_UART2
 static uart_port_t *uart2_port;
 
+#if ENABLE_UART_LISTENING
 ISR(USART2_RXC_vect) {
 	// Set RXSIF bit to '1' to clear it
 	USART2.STATUS = USART_RXSIF_bm | USART_ISFIF_bm;
@@ -72,6 +137,15 @@ ISR(USART2_RXC_vect) {
 	}
 }
 #endif
+#if UART_TX_BUFFER_BYTES > 0
+ISR(USART2_DRE_vect) {
+	UARTx_DRE_IRQHandler(uart2_port);
+}
+ISR(USART2_TXC_vect) {
+	UARTx_TXC_IRQHandler(uart2_port);
+}
+#endif
+#endif
 
 //
 // USART3
@@ -79,6 +153,7 @@ ISR(USART2_RXC_vect) {
 #if HAVE_UART3
 static uart_port_t *uart3_port;
 
+#if ENABLE_UART_LISTENING
 ISR(USART3_RXC_vect) {
 	// Set RXSIF bit to '1' to clear it
 	USART3.STATUS = USART_RXSIF_bm | USART_ISFIF_bm;
@@ -88,7 +163,16 @@ ISR(USART3_RXC_vect) {
 	}
 }
 #endif
-#else // ENABLE_UART_LISTENING
+#if UART_TX_BUFFER_BYTES > 0
+ISR(USART3_DRE_vect) {
+	UARTx_DRE_IRQHandler(uart3_port);
+}
+ISR(USART3_TXC_vect) {
+	UARTx_TXC_IRQHandler(uart3_port);
+}
+#endif
+#endif
+#else // ENABLE_UART_LISTENING || UART_TX_BUFFER_BYTES > 0
 #define ASSIGN_IRQ_PORT(_irqn_, _p_) ((void )0U)
 
-#endif // ENABLE_UART_LISTENING
+#endif // ENABLE_UART_LISTENING || UART_TX_BUFFER_BYTES > 0
@@ -43,5 +43,6 @@
 
 #define NEED_RTC (uHAL_USE_RTC || uHAL_USE_UPTIME || uHAL_USE_HIBERNATE)
 #define USE_RTC_UPTIME (uHAL_USE_UPTIME && ! uHAL_USE_UPTIME_EMULATION)
+#define NEED_DMA ((uHAL_USE_UART && (uHAL_USE_UART_TX_DMA || uHAL_USE_UART_RX_DMA)) || (uHAL_USE_SPI && uHAL_USE_SPI_DMA) || (uHAL_USE_I2C && uHAL_USE_I2C_DMA))
 
 #endif // _uHAL_PLATFORM_CMSIS_COMMON_H
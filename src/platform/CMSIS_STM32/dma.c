@@ -0,0 +1,387 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/***********************************************************************
+*                                                                      *
+*                                                                      *
+* Copyright 2026 svijsv                                                *
+* This program is free software: you can redistribute it and/or modify *
+* it under the terms of the GNU General Public License as published by *
+* the Free Software Foundation, version 3.                             *
+*                                                                      *
+* This program is distributed in the hope that it will be useful, but  *
+* WITHOUT ANY WARRANTY; without even the implied warranty of           *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+* General Public License for more details.                             *
+*                                                                      *
+* You should have received a copy of the GNU General Public License    *
+* along with this program.  If not, see <http:// www.gnu.org/licenses/>.*
+*                                                                      *
+*                                                                      *
+***********************************************************************/
+// dma.c
+// Manage the DMA controllers
+// NOTES:
+//   Stream interrupts are dispatched to the callback of whichever driver has
+//   claimed the stream; the IRQ handlers themselves are in dma_define_irq.h
+//
+//   The controller clocks are left on once enabled because there's no way to
+//   know when all the streams are finished with them short of tracking each
+//   one, and they only draw power when the bus is active anyway
+//
+#include "dma.h"
+#include "system.h"
+
+#if NEED_DMA
+
+// Both STM32F1 controllers and all others have at most 8 streams, which lets
+// the index be ((controller * 8) + stream)
+#define DMA_STREAM_COUNT 16U
+
+#if HAVE_STM32F1_DMA
+# define STREAM_CR   CCR
+# define STREAM_NDTR CNDTR
+# define STREAM_PAR  CPAR
+# define STREAM_MAR  CMAR
+# define STREAM_CR_EN DMA_CCR_EN
+# define STREAM_CR_IRQ_MASK (DMA_CCR_TCIE|DMA_CCR_HTIE|DMA_CCR_TEIE)
+//
+// Each channel has 4 flags: GIF, TCIF, HTIF, and TEIF
+# define STREAM_FLAGS_MASK 0x0FU
+#else
+# define STREAM_CR   CR
+# define STREAM_NDTR NDTR
+# define STREAM_PAR  PAR
+# define STREAM_MAR  M0AR
+# define STREAM_CR_EN DMA_SxCR_EN
+# define STREAM_CR_IRQ_MASK (DMA_SxCR_TCIE|DMA_SxCR_HTIE|DMA_SxCR_TEIE|DMA_SxCR_DMEIE)
+//
+// Each stream has 5 flags: FEIF, (reserved), DMEIF, TEIF, HTIF, and TCIF
+# define STREAM_FLAGS_MASK 0x3DU
+#endif
+
+static const dma_stream_t *claimed_streams[DMA_STREAM_COUNT];
+
+
+INLINE DMA_TypeDef* get_dmax(uint_fast8_t index) {
+#if defined(DMA2)
+	return (index < 8U) ? DMA1 : DMA2;
+#else
+	UNUSED(index);
+	return DMA1;
+#endif
+}
+INLINE uint_fast8_t get_flag_pos(uint_fast8_t index) {
+#if HAVE_STM32F1_DMA
+	// The flags for channel 1 start at bit 0
+	return ((index & 0x07U) - 1U) * 4U;
+#else
+	// Streams 0-3 are in the low registers and 4-7 in the high registers,
+	// both with the same layout
+	static const uint8_t pos[4] = { 0U, 6U, 16U, 22U };
+	return pos[index & 0x03U];
+#endif
+}
+INLINE __IO uint32_t* get_isr(uint_fast8_t index) {
+#if HAVE_STM32F1_DMA
+	return &get_dmax(index)->ISR;
+#else
+	return ((index & 0x04U) == 0) ? &get_dmax(index)->LISR : &get_dmax(index)->HISR;
+#endif
+}
+INLINE __IO uint32_t* get_ifcr(uint_fast8_t index) {
+#if HAVE_STM32F1_DMA
+	return &get_dmax(index)->IFCR;
+#else
+	return ((index & 0x04U) == 0) ? &get_dmax(index)->LIFCR : &get_dmax(index)->HIFCR;
+#endif
+}
+INLINE void clear_flags(uint_fast8_t index) {
+	*get_ifcr(index) = (uint32_t )STREAM_FLAGS_MASK << get_flag_pos(index);
+
+	return;
+}
+//
+// Convert the status register flags to DMA_FLAG_*
+INLINE uint_fast8_t get_flags(uint_fast8_t index) {
+	uint_fast8_t raw, flags;
+
+	raw = (*get_isr(index) >> get_flag_pos(index)) & STREAM_FLAGS_MASK;
+#if HAVE_STM32F1_DMA
+	// TCIF, HTIF, and TEIF are already in the same order
+	flags = (raw >> 1U) & (DMA_FLAG_TC|DMA_FLAG_HT|DMA_FLAG_TE);
+#else
+	flags = 0;
+	if (BIT_IS_SET(raw, 0x20U)) {
+		flags |= DMA_FLAG_TC;
+	}
+	if (BIT_IS_SET(raw, 0x10U)) {
+		flags |= DMA_FLAG_HT;
+	}
+	// Treat direct-mode errors as transfer errors too; FIFO errors are ignored
+	// because the FIFO isn't used and the flag can be set spuriously in
+	// direct mode
+	if (BIT_IS_SET(raw, 0x0CU)) {
+		flags |= DMA_FLAG_TE;
+	}
+#endif
+
+	return flags;
+}
+
+//
+// Called by each of the stream IRQ handlers; with a constant index most of
+// this should be resolved at compile time
+INLINE void DMAx_IRQHandler(uint_fast8_t index) {
+	const dma_stream_t *s;
+	uint_fast8_t flags;
+
+	flags = get_flags(index);
+	clear_flags(index);
+
+	s = claimed_streams[index];
+	if ((s != NULL) && (s->callback != NULL) && (flags != 0)) {
+		s->callback(s->callback_arg, flags);
+	}
+
+	return;
+}
+#include "dma_define_irq.h"
+
+
+err_t dma_stream_init(dma_stream_t *s, dma_id_t id, dma_callback_t callback, void *callback_arg) {
+	uint_fast8_t index;
+
+	uHAL_assert(s != NULL);
+
+	s->streamx = NULL;
+	s->callback = callback;
+	s->callback_arg = callback_arg;
+	if (id == DMA_ID_NONE) {
+		return ERR_NOTSUP;
+	}
+
+	index = DMA_ID_GET_INDEX(id);
+	s->index = index;
+#if ! HAVE_STM32F1_DMA
+	s->channel = DMA_ID_GET_CHANNEL(id);
+#endif
+
+	switch (index) {
+#if HAVE_STM32F1_DMA
+	case DMA_ID_GET_INDEX(DMA_ID(1, 1, 0)):
+		s->streamx = DMA1_Channel1;
+		s->irqn = DMA1_Channel1_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 2, 0)):
+		s->streamx = DMA1_Channel2;
+		s->irqn = DMA1_Channel2_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 3, 0)):
+		s->streamx = DMA1_Channel3;
+		s->irqn = DMA1_Channel3_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 4, 0)):
+		s->streamx = DMA1_Channel4;
+		s->irqn = DMA1_Channel4_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 5, 0)):
+		s->streamx = DMA1_Channel5;
+		s->irqn = DMA1_Channel5_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 6, 0)):
+		s->streamx = DMA1_Channel6;
+		s->irqn = DMA1_Channel6_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 7, 0)):
+		s->streamx = DMA1_Channel7;
+		s->irqn = DMA1_Channel7_IRQn;
+		break;
+# if defined(DMA2_Channel1)
+	case DMA_ID_GET_INDEX(DMA_ID(2, 1, 0)):
+		s->streamx = DMA2_Channel1;
+		s->irqn = DMA2_Channel1_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(2, 2, 0)):
+		s->streamx = DMA2_Channel2;
+		s->irqn = DMA2_Channel2_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(2, 3, 0)):
+		s->streamx = DMA2_Channel3;
+		s->irqn = DMA2_Channel3_IRQn;
+		break;
+	// Channels 4 and 5 share an IRQ
+	case DMA_ID_GET_INDEX(DMA_ID(2, 4, 0)):
+		s->streamx = DMA2_Channel4;
+		s->irqn = DMA2_Channel4_5_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(2, 5, 0)):
+		s->streamx = DMA2_Channel5;
+		s->irqn = DMA2_Channel4_5_IRQn;
+		break;
+# endif // DMA2_Channel1
+
+#else // HAVE_STM32F1_DMA
+	case DMA_ID_GET_INDEX(DMA_ID(1, 0, 0)):
+		s->streamx = DMA1_Stream0;
+		s->irqn = DMA1_Stream0_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 1, 0)):
+		s->streamx = DMA1_Stream1;
+		s->irqn = DMA1_Stream1_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 2, 0)):
+		s->streamx = DMA1_Stream2;
+		s->irqn = DMA1_Stream2_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 3, 0)):
+		s->streamx = DMA1_Stream3;
+		s->irqn = DMA1_Stream3_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 4, 0)):
+		s->streamx = DMA1_Stream4;
+		s->irqn = DMA1_Stream4_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 5, 0)):
+		s->streamx = DMA1_Stream5;
+		s->irqn = DMA1_Stream5_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 6, 0)):
+		s->streamx = DMA1_Stream6;
+		s->irqn = DMA1_Stream6_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(1, 7, 0)):
+		s->streamx = DMA1_Stream7;
+		s->irqn = DMA1_Stream7_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(2, 0, 0)):
+		s->streamx = DMA2_Stream0;
+		s->irqn = DMA2_Stream0_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(2, 1, 0)):
+		s->streamx = DMA2_Stream1;
+		s->irqn = DMA2_Stream1_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(2, 2, 0)):
+		s->streamx = DMA2_Stream2;
+		s->irqn = DMA2_Stream2_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(2, 3, 0)):
+		s->streamx = DMA2_Stream3;
+		s->irqn = DMA2_Stream3_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(2, 4, 0)):
+		s->streamx = DMA2_Stream4;
+		s->irqn = DMA2_Stream4_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(2, 5, 0)):
+		s->streamx = DMA2_Stream5;
+		s->irqn = DMA2_Stream5_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(2, 6, 0)):
+		s->streamx = DMA2_Stream6;
+		s->irqn = DMA2_Stream6_IRQn;
+		break;
+	case DMA_ID_GET_INDEX(DMA_ID(2, 7, 0)):
+		s->streamx = DMA2_Stream7;
+		s->irqn = DMA2_Stream7_IRQn;
+		break;
+#endif // HAVE_STM32F1_DMA
+
+	default:
+		return ERR_NOTSUP;
+	}
+
+	return ERR_OK;
+}
+err_t dma_stream_claim(const dma_stream_t *s) {
+	uHAL_assert(s != NULL);
+	uHAL_assert(dma_stream_is_valid(s));
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (s == NULL) {
+		return ERR_BADARG;
+	}
+	if (!dma_stream_is_valid(s)) {
+		return ERR_INIT;
+	}
+#endif
+
+	if (claimed_streams[s->index] == s) {
+		return ERR_OK;
+	}
+	if (claimed_streams[s->index] != NULL) {
+		return ERR_INUSE;
+	}
+	claimed_streams[s->index] = s;
+
+#if defined(DMA2)
+	clock_enable((s->index < 8U) ? RCC_PERIPH_DMA1 : RCC_PERIPH_DMA2);
+#else
+	clock_enable(RCC_PERIPH_DMA1);
+#endif
+	NVIC_SetPriority(s->irqn, DMA_IRQp);
+	NVIC_ClearPendingIRQ(s->irqn);
+	NVIC_EnableIRQ(s->irqn);
+
+	return ERR_OK;
+}
+void dma_stream_release(const dma_stream_t *s) {
+	uHAL_assert(s != NULL);
+
+	if ((s == NULL) || (claimed_streams[s->index] != s)) {
+		return;
+	}
+
+	dma_stream_stop(s);
+	// The IRQ is left enabled because on some devices it's shared between
+	// streams; without a claimant it just clears the flags
+	claimed_streams[s->index] = NULL;
+
+	return;
+}
+void dma_stream_start(const dma_stream_t *s, volatile void *periph, const volatile void *mem, uint16_t count, uint32_t cfg) {
+	uHAL_assert(s != NULL);
+	uHAL_assert(claimed_streams[s->index] == s);
+
+	// The stream can only be configured while disabled
+	dma_stream_stop(s);
+
+	s->streamx->STREAM_PAR = (uint32_t )periph;
+	s->streamx->STREAM_MAR = (uint32_t )mem;
+	s->streamx->STREAM_NDTR = count;
+#if HAVE_STM32F1_DMA
+	s->streamx->STREAM_CR = cfg;
+#else
+	s->streamx->STREAM_CR = cfg | ((uint32_t )s->channel << DMA_SxCR_CHSEL_Pos);
+#endif
+	SET_BIT(s->streamx->STREAM_CR, STREAM_CR_EN);
+
+	return;
+}
+void dma_stream_stop(const dma_stream_t *s) {
+	uHAL_assert(s != NULL);
+
+	// Disable the interrupts first so that stopping a transfer early doesn't
+	// trigger the callback
+	CLEAR_BIT(s->streamx->STREAM_CR, STREAM_CR_IRQ_MASK);
+	CLEAR_BIT(s->streamx->STREAM_CR, STREAM_CR_EN);
+	// Non-F1 streams don't stop until any ongoing bus transfer is finished
+	while (BIT_IS_SET(s->streamx->STREAM_CR, STREAM_CR_EN)) {
+		// Nothing to do here
+	}
+	clear_flags(s->index);
+	NVIC_ClearPendingIRQ(s->irqn);
+
+	return;
+}
+bool dma_stream_is_enabled(const dma_stream_t *s) {
+	uHAL_assert(s != NULL);
+
+	return BIT_IS_SET(s->streamx->STREAM_CR, STREAM_CR_EN);
+}
+uint16_t dma_stream_remaining(const dma_stream_t *s) {
+	uHAL_assert(s != NULL);
+
+	return (uint16_t )s->streamx->STREAM_NDTR;
+}
+
+
+#endif // NEED_DMA
@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/***********************************************************************
+*                                                                      *
+*                                                                      *
+* Copyright 2026 svijsv                                                *
+* This program is free software: you can redistribute it and/or modify *
+* it under the terms of the GNU General Public License as published by *
+* the Free Software Foundation, version 3.                             *
+*                                                                      *
+* This program is distributed in the hope that it will be useful, but  *
+* WITHOUT ANY WARRANTY; without even the implied warranty of           *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+* General Public License for more details.                             *
+*                                                                      *
+* You should have received a copy of the GNU General Public License    *
+* along with this program.  If not, see <http:// www.gnu.org/licenses/>.*
+*                                                                      *
+*                                                                      *
+***********************************************************************/
+// dma.h
+// Manage the DMA controllers
+// NOTES:
+//   Streams are claimed by peripheral drivers as needed, there's no interface
+//   exposed to the frontend
+//
+//   The request mappings are in the DMA section of the reference manual, only
+//   the ones actually used are defined here
+//
+#ifndef _uHAL_PLATFORM_CMSIS_DMA_H
+#define _uHAL_PLATFORM_CMSIS_DMA_H
+
+
+#include "common.h"
+
+
+#if NEED_DMA
+
+//
+// Identify a DMA controller, stream, and (on non-F1 devices) request channel
+// Use the numbering in the reference manual; on STM32F1 devices the stream
+// is what the manual calls the channel and the request channel is ignored
+typedef uint_fast8_t dma_id_t;
+#define DMA_ID(_dma_, _stream_, _ch_) ((dma_id_t )( \
+	(((_ch_) & 0x07U) << 4U) | \
+	((((_dma_) - 1U) & 0x01U) << 3U) | \
+	(((_stream_) & 0x07U) << 0U) \
+	))
+#define DMA_ID_NONE ((dma_id_t )0xFFU)
+#define DMA_ID_GET_INDEX(_id_)   ((_id_) & 0x0FU)
+#define DMA_ID_GET_CHANNEL(_id_) (((_id_) >> 4U) & 0x07U)
+
+//
+// Flags passed to the stream callback
+#define DMA_FLAG_TC 0x01U // Transfer complete
+#define DMA_FLAG_HT 0x02U // Half transfer
+#define DMA_FLAG_TE 0x04U // Transfer error
+
+//
+// Stream configuration flags passed to dma_stream_start()
+#if HAVE_STM32F1_DMA
+# define DMA_CFG_PERIPH_TO_MEM 0U
+# define DMA_CFG_MEM_TO_PERIPH DMA_CCR_DIR
+# define DMA_CFG_MINC          DMA_CCR_MINC
+# define DMA_CFG_CIRC          DMA_CCR_CIRC
+# define DMA_CFG_IRQ_TC        DMA_CCR_TCIE
+# define DMA_CFG_IRQ_HT        DMA_CCR_HTIE
+# define DMA_CFG_IRQ_TE        DMA_CCR_TEIE
+# define DMA_CFG_PRIORITY_HIGH DMA_CCR_PL_1
+#else
+# define DMA_CFG_PERIPH_TO_MEM 0U
+# define DMA_CFG_MEM_TO_PERIPH DMA_SxCR_DIR_0
+# define DMA_CFG_MINC          DMA_SxCR_MINC
+# define DMA_CFG_CIRC          DMA_SxCR_CIRC
+# define DMA_CFG_IRQ_TC        DMA_SxCR_TCIE
+# define DMA_CFG_IRQ_HT        DMA_SxCR_HTIE
+# define DMA_CFG_IRQ_TE        DMA_SxCR_TEIE
+# define DMA_CFG_PRIORITY_HIGH DMA_SxCR_PL_1
+#endif
+
+//
+// Request mappings
+#if HAVE_STM32F1_DMA
+# define DMA_UART1_TX DMA_ID(1, 4, 0)
+# define DMA_UART2_TX DMA_ID(1, 7, 0)
+# define DMA_UART3_TX DMA_ID(1, 2, 0)
+# define DMA_UART4_TX DMA_ID(2, 5, 0)
+# define DMA_UART5_TX DMA_ID_NONE
+# define DMA_UART6_TX DMA_ID_NONE
+# define DMA_UART7_TX DMA_ID_NONE
+# define DMA_UART8_TX DMA_ID_NONE
+# define DMA_UART1_RX DMA_ID(1, 5, 0)
+# define DMA_UART2_RX DMA_ID(1, 6, 0)
+# define DMA_UART3_RX DMA_ID(1, 3, 0)
+# define DMA_UART4_RX DMA_ID(2, 3, 0)
+# define DMA_UART5_RX DMA_ID_NONE
+# define DMA_UART6_RX DMA_ID_NONE
+# define DMA_UART7_RX DMA_ID_NONE
+# define DMA_UART8_RX DMA_ID_NONE
+# define DMA_SPI1_TX DMA_ID(1, 3, 0)
+# define DMA_SPI2_TX DMA_ID(1, 5, 0)
+# define DMA_SPI3_TX DMA_ID(2, 2, 0)
+# define DMA_SPI4_TX DMA_ID_NONE
+# define DMA_SPI5_TX DMA_ID_NONE
+# define DMA_SPI6_TX DMA_ID_NONE
+# define DMA_SPI1_RX DMA_ID(1, 2, 0)
+# define DMA_SPI2_RX DMA_ID(1, 4, 0)
+# define DMA_SPI3_RX DMA_ID(2, 1, 0)
+# define DMA_SPI4_RX DMA_ID_NONE
+# define DMA_SPI5_RX DMA_ID_NONE
+# define DMA_SPI6_RX DMA_ID_NONE
+# define DMA_I2C1_TX DMA_ID(1, 6, 0)
+# define DMA_I2C2_TX DMA_ID(1, 4, 0)
+# define DMA_I2C3_TX DMA_ID_NONE
+# define DMA_I2C1_RX DMA_ID(1, 7, 0)
+# define DMA_I2C2_RX DMA_ID(1, 5, 0)
+# define DMA_I2C3_RX DMA_ID_NONE
+#else
+# define DMA_UART1_TX DMA_ID(2, 7, 4)
+# define DMA_UART2_TX DMA_ID(1, 6, 4)
+# define DMA_UART3_TX DMA_ID(1, 3, 4)
+# define DMA_UART4_TX DMA_ID(1, 4, 4)
+# define DMA_UART5_TX DMA_ID(1, 7, 4)
+# define DMA_UART6_TX DMA_ID(2, 6, 5)
+# define DMA_UART7_TX DMA_ID(1, 1, 5)
+# define DMA_UART8_TX DMA_ID(1, 0, 5)
+# define DMA_UART1_RX DMA_ID(2, 2, 4)
+# define DMA_UART2_RX DMA_ID(1, 5, 4)
+# define DMA_UART3_RX DMA_ID(1, 1, 4)
+# define DMA_UART4_RX DMA_ID(1, 2, 4)
+# define DMA_UART5_RX DMA_ID(1, 0, 4)
+# define DMA_UART6_RX DMA_ID(2, 1, 5)
+# define DMA_UART7_RX DMA_ID(1, 3, 5)
+# define DMA_UART8_RX DMA_ID(1, 6, 5)
+// SPI1 and SPI3 each have a second option for both directions, these are
+// the ones that avoid USART1, USART2, and USART6 where possible
+# define DMA_SPI1_TX DMA_ID(2, 3, 3)
+# define DMA_SPI2_TX DMA_ID(1, 4, 0)
+# define DMA_SPI3_TX DMA_ID(1, 7, 0)
+# define DMA_SPI4_TX DMA_ID_NONE
+# define DMA_SPI5_TX DMA_ID_NONE
+# define DMA_SPI6_TX DMA_ID_NONE
+# define DMA_SPI1_RX DMA_ID(2, 0, 3)
+# define DMA_SPI2_RX DMA_ID(1, 3, 0)
+# define DMA_SPI3_RX DMA_ID(1, 0, 0)
+# define DMA_SPI4_RX DMA_ID_NONE
+# define DMA_SPI5_RX DMA_ID_NONE
+# define DMA_SPI6_RX DMA_ID_NONE
+// I2C1 and I2C2 each have a second option for receiving and I2C1 for
+// transmitting, these are the ones that avoid USART2 and USART3
+# define DMA_I2C1_TX DMA_ID(1, 7, 1)
+# define DMA_I2C2_TX DMA_ID(1, 7, 7)
+# define DMA_I2C3_TX DMA_ID(1, 4, 3)
+# define DMA_I2C1_RX DMA_ID(1, 0, 1)
+# define DMA_I2C2_RX DMA_ID(1, 2, 7)
+# define DMA_I2C3_RX DMA_ID(1, 2, 3)
+#endif
+
+
+//
+// Look up the registers used by a stream and set the callback called from
+// its interrupt
+// The stream isn't claimed until dma_stream_claim() is called
+err_t dma_stream_init(dma_stream_t *s, dma_id_t id, dma_callback_t callback, void *callback_arg);
+//
+// Claim a stream for exclusive use
+// Returns ERR_INUSE if the stream is claimed by something else
+err_t dma_stream_claim(const dma_stream_t *s);
+//
+// Release a claimed stream, stopping any transfer in progress
+void dma_stream_release(const dma_stream_t *s);
+//
+// Start a transfer on a claimed stream
+// 'cfg' is made up of DMA_CFG_* flags
+void dma_stream_start(const dma_stream_t *s, volatile void *periph, const volatile void *mem, uint16_t count, uint32_t cfg);
+//
+// Stop a transfer without calling the stream callback
+void dma_stream_stop(const dma_stream_t *s);
+//
+// Check if a stream has a transfer in progress
+bool dma_stream_is_enabled(const dma_stream_t *s);
+//
+// Get the number of items remaining in the current transfer
+uint16_t dma_stream_remaining(const dma_stream_t *s);
+
+INLINE bool dma_stream_is_valid(const dma_stream_t *s) {
+	return (s->streamx != NULL);
+}
+
+
+#endif // NEED_DMA
+
+#endif // _uHAL_PLATFORM_CMSIS_DMA_H
@@ -0,0 +1,124 @@
+//
+// Generated by tools/cmsis/dma_define_irq.sh on Fri Oct 16 20:53:06 UTC 2026
+//
+
+#if HAVE_STM32F1_DMA
+
+void DMA1_Channel1_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 1, 0)));
+	return;
+}
+void DMA1_Channel2_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 2, 0)));
+	return;
+}
+void DMA1_Channel3_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 3, 0)));
+	return;
+}
+void DMA1_Channel4_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 4, 0)));
+	return;
+}
+void DMA1_Channel5_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 5, 0)));
+	return;
+}
+void DMA1_Channel6_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 6, 0)));
+	return;
+}
+void DMA1_Channel7_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 7, 0)));
+	return;
+}
+
+#if defined(DMA2_Channel1)
+void DMA2_Channel1_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 1, 0)));
+	return;
+}
+void DMA2_Channel2_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 2, 0)));
+	return;
+}
+void DMA2_Channel3_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 3, 0)));
+	return;
+}
+void DMA2_Channel4_5_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 4, 0)));
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 5, 0)));
+	return;
+}
+#endif // DMA2_Channel1
+
+#else // HAVE_STM32F1_DMA
+
+void DMA1_Stream0_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 0, 0)));
+	return;
+}
+void DMA1_Stream1_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 1, 0)));
+	return;
+}
+void DMA1_Stream2_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 2, 0)));
+	return;
+}
+void DMA1_Stream3_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 3, 0)));
+	return;
+}
+void DMA1_Stream4_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 4, 0)));
+	return;
+}
+void DMA1_Stream5_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 5, 0)));
+	return;
+}
+void DMA1_Stream6_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 6, 0)));
+	return;
+}
+void DMA1_Stream7_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(1, 7, 0)));
+	return;
+}
+
+void DMA2_Stream0_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 0, 0)));
+	return;
+}
+void DMA2_Stream1_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 1, 0)));
+	return;
+}
+void DMA2_Stream2_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 2, 0)));
+	return;
+}
+void DMA2_Stream3_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 3, 0)));
+	return;
+}
+void DMA2_Stream4_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 4, 0)));
+	return;
+}
+void DMA2_Stream5_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 5, 0)));
+	return;
+}
+void DMA2_Stream6_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 6, 0)));
+	return;
+}
+void DMA2_Stream7_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 7, 0)));
+	return;
+}
+
+#endif // HAVE_STM32F1_DMA
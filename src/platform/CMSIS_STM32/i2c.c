@@ -26,6 +26,7 @@
 #include "i2c.h"
 #include "system.h"
 #include "gpio.h"
+#include "dma.h"
 
 
 #if uHAL_USE_I2C
@@ -47,19 +48,12 @@
 # error "Can't determine I2C bus clock"
 #endif
 
-#if I2C_FREQUENCY_HZ > 100000
-# define USE_FAST_MODE 1
-  // I have no fucking idea when or why to use the 9/16 duty cycle mode,
-  // the manual only says it's needed to reach 400KHz
-# if I2C_FREQUENCY_HZ >= 350000
-#  define USE_FAST_DUTY_MODE 1
-# else
-#  define USE_FAST_DUTY_MODE 0
-# endif
-#else
-# define USE_FAST_MODE 0
-# define USE_FAST_DUTY_MODE 0
-#endif
+// The F1 and F4 I2C peripherals top out at fast mode; fast mode plus needs
+// the separate FMPI2C peripheral found on only a few devices
+#define SM_MAX_HZ 100000U
+#define FM_MAX_HZ 400000U
+// Fast mode needs a bus clock of at least 4MHz
+#define FM_MIN_BUSFREQ 4000000U
 
 #if (I2Cx_BUSFREQ/(I2C_FREQUENCY_HZ*2)) > (I2C_CCR_CCR >> I2C_CCR_CCR_Pos)
 # error "I2C frequency is too low for the bus clock"
@@ -67,69 +61,94 @@
 #if (I2Cx_BUSFREQ < 2000000)
 # error "I2C bus frequency is too low, must be at least 2MHz"
 #endif
-#if (I2Cx_BUSFREQ < 4000000) && USE_FAST_MODE
+#if (I2Cx_BUSFREQ < FM_MIN_BUSFREQ) && (I2C_FREQUENCY_HZ > SM_MAX_HZ)
 # error "I2C bus frequency must be at least 4MHz for >100KHz operation"
 #endif
-#if (I2Cx_BUSFREQ % 10000000) != 0 && USE_FAST_DUTY_MODE
-# error "I2C bus frequency must be a multiple of 10MHz for 400KHz operation"
-#endif
 
-DEBUG_CPP_MACRO(USE_FAST_MODE)
-DEBUG_CPP_MACRO(USE_FAST_DUTY_MODE)
+#if uHAL_USE_I2C_DMA && I2C_DMA_MIN_BYTES < 2
+# error "I2C_DMA_MIN_BYTES must be >= 2"
+#endif
 
 #define BUS_IS_OWNED(_if_) (BITS_ARE_SET((_if_)->SR2, I2C_SR2_BUSY|I2C_SR2_MSL))
 #define PERIPH_IS_INITIALIZED(_if_) ((_if_)->CCR != 0 && BIT_IS_SET((_if_)->CR1, I2C_CR1_PE))
 
-void i2c_init(void) {
-	uint32_t pclk_MHz, reg;
-
-#if ! uHAL_SKIP_INIT_CHECKS
+#if uHAL_USE_I2C_IRQ
+static void irq_cancel(err_t status);
 #endif
-#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+#if uHAL_USE_I2C_DMA
+static dma_stream_t tx_dma, rx_dma;
+
+static void tx_dma_callback(void *arg, uint_fast8_t flags);
+static void rx_dma_callback(void *arg, uint_fast8_t flags);
 #endif
 
-	pclk_MHz = I2Cx_BUSFREQ/1000000U;
+#include "platform/common/i2c_batch.c"
+#include "platform/common/i2c_device.c"
 
-	// Start the clock and reset the peripheral
-	clock_init(I2Cx_CLOCKEN);
+//
+// Divide and round up so that the resulting frequency is never faster than
+// asked for
+static uint32_t calculate_ccr(uint32_t hz, uint32_t mult) {
+	return (I2Cx_BUSFREQ + ((hz * mult) - 1U)) / (hz * mult);
+}
+//
+// Configure the I2C clock timing
+// Must be called with the peripheral disabled
+//
+// The reference manual formula uses the cycle *time* of the target clock
+// and peripheral clock to calculate the prescaler, but the time is just
+// the reciprocol of the frequency (i.e. a period of 1/10^9 seconds (1ns)
+// corresponds to a frequency of 10^9Hz) so that CCR = i2c_ns/pclk_ns can
+// be rewritten as CCR = pclk_hz/i2c_hz and we can spare ourselves a bit
+// of math calculating the time periods
+//
+// The formula for standard mode is:
+//   T = CCR * Tpclk * 2
+// For fast mode:
+//   T = CCR * Tpclk * 3
+// For fast duty mode
+//   T = CCR * Tpclk * 25
+// And converted to our desired frequency-based format and re-arranged:
+//   CCR = Fpclk / (F * X)
+// where 'X' is 2, 3, or 25 as needed
+// They could have made this all clearer.
+//
+// Returns the frequency actually set
+static uint32_t set_frequency(uint32_t hz) {
+	uint32_t ccr, duty_ccr, achieved, duty_achieved, reg;
 
-	//
-	// Set the frequency (in MHz) of the RCC bus the I2C peripheral is on so
-	// that clock timing can be generated accurately
-	MODIFY_BITS(I2Cx->CR2, I2C_CR2_FREQ,
-		(pclk_MHz << I2C_CR2_FREQ_Pos)
-		);
-	//
-	// Configure the I2C clock timing
-	// The reference manual formula uses the cycle *time* of the target clock
-	// and peripheral clock to calculate the prescaler, but the time is just
-	// the reciprocol of the frequency (i.e. a period of 1/10^9 seconds (1ns)
-	// corresponds to a frequency of 10^9Hz) so that CCR = i2c_ns/pclk_ns can
-	// be rewritten as CCR = pclk_hz/i2c_hz and we can spare ourselves a bit
-	// of math calculating the time periods
-	//
-	// The formula for standard mode is:
-	//   T = CCR * Tpclk * 2
-	// For fast mode:
-	//   T = CCR * Tpclk * 3
-	// For fast duty mode
-	//   T = CCR * Tpclk * 25
-	// And converted to our desired frequency-based format and re-arranged:
-	//   CCR = Fpclk / (F * X)
-	// where 'X' is 2, 3, or 25 as needed
-	// They could have made this all clearer.
-	if (USE_FAST_MODE) {
-		if (USE_FAST_DUTY_MODE) {
-			reg = (I2Cx_BUSFREQ / (I2C_FREQUENCY_HZ * 25U)) << I2C_CCR_CCR_Pos;
+	if ((hz > SM_MAX_HZ) && (I2Cx_BUSFREQ >= FM_MIN_BUSFREQ)) {
+		if (hz > FM_MAX_HZ) {
+			hz = FM_MAX_HZ;
+		}
+		// The 16/9 duty cycle exists to reach 400KHz when the bus clock isn't
+		// a multiple of 1.2MHz, so use whichever of the two gets closer
+		ccr = calculate_ccr(hz, 3U);
+		duty_ccr = calculate_ccr(hz, 25U);
+		achieved = I2Cx_BUSFREQ / (ccr * 3U);
+		duty_achieved = I2Cx_BUSFREQ / (duty_ccr * 25U);
+		if (duty_achieved > achieved) {
+			reg = (duty_ccr << I2C_CCR_CCR_Pos) | I2C_CCR_DUTY;
+			achieved = duty_achieved;
 		} else {
-			reg = (I2Cx_BUSFREQ / (I2C_FREQUENCY_HZ * 3U)) << I2C_CCR_CCR_Pos;
-			reg |= (1U << I2C_CCR_DUTY_Pos);
+			reg = (ccr << I2C_CCR_CCR_Pos);
 		}
-		reg |= (1U << I2C_CCR_FS_Pos);
+		reg |= I2C_CCR_FS;
 	} else {
-		reg = (I2Cx_BUSFREQ / (I2C_FREQUENCY_HZ * 2U)) << I2C_CCR_CCR_Pos;
+		if (hz > SM_MAX_HZ) {
+			hz = SM_MAX_HZ;
+		}
+		// The minimum CCR in standard mode is 4
+		ccr = calculate_ccr(hz, 2U);
+		if (ccr < 4U) {
+			ccr = 4U;
+		} else if (ccr > (I2C_CCR_CCR >> I2C_CCR_CCR_Pos)) {
+			ccr = (I2C_CCR_CCR >> I2C_CCR_CCR_Pos);
+		}
+		achieved = I2Cx_BUSFREQ / (ccr * 2U);
+		reg = (ccr << I2C_CCR_CCR_Pos);
 	}
-	MODIFY_BITS(I2Cx->CCR, I2C_CCR_FS|I2C_CCR_CCR, reg);
+	MODIFY_BITS(I2Cx->CCR, I2C_CCR_FS|I2C_CCR_DUTY|I2C_CCR_CCR, reg);
 
 	//
 	// Configure the I2C maximum rise time
@@ -137,13 +156,58 @@ void i2c_init(void) {
 	// (Fpclk/(1/Trise))+1 when adapted from ns to MHz Trise is defined by
 	// the I2C specificiation, for standard mode it's 1000nS (1uS) and for
 	// fast mode its 300nS (0.3uS)
-	if (USE_FAST_MODE) {
+	if (BIT_IS_SET(reg, I2C_CCR_FS)) {
 		reg = ((I2Cx_BUSFREQ / 3333333U) + 1U) << I2C_TRISE_TRISE_Pos;
 	} else {
-		reg = ((pclk_MHz) + 1U) << I2C_TRISE_TRISE_Pos;
+		reg = ((I2Cx_BUSFREQ / 1000000U) + 1U) << I2C_TRISE_TRISE_Pos;
 	}
 	MODIFY_BITS(I2Cx->TRISE, I2C_TRISE_TRISE, reg);
 
+	// Make the device interface set the speed again the next time it's used
+	bus_lock.hz = 0;
+
+	return achieved;
+}
+
+void i2c_init(void) {
+	uint32_t pclk_MHz;
+
+#if ! uHAL_SKIP_INIT_CHECKS
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+#endif
+
+	pclk_MHz = I2Cx_BUSFREQ/1000000U;
+
+	// Start the clock and reset the peripheral
+	clock_init(I2Cx_CLOCKEN);
+
+	//
+	// Set the frequency (in MHz) of the RCC bus the I2C peripheral is on so
+	// that clock timing can be generated accurately
+	MODIFY_BITS(I2Cx->CR2, I2C_CR2_FREQ,
+		(pclk_MHz << I2C_CR2_FREQ_Pos)
+		);
+	set_frequency(I2C_FREQUENCY_HZ);
+
+#if uHAL_USE_I2C_DMA
+	// Only the RX stream signals completion; transmissions finish when the
+	// last byte has left the shift register, which the event interrupt
+	// reports
+	dma_stream_init(&tx_dma, I2Cx_DMA_TX, tx_dma_callback, NULL);
+	dma_stream_init(&rx_dma, I2Cx_DMA_RX, rx_dma_callback, NULL);
+#endif
+#if uHAL_USE_I2C_IRQ
+	// The peripheral's interrupts are only enabled during a transfer so the
+	// NVIC lines can be left on
+	NVIC_SetPriority(I2Cx_EV_IRQn, I2C_IRQp);
+	NVIC_SetPriority(I2Cx_ER_IRQn, I2C_IRQp);
+	NVIC_ClearPendingIRQ(I2Cx_EV_IRQn);
+	NVIC_ClearPendingIRQ(I2Cx_ER_IRQn);
+	NVIC_EnableIRQ(I2Cx_EV_IRQn);
+	NVIC_EnableIRQ(I2Cx_ER_IRQn);
+#endif
+
 	i2c_off();
 
 	return;
@@ -194,6 +258,11 @@ err_t i2c_off(void) {
 		return ERR_OK;
 	}
 
+#if uHAL_USE_I2C_IRQ
+	// Any transfer in progress is abandoned without calling the callback
+	irq_cancel(ERR_INTERRUPT);
+#endif
+
 	// This probably isn't needed, the only time it might matter is if the
 	// peripheral is disabled before the stop condition has been fully
 	// broadcast
@@ -223,12 +292,399 @@ bool i2c_is_on(void) {
 
 	return (clock_is_enabled(I2Cx_CLOCKEN) && BIT_IS_SET(I2Cx->CR1, I2C_CR1_PE));
 }
+#if uHAL_USE_I2C_IRQ
+//
+// The transfer being handled by the event and error interrupts
+// Only the ISRs touch it while a transfer is in progress
+static volatile struct {
+	const uint8_t *tx;
+	uint8_t *rx;
+	txsize_t size;
+	txsize_t i;
+	// The address byte, including the direction bit
+	uint8_t addr;
+	i2c_callback_t callback;
+	bool busy;
+	err_t status;
+#if uHAL_USE_I2C_DMA
+	// Set if the data phase is handled by DMA
+	bool dma;
+#endif
+} xfer;
 
-err_t i2c_receive_block(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, utime_t timeout) {
+#define I2C_CR2_IT_ALL (I2C_CR2_ITEVTEN|I2C_CR2_ITBUFEN|I2C_CR2_ITERREN)
+#if uHAL_USE_I2C_DMA
+# define XFER_USES_DMA() (xfer.dma)
+#else
+# define XFER_USES_DMA() (false)
+#endif
+
+//
+// Stop the transfer without calling the callback
+// Must be called with interrupts disabled or from one of the ISRs
+static void irq_stop(err_t status) {
+	CLEAR_BIT(I2Cx->CR2, I2C_CR2_IT_ALL);
+#if uHAL_USE_I2C_DMA
+	if (xfer.dma) {
+		CLEAR_BIT(I2Cx->CR2, I2C_CR2_DMAEN|I2C_CR2_LAST);
+		dma_stream_release((xfer.rx != NULL) ? &rx_dma : &tx_dma);
+		xfer.dma = false;
+	}
+#endif
+	// On success the stop condition was already requested at the right point
+	// in the transfer
+	if ((status != ERR_OK) && BUS_IS_OWNED(I2Cx)) {
+		SET_BIT(I2Cx->CR1, I2C_CR1_STOP);
+	}
+	xfer.status = status;
+	xfer.busy = false;
+
+	return;
+}
+static void irq_finish(err_t status) {
+	i2c_callback_t callback = xfer.callback;
+
+	irq_stop(status);
+	// The callback is called last so that it can start another transfer
+	if (callback != NULL) {
+		callback(status);
+	}
+
+	return;
+}
+static void irq_cancel(err_t status) {
+	uint32_t primask;
+
+	DISABLE_INTERRUPTS(primask);
+	if (xfer.busy) {
+		irq_stop(status);
+	}
+	RESTORE_INTERRUPTS(primask);
+
+	return;
+}
+
+#if uHAL_USE_I2C_DMA
+//
+// Set up DMA for the data phase of a transfer
+// The stream is claimed for each transfer rather than at initialization so
+// that peripherals sharing it can use it while the I2C bus is idle
+// Returns false if the transfer is too short or long for DMA or the stream
+// isn't available, in which case each byte is handled by the event interrupt
+static bool dma_start(const uint8_t *tx, uint8_t *rx, txsize_t size) {
+	const dma_stream_t *s = (rx != NULL) ? &rx_dma : &tx_dma;
+
+	// The DMA transfer count register is only 16 bits
+	if ((size < I2C_DMA_MIN_BYTES) || (size > 0xFFFFU)) {
+		return false;
+	}
+	if (!dma_stream_is_valid(s) || (dma_stream_claim(s) != ERR_OK)) {
+		return false;
+	}
+
+	if (rx != NULL) {
+		dma_stream_start(s, &I2Cx->DR, rx, (uint16_t )size,
+			DMA_CFG_PERIPH_TO_MEM | DMA_CFG_MINC | DMA_CFG_IRQ_TC | DMA_CFG_IRQ_TE | DMA_CFG_PRIORITY_HIGH);
+		// LAST has the peripheral NACK the final byte on its own
+		SET_BIT(I2Cx->CR2, I2C_CR2_DMAEN|I2C_CR2_LAST);
+	} else {
+		dma_stream_start(s, &I2Cx->DR, tx, (uint16_t )size,
+			DMA_CFG_MEM_TO_PERIPH | DMA_CFG_MINC | DMA_CFG_IRQ_TE);
+		SET_BIT(I2Cx->CR2, I2C_CR2_DMAEN);
+	}
+
+	return true;
+}
+static void rx_dma_callback(void *arg, uint_fast8_t flags) {
+	UNUSED(arg);
+
+	if (!xfer.busy) {
+		return;
+	}
+	if (BIT_IS_SET(flags, DMA_FLAG_TE)) {
+		irq_finish(ERR_IO);
+	} else if (BIT_IS_SET(flags, DMA_FLAG_TC)) {
+		// The last byte has been NACKed and read, all that's left is the
+		// stop condition
+		SET_BIT(I2Cx->CR1, I2C_CR1_STOP);
+		irq_finish(ERR_OK);
+	}
+
+	return;
+}
+static void tx_dma_callback(void *arg, uint_fast8_t flags) {
+	UNUSED(arg);
+
+	if (xfer.busy && BIT_IS_SET(flags, DMA_FLAG_TE)) {
+		irq_finish(ERR_IO);
+	}
+
+	return;
+}
+#endif // uHAL_USE_I2C_DMA
+//
+// Start a transfer; exactly one of tx and rx must be non-NULL
+static err_t irq_start(uint8_t addr, const uint8_t *tx, uint8_t *rx, txsize_t size, i2c_callback_t callback) {
+	uint32_t primask;
+
+	DISABLE_INTERRUPTS(primask);
+	if (xfer.busy || BIT_IS_SET(I2Cx->SR2, I2C_SR2_BUSY)) {
+		RESTORE_INTERRUPTS(primask);
+		return ERR_RETRY;
+	}
+	xfer.busy = true;
+	RESTORE_INTERRUPTS(primask);
+
+	xfer.tx = tx;
+	xfer.rx = rx;
+	xfer.size = size;
+	xfer.i = 0;
+	// LSB of address is 1 for RX and 0 for TX
+	xfer.addr = (uint8_t )((addr << 1U) | ((rx != NULL) ? 0x01U : 0x00U));
+	xfer.callback = callback;
+	xfer.status = ERR_OK;
+
+#if uHAL_USE_I2C_DMA
+	xfer.dma = dma_start(tx, rx, size);
+#endif
+
+	// The receive procedures are the same as the polled version's, see
+	// i2c_receive_block()
+	if ((rx != NULL) && (size == 2) && !XFER_USES_DMA()) {
+		SET_BIT(I2Cx->CR1, I2C_CR1_POS);
+	} else {
+		CLEAR_BIT(I2Cx->CR1, I2C_CR1_POS);
+	}
+	CLEAR_BIT(I2Cx->SR1, I2C_SR1_BERR|I2C_SR1_ARLO|I2C_SR1_AF|I2C_SR1_OVR);
+	if (XFER_USES_DMA()) {
+		// The buffer interrupt must be left off while DMA requests are enabled
+		SET_BIT(I2Cx->CR2, I2C_CR2_ITEVTEN|I2C_CR2_ITERREN);
+	} else {
+		SET_BIT(I2Cx->CR2, I2C_CR2_IT_ALL);
+	}
+	SET_BIT(I2Cx->CR1, I2C_CR1_START|I2C_CR1_ACK);
+
+	return ERR_OK;
+}
+//
+// Wait for an asynchronous transfer to finish before touching the peripheral
+static err_t irq_wait(utime_t timeout) {
+	while (xfer.busy) {
+		if (TIMES_UP(timeout)) {
+			return ERR_TIMEOUT;
+		}
+	}
+
+	return ERR_OK;
+}
+//
+// The ISRs can only run if the caller isn't masking them
+static bool irq_can_sleep(void) {
+	return ((__get_PRIMASK() == 0) && (__get_IPSR() == 0));
+}
+//
+// Handle a blocking transfer with interrupts, sleeping until it's done
+static err_t irq_transfer_block(uint8_t addr, const uint8_t *tx, uint8_t *rx, txsize_t size, utime_t timeout) {
 	err_t res;
-	txsize_t i;
+
+	while ((res = irq_start(addr, tx, rx, size, NULL)) == ERR_RETRY) {
+		if (TIMES_UP(timeout)) {
+			return ERR_TIMEOUT;
+		}
+	}
+
+	// Whatever set up the last deep sleep may have left this set and stop
+	// mode would halt the peripheral
+	CLEAR_BIT(SCB->SCR, SCB_SCR_SLEEPDEEP_Msk);
+	while (true) {
+		if (TIMES_UP(timeout)) {
+			irq_cancel(ERR_TIMEOUT);
+			break;
+		}
+		// WFI wakes on a pending interrupt even when they're masked, so masking
+		// them here closes the window between checking the flag and sleeping;
+		// the systick interrupt wakes us to check the timeout
+		__disable_irq();
+		if (!xfer.busy) {
+			__enable_irq();
+			break;
+		}
+		__WFI();
+		__enable_irq();
+	}
+
+	return xfer.status;
+}
+
+static void irq_rx_event(uint32_t sr1) {
+	txsize_t left = xfer.size - xfer.i;
+
+	if (left > 3U) {
+		if (BIT_IS_SET(sr1, I2C_SR1_RXNE)) {
+			xfer.rx[xfer.i++] = I2Cx->DR;
+			// The last 3 bytes are handled when BTF is set
+			if (left == 4U) {
+				CLEAR_BIT(I2Cx->CR2, I2C_CR2_ITBUFEN);
+			}
+		}
+	} else if (left == 3U) {
+		// Two bytes ready, one in DR and one in the shift register
+		if (BIT_IS_SET(sr1, I2C_SR1_BTF)) {
+			CLEAR_BIT(I2Cx->CR1, I2C_CR1_ACK);
+			xfer.rx[xfer.i++] = I2Cx->DR;
+			SET_BIT(I2Cx->CR1, I2C_CR1_STOP);
+			xfer.rx[xfer.i++] = I2Cx->DR;
+			SET_BIT(I2Cx->CR2, I2C_CR2_ITBUFEN);
+		}
+	} else if (left == 2U) {
+		// Only reached by 2-byte receptions
+		if (BIT_IS_SET(sr1, I2C_SR1_BTF)) {
+			SET_BIT(I2Cx->CR1, I2C_CR1_STOP);
+			xfer.rx[xfer.i++] = I2Cx->DR;
+			xfer.rx[xfer.i++] = I2Cx->DR;
+			irq_finish(ERR_OK);
+		}
+	} else {
+		if (BIT_IS_SET(sr1, I2C_SR1_RXNE)) {
+			xfer.rx[xfer.i++] = I2Cx->DR;
+			irq_finish(ERR_OK);
+		}
+	}
+
+	return;
+}
+static void irq_tx_event(uint32_t sr1) {
+	if (xfer.i < xfer.size) {
+		if (BIT_IS_SET(sr1, I2C_SR1_TXE)) {
+			I2Cx->DR = xfer.tx[xfer.i++];
+			// Wait for BTF once the last byte is loaded
+			if (xfer.i == xfer.size) {
+				CLEAR_BIT(I2Cx->CR2, I2C_CR2_ITBUFEN);
+			}
+		}
+	} else if (BIT_IS_SET(sr1, I2C_SR1_BTF)) {
+		SET_BIT(I2Cx->CR1, I2C_CR1_STOP);
+		irq_finish(ERR_OK);
+	}
+
+	return;
+}
+#if uHAL_USE_I2C_DMA
+static void irq_dma_event(uint32_t sr1) {
+	// Receptions are finished by the DMA callback
+	// BTF may be set briefly during a transmission if the stream falls behind,
+	// it's only the end of the transfer once the stream has nothing left
+	if ((xfer.rx == NULL) && BIT_IS_SET(sr1, I2C_SR1_BTF) && (dma_stream_remaining(&tx_dma) == 0U)) {
+		SET_BIT(I2Cx->CR1, I2C_CR1_STOP);
+		irq_finish(ERR_OK);
+	}
+
+	return;
+}
+#endif
+void I2Cx_EV_IRQHandler(void) {
+	uint32_t sr1 = I2Cx->SR1;
 	volatile uint32_t tmp;
 
+	if (!xfer.busy) {
+		CLEAR_BIT(I2Cx->CR2, I2C_CR2_IT_ALL);
+		return;
+	}
+
+	if (BIT_IS_SET(sr1, I2C_SR1_SB)) {
+		// Reading SR1 followed by writing DR clears SB
+		I2Cx->DR = xfer.addr;
+		return;
+	}
+	if (BIT_IS_SET(sr1, I2C_SR1_ADDR)) {
+		if (xfer.rx == NULL) {
+			// Read SR2 to clear the ADDR flag
+			tmp = I2Cx->SR2;
+		} else if (XFER_USES_DMA()) {
+			// The LAST bit takes care of NACKing the final byte
+			tmp = I2Cx->SR2;
+		} else {
+			switch (xfer.size) {
+			case 1:
+				CLEAR_BIT(I2Cx->CR1, I2C_CR1_ACK);
+				tmp = I2Cx->SR2;
+				SET_BIT(I2Cx->CR1, I2C_CR1_STOP);
+				break;
+			case 2:
+				tmp = I2Cx->SR2;
+				CLEAR_BIT(I2Cx->CR1, I2C_CR1_ACK);
+				// Both bytes are read once BTF is set
+				CLEAR_BIT(I2Cx->CR2, I2C_CR2_ITBUFEN);
+				break;
+			case 3:
+				tmp = I2Cx->SR2;
+				CLEAR_BIT(I2Cx->CR2, I2C_CR2_ITBUFEN);
+				break;
+			default:
+				tmp = I2Cx->SR2;
+				break;
+			}
+		}
+		UNUSED(tmp);
+		return;
+	}
+
+#if uHAL_USE_I2C_DMA
+	if (xfer.dma) {
+		irq_dma_event(sr1);
+		return;
+	}
+#endif
+	if (xfer.rx != NULL) {
+		irq_rx_event(sr1);
+	} else {
+		irq_tx_event(sr1);
+	}
+
+	return;
+}
+void I2Cx_ER_IRQHandler(void) {
+	uint32_t sr1 = I2Cx->SR1;
+	err_t res;
+
+	// Use the same codes as the polled functions
+	if (BIT_IS_SET(sr1, I2C_SR1_ARLO)) {
+		res = ERR_RETRY;
+	} else if (BIT_IS_SET(sr1, I2C_SR1_AF)) {
+		res = ERR_INTERRUPT;
+	} else {
+		res = ERR_UNKNOWN;
+	}
+	CLEAR_BIT(I2Cx->SR1, I2C_SR1_BERR|I2C_SR1_ARLO|I2C_SR1_AF|I2C_SR1_OVR);
+
+	if (xfer.busy) {
+		irq_finish(res);
+	} else {
+		CLEAR_BIT(I2Cx->CR2, I2C_CR2_IT_ALL);
+	}
+
+	return;
+}
+
+err_t i2c_transmit_block_async(uint8_t addr, const uint8_t *tx_buffer, txsize_t tx_size, i2c_callback_t callback) {
+	uHAL_assert(PERIPH_IS_INITIALIZED(I2Cx));
+	uHAL_assert(addr <= 0x7FU);
+	uHAL_assert(tx_buffer != NULL);
+	uHAL_assert(tx_size > 0);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!PERIPH_IS_INITIALIZED(I2Cx)) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((addr > 0x7FU) || (tx_buffer == NULL) || (tx_size <= 0)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	return irq_start(addr, tx_buffer, NULL, tx_size, callback);
+}
+err_t i2c_receive_block_async(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, i2c_callback_t callback) {
 	uHAL_assert(PERIPH_IS_INITIALIZED(I2Cx));
 	uHAL_assert(addr <= 0x7FU);
 	uHAL_assert(rx_buffer != NULL);
@@ -244,15 +700,73 @@ err_t i2c_receive_block(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, utim
 	}
 #endif
 
+	return irq_start(addr, NULL, rx_buffer, rx_size, callback);
+}
+bool i2c_is_busy(void) {
+	return xfer.busy;
+}
+#endif // uHAL_USE_I2C_IRQ
+
+uint32_t i2c_set_frequency(uint32_t hz) {
+	uint32_t achieved;
+
+	uHAL_assert(hz > 0U);
+	uHAL_assert(i2c_is_on());
+
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!i2c_is_on()) {
+		return 0;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (hz == 0U) {
+		return 0;
+	}
+#endif
+#if uHAL_USE_I2C_IRQ
+	if (xfer.busy) {
+		return 0;
+	}
+#endif
+	// The timing can't be changed in the middle of a transaction
+	if (BUS_IS_OWNED(I2Cx)) {
+		return 0;
+	}
+
+	// CCR and TRISE can only be written with the peripheral disabled
+	// The pins are switched the same way as in i2c_off() and i2c_on() to
+	// keep them from briefly pulling low
+	pins_off();
+	CLEAR_BIT(I2Cx->CR1, I2C_CR1_PE);
+	while (BIT_IS_SET(I2Cx->CR1, I2C_CR1_PE)) {
+		// Nothing to do here
+	}
+	achieved = set_frequency(hz);
+	SET_BIT(I2Cx->CR1, I2C_CR1_PE);
+	while (!BIT_IS_SET(I2Cx->CR1, I2C_CR1_PE)) {
+		// Nothing to do here
+	}
+	pins_on();
+
+	return achieved;
+}
+
+//
+// If 'restart' is set, the bus is still held from a transmission and the
+// start condition becomes a repeated start
+static err_t _i2c_receive_block(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, utime_t timeout, bool restart) {
+	err_t res;
+	txsize_t i;
+	volatile uint32_t tmp;
+
 	res = ERR_OK;
-	timeout = SET_TIMEOUT_MS(timeout);
 
 	/*
 	if (BIT_IS_SET(I2Cx->SR2, I2C_SR2_BUSY) && !BIT_IS_SET(I2Cx->SR2, I2C_SR2_MSL)) {
 		return ERR_RETRY;
 	}
 	*/
-	while (BIT_IS_SET(I2Cx->SR2, I2C_SR2_BUSY)) {
+	while (!restart && BIT_IS_SET(I2Cx->SR2, I2C_SR2_BUSY)) {
 		if (TIMES_UP(timeout)) {
 			return ERR_TIMEOUT;
 		}
@@ -266,7 +780,7 @@ err_t i2c_receive_block(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, utim
 	} else {
 		CLEAR_BIT(I2Cx->CR1, I2C_CR1_POS);
 	}
-	CLEAR_BIT(I2Cx->SR1, I2C_SR1_BERR|I2C_SR1_ARLO);
+	CLEAR_BIT(I2Cx->SR1, I2C_SR1_BERR|I2C_SR1_ARLO|I2C_SR1_AF);
 	SET_BIT(I2Cx->CR1, I2C_CR1_START|I2C_CR1_ACK);
 	while (!BIT_IS_SET(I2Cx->SR1, I2C_SR1_SB)) {
 		if (TIMES_UP(timeout)) {
@@ -297,6 +811,12 @@ err_t i2c_receive_block(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, utim
 			res = ERR_UNKNOWN;
 			goto END;
 		}
+		// Nobody answered, or the device is busy the way EEPROMs are during
+		// a write cycle
+		if (BIT_IS_SET(I2Cx->SR1, I2C_SR1_AF)) {
+			res = ERR_INTERRUPT;
+			goto END;
+		}
 	}
 
 	// I don't know why I2C is so convoluted when SPI and UART are both so
@@ -430,6 +950,37 @@ END:
 	UNUSED(tmp);
 	return res;
 }
+err_t i2c_receive_block(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, utime_t timeout) {
+	uHAL_assert(PERIPH_IS_INITIALIZED(I2Cx));
+	uHAL_assert(addr <= 0x7FU);
+	uHAL_assert(rx_buffer != NULL);
+	uHAL_assert(rx_size > 0);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!PERIPH_IS_INITIALIZED(I2Cx)) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((addr > 0x7FU) || (rx_buffer == NULL) || (rx_size <= 0)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	timeout = SET_TIMEOUT_MS(timeout);
+
+#if uHAL_USE_I2C_IRQ
+	// Use the interrupt-driven version when possible; it can't be used when
+	// the I2C interrupts are masked, such as when called from an ISR
+	if (irq_can_sleep()) {
+		return irq_transfer_block(addr, NULL, rx_buffer, rx_size, timeout);
+	}
+	if (irq_wait(timeout) != ERR_OK) {
+		return ERR_TIMEOUT;
+	}
+#endif
+
+	return _i2c_receive_block(addr, rx_buffer, rx_size, timeout, false);
+}
 
 static err_t _i2c_transmit_block_begin(uint8_t addr, utime_t timeout) {
 	err_t res = ERR_OK;
@@ -481,6 +1032,12 @@ static err_t _i2c_transmit_block_begin(uint8_t addr, utime_t timeout) {
 			res = ERR_UNKNOWN;
 			goto END;
 		}
+		// Nobody answered, or the device is busy the way EEPROMs are during
+		// a write cycle
+		if (BIT_IS_SET(I2Cx->SR1, I2C_SR1_AF)) {
+			res = ERR_INTERRUPT;
+			goto END;
+		}
 	}
 	// Read SR2 to clear the ADDR flag
 	tmp = I2Cx->SR2;
@@ -505,6 +1062,12 @@ err_t i2c_transmit_block_begin(uint8_t addr, utime_t timeout) {
 
 	timeout = SET_TIMEOUT_MS(timeout);
 
+#if uHAL_USE_I2C_IRQ
+	if (irq_wait(timeout) != ERR_OK) {
+		return ERR_TIMEOUT;
+	}
+#endif
+
 	return _i2c_transmit_block_begin(addr, timeout);
 }
 
@@ -532,6 +1095,60 @@ static err_t _i2c_transmit_block_continue(const uint8_t *tx_buffer, txsize_t tx_
 END:
 	return res;
 }
+#if uHAL_USE_I2C_DMA
+//
+// Handle the data phase of a transmission with DMA
+// Returns ERR_NOTSUP or ERR_INUSE if the stream isn't available and nothing
+// was sent, in which case the caller can fall back to polling
+static err_t dma_transmit_block_continue(const uint8_t *tx_buffer, txsize_t tx_size, utime_t timeout) {
+	err_t res;
+
+	if (!dma_stream_is_valid(&tx_dma)) {
+		return ERR_NOTSUP;
+	}
+	if ((res = dma_stream_claim(&tx_dma)) != ERR_OK) {
+		return res;
+	}
+
+	SET_BIT(I2Cx->CR2, I2C_CR2_DMAEN);
+	while (tx_size > 0) {
+		// The DMA transfer count register is only 16 bits
+		uint16_t count = (tx_size > 0xFFFFU) ? 0xFFFFU : (uint16_t )tx_size;
+
+		// No stream interrupts are needed because the hardware disables the
+		// stream on error
+		dma_stream_start(&tx_dma, &I2Cx->DR, tx_buffer, count, DMA_CFG_MEM_TO_PERIPH | DMA_CFG_MINC);
+		// Like the polled version, return once the last byte has moved on to
+		// the shift register
+		while ((dma_stream_remaining(&tx_dma) != 0U) || !BIT_IS_SET(I2Cx->SR1, I2C_SR1_TXE)) {
+			if (TIMES_UP(timeout)) {
+				res = ERR_TIMEOUT;
+				goto END;
+			}
+			if (BIT_IS_SET(I2Cx->SR1, I2C_SR1_AF)) {
+				res = ERR_INTERRUPT;
+				goto END;
+			}
+			if (BIT_IS_SET(I2Cx->SR1, I2C_SR1_ARLO|I2C_SR1_BERR)) {
+				res = ERR_UNKNOWN;
+				goto END;
+			}
+			if (!dma_stream_is_enabled(&tx_dma) && (dma_stream_remaining(&tx_dma) != 0U)) {
+				res = ERR_IO;
+				goto END;
+			}
+		}
+
+		tx_buffer += count;
+		tx_size -= count;
+	}
+
+END:
+	CLEAR_BIT(I2Cx->CR2, I2C_CR2_DMAEN);
+	dma_stream_release(&tx_dma);
+	return res;
+}
+#endif
 err_t i2c_transmit_block_continue(const uint8_t *tx_buffer, txsize_t tx_size, utime_t timeout) {
 	uHAL_assert(PERIPH_IS_INITIALIZED(I2Cx));
 	uHAL_assert(tx_buffer != NULL);
@@ -549,6 +1166,16 @@ err_t i2c_transmit_block_continue(const uint8_t *tx_buffer, txsize_t tx_size, ut
 
 	timeout = SET_TIMEOUT_MS(timeout);
 
+#if uHAL_USE_I2C_DMA
+	if (tx_size >= I2C_DMA_MIN_BYTES) {
+		err_t res = dma_transmit_block_continue(tx_buffer, tx_size, timeout);
+
+		if ((res != ERR_NOTSUP) && (res != ERR_INUSE)) {
+			return res;
+		}
+	}
+#endif
+
 	return _i2c_transmit_block_continue(tx_buffer, tx_size, timeout);
 }
 
@@ -562,7 +1189,8 @@ err_t i2c_transmit_block_end(void) {
 	}
 #endif
 
-	while (!BIT_IS_SET(I2Cx->SR1, I2C_SR1_BTF|I2C_SR1_TXE)) {
+	// Nothing more is going out after a NACK
+	while (!BIT_IS_SET(I2Cx->SR1, I2C_SR1_BTF|I2C_SR1_TXE|I2C_SR1_AF)) {
 		if (TIMES_UP(timeout)) {
 			break;
 		}
@@ -608,6 +1236,15 @@ err_t i2c_transmit_block(uint8_t addr, const uint8_t *tx_buffer, txsize_t tx_siz
 
 	timeout = SET_TIMEOUT_MS(timeout);
 
+#if uHAL_USE_I2C_IRQ
+	if (irq_can_sleep()) {
+		return irq_transfer_block(addr, tx_buffer, NULL, tx_size, timeout);
+	}
+	if (irq_wait(timeout) != ERR_OK) {
+		return ERR_TIMEOUT;
+	}
+#endif
+
 	if ((res = _i2c_transmit_block_begin(addr, timeout)) != ERR_OK) {
 		goto END;
 	}
@@ -620,6 +1257,65 @@ END:
 	return res;
 }
 
+err_t i2c_write_read(uint8_t addr, const uint8_t *tx_buffer, txsize_t tx_size, uint8_t *rx_buffer, txsize_t rx_size, utime_t timeout) {
+	err_t res = ERR_OK;
+
+	uHAL_assert(PERIPH_IS_INITIALIZED(I2Cx));
+	uHAL_assert(addr <= 0x7FU);
+	uHAL_assert(tx_buffer != NULL);
+	uHAL_assert(tx_size > 0);
+	uHAL_assert(rx_buffer != NULL);
+	uHAL_assert(rx_size > 0);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!PERIPH_IS_INITIALIZED(I2Cx)) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((addr > 0x7FU) || (tx_buffer == NULL) || (tx_size <= 0) || (rx_buffer == NULL) || (rx_size <= 0)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	timeout = SET_TIMEOUT_MS(timeout);
+
+	// Register reads are usually only a few bytes, so there's little to gain
+	// from the interrupts here
+#if uHAL_USE_I2C_IRQ
+	if (irq_wait(timeout) != ERR_OK) {
+		return ERR_TIMEOUT;
+	}
+#endif
+
+	if ((res = _i2c_transmit_block_begin(addr, timeout)) != ERR_OK) {
+		goto END;
+	}
+	if ((res = _i2c_transmit_block_continue(tx_buffer, tx_size, timeout)) != ERR_OK) {
+		goto END;
+	}
+	// Let the last byte finish before the repeated start
+	while (!BIT_IS_SET(I2Cx->SR1, I2C_SR1_BTF)) {
+		if (TIMES_UP(timeout)) {
+			res = ERR_TIMEOUT;
+			goto END;
+		}
+		if (BIT_IS_SET(I2Cx->SR1, I2C_SR1_AF)) {
+			res = ERR_INTERRUPT;
+			goto END;
+		}
+		if (BIT_IS_SET(I2Cx->SR1, I2C_SR1_ARLO|I2C_SR1_BERR)) {
+			res = ERR_UNKNOWN;
+			goto END;
+		}
+	}
+
+	// The reception sends the stop condition itself, even on failure
+	return _i2c_receive_block(addr, rx_buffer, rx_size, timeout, true);
+
+END:
+	i2c_transmit_block_end();
+	return res;
+}
 
 /*
 err_t i2c_transmit_block(uint8_t addr, const uint8_t *tx_buffer, txsize_t tx_size, utime_t timeout) {
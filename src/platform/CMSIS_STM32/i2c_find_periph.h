@@ -1,5 +1,5 @@
 //
-// Generated by tools/cmsis/i2c_find_periph.sh on Mon Nov 25 03:58:32 PM EST 2024
+// Generated by tools/cmsis/i2c_find_periph.sh on Fri Oct 16 23:25:23 UTC 2026
 //
 
 #if INCLUDED_BY_I2C_C
@@ -55,6 +55,12 @@
 #  define I2Cx I2C1
 #  define I2Cx_CLOCKEN RCC_PERIPH_I2C1
 #  define I2Cx_AF GPIOAF_I2C1
+#  define I2Cx_EV_IRQn I2C1_EV_IRQn
+#  define I2Cx_ER_IRQn I2C1_ER_IRQn
+#  define I2Cx_EV_IRQHandler I2C1_EV_IRQHandler
+#  define I2Cx_ER_IRQHandler I2C1_ER_IRQHandler
+#  define I2Cx_DMA_TX DMA_I2C1_TX
+#  define I2Cx_DMA_RX DMA_I2C1_RX
 # endif
 
 #else // HAVE_I2C1
@@ -111,6 +117,12 @@
 #  define I2Cx I2C2
 #  define I2Cx_CLOCKEN RCC_PERIPH_I2C2
 #  define I2Cx_AF GPIOAF_I2C2
+#  define I2Cx_EV_IRQn I2C2_EV_IRQn
+#  define I2Cx_ER_IRQn I2C2_ER_IRQn
+#  define I2Cx_EV_IRQHandler I2C2_EV_IRQHandler
+#  define I2Cx_ER_IRQHandler I2C2_ER_IRQHandler
+#  define I2Cx_DMA_TX DMA_I2C2_TX
+#  define I2Cx_DMA_RX DMA_I2C2_RX
 # endif
 
 #else // HAVE_I2C2
@@ -167,6 +179,12 @@
 #  define I2Cx I2C3
 #  define I2Cx_CLOCKEN RCC_PERIPH_I2C3
 #  define I2Cx_AF GPIOAF_I2C3
+#  define I2Cx_EV_IRQn I2C3_EV_IRQn
+#  define I2Cx_ER_IRQn I2C3_ER_IRQn
+#  define I2Cx_EV_IRQHandler I2C3_EV_IRQHandler
+#  define I2Cx_ER_IRQHandler I2C3_ER_IRQHandler
+#  define I2Cx_DMA_TX DMA_I2C3_TX
+#  define I2Cx_DMA_RX DMA_I2C3_RX
 # endif
 
 #else // HAVE_I2C3
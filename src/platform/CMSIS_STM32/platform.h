@@ -30,6 +30,7 @@
 #define PLATFORM_INTERFACE_H "interface/platform/cmsis.h"
 
 #include "ulib/include/debug.h"
+#include "ulib/include/error.h"
 #include "ulib/include/types.h"
 #include "ulib/include/time.h"
 
@@ -80,6 +81,40 @@
 # define uHAL_USE_INTERNAL_LS_OSC 1
 #endif
 
+#ifndef uHAL_USE_UART_TX_DMA
+# define uHAL_USE_UART_TX_DMA 0
+#endif
+#ifndef uHAL_USE_UART_RX_DMA
+# define uHAL_USE_UART_RX_DMA 0
+#endif
+#ifndef uHAL_USE_SPI_DMA
+# define uHAL_USE_SPI_DMA 0
+#endif
+#ifndef SPI_DMA_MIN_BYTES
+# define SPI_DMA_MIN_BYTES 16U
+#endif
+#ifndef uHAL_USE_SPI_QUEUE
+# define uHAL_USE_SPI_QUEUE 0
+#endif
+#ifndef SPI_QUEUE_LENGTH
+# define SPI_QUEUE_LENGTH 8U
+#endif
+#if uHAL_USE_SPI_QUEUE && ! uHAL_USE_SPI_DMA
+# error "uHAL_USE_SPI_QUEUE requires uHAL_USE_SPI_DMA"
+#endif
+#ifndef uHAL_USE_I2C_IRQ
+# define uHAL_USE_I2C_IRQ 0
+#endif
+#ifndef uHAL_USE_I2C_DMA
+# define uHAL_USE_I2C_DMA 0
+#endif
+#ifndef I2C_DMA_MIN_BYTES
+# define I2C_DMA_MIN_BYTES 16U
+#endif
+#if uHAL_USE_I2C_DMA && ! uHAL_USE_I2C_IRQ
+# error "uHAL_USE_I2C_DMA requires uHAL_USE_I2C_IRQ"
+#endif
+
 // Don't hibernate longer than this many seconds
 // Must be < 24 hours for calendar-based RTCs due to how the wakeup timer
 // is set
@@ -228,25 +263,128 @@ typedef struct {
 	gpio_pin_t pin;
 } gpio_listen_t;
 
+//
+// The DMA controller is shared between peripherals so each user keeps track of
+// the stream it's using and what to call when there's an interrupt
+// What the STM32F1 calls channels are called streams on the other lines and
+// channels there are the request mappings within a stream
+typedef void (*dma_callback_t)(void *arg, uint_fast8_t flags);
 typedef struct {
-	uint8_t buffer[UART_INPUT_BUFFER_BYTES];
-	uint8_t bytes;
-} uart_buffer_t;
-typedef struct {
+#if HAVE_STM32F1_DMA
+	DMA_Channel_TypeDef *streamx;
+#else
+	DMA_Stream_TypeDef *streamx;
+	uint8_t channel;
+#endif
+	// Index of the stream in the table of claimed streams, this also determines
+	// the controller and interrupt flag positions
+	uint8_t index;
+	uint8_t irqn;
+	dma_callback_t callback;
+	void *callback_arg;
+} dma_stream_t;
+
+#if uHAL_USE_I2C_IRQ
+typedef void (*i2c_callback_t)(err_t status);
+#endif
+
+typedef struct spi_port_t spi_port_t;
+#if uHAL_USE_SPI_DMA
+typedef void (*spi_callback_t)(spi_port_t *port, err_t status);
+#endif
+#if uHAL_USE_SPI_QUEUE
+// spi_device_t is defined in interface/spi.h, which is included later
+struct spi_device_t;
+typedef struct spi_transaction_t spi_transaction_t;
+typedef void (*spi_transaction_callback_t)(spi_transaction_t *transaction, err_t status);
+struct spi_transaction_t {
+	const struct spi_device_t *dev;
+	const uint8_t *tx_buffer;
+	uint8_t *rx_buffer;
+	uint_fast16_t size;
+	spi_transaction_callback_t callback;
+	void *callback_arg;
+};
+#include "platform/common/spi_queue.h"
+#endif
+#include "platform/common/spi_trace.h"
+struct spi_port_t {
+	SPI_TypeDef *spix;
+	// Need to know the pins and clock when turning the peripheral on or off.
+	rcc_periph_t clocken;
+	gpio_pin_t sck_pin;
+	gpio_pin_t miso_pin;
+	gpio_pin_t mosi_pin;
+	uint8_t gpio_af;
+
+	// The last speed requested by spi_device_begin() and the prescaler it maps
+	// to, so that talking to the same device repeatedly doesn't recalculate it
+	uint32_t device_hz;
+	uint16_t device_br;
+
+#if uHAL_USE_SPI_DMA
+	dma_stream_t tx_dma;
+	dma_stream_t rx_dma;
+	spi_callback_t dma_done_callback;
+	volatile bool dma_busy;
+	// Set while the transfer belongs to one of the blocking functions
+	volatile bool dma_blocking;
+	volatile err_t dma_status;
+	// The source or destination for whichever side of a transfer doesn't have
+	// a buffer: the filler byte when receiving and the discarded input when
+	// transmitting
+	volatile uint8_t dma_scratch;
+#endif
+#if uHAL_USE_SPI_QUEUE
+	volatile spi_queue_t queue;
+	// The transaction currently being transferred, NULL if the engine is stopped
+	spi_transaction_t *volatile queue_current;
+	// The device selected by spi_device_begin(), NULL if the bus is free for
+	// the queue
+	const struct spi_device_t *volatile bus_owner;
+#endif
+#if ENABLE_SPI_TRACE
+	spi_trace_port_t trace;
+#endif
+};
+
+#include "platform/common/uart_buf.h"
+typedef struct uart_port_t uart_port_t;
+#if uHAL_USE_UART_TX_DMA
+typedef void (*uart_tx_callback_t)(uart_port_t *port, err_t status);
+#endif
+struct uart_port_t {
 	USART_TypeDef *uartx;
 	// Need to know the pins and clock when turning the peripheral on or off.
 	rcc_periph_t clocken;
 	gpio_pin_t rx_pin;
 	gpio_pin_t tx_pin;
+#if ENABLE_UART_FLOW_CONTROL
+	gpio_pin_t rts_pin;
+	gpio_pin_t cts_pin;
+#endif
 	uint8_t gpio_af;
 	// Enabling/disabling interrupts is easier if we track the IRQn rather than
 	// recalculating each time
 	uint8_t irqn;
 
-#if UART_INPUT_BUFFER_BYTES > 0
+#if UART_INPUT_BUFFER_BYTES > 0 && ENABLE_UART_LISTENING
 	volatile uart_buffer_t rx_buf;
 #endif
-} uart_port_t;
+#if ENABLE_UART_STATS
+	volatile uart_stats_t stats;
+#endif
+#if uHAL_USE_UART_TX_DMA
+	dma_stream_t tx_dma;
+	uart_tx_callback_t tx_callback;
+	// The segments left to send in a scatter-gather transmission
+	const uart_iovec_t *tx_iov;
+	uint8_t tx_iovcnt;
+#endif
+#if uHAL_USE_UART_RX_DMA
+	dma_stream_t rx_dma;
+#endif
+};
 
 typedef enum {
 	GPIO_MODE_RESET = 0, // Reset state of the pin
@@ -52,6 +52,7 @@
 #define HAVE_STM32F1_HSI    0
 #define HAVE_STM32F1_LSI    0
 #define HAVE_STM32F1_FLASH  0
+#define HAVE_STM32F1_DMA    0
 #define HAVE_AHB2      1
 #define HAVE_AHB_RESET 1
 
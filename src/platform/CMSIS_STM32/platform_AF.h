@@ -182,6 +182,9 @@
 #define GPIOAF_SPI3  GPIOAF6
 // FIXME: enable this on devices that support it
 //#define GPIOAF_SPI3_ALT GPIOAF5
+#define GPIOAF_SPI4  GPIOAF5
+#define GPIOAF_SPI5  GPIOAF6
+#define GPIOAF_SPI6  GPIOAF5
 #define GPIOAF_UART1 GPIOAF7
 #define GPIOAF_UART2 GPIOAF7
 #define GPIOAF_UART3 GPIOAF7
@@ -27,25 +27,18 @@
 #include "spi.h"
 #include "system.h"
 #include "gpio.h"
+#include "dma.h"
 
 
 #if uHAL_USE_SPI
 #define INCLUDED_BY_SPI_C 1
 
-#include "spi_find_periph.h"
+#include "platform/common/crc16.h"
 
-#if ! defined(SPIx)
-# error "Can't determine SPI peripheral"
-#endif
+#include "spi_find_periph.h"
 
-#if (SPIx_CLOCKEN & RCC_BUS_MASK) == RCC_BUS_APB1
-# define SPIx_BUSFREQ G_freq_PCLK1
-#elif (SPIx_CLOCKEN & RCC_BUS_MASK) == RCC_BUS_APB2
-# define SPIx_BUSFREQ G_freq_PCLK2
-#elif (SPIx_CLOCKEN & RCC_BUS_MASK) == RCC_BUS_AHB1
-# define SPIx_BUSFREQ G_freq_HCLK
-#else
-# error "Can't determine SPI bus clock"
+#if ! defined(SPI_DEFAULT_SPIx)
+# error "Can't determine default SPI peripheral"
 #endif
 
 #define DIV_256 (0b111U << SPI_CR1_BR_Pos)
@@ -59,19 +52,146 @@
 
 #define BUS_IS_FREE(_spix_) (SELECT_BITS((_spix_)->SR, SPI_SR_TXE|SPI_SR_BSY) == SPI_SR_TXE)
 
+#define SET_DEFAULT_PORT(_p_) do { if ((_p_) == NULL) (_p_) = SPI_DEFAULT_PORT; } while (0)
+
+
+static uint32_t spi_busfreq(const spi_port_t *p);
+static uint32_t calculate_prescaler(const spi_port_t *p, uint32_t goal);
+static uint32_t calculate_prescaler_max(const spi_port_t *p, uint32_t limit);
+static void device_deselect(spi_port_t *p, const spi_device_t *dev);
+
+#if uHAL_USE_SPI_DMA
+static void dma_callback(void *arg, uint_fast8_t flags);
+static void dma_finish(spi_port_t *p, err_t status);
+static err_t dma_wait(spi_port_t *p, utime_t timeout);
+#else
+# define dma_wait(_p_, _timeout_) (ERR_OK)
+#endif
+
+#if uHAL_USE_SPI_QUEUE
+#include "platform/common/spi_queue.c"
+
+static void queue_kick(spi_port_t *p);
+#else
+# define queue_kick(_p_) ((void )0U)
+#endif
 
-static uint32_t calculate_prescaler(uint32_t goal);
+#if ENABLE_SPI_TRACE
+#include "platform/common/spi_trace.c"
+#else
+# define spi_trace_begin(_pt_, _dev_) ((void )0U)
+# define spi_trace_end(_pt_, _dev_) ((void )0U)
+#endif
 
 
 void spi_init(void) {
+	const spi_port_cfg_t spi_cfg = {
+		.sck_pin  = SPI_SCK_PIN,
+		.miso_pin = SPI_MISO_PIN,
+		.mosi_pin = SPI_MOSI_PIN,
+	};
+
+	// The pins were checked when finding SPI_DEFAULT_SPIx so this can't fail
+	spi_init_port(SPI_DEFAULT_PORT, &spi_cfg);
+
+	return;
+}
+err_t spi_init_port(spi_port_t *p, const spi_port_cfg_t *conf) {
+#if uHAL_USE_SPI_DMA
+	dma_id_t tx_dma, rx_dma;
+#endif
+
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(conf != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (conf == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	if (false) {
+		// Nothing to do here
+#if HAVE_SPI1
+	} else if (IS_SPI1_STRUCT(conf)) {
+		p->spix = SPI1;
+		p->clocken = RCC_PERIPH_SPI1;
+		p->gpio_af = GPIOAF_SPI1;
+#if uHAL_USE_SPI_DMA
+		tx_dma = DMA_SPI1_TX;
+		rx_dma = DMA_SPI1_RX;
+#endif
+#endif
+#if HAVE_SPI2
+	} else if (IS_SPI2_STRUCT(conf)) {
+		p->spix = SPI2;
+		p->clocken = RCC_PERIPH_SPI2;
+		p->gpio_af = GPIOAF_SPI2;
+#if uHAL_USE_SPI_DMA
+		tx_dma = DMA_SPI2_TX;
+		rx_dma = DMA_SPI2_RX;
+#endif
+#endif
+#if HAVE_SPI3
+	} else if (IS_SPI3_STRUCT(conf)) {
+		p->spix = SPI3;
+		p->clocken = RCC_PERIPH_SPI3;
+		p->gpio_af = GPIOAF_SPI3;
+#if uHAL_USE_SPI_DMA
+		tx_dma = DMA_SPI3_TX;
+		rx_dma = DMA_SPI3_RX;
+#endif
+#endif
+#if HAVE_SPI4
+	} else if (IS_SPI4_STRUCT(conf)) {
+		p->spix = SPI4;
+		p->clocken = RCC_PERIPH_SPI4;
+		p->gpio_af = GPIOAF_SPI4;
+#if uHAL_USE_SPI_DMA
+		tx_dma = DMA_SPI4_TX;
+		rx_dma = DMA_SPI4_RX;
+#endif
+#endif
+#if HAVE_SPI5
+	} else if (IS_SPI5_STRUCT(conf)) {
+		p->spix = SPI5;
+		p->clocken = RCC_PERIPH_SPI5;
+		p->gpio_af = GPIOAF_SPI5;
+#if uHAL_USE_SPI_DMA
+		tx_dma = DMA_SPI5_TX;
+		rx_dma = DMA_SPI5_RX;
+#endif
+#endif
+#if HAVE_SPI6
+	} else if (IS_SPI6_STRUCT(conf)) {
+		p->spix = SPI6;
+		p->clocken = RCC_PERIPH_SPI6;
+		p->gpio_af = GPIOAF_SPI6;
+#if uHAL_USE_SPI_DMA
+		tx_dma = DMA_SPI6_TX;
+		rx_dma = DMA_SPI6_RX;
+#endif
+#endif
+
+	} else {
+		return ERR_NOTSUP;
+	}
+
+	p->sck_pin = conf->sck_pin;
+	p->miso_pin = conf->miso_pin;
+	p->mosi_pin = conf->mosi_pin;
+	p->device_hz = 0;
+	p->device_br = 0;
+
 	// Start the clock and reset the peripheral
-	clock_init(SPIx_CLOCKEN);
+	clock_init(p->clocken);
 
 	// Set SPI parameters
 	// Per http:// elm-chan.org/docs/mmc/mmc_e.html, this needs to correspond
 	// to SPI mode 0 for use with SD cards but mode 3 sometimes works too.
 	// https:// www.electronicshub.org/basics-serial-peripheral-interface-spi/#Mode_0
-	MODIFY_BITS(SPIx->CR1,
+	MODIFY_BITS(p->spix->CR1,
 		SPI_CR1_CPHA|SPI_CR1_CPOL|SPI_CR1_MSTR|SPI_CR1_LSBFIRST|SPI_CR1_SSI|SPI_CR1_SSM|SPI_CR1_DFF|SPI_CR1_BR,
 		(0b0U << SPI_CR1_CPHA_Pos    )  | // First clock transition (rising edge when polarity is low)
 		(0b0U << SPI_CR1_CPOL_Pos    )  | // Keep clock low when idle
@@ -80,38 +200,69 @@ void spi_init(void) {
 		(0b1U << SPI_CR1_SSI_Pos     )  | // Keep SS pin high internally
 		(0b1U << SPI_CR1_SSM_Pos     )  | // Enable software slave management
 		(0b0U << SPI_CR1_DFF_Pos     )  | // 8 bit frames
-		calculate_prescaler(SPI_FREQUENCY_HZ) | // Baud rate prescaler
+		calculate_prescaler(p, SPI_FREQUENCY_HZ) | // Baud rate prescaler
 		0);
 
-	spi_off();
+#if uHAL_USE_SPI_DMA
+	// Only the RX stream signals completion because it's the one that
+	// finishes last; the TX stream only needs to report errors
+	dma_stream_init(&p->tx_dma, tx_dma, dma_callback, p);
+	dma_stream_init(&p->rx_dma, rx_dma, dma_callback, p);
+	p->dma_busy = false;
+#endif
+#if uHAL_USE_SPI_QUEUE
+	p->queue_current = NULL;
+	p->bus_owner = NULL;
+	spi_queue_reset(&p->queue);
+#endif
+#if ENABLE_SPI_TRACE
+	p->trace.dev = NULL;
+	p->trace.have_last = false;
+#endif
 
-	return;
+	spi_off(p);
+
+	return ERR_OK;
 }
-static uint32_t calculate_prescaler(uint32_t goal) {
-	uint32_t scaler;
+static uint32_t spi_busfreq(const spi_port_t *p) {
+	switch (SELECT_BITS(p->clocken, RCC_BUS_MASK)) {
+	case RCC_BUS_APB1:
+		return G_freq_PCLK1;
+	case RCC_BUS_APB2:
+		return G_freq_PCLK2;
+	case RCC_BUS_AHB1:
+		return G_freq_HCLK;
+	}
+
+	return 0;
+}
+static uint32_t calculate_prescaler(const spi_port_t *p, uint32_t goal) {
+	uint32_t scaler, busfreq;
+
+	busfreq = spi_busfreq(p);
 
 	// Allow speed up to 10% slower than requested
 	goal -= (goal / 10U);
 
-	if ((SPIx_BUSFREQ / 256U) >= goal) {
+	if ((busfreq / 256U) >= goal) {
 		scaler = DIV_256;
 	} else
-	if ((SPIx_BUSFREQ / 128U) >= goal) {
+	if ((busfreq / 128U) >= goal) {
 		scaler = DIV_128;
 	} else
-	if ((SPIx_BUSFREQ / 64U) >= goal) {
+	if ((busfreq / 64U) >= goal) {
 		scaler = DIV_64;
 	} else
-	if ((SPIx_BUSFREQ / 32U) >= goal) {
+	if ((busfreq / 32U) >= goal) {
 		scaler = DIV_32;
 	} else
-	if ((SPIx_BUSFREQ / 16U) >= goal) {
+	if ((busfreq / 16U) >= goal) {
 		scaler = DIV_16;
 	} else
-	if ((SPIx_BUSFREQ / 8U) >= goal) {
+	if ((busfreq / 8U) >= goal) {
 		scaler = DIV_8;
 	} else
-	if ((SPIx_BUSFREQ / 4U) >= goal) {
+	if ((busfreq / 4U) >= goal) {
 		scaler = DIV_4;
 	} else {
 		scaler = DIV_2;
@@ -119,92 +270,638 @@ static uint32_t calculate_prescaler(uint32_t goal) {
 
 	return scaler;
 }
-static void pins_on(void) {
-	gpio_set_AF(SPI_SCK_PIN,  SPIx_AF);
-	gpio_set_AF(SPI_MISO_PIN, SPIx_AF);
-	gpio_set_AF(SPI_MOSI_PIN, SPIx_AF);
+//
+// Find the fastest speed that doesn't exceed 'limit', falling back to the
+// slowest available if they're all too fast
+static uint32_t calculate_prescaler_max(const spi_port_t *p, uint32_t limit) {
+	uint32_t br, busfreq;
+
+	busfreq = spi_busfreq(p);
+
+	// The prescaler values map to powers of 2 starting at 2
+	for (br = 0; br < 0b111U; ++br) {
+		if ((busfreq >> (br + 1U)) <= limit) {
+			break;
+		}
+	}
+
+	return (br << SPI_CR1_BR_Pos);
+}
+static void pins_on(const spi_port_t *p) {
+	gpio_set_AF(p->sck_pin,  p->gpio_af);
+	gpio_set_AF(p->miso_pin, p->gpio_af);
+	gpio_set_AF(p->mosi_pin, p->gpio_af);
 
 	// Peripheral pin modes specified in the STM32F1 reference manual section
 	// 9.1.11
 	// I can't find specifications for the other devices, I'm assuming they
 	// just need to be AF
-	gpio_set_mode(SPI_SCK_PIN,  GPIO_MODE_PP_AF, GPIO_FLOAT);
-	gpio_set_mode(SPI_MOSI_PIN, GPIO_MODE_PP_AF, GPIO_FLOAT);
-	gpio_set_mode(SPI_MISO_PIN, GPIO_MODE_IN_AF, GPIO_FLOAT);
+	gpio_set_mode(p->sck_pin,  GPIO_MODE_PP_AF, GPIO_FLOAT);
+	gpio_set_mode(p->mosi_pin, GPIO_MODE_PP_AF, GPIO_FLOAT);
+	gpio_set_mode(p->miso_pin, GPIO_MODE_IN_AF, GPIO_FLOAT);
 
 	return;
 }
-static void pins_off(void) {
-	gpio_set_mode(SPI_SCK_PIN,  GPIO_MODE_RESET, GPIO_FLOAT);
-	gpio_set_mode(SPI_MOSI_PIN, GPIO_MODE_RESET, GPIO_FLOAT);
-	gpio_set_mode(SPI_MISO_PIN, GPIO_MODE_RESET, GPIO_FLOAT);
+static void pins_off(const spi_port_t *p) {
+	gpio_set_mode(p->sck_pin,  GPIO_MODE_RESET, GPIO_FLOAT);
+	gpio_set_mode(p->mosi_pin, GPIO_MODE_RESET, GPIO_FLOAT);
+	gpio_set_mode(p->miso_pin, GPIO_MODE_RESET, GPIO_FLOAT);
 
 	return;
 }
-err_t spi_on(void) {
-	clock_enable(SPIx_CLOCKEN);
-	SET_BIT(SPIx->CR1, SPI_CR1_SPE);
-	while (!BIT_IS_SET(SPIx->CR1, SPI_CR1_SPE)) {
+err_t spi_on(spi_port_t *p) {
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
+#endif
+
+	clock_enable(p->clocken);
+	SET_BIT(p->spix->CR1, SPI_CR1_SPE);
+	while (!BIT_IS_SET(p->spix->CR1, SPI_CR1_SPE)) {
 		// Nothing to do here
 	}
 
-	pins_on();
+	pins_on(p);
 
 	return ERR_OK;
 }
-err_t spi_off(void) {
+err_t spi_off(spi_port_t *p) {
 	uint16_t rx;
 
-	uHAL_assert(clock_is_enabled(SPIx_CLOCKEN));
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
+	uHAL_assert(clock_is_enabled(p->clocken));
 #if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
 #endif
 #if ! uHAL_SKIP_INVALID_ARG_CHECKS
 #endif
 #if ! uHAL_SKIP_OTHER_CHECKS
-	if (!clock_is_enabled(SPIx_CLOCKEN)) {
+	if (!clock_is_enabled(p->clocken)) {
 		return ERR_UNKNOWN;
 	}
 #endif
 
+#if uHAL_USE_SPI_QUEUE
+	// Queued transactions are dropped without calling their callbacks, but the
+	// device being talked to still needs to be deselected
+	if (p->queue_current != NULL) {
+		if (p->queue_current->dev != NULL) {
+			device_deselect(p, p->queue_current->dev);
+		}
+		p->queue_current = NULL;
+	}
+	spi_queue_reset(&p->queue);
+#endif
+#if uHAL_USE_SPI_DMA
+	// Any transfer in progress is abandoned without calling its callback
+	if (p->dma_busy) {
+		dma_finish(p, ERR_INIT);
+	}
+#endif
+
 	// If the SPI peripheral clock is already disabled but the status flags
 	// for whatever reason haven't been cleared, this would become an infinite
 	// loop
-	if (BIT_IS_SET(SPIx->CR1, SPI_CR1_SPE)) {
+	if (BIT_IS_SET(p->spix->CR1, SPI_CR1_SPE)) {
 		// Section 25.3.8 of the reference manual says the BSY flag may become
 		// unreliable if the proper procedure isn't followed before shutting an
 		// SPI interface down
-		while (BIT_IS_SET(SPIx->SR, SPI_SR_RXNE)) {
-			rx = SPIx->DR;
+		while (BIT_IS_SET(p->spix->SR, SPI_SR_RXNE)) {
+			rx = p->spix->DR;
 			// If for whatever reason there are still bytes coming in we have no
 			// way of knowing how many so just wait until we've gone an arbitrary
 			// period of time without seeing any
 			delay_ms(1);
 		}
 		rx = rx; // Shut the compiler up
-		while (!BUS_IS_FREE(SPIx)) {
+		while (!BUS_IS_FREE(p->spix)) {
 			// Nothing to do here
 		}
 	}
 
-	pins_off();
+	pins_off(p);
 
-	CLEAR_BIT(SPIx->CR1, SPI_CR1_SPE);
-	while (BIT_IS_SET(SPIx->CR1, SPI_CR1_SPE)) {
+	CLEAR_BIT(p->spix->CR1, SPI_CR1_SPE);
+	while (BIT_IS_SET(p->spix->CR1, SPI_CR1_SPE)) {
 		// Nothing to do here
 	}
-	clock_disable(SPIx_CLOCKEN);
+	clock_disable(p->clocken);
 
 	return ERR_OK;
 }
-bool spi_is_on(void) {
-	return (clock_is_enabled(SPIx_CLOCKEN) && BIT_IS_SET(SPIx->CR1, SPI_CR1_SPE));
+bool spi_is_on(const spi_port_t *p) {
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return false;
+	}
+#endif
+
+	return (clock_is_enabled(p->clocken) && BIT_IS_SET(p->spix->CR1, SPI_CR1_SPE));
+}
+
+//
+// The reference manual says the clock and frame settings mustn't be changed
+// while a transfer is in progress, so the peripheral is disabled around the
+// change; that's slow enough that it's only done when something actually
+// changes
+static void set_cr1_config(spi_port_t *p, uint32_t mask, uint32_t cfg) {
+	if (SELECT_BITS(p->spix->CR1, mask) != cfg) {
+		while (!BUS_IS_FREE(p->spix)) {
+			// Nothing to do here
+		}
+		CLEAR_BIT(p->spix->CR1, SPI_CR1_SPE);
+		MODIFY_BITS(p->spix->CR1, mask, cfg);
+		SET_BIT(p->spix->CR1, SPI_CR1_SPE);
+	}
+
+	return;
 }
+uint32_t spi_set_frequency(spi_port_t *p, uint32_t hz) {
+	uint32_t br;
+
+	SET_DEFAULT_PORT(p);
 
-err_t spi_exchange_byte(uint8_t tx, uint8_t *rx, utime_t timeout) {
+	uHAL_assert(hz > 0U);
+	uHAL_assert(spi_is_on(p));
+
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!spi_is_on(p)) {
+		return 0;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (hz == 0U) {
+		return 0;
+	}
+#endif
+#if uHAL_USE_SPI_DMA
+	if (p->dma_busy) {
+		return 0;
+	}
+#endif
+
+	br = calculate_prescaler_max(p, hz);
+	set_cr1_config(p, SPI_CR1_BR, br);
+
+	return spi_busfreq(p) >> ((br >> SPI_CR1_BR_Pos) + 1U);
+}
+
+//
+// A device with no port set is on the default one
+static spi_port_t* device_port(const spi_device_t *dev) {
+	return (dev->port != NULL) ? dev->port : SPI_DEFAULT_PORT;
+}
+//
+// Configure the bus for a device and select it
+static void device_select(spi_port_t *p, const spi_device_t *dev) {
+	uint32_t hz, cfg;
+
+	hz = (dev->max_hz != 0U) ? dev->max_hz : SPI_FREQUENCY_HZ;
+	if (hz != p->device_hz) {
+		p->device_br = (uint16_t )calculate_prescaler_max(p, hz);
+		p->device_hz = hz;
+	}
+	cfg = p->device_br;
+	if (BIT_IS_SET(dev->mode, SPI_MODE_1)) {
+		SET_BIT(cfg, SPI_CR1_CPHA);
+	}
+	if (BIT_IS_SET(dev->mode, SPI_MODE_2)) {
+		SET_BIT(cfg, SPI_CR1_CPOL);
+	}
+
+	set_cr1_config(p, SPI_CR1_CPHA|SPI_CR1_CPOL|SPI_CR1_BR, cfg);
+
+	if (dev->cs_pin != 0) {
+		gpio_set_state(dev->cs_pin, GPIO_LOW);
+	}
+	spi_trace_begin(&p->trace, dev);
+
+	return;
+}
+static void device_deselect(spi_port_t *p, const spi_device_t *dev) {
+	if (dev->cs_pin != 0) {
+		gpio_set_state(dev->cs_pin, GPIO_HIGH);
+	}
+	spi_trace_end(&p->trace, dev);
+	UNUSED(p);
+
+	return;
+}
+err_t spi_device_begin(const spi_device_t *dev) {
+	spi_port_t *p;
+#if uHAL_USE_SPI_DMA
+	uint32_t primask;
+#endif
+
+	uHAL_assert(dev != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (dev == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	p = device_port(dev);
+
+	uHAL_assert(spi_is_on(p));
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!spi_is_on(p)) {
+		return ERR_INIT;
+	}
+#endif
+#if uHAL_USE_SPI_DMA
+	// The queue may start a transaction from an ISR, so the check and taking
+	// the bus have to happen together
+	DISABLE_INTERRUPTS(primask);
+	if (p->dma_busy) {
+		RESTORE_INTERRUPTS(primask);
+		return ERR_RETRY;
+	}
+# if uHAL_USE_SPI_QUEUE
+	p->bus_owner = dev;
+# endif
+	RESTORE_INTERRUPTS(primask);
+#endif
+
+	device_select(p, dev);
+
+	return ERR_OK;
+}
+err_t spi_device_end(const spi_device_t *dev) {
+	spi_port_t *p;
+
+	uHAL_assert(dev != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (dev == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	p = device_port(dev);
+	device_deselect(p, dev);
+
+#if uHAL_USE_SPI_QUEUE
+	// Anything queued while the device had the bus is started now
+	if (p->bus_owner == dev) {
+		p->bus_owner = NULL;
+		queue_kick(p);
+	}
+#endif
+
+	return ERR_OK;
+}
+
+#if uHAL_USE_SPI_DMA
+//
+// The streams are claimed for each transfer rather than at initialization so
+// that peripherals sharing them can use them while the SPI bus is idle
+static err_t dma_prepare(spi_port_t *p, spi_callback_t callback) {
 	err_t res;
 
+	if (!dma_stream_is_valid(&p->tx_dma) || !dma_stream_is_valid(&p->rx_dma)) {
+		return ERR_NOTSUP;
+	}
+	if (p->dma_busy) {
+		return ERR_RETRY;
+	}
+	if ((res = dma_stream_claim(&p->rx_dma)) != ERR_OK) {
+		return res;
+	}
+	if ((res = dma_stream_claim(&p->tx_dma)) != ERR_OK) {
+		dma_stream_release(&p->rx_dma);
+		return res;
+	}
+	p->dma_done_callback = callback;
+	p->dma_blocking = false;
+
+	return ERR_OK;
+}
+//
+// Either 'tx' or 'rx' may be NULL, in which case p->dma_scratch is used instead
+static void dma_start(spi_port_t *p, const uint8_t *tx, uint8_t *rx, uint16_t size) {
+	p->dma_busy = true;
+	p->dma_status = ERR_OK;
+
+	// Anything left over in the data register would be taken as the first
+	// byte received
+	(void )p->spix->DR;
+
+	// RX gets the higher priority so that it can't fall behind TX and overrun
+	dma_stream_start(&p->rx_dma, &p->spix->DR, (rx != NULL) ? rx : &p->dma_scratch, size,
+		DMA_CFG_PERIPH_TO_MEM | ((rx != NULL) ? DMA_CFG_MINC : 0U) | DMA_CFG_IRQ_TC | DMA_CFG_IRQ_TE | DMA_CFG_PRIORITY_HIGH);
+	dma_stream_start(&p->tx_dma, &p->spix->DR, (tx != NULL) ? tx : &p->dma_scratch, size,
+		DMA_CFG_MEM_TO_PERIPH | ((tx != NULL) ? DMA_CFG_MINC : 0U) | DMA_CFG_IRQ_TE);
+	// The reference manual says to enable RX requests before TX requests
+	SET_BIT(p->spix->CR2, SPI_CR2_RXDMAEN);
+	SET_BIT(p->spix->CR2, SPI_CR2_TXDMAEN);
+
+	return;
+}
+static void dma_finish(spi_port_t *p, err_t status) {
+	CLEAR_BIT(p->spix->CR2, SPI_CR2_TXDMAEN|SPI_CR2_RXDMAEN);
+	dma_stream_release(&p->tx_dma);
+	dma_stream_release(&p->rx_dma);
+
+	// When a transfer is cut short there may still be a byte being shifted
+	// in that would otherwise be picked up by the next one
+	if (status != ERR_OK) {
+		while (BIT_IS_SET(p->spix->SR, SPI_SR_BSY)) {
+			// Nothing to do here
+		}
+		(void )p->spix->DR;
+	}
+
+	p->dma_status = status;
+	p->dma_busy = false;
+
+	return;
+}
+static void dma_callback(void *arg, uint_fast8_t flags) {
+	spi_port_t *p = arg;
+	spi_callback_t callback = p->dma_done_callback;
+	err_t res;
+
+	res = BIT_IS_SET(flags, DMA_FLAG_TE) ? ERR_IO : ERR_OK;
+	dma_finish(p, res);
+
+	// The callback is called last so that it can start another transfer
+	if (callback != NULL) {
+		callback(p, res);
+	}
+	// Anything queued behind a transfer started with the asynchronous API is
+	// picked up here
+	// A blocking transfer is usually one part of a longer exchange with a
+	// device that's still selected, so the queue has to wait for
+	// spi_device_end() instead
+	if (!p->dma_blocking) {
+		queue_kick(p);
+	}
+
+	return;
+}
+//
+// dma_busy is cleared by the DMA ISR and the timeouts depend on the SysTick
+// ISR, so neither can be waited on if the caller is masking them
+static bool dma_can_wait(void) {
+	return ((__get_PRIMASK() == 0) && (__get_IPSR() == 0));
+}
+//
+// Wait for any asynchronous transfer to finish before touching the data
+// register
+static err_t dma_wait(spi_port_t *p, utime_t timeout) {
+	if (p->dma_busy && !dma_can_wait()) {
+		return ERR_RETRY;
+	}
+	while (p->dma_busy) {
+		if (TIMES_UP(timeout)) {
+			return ERR_TIMEOUT;
+		}
+	}
+
+	return ERR_OK;
+}
+//
+// Handle a blocking transfer with DMA
+// Returns ERR_NOTSUP or ERR_INUSE if the streams aren't available or the
+// transfer couldn't be waited on and nothing was sent, in which case the
+// caller can fall back to polling
+static err_t dma_transfer_block(spi_port_t *p, const uint8_t *tx, uint8_t *rx, txsize_t size, utime_t timeout) {
+	err_t res = ERR_OK;
+	bool started = false;
+
+	if (!dma_can_wait()) {
+		return ERR_NOTSUP;
+	}
+	while (size > 0) {
+		// The DMA transfer count register is only 16 bits
+		uint16_t count = (size > 0xFFFFU) ? 0xFFFFU : (uint16_t )size;
+
+		if ((res = dma_prepare(p, NULL)) != ERR_OK) {
+			res = (started) ? ERR_RETRY : res;
+			goto END;
+		}
+		started = true;
+		p->dma_blocking = true;
+		dma_start(p, tx, rx, count);
+		while (p->dma_busy) {
+			if (TIMES_UP(timeout)) {
+				dma_finish(p, ERR_TIMEOUT);
+				res = ERR_TIMEOUT;
+				goto END;
+			}
+		}
+		if ((res = p->dma_status) != ERR_OK) {
+			goto END;
+		}
+
+		if (tx != NULL) {
+			tx += count;
+		}
+		if (rx != NULL) {
+			rx += count;
+		}
+		size -= count;
+	}
+
+END:
+	return res;
+}
+err_t spi_transmit_block_async(spi_port_t *p, const uint8_t *tx_buffer, txsize_t tx_size, spi_callback_t callback) {
+	err_t res;
+
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
+	uHAL_assert(tx_buffer != NULL);
+	uHAL_assert(tx_size > 0);
+	uHAL_assert(tx_size <= 0xFFFFU);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((tx_buffer == NULL) || (tx_size == 0) || (tx_size > 0xFFFFU)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	if ((res = dma_prepare(p, callback)) != ERR_OK) {
+		return res;
+	}
+	dma_start(p, tx_buffer, NULL, (uint16_t )tx_size);
+
+	return ERR_OK;
+}
+err_t spi_receive_block_async(spi_port_t *p, uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, spi_callback_t callback) {
+	err_t res;
+
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
+	uHAL_assert(rx_buffer != NULL);
+	uHAL_assert(rx_size > 0);
+	uHAL_assert(rx_size <= 0xFFFFU);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((rx_buffer == NULL) || (rx_size == 0) || (rx_size > 0xFFFFU)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	if ((res = dma_prepare(p, callback)) != ERR_OK) {
+		return res;
+	}
+	p->dma_scratch = tx;
+	dma_start(p, NULL, rx_buffer, (uint16_t )rx_size);
+
+	return ERR_OK;
+}
+bool spi_is_busy(const spi_port_t *p) {
+	SET_DEFAULT_PORT(p);
+
+	return p->dma_busy;
+}
+#endif // uHAL_USE_SPI_DMA
+
+#if uHAL_USE_SPI_QUEUE
+static void queue_done(spi_port_t *p, err_t status);
+//
+// Start the oldest queued transaction if nothing else is using the bus
+// Nothing is started while a device selected by spi_device_begin() has the
+// bus or while the DMA streams are in use; the transaction stays queued until
+// the next time the queue is started
+// Transactions that can't be started for any other reason are finished with
+// an error and the next one is tried
+// Must be called with interrupts disabled or from the DMA ISR
+static void queue_start_next(spi_port_t *p) {
+	spi_transaction_t *t;
+	err_t res;
+
+	while ((p->queue_current == NULL) && (p->bus_owner == NULL) && !p->dma_busy && ((t = spi_queue_peek(&p->queue)) != NULL)) {
+		if ((res = dma_prepare(p, queue_done)) == ERR_OK) {
+			if (t->dev != NULL) {
+				device_select(p, t->dev);
+			}
+			p->queue_current = t;
+			p->dma_scratch = 0xFFU;
+			dma_start(p, t->tx_buffer, t->rx_buffer, (uint16_t )t->size);
+			return;
+		}
+		if ((res == ERR_INUSE) || (res == ERR_RETRY)) {
+			return;
+		}
+
+		spi_queue_pop(&p->queue);
+		if (t->callback != NULL) {
+			t->callback(t, res);
+		}
+	}
+
+	return;
+}
+//
+// Called by dma_callback() when a queued transaction finishes
+static void queue_done(spi_port_t *p, err_t status) {
+	spi_transaction_t *t = p->queue_current;
+
+	p->queue_current = NULL;
+	spi_queue_pop(&p->queue);
+	if (t->dev != NULL) {
+		device_deselect(p, t->dev);
+	}
+	if (t->callback != NULL) {
+		t->callback(t, status);
+	}
+	queue_start_next(p);
+
+	return;
+}
+//
+// Restart the engine if it was held up by another user of the bus
+static void queue_kick(spi_port_t *p) {
+	uint32_t primask;
+
+	DISABLE_INTERRUPTS(primask);
+	queue_start_next(p);
+	RESTORE_INTERRUPTS(primask);
+
+	return;
+}
+err_t spi_queue_submit(spi_port_t *p, spi_transaction_t *transaction) {
+	err_t res;
+	uint32_t primask;
+
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(transaction != NULL);
+	uHAL_assert((transaction == NULL) || ((transaction->size > 0) && (transaction->size <= 0xFFFFU)));
+	uHAL_assert((transaction == NULL) || (transaction->tx_buffer != NULL) || (transaction->rx_buffer != NULL));
+	uHAL_assert((transaction == NULL) || (transaction->dev == NULL) || (device_port(transaction->dev) == p));
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (!spi_is_on(p)) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((transaction == NULL) || (transaction->size == 0) || (transaction->size > 0xFFFFU)) {
+		return ERR_BADARG;
+	}
+	if ((transaction->tx_buffer == NULL) && (transaction->rx_buffer == NULL)) {
+		return ERR_BADARG;
+	}
+	// The device is selected by the engine of the port it's on, which would
+	// leave this port's engine talking to whatever is selected on its own bus
+	if ((transaction->dev != NULL) && (device_port(transaction->dev) != p)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	DISABLE_INTERRUPTS(primask);
+	if (spi_queue_push(&p->queue, transaction)) {
+		queue_start_next(p);
+		res = ERR_OK;
+	} else {
+		res = ERR_RETRY;
+	}
+	RESTORE_INTERRUPTS(primask);
+
+	return res;
+}
+uint_fast8_t spi_queue_pending(const spi_port_t *p) {
+	SET_DEFAULT_PORT(p);
+
+	return spi_queue_used(&p->queue);
+}
+#endif // uHAL_USE_SPI_QUEUE
+
+err_t spi_exchange_byte(spi_port_t *p, uint8_t tx, uint8_t *rx, utime_t timeout) {
+	err_t res;
+
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
 	uHAL_assert(rx != NULL);
 #if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
 #endif
 #if ! uHAL_SKIP_INVALID_ARG_CHECKS
 	if (rx == NULL) {
@@ -212,11 +909,13 @@ err_t spi_exchange_byte(uint8_t tx, uint8_t *rx, utime_t timeout) {
 	}
 #endif
 
-	res = ERR_OK;
 	timeout = SET_TIMEOUT_MS(timeout);
+	if ((res = dma_wait(p, timeout)) != ERR_OK) {
+		goto END;
+	}
 
 	/*
-	while (!BUS_IS_FREE(SPIx)) {
+	while (!BUS_IS_FREE(p->spix)) {
 		if (TIMES_UP(timeout)) {
 			res = ERR_TIMEOUT;
 			goto END;
@@ -224,25 +923,99 @@ err_t spi_exchange_byte(uint8_t tx, uint8_t *rx, utime_t timeout) {
 	}
 	*/
 
-	SPIx->DR = tx;
-	while (!BIT_IS_SET(SPIx->SR, SPI_SR_RXNE)) {
+	p->spix->DR = tx;
+	while (!BIT_IS_SET(p->spix->SR, SPI_SR_RXNE)) {
 		if (TIMES_UP(timeout)) {
 			res = ERR_TIMEOUT;
 			goto END;
 		}
 	}
-	*rx = SPIx->DR;
+	*rx = p->spix->DR;
 
 END:
 	return res;
 }
-err_t spi_receive_block(uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, utime_t timeout) {
+err_t spi_exchange_block(spi_port_t *p, const uint8_t *tx_buffer, uint8_t *rx_buffer, txsize_t size, utime_t timeout) {
 	err_t res;
 	txsize_t i;
 
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
+	uHAL_assert(tx_buffer != NULL);
+	uHAL_assert(rx_buffer != NULL);
+	uHAL_assert(size > 0);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (tx_buffer == NULL || rx_buffer == NULL || size == 0) {
+		return ERR_BADARG;
+	}
+#endif
+
+	timeout = SET_TIMEOUT_MS(timeout);
+	if ((res = dma_wait(p, timeout)) != ERR_OK) {
+		goto END;
+	}
+
+#if uHAL_USE_SPI_DMA
+	if (size >= SPI_DMA_MIN_BYTES) {
+		res = dma_transfer_block(p, tx_buffer, rx_buffer, size, timeout);
+		if ((res != ERR_NOTSUP) && (res != ERR_INUSE)) {
+			goto END;
+		}
+		res = ERR_OK;
+	}
+#endif
+
+	// The next byte is loaded as soon as the current one moves into the shift
+	// register so that the clock doesn't stop between frames; the received
+	// byte is read while the next one is being shifted
+	p->spix->DR = tx_buffer[0];
+	for (i = 1; i < size; ++i) {
+		while (!BIT_IS_SET(p->spix->SR, SPI_SR_TXE)) {
+			if (TIMES_UP(timeout)) {
+				res = ERR_TIMEOUT;
+				goto END;
+			}
+		}
+		p->spix->DR = tx_buffer[i];
+
+		while (!BIT_IS_SET(p->spix->SR, SPI_SR_RXNE)) {
+			if (TIMES_UP(timeout)) {
+				res = ERR_TIMEOUT;
+				goto END;
+			}
+		}
+		rx_buffer[i-1] = p->spix->DR;
+	}
+	while (!BIT_IS_SET(p->spix->SR, SPI_SR_RXNE)) {
+		if (TIMES_UP(timeout)) {
+			res = ERR_TIMEOUT;
+			goto END;
+		}
+	}
+	rx_buffer[i-1] = p->spix->DR;
+
+END:
+	return res;
+}
+err_t spi_receive_block(spi_port_t *p, uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, utime_t timeout) {
+	err_t res;
+	txsize_t i;
+
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
 	uHAL_assert(rx_buffer != NULL);
 	uHAL_assert(rx_size > 0);
 #if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
 #endif
 #if ! uHAL_SKIP_INVALID_ARG_CHECKS
 	if (rx_buffer == NULL || rx_size == 0) {
@@ -250,11 +1023,24 @@ err_t spi_receive_block(uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, utime_
 	}
 #endif
 
-	res = ERR_OK;
 	timeout = SET_TIMEOUT_MS(timeout);
+	if ((res = dma_wait(p, timeout)) != ERR_OK) {
+		goto END;
+	}
+
+#if uHAL_USE_SPI_DMA
+	if (rx_size >= SPI_DMA_MIN_BYTES) {
+		p->dma_scratch = tx;
+		res = dma_transfer_block(p, NULL, rx_buffer, rx_size, timeout);
+		if ((res != ERR_NOTSUP) && (res != ERR_INUSE)) {
+			goto END;
+		}
+		res = ERR_OK;
+	}
+#endif
 
 	/*
-	while (!BUS_IS_FREE(SPIx)) {
+	while (!BUS_IS_FREE(p->spix)) {
 		if (TIMES_UP(timeout)) {
 			res = ERR_TIMEOUT;
 			goto END;
@@ -264,44 +1050,50 @@ err_t spi_receive_block(uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, utime_
 
 	// The tx buffer stays one step ahead of the rx buffer throughout the loop
 	// in order to keep the transfer continuous
-	SPIx->DR = tx;
+	p->spix->DR = tx;
 	rx_size -= 1;
 	for (i = 0; i < rx_size; ++i) {
-		while (!BIT_IS_SET(SPIx->SR, SPI_SR_TXE)) {
+		while (!BIT_IS_SET(p->spix->SR, SPI_SR_TXE)) {
 			if (TIMES_UP(timeout)) {
 				res = ERR_TIMEOUT;
 				goto END;
 			}
 		}
-		SPIx->DR = tx;
+		p->spix->DR = tx;
 
-		while (!BIT_IS_SET(SPIx->SR, SPI_SR_RXNE)) {
+		while (!BIT_IS_SET(p->spix->SR, SPI_SR_RXNE)) {
 			if (TIMES_UP(timeout)) {
 				res = ERR_TIMEOUT;
 				goto END;
 			}
 		}
-		rx_buffer[i] = SPIx->DR;
+		rx_buffer[i] = p->spix->DR;
 	}
-	while (!BIT_IS_SET(SPIx->SR, SPI_SR_RXNE)) {
+	while (!BIT_IS_SET(p->spix->SR, SPI_SR_RXNE)) {
 		if (TIMES_UP(timeout)) {
 			res = ERR_TIMEOUT;
 			break;
 		}
 	}
-	rx_buffer[i] = SPIx->DR;
+	rx_buffer[i] = p->spix->DR;
 
 END:
 	return res;
 }
-err_t spi_transmit_block(const uint8_t *tx_buffer, txsize_t tx_size, utime_t timeout) {
+err_t spi_transmit_block(spi_port_t *p, const uint8_t *tx_buffer, txsize_t tx_size, utime_t timeout) {
 	err_t res;
 	uint16_t rx;
 	txsize_t i;
 
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
 	uHAL_assert(tx_buffer != NULL);
 	uHAL_assert(tx_size > 0);
 #if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
 #endif
 #if ! uHAL_SKIP_INVALID_ARG_CHECKS
 	if (tx_buffer == NULL || tx_size == 0) {
@@ -309,11 +1101,23 @@ err_t spi_transmit_block(const uint8_t *tx_buffer, txsize_t tx_size, utime_t tim
 	}
 #endif
 
-	res = ERR_OK;
 	timeout = SET_TIMEOUT_MS(timeout);
+	if ((res = dma_wait(p, timeout)) != ERR_OK) {
+		goto END;
+	}
+
+#if uHAL_USE_SPI_DMA
+	if (tx_size >= SPI_DMA_MIN_BYTES) {
+		res = dma_transfer_block(p, tx_buffer, NULL, tx_size, timeout);
+		if ((res != ERR_NOTSUP) && (res != ERR_INUSE)) {
+			goto END;
+		}
+		res = ERR_OK;
+	}
+#endif
 
 	/*
-	while (!BUS_IS_FREE(SPIx)) {
+	while (!BUS_IS_FREE(p->spix)) {
 		if (TIMES_UP(timeout)) {
 			res = ERR_TIMEOUT;
 			goto END;
@@ -323,35 +1127,283 @@ err_t spi_transmit_block(const uint8_t *tx_buffer, txsize_t tx_size, utime_t tim
 
 	// The tx buffer stays one step ahead of the rx buffer throughout the loop
 	// in order to keep the transfer continuous
-	SPIx->DR = tx_buffer[0];
+	p->spix->DR = tx_buffer[0];
 	for (i = 1; i < tx_size; ++i) {
-		while (!BIT_IS_SET(SPIx->SR, SPI_SR_TXE)) {
+		while (!BIT_IS_SET(p->spix->SR, SPI_SR_TXE)) {
 			if (TIMES_UP(timeout)) {
 				res = ERR_TIMEOUT;
 				goto END;
 			}
 		}
-		SPIx->DR = tx_buffer[i];
+		p->spix->DR = tx_buffer[i];
 
-		while (!BIT_IS_SET(SPIx->SR, SPI_SR_RXNE)) {
+		while (!BIT_IS_SET(p->spix->SR, SPI_SR_RXNE)) {
 			if (TIMES_UP(timeout)) {
 				res = ERR_TIMEOUT;
 				goto END;
 			}
 		}
-		rx = SPIx->DR;
+		rx = p->spix->DR;
 	}
-	while (!BIT_IS_SET(SPIx->SR, SPI_SR_RXNE)) {
+	while (!BIT_IS_SET(p->spix->SR, SPI_SR_RXNE)) {
 		if (TIMES_UP(timeout)) {
 			res = ERR_TIMEOUT;
 			break;
 		}
 	}
-	rx = SPIx->DR;
+	rx = p->spix->DR;
 	UNUSED(rx);
 
 END:
 	return res;
 }
 
+//
+// Exchange a block of 16-bit frames the same way spi_exchange_block() does
+// 8-bit ones
+// If 'tx' is NULL, 'fill' is sent instead and if 'rx' is NULL the received
+// words are discarded
+// DFF only changes the frame size; with MSB-first bit order the high byte of
+// each word goes out first regardless of the CPU's byte order
+static err_t exchange16(spi_port_t *p, const uint16_t *tx, uint16_t fill, uint16_t *rx, txsize_t count, utime_t timeout) {
+	err_t res;
+	txsize_t i;
+	uint16_t c;
+
+	timeout = SET_TIMEOUT_MS(timeout);
+	if ((res = dma_wait(p, timeout)) != ERR_OK) {
+		return res;
+	}
+
+	set_cr1_config(p, SPI_CR1_DFF, SPI_CR1_DFF);
+
+	p->spix->DR = (tx != NULL) ? tx[0] : fill;
+	for (i = 1; i < count; ++i) {
+		while (!BIT_IS_SET(p->spix->SR, SPI_SR_TXE)) {
+			if (TIMES_UP(timeout)) {
+				res = ERR_TIMEOUT;
+				goto END;
+			}
+		}
+		p->spix->DR = (tx != NULL) ? tx[i] : fill;
+
+		while (!BIT_IS_SET(p->spix->SR, SPI_SR_RXNE)) {
+			if (TIMES_UP(timeout)) {
+				res = ERR_TIMEOUT;
+				goto END;
+			}
+		}
+		c = p->spix->DR;
+		if (rx != NULL) {
+			rx[i-1] = c;
+		}
+	}
+	while (!BIT_IS_SET(p->spix->SR, SPI_SR_RXNE)) {
+		if (TIMES_UP(timeout)) {
+			res = ERR_TIMEOUT;
+			goto END;
+		}
+	}
+	c = p->spix->DR;
+	if (rx != NULL) {
+		rx[i-1] = c;
+	}
+
+END:
+	// The 8-bit functions expect DFF to be cleared
+	// A timed-out transfer may still be busy, set_cr1_config() waits for it
+	set_cr1_config(p, SPI_CR1_DFF, 0);
+	return res;
+}
+err_t spi_exchange_block16(spi_port_t *p, const uint16_t *tx_buffer, uint16_t *rx_buffer, txsize_t count, utime_t timeout) {
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
+	uHAL_assert(tx_buffer != NULL);
+	uHAL_assert(rx_buffer != NULL);
+	uHAL_assert(count > 0);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (tx_buffer == NULL || rx_buffer == NULL || count == 0) {
+		return ERR_BADARG;
+	}
+#endif
+
+	return exchange16(p, tx_buffer, 0, rx_buffer, count, timeout);
+}
+err_t spi_receive_block16(spi_port_t *p, uint16_t *rx_buffer, txsize_t rx_count, uint16_t tx, utime_t timeout) {
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
+	uHAL_assert(rx_buffer != NULL);
+	uHAL_assert(rx_count > 0);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (rx_buffer == NULL || rx_count == 0) {
+		return ERR_BADARG;
+	}
+#endif
+
+	return exchange16(p, NULL, tx, rx_buffer, rx_count, timeout);
+}
+err_t spi_transmit_block16(spi_port_t *p, const uint16_t *tx_buffer, txsize_t tx_count, utime_t timeout) {
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
+	uHAL_assert(tx_buffer != NULL);
+	uHAL_assert(tx_count > 0);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (tx_buffer == NULL || tx_count == 0) {
+		return ERR_BADARG;
+	}
+#endif
+
+	return exchange16(p, tx_buffer, 0, NULL, tx_count, timeout);
+}
+
+//
+// The CRC unit works on whole frames and its width follows DFF, so the 16-bit
+// CRC needs 16-bit frames; odd-sized blocks are handled in software instead
+// With MSB-first bit order a frame made from two consecutive bytes, the first
+// in the high half, goes out on the wire exactly as the bytes would have
+// If 'tx' is NULL, 'fill' is sent instead and if 'rx' is NULL the received
+// bytes are discarded; the CRC is of whichever side has a buffer
+static err_t crc16_block(spi_port_t *p, const uint8_t *tx, uint8_t fill, uint8_t *rx, txsize_t size, uint16_t *crc, utime_t timeout) {
+	err_t res;
+	txsize_t i, words;
+	uint16_t fill16, c;
+
+	timeout = SET_TIMEOUT_MS(timeout);
+	if ((res = dma_wait(p, timeout)) != ERR_OK) {
+		return res;
+	}
+
+	// The CRC registers are only reset by clearing CRCEN, and that and DFF
+	// can only be changed while the peripheral is disabled
+	while (!BUS_IS_FREE(p->spix)) {
+		// Nothing to do here
+	}
+	CLEAR_BIT(p->spix->CR1, SPI_CR1_SPE);
+	CLEAR_BIT(p->spix->CR1, SPI_CR1_CRCEN);
+	p->spix->CRCPR = CRC16_POLY;
+	SET_BIT(p->spix->CR1, SPI_CR1_DFF|SPI_CR1_CRCEN);
+	SET_BIT(p->spix->CR1, SPI_CR1_SPE);
+
+	words = size / 2U;
+	fill16 = ((uint16_t )fill << 8) | fill;
+	p->spix->DR = (tx != NULL) ? (((uint16_t )tx[0] << 8) | tx[1]) : fill16;
+	for (i = 1; i < words; ++i) {
+		while (!BIT_IS_SET(p->spix->SR, SPI_SR_TXE)) {
+			if (TIMES_UP(timeout)) {
+				res = ERR_TIMEOUT;
+				goto END;
+			}
+		}
+		p->spix->DR = (tx != NULL) ? (((uint16_t )tx[i*2U] << 8) | tx[(i*2U)+1U]) : fill16;
+
+		while (!BIT_IS_SET(p->spix->SR, SPI_SR_RXNE)) {
+			if (TIMES_UP(timeout)) {
+				res = ERR_TIMEOUT;
+				goto END;
+			}
+		}
+		c = p->spix->DR;
+		if (rx != NULL) {
+			rx[(i-1U)*2U] = (uint8_t )(c >> 8);
+			rx[((i-1U)*2U)+1U] = (uint8_t )c;
+		}
+	}
+	while (!BIT_IS_SET(p->spix->SR, SPI_SR_RXNE)) {
+		if (TIMES_UP(timeout)) {
+			res = ERR_TIMEOUT;
+			goto END;
+		}
+	}
+	c = p->spix->DR;
+	if (rx != NULL) {
+		rx[(i-1U)*2U] = (uint8_t )(c >> 8);
+		rx[((i-1U)*2U)+1U] = (uint8_t )c;
+	}
+
+	*crc = (rx != NULL) ? (uint16_t )p->spix->RXCRCR : (uint16_t )p->spix->TXCRCR;
+
+END:
+	set_cr1_config(p, SPI_CR1_DFF|SPI_CR1_CRCEN, 0);
+	return res;
+}
+err_t spi_receive_block_crc16(spi_port_t *p, uint8_t *rx_buffer, txsize_t rx_size, uint8_t tx, uint16_t *crc, utime_t timeout) {
+	err_t res;
+
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
+	uHAL_assert(rx_buffer != NULL);
+	uHAL_assert(rx_size > 0);
+	uHAL_assert(crc != NULL);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (rx_buffer == NULL || rx_size == 0 || crc == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	if ((rx_size % 2U) == 0) {
+		return crc16_block(p, NULL, tx, rx_buffer, rx_size, crc, timeout);
+	}
+
+	if ((res = spi_receive_block(p, rx_buffer, rx_size, tx, timeout)) == ERR_OK) {
+		*crc = crc16_update(0, rx_buffer, rx_size);
+	}
+
+	return res;
+}
+err_t spi_transmit_block_crc16(spi_port_t *p, const uint8_t *tx_buffer, txsize_t tx_size, uint16_t *crc, utime_t timeout) {
+	err_t res;
+
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p->spix != NULL);
+	uHAL_assert(tx_buffer != NULL);
+	uHAL_assert(tx_size > 0);
+	uHAL_assert(crc != NULL);
+#if ! uHAL_SKIP_INIT_CHECKS
+	if (p->spix == NULL) {
+		return ERR_INIT;
+	}
+#endif
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (tx_buffer == NULL || tx_size == 0 || crc == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	if ((tx_size % 2U) == 0) {
+		return crc16_block(p, tx_buffer, 0, NULL, tx_size, crc, timeout);
+	}
+
+	if ((res = spi_transmit_block(p, tx_buffer, tx_size, timeout)) == ERR_OK) {
+		*crc = crc16_update(0, tx_buffer, tx_size);
+	}
+
+	return res;
+}
+
+
 #endif // uHAL_USE_SPI
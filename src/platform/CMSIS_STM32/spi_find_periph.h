@@ -1,5 +1,5 @@
 //
-// Generated by tools/cmsis/spi_find_periph.sh on Mon Nov 25 03:58:32 PM EST 2024
+// Generated by tools/cmsis/spi_find_periph.sh on Fri Oct 16 23:15:18 UTC 2026
 //
 
 #if INCLUDED_BY_SPI_C
@@ -67,15 +67,16 @@
 # define IS_SPI1_SCK(_p_) (IS_SPI1_SCK_DEF(_p_) || IS_SPI1_SCK_ALT1(_p_) || IS_SPI1_SCK_ALT2(_p_))
 
 # define IS_SPI1(_mosi_, _miso_, _sck_) (IS_SPI1_MOSI(_mosi_) && IS_SPI1_MISO(_miso_) && IS_SPI1_SCK(_sck_))
+# define IS_SPI1_STRUCT(_p_) (IS_SPI1((_p_)->mosi_pin, (_p_)->miso_pin, (_p_)->sck_pin))
 
-# if !defined(SPIx) && IS_SPI1(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
-#  define SPIx SPI1
-#  define SPIx_CLOCKEN RCC_PERIPH_SPI1
-#  define SPIx_AF GPIOAF_SPI1
+# if !defined(SPI_DEFAULT_SPIx) && IS_SPI1(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
+#  define SPI_DEFAULT_SPIx SPI1
+   DEBUG_CPP_MSG("Default SPI port on SPI1")
 # endif
 
 #else // HAVE_SPI1
 # define IS_SPI1(_mosi_, _miso_, _sck_) (0)
+# define IS_SPI1_STRUCT(_p_) (0)
 #endif // HAVE_SPI1
 
 //
@@ -140,15 +141,16 @@
 # define IS_SPI2_SCK(_p_) (IS_SPI2_SCK_DEF(_p_) || IS_SPI2_SCK_ALT1(_p_) || IS_SPI2_SCK_ALT2(_p_))
 
 # define IS_SPI2(_mosi_, _miso_, _sck_) (IS_SPI2_MOSI(_mosi_) && IS_SPI2_MISO(_miso_) && IS_SPI2_SCK(_sck_))
+# define IS_SPI2_STRUCT(_p_) (IS_SPI2((_p_)->mosi_pin, (_p_)->miso_pin, (_p_)->sck_pin))
 
-# if !defined(SPIx) && IS_SPI2(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
-#  define SPIx SPI2
-#  define SPIx_CLOCKEN RCC_PERIPH_SPI2
-#  define SPIx_AF GPIOAF_SPI2
+# if !defined(SPI_DEFAULT_SPIx) && IS_SPI2(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
+#  define SPI_DEFAULT_SPIx SPI2
+   DEBUG_CPP_MSG("Default SPI port on SPI2")
 # endif
 
 #else // HAVE_SPI2
 # define IS_SPI2(_mosi_, _miso_, _sck_) (0)
+# define IS_SPI2_STRUCT(_p_) (0)
 #endif // HAVE_SPI2
 
 //
@@ -213,15 +215,16 @@
 # define IS_SPI3_SCK(_p_) (IS_SPI3_SCK_DEF(_p_) || IS_SPI3_SCK_ALT1(_p_) || IS_SPI3_SCK_ALT2(_p_))
 
 # define IS_SPI3(_mosi_, _miso_, _sck_) (IS_SPI3_MOSI(_mosi_) && IS_SPI3_MISO(_miso_) && IS_SPI3_SCK(_sck_))
+# define IS_SPI3_STRUCT(_p_) (IS_SPI3((_p_)->mosi_pin, (_p_)->miso_pin, (_p_)->sck_pin))
 
-# if !defined(SPIx) && IS_SPI3(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
-#  define SPIx SPI3
-#  define SPIx_CLOCKEN RCC_PERIPH_SPI3
-#  define SPIx_AF GPIOAF_SPI3
+# if !defined(SPI_DEFAULT_SPIx) && IS_SPI3(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
+#  define SPI_DEFAULT_SPIx SPI3
+   DEBUG_CPP_MSG("Default SPI port on SPI3")
 # endif
 
 #else // HAVE_SPI3
 # define IS_SPI3(_mosi_, _miso_, _sck_) (0)
+# define IS_SPI3_STRUCT(_p_) (0)
 #endif // HAVE_SPI3
 
 //
@@ -286,15 +289,16 @@
 # define IS_SPI4_SCK(_p_) (IS_SPI4_SCK_DEF(_p_) || IS_SPI4_SCK_ALT1(_p_) || IS_SPI4_SCK_ALT2(_p_))
 
 # define IS_SPI4(_mosi_, _miso_, _sck_) (IS_SPI4_MOSI(_mosi_) && IS_SPI4_MISO(_miso_) && IS_SPI4_SCK(_sck_))
+# define IS_SPI4_STRUCT(_p_) (IS_SPI4((_p_)->mosi_pin, (_p_)->miso_pin, (_p_)->sck_pin))
 
-# if !defined(SPIx) && IS_SPI4(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
-#  define SPIx SPI4
-#  define SPIx_CLOCKEN RCC_PERIPH_SPI4
-#  define SPIx_AF GPIOAF_SPI4
+# if !defined(SPI_DEFAULT_SPIx) && IS_SPI4(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
+#  define SPI_DEFAULT_SPIx SPI4
+   DEBUG_CPP_MSG("Default SPI port on SPI4")
 # endif
 
 #else // HAVE_SPI4
 # define IS_SPI4(_mosi_, _miso_, _sck_) (0)
+# define IS_SPI4_STRUCT(_p_) (0)
 #endif // HAVE_SPI4
 
 //
@@ -359,15 +363,16 @@
 # define IS_SPI5_SCK(_p_) (IS_SPI5_SCK_DEF(_p_) || IS_SPI5_SCK_ALT1(_p_) || IS_SPI5_SCK_ALT2(_p_))
 
 # define IS_SPI5(_mosi_, _miso_, _sck_) (IS_SPI5_MOSI(_mosi_) && IS_SPI5_MISO(_miso_) && IS_SPI5_SCK(_sck_))
+# define IS_SPI5_STRUCT(_p_) (IS_SPI5((_p_)->mosi_pin, (_p_)->miso_pin, (_p_)->sck_pin))
 
-# if !defined(SPIx) && IS_SPI5(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
-#  define SPIx SPI5
-#  define SPIx_CLOCKEN RCC_PERIPH_SPI5
-#  define SPIx_AF GPIOAF_SPI5
+# if !defined(SPI_DEFAULT_SPIx) && IS_SPI5(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
+#  define SPI_DEFAULT_SPIx SPI5
+   DEBUG_CPP_MSG("Default SPI port on SPI5")
 # endif
 
 #else // HAVE_SPI5
 # define IS_SPI5(_mosi_, _miso_, _sck_) (0)
+# define IS_SPI5_STRUCT(_p_) (0)
 #endif // HAVE_SPI5
 
 //
@@ -432,15 +437,16 @@
 # define IS_SPI6_SCK(_p_) (IS_SPI6_SCK_DEF(_p_) || IS_SPI6_SCK_ALT1(_p_) || IS_SPI6_SCK_ALT2(_p_))
 
 # define IS_SPI6(_mosi_, _miso_, _sck_) (IS_SPI6_MOSI(_mosi_) && IS_SPI6_MISO(_miso_) && IS_SPI6_SCK(_sck_))
+# define IS_SPI6_STRUCT(_p_) (IS_SPI6((_p_)->mosi_pin, (_p_)->miso_pin, (_p_)->sck_pin))
 
-# if !defined(SPIx) && IS_SPI6(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
-#  define SPIx SPI6
-#  define SPIx_CLOCKEN RCC_PERIPH_SPI6
-#  define SPIx_AF GPIOAF_SPI6
+# if !defined(SPI_DEFAULT_SPIx) && IS_SPI6(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
+#  define SPI_DEFAULT_SPIx SPI6
+   DEBUG_CPP_MSG("Default SPI port on SPI6")
 # endif
 
 #else // HAVE_SPI6
 # define IS_SPI6(_mosi_, _miso_, _sck_) (0)
+# define IS_SPI6_STRUCT(_p_) (0)
 #endif // HAVE_SPI6
 
 #endif // INCLUDED_BY_SPI_C
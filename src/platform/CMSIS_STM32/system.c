@@ -211,6 +211,8 @@ void platform_init(void) {
 	const uart_port_cfg_t uart_cfg = {
 		.rx_pin = UART_COMM_RX_PIN,
 		.tx_pin = UART_COMM_TX_PIN,
+		.rts_pin = UART_COMM_RTS_PIN,
+		.cts_pin = UART_COMM_CTS_PIN,
 		.baud_rate = UART_COMM_BAUDRATE,
 	};
 
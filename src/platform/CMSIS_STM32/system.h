@@ -38,6 +38,12 @@
 #define UART_IRQp        4
 #define SLEEP_ALARM_IRQp 5
 #define USCOUNTER_IRQp   6
+#define DMA_IRQp         4
+#define I2C_IRQp         4
+
+// Disable/restore interrupts while preserving original state
+#define DISABLE_INTERRUPTS(primask) do { primask = __get_PRIMASK(); __disable_irq(); } while (0);
+#define RESTORE_INTERRUPTS(primask) do { __set_PRIMASK(primask); } while (0);
 
 
 // Initialize/Enable/Disable one or more peripheral clocks
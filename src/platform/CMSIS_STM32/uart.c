@@ -25,13 +25,65 @@
 #include "uart.h"
 #include "system.h"
 #include "gpio.h"
-
-// For memcpy() and memmove()
-#include <string.h>
+#include "dma.h"
 
 #if uHAL_USE_UART
 
+#if uHAL_USE_UART_RX_DMA
+# if ! ENABLE_UART_LISTENING || UART_INPUT_BUFFER_BYTES <= 0
+#  error "uHAL_USE_UART_RX_DMA requires ENABLE_UART_LISTENING and UART_INPUT_BUFFER_BYTES > 0"
+# endif
+# if UART_INPUT_BUFFER_BYTES > 0xFFFFU
+#  error "UART_INPUT_BUFFER_BYTES must be <= 0xFFFF when using uHAL_USE_UART_RX_DMA"
+# endif
+//
+// When receiving with DMA, the controller writes to the RX buffer without
+// checking for room and the head is only brought up to date by the stream's
+// half- and full-transfer interrupts and the UART's IDLE interrupt. Everywhere
+// else calculates where the controller is from the stream's transfer counter.
+// This works as long as those interrupts aren't delayed by more than half the
+// time it takes to fill the buffer, which keeps (pos - head) below the size of
+// the buffer.
+//
+// Because the indices are never checked against each other, it's possible for
+// them to alias if the buffer isn't read for long enough but uart_buffer_size_t
+// is 32 bits on ARM so that won't happen in practice.
+INLINE uart_buffer_size_t rx_dma_head(const uart_port_t *p) {
+	uart_buffer_size_t head, pos;
+
+	// Read the head before the counter so that if an interrupt updates the
+	// head in between, the position is still ahead of it
+	head = p->rx_buf.head;
+	// DMAR is only set while the stream belongs to the receiver; the counter
+	// is still valid after the stream is stopped so it's cleared only after
+	// the final update
+	if (!dma_stream_is_valid(&p->rx_dma) || !BIT_IS_SET(p->uartx->CR3, USART_CR3_DMAR)) {
+		return head;
+	}
+	pos = (uart_buffer_size_t )(UART_INPUT_BUFFER_BYTES - dma_stream_remaining(&p->rx_dma));
+
+	return head + (uart_buffer_size_t )((pos - head) & UART_INPUT_BUFFER_MASK);
+}
+INLINE void uart_buffer_pushed(uart_port_t *p, uart_buffer_size_t from);
+//
+// Bring the head up to date; this should only be called from the DMA and UART
+// ISRs, which share a priority and so can't interrupt each other, or when
+// the stream is stopped
+INLINE void rx_dma_sync_head(uart_port_t *p) {
+	uart_buffer_size_t head = rx_dma_head(p);
+	uart_buffer_size_t from = p->rx_buf.head;
+
+	UART_STATS_ADD(p, rx_bytes, (uart_buffer_size_t )(head - from));
+	p->rx_buf.head = head;
+	uart_buffer_pushed(p, from);
+
+	return;
+}
+# define UART_BUFFER_HEAD(_p_) (rx_dma_head(_p_))
+#endif // uHAL_USE_UART_RX_DMA
+
 #include "platform/common/uart_buf.c"
+#include "uart_calc_brr.h"
 #include "uart_find_periph.h"
 #include "uart_define_irq.h"
 
@@ -52,16 +104,39 @@
 
 DEBUG_CPP_MACRO(UART_INPUT_BUFFER_BYTES)
 
+// The F1 line doesn't support oversampling by 8
+#if defined(USART_CR1_OVER8)
+# define HAVE_UART_OVER8 1
+#else
+# define HAVE_UART_OVER8 0
+#endif
+
 #if defined(UART_COMM_PORT)
 # define SET_DEFAULT_PORT(_p_) do { if ((_p_) == NULL) (_p_) = UART_COMM_PORT; } while (0)
 #else
 # define SET_DEFAULT_PORT(_p_)
 #endif
 
-static uint16_t calculate_baud_div(uint32_t baud, uint32_t busfreq);
+static uint32_t uart_busfreq(const uart_port_t *p);
+#if ENABLE_UART_FLOW_CONTROL
+static bool uart_is_cts_pin(const uart_port_t *p, gpio_pin_t pin);
+#endif
+#if uHAL_USE_UART_TX_DMA
+static void tx_dma_callback(void *arg, uint_fast8_t flags);
+#endif
+#if uHAL_USE_UART_RX_DMA
+static void rx_dma_callback(void *arg, uint_fast8_t flags);
+#endif
 
 err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 	uint32_t tmp;
+	bool over8;
+#if uHAL_USE_UART_TX_DMA
+	dma_id_t tx_dma;
+#endif
+#if uHAL_USE_UART_RX_DMA
+	dma_id_t rx_dma;
+#endif
 
 	SET_DEFAULT_PORT(p);
 
@@ -85,6 +160,12 @@ err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 		p->clocken = RCC_PERIPH_UART1;
 		p->gpio_af = GPIOAF_UART1;
 		ASSIGN_IRQ_PORT(1, p);
+#if uHAL_USE_UART_TX_DMA
+		tx_dma = DMA_UART1_TX;
+#endif
+#if uHAL_USE_UART_RX_DMA
+		rx_dma = DMA_UART1_RX;
+#endif
 #endif
 #if HAVE_UART2
 	} else if (IS_UART2_STRUCT(conf)) {
@@ -93,6 +174,12 @@ err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 		p->clocken = RCC_PERIPH_UART2;
 		p->gpio_af = GPIOAF_UART2;
 		ASSIGN_IRQ_PORT(2, p);
+#if uHAL_USE_UART_TX_DMA
+		tx_dma = DMA_UART2_TX;
+#endif
+#if uHAL_USE_UART_RX_DMA
+		rx_dma = DMA_UART2_RX;
+#endif
 #endif
 #if HAVE_UART3
 	} else if (IS_UART3_STRUCT(conf)) {
@@ -101,6 +188,12 @@ err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 		p->clocken = RCC_PERIPH_UART3;
 		p->gpio_af = GPIOAF_UART3;
 		ASSIGN_IRQ_PORT(3, p);
+#if uHAL_USE_UART_TX_DMA
+		tx_dma = DMA_UART3_TX;
+#endif
+#if uHAL_USE_UART_RX_DMA
+		rx_dma = DMA_UART3_RX;
+#endif
 #endif
 #if HAVE_UART6
 	} else if (IS_UART6_STRUCT(conf)) {
@@ -109,6 +202,12 @@ err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 		p->clocken = RCC_PERIPH_UART6;
 		p->gpio_af = GPIOAF_UART6;
 		ASSIGN_IRQ_PORT(6, p);
+#if uHAL_USE_UART_TX_DMA
+		tx_dma = DMA_UART6_TX;
+#endif
+#if uHAL_USE_UART_RX_DMA
+		rx_dma = DMA_UART6_RX;
+#endif
 #endif
 	//
 	// UART peripherals
@@ -119,6 +218,12 @@ err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 		p->clocken = RCC_PERIPH_UART4;
 		p->gpio_af = GPIOAF_UART4;
 		ASSIGN_IRQ_PORT(4, p);
+#if uHAL_USE_UART_TX_DMA
+		tx_dma = DMA_UART4_TX;
+#endif
+#if uHAL_USE_UART_RX_DMA
+		rx_dma = DMA_UART4_RX;
+#endif
 #endif
 #if HAVE_UART5
 	} else if (IS_UART5_STRUCT(conf)) {
@@ -127,6 +232,12 @@ err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 		p->clocken = RCC_PERIPH_UART5;
 		p->gpio_af = GPIOAF_UART5;
 		ASSIGN_IRQ_PORT(5, p);
+#if uHAL_USE_UART_TX_DMA
+		tx_dma = DMA_UART5_TX;
+#endif
+#if uHAL_USE_UART_RX_DMA
+		rx_dma = DMA_UART5_RX;
+#endif
 #endif
 #if HAVE_UART7
 	} else if (IS_UART7_STRUCT(conf)) {
@@ -135,6 +246,12 @@ err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 		p->clocken = RCC_PERIPH_UART7;
 		p->gpio_af = GPIOAF_UART7;
 		ASSIGN_IRQ_PORT(7, p);
+#if uHAL_USE_UART_TX_DMA
+		tx_dma = DMA_UART7_TX;
+#endif
+#if uHAL_USE_UART_RX_DMA
+		rx_dma = DMA_UART7_RX;
+#endif
 #endif
 #if HAVE_UART8
 	} else if (IS_UART8_STRUCT(conf)) {
@@ -143,14 +260,45 @@ err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 		p->clocken = RCC_PERIPH_UART8;
 		p->gpio_af = GPIOAF_UART8;
 		ASSIGN_IRQ_PORT(8, p);
+#if uHAL_USE_UART_TX_DMA
+		tx_dma = DMA_UART8_TX;
+#endif
+#if uHAL_USE_UART_RX_DMA
+		rx_dma = DMA_UART8_RX;
+#endif
 #endif
 
 	} else {
 		return ERR_NOTSUP;
 	}
 
+#if ENABLE_UART_FLOW_CONTROL
+	// CTS is handled by the peripheral so it has to be the peripheral's own
+	// pin, but RTS needs to follow the rx buffer rather than the data register
+	// so it's driven in software and can be any pin
+	if ((conf->cts_pin != 0) && !uart_is_cts_pin(p, conf->cts_pin)) {
+		return ERR_BADARG;
+	}
+	// With RX DMA the fill level of the rx buffer is only seen at the HT, TC,
+	// and IDLE interrupts and the controller keeps writing to it regardless,
+	// so RTS couldn't be relied on to prevent an overrun
+# if UART_INPUT_BUFFER_BYTES <= 0 || ! ENABLE_UART_LISTENING || uHAL_USE_UART_RX_DMA
+	if (conf->rts_pin != 0) {
+		return ERR_NOTSUP;
+	}
+# endif
+#else
+	if ((conf->rts_pin != 0) || (conf->cts_pin != 0)) {
+		return ERR_NOTSUP;
+	}
+#endif
+
 	p->rx_pin = conf->rx_pin;
 	p->tx_pin = conf->tx_pin;
+#if ENABLE_UART_FLOW_CONTROL
+	p->rts_pin = conf->rts_pin;
+	p->cts_pin = conf->cts_pin;
+#endif
 
 	clock_init(p->clocken);
 
@@ -165,29 +313,46 @@ err_t uart_init_port(uart_port_t *p, const uart_port_cfg_t *conf) {
 	MODIFY_BITS(p->uartx->CR2, USART_CR2_STOP,
 		(0b00 << USART_CR2_STOP_Pos) | // Keep at 00 for 1 stop bit
 		0);
+#if ENABLE_UART_FLOW_CONTROL
+	MODIFY_BITS(p->uartx->CR3, USART_CR3_CTSE|USART_CR3_RTSE,
+		((p->cts_pin != 0) ? USART_CR3_CTSE : 0) | // Hold off transmission while CTS is high
+		(0b0 << USART_CR3_RTSE_Pos) | // RTS is handled in software
+		0);
+#endif
 
-	switch (SELECT_BITS(p->clocken, RCC_BUS_MASK)) {
-	case RCC_BUS_APB1:
-		tmp = G_freq_PCLK1;
-		break;
-	case RCC_BUS_APB2:
-		tmp = G_freq_PCLK2;
-		break;
-	case RCC_BUS_AHB1:
-		tmp = G_freq_HCLK;
-		break;
-	default:
+	tmp = uart_busfreq(p);
+	if (tmp == 0) {
 		return ERR_UNKNOWN;
-		break;
 	}
-	tmp = calculate_baud_div(conf->baud_rate, tmp);
+	tmp = uart_calc_brr(conf->baud_rate, tmp, HAVE_UART_OVER8, &over8);
 	if (tmp == 0) {
 		return ERR_IMPOSSIBLE;
 	}
+	// OVER8 can only be changed while the UART is disabled, which it was above
+#if HAVE_UART_OVER8
+	if (over8) {
+		SET_BIT(p->uartx->CR1, USART_CR1_OVER8);
+	} else {
+		CLEAR_BIT(p->uartx->CR1, USART_CR1_OVER8);
+	}
+#endif
 	p->uartx->BRR = (uint16_t )tmp;
 
-#if UART_INPUT_BUFFER_BYTES > 0
-	p->rx_buf.bytes = 0;
+#if UART_INPUT_BUFFER_BYTES > 0 && ENABLE_UART_LISTENING
+	uart_buffer_reset(&p->rx_buf);
+#endif
+#if ENABLE_UART_STATS
+	uart_stats_reset(p);
+#endif
+#if uHAL_USE_UART_TX_DMA
+	// A UART without a DMA stream is still usable, it just can't do
+	// asynchronous transmission
+	dma_stream_init(&p->tx_dma, tx_dma, tx_dma_callback, p);
+	p->tx_callback = NULL;
+#endif
+#if uHAL_USE_UART_RX_DMA
+	// A UART without a DMA stream falls back to using the RXNE interrupt
+	dma_stream_init(&p->rx_dma, rx_dma, rx_dma_callback, p);
 #endif
 
 	NVIC_SetPriority(p->irqn, UART_IRQp);
@@ -211,6 +376,18 @@ static void pins_on(const uart_port_t *p) {
 	gpio_set_mode(p->tx_pin, GPIO_MODE_PP_AF, GPIO_FLOAT);
 	gpio_set_mode(p->rx_pin, GPIO_MODE_IN_AF, GPIO_FLOAT);
 
+#if ENABLE_UART_FLOW_CONTROL
+	if (p->cts_pin != 0) {
+		gpio_set_AF(p->cts_pin, p->gpio_af);
+		gpio_set_mode(p->cts_pin, GPIO_MODE_IN_AF, GPIO_FLOAT);
+	}
+# if UART_INPUT_BUFFER_BYTES > 0 && ENABLE_UART_LISTENING
+	if (p->rts_pin != 0) {
+		gpio_set_mode(p->rts_pin, GPIO_MODE_PP, uart_rts_state(p));
+	}
+# endif
+#endif
+
 	return;
 }
 static void pins_off(const uart_port_t *p) {
@@ -218,6 +395,14 @@ static void pins_off(const uart_port_t *p) {
 
 	gpio_set_mode(p->tx_pin, GPIO_MODE_RESET, GPIO_FLOAT);
 	gpio_set_mode(p->rx_pin, GPIO_MODE_RESET, GPIO_FLOAT);
+#if ENABLE_UART_FLOW_CONTROL
+	if (p->cts_pin != 0) {
+		gpio_set_mode(p->cts_pin, GPIO_MODE_RESET, GPIO_FLOAT);
+	}
+	if (p->rts_pin != 0) {
+		gpio_set_mode(p->rts_pin, GPIO_MODE_RESET, GPIO_FLOAT);
+	}
+#endif
 
 	return;
 }
@@ -258,6 +443,13 @@ err_t uart_off(const uart_port_t *p) {
 	}
 #endif
 
+#if uHAL_USE_UART_TX_DMA
+	// Any transmission in progress is abandoned without calling the callback
+	if (dma_stream_is_valid(&p->tx_dma)) {
+		dma_stream_release(&p->tx_dma);
+		CLEAR_BIT(p->uartx->CR3, USART_CR3_DMAT);
+	}
+#endif
 	CLEAR_BIT(p->uartx->CR1, USART_CR1_UE);
 	while (BIT_IS_SET(p->uartx->CR1, USART_CR1_UE)) {
 		// Nothing to do here
@@ -299,6 +491,35 @@ err_t uart_listen_on(const uart_port_t *p) {
 	}
 #endif
 
+#if uHAL_USE_UART_RX_DMA
+	if (dma_stream_is_valid(&p->rx_dma) && !BIT_IS_SET(p->uartx->CR1, USART_CR1_IDLEIE)) {
+		err_t res;
+		// The port is const to the caller but the buffer belongs to the
+		// driver
+		volatile uart_buffer_t *rx_buf = (volatile uart_buffer_t *)&p->rx_buf;
+
+		// The registers can't be written with the clock off
+		if (!clock_is_enabled(p->clocken)) {
+			return ERR_INIT;
+		}
+		if ((res = dma_stream_claim(&p->rx_dma)) != ERR_OK) {
+			return res;
+		}
+
+		// The controller always starts over at the beginning of the buffer,
+		// so anything left in it is lost
+		rx_buf->head = 0;
+		rx_buf->tail = 0;
+		dma_stream_start(&p->rx_dma, &p->uartx->DR, p->rx_buf.buffer, UART_INPUT_BUFFER_BYTES,
+			DMA_CFG_PERIPH_TO_MEM | DMA_CFG_MINC | DMA_CFG_CIRC | DMA_CFG_IRQ_HT | DMA_CFG_IRQ_TC | DMA_CFG_IRQ_TE);
+		SET_BIT(p->uartx->CR3, USART_CR3_DMAR);
+		MODIFY_BITS(p->uartx->CR1, USART_CR1_RXNEIE|USART_CR1_IDLEIE,
+			(0b0 << USART_CR1_RXNEIE_Pos) | // RXNE interrupt disable
+			(0b1 << USART_CR1_IDLEIE_Pos) | // IDLE interrupt enable
+			0);
+	}
+#endif
+
 	NVIC_ClearPendingIRQ(p->irqn);
 	NVIC_EnableIRQ(p->irqn);
 
@@ -321,6 +542,20 @@ err_t uart_listen_off(const uart_port_t *p) {
 	NVIC_DisableIRQ(p->irqn);
 	NVIC_ClearPendingIRQ(p->irqn);
 
+#if uHAL_USE_UART_RX_DMA
+	if (dma_stream_is_valid(&p->rx_dma) && BIT_IS_SET(p->uartx->CR1, USART_CR1_IDLEIE)) {
+		MODIFY_BITS(p->uartx->CR1, USART_CR1_RXNEIE|USART_CR1_IDLEIE,
+			(0b1 << USART_CR1_RXNEIE_Pos) | // RXNE interrupt enable
+			(0b0 << USART_CR1_IDLEIE_Pos) | // IDLE interrupt disable
+			0);
+		// Anything received before now stays in the buffer
+		dma_stream_stop(&p->rx_dma);
+		rx_dma_sync_head((uart_port_t *)p);
+		CLEAR_BIT(p->uartx->CR3, USART_CR3_DMAR);
+		dma_stream_release(&p->rx_dma);
+	}
+#endif
+
 	return ERR_OK;
 }
 bool uart_is_listening(const uart_port_t *p) {
@@ -342,40 +577,185 @@ bool uart_is_listening(const uart_port_t *p) {
 bool uart_rx_is_available(const uart_port_t *p) {
 #if UART_INPUT_BUFFER_BYTES > 0
 	SET_DEFAULT_PORT(p);
-	return (p->rx_buf.bytes != 0);
+	return (UART_BUFFER_HEAD(p) != p->rx_buf.tail);
 #else
 	UNUSED(p);
 	return false;
 #endif
 }
+uint_fast16_t uart_rx_overrun_count(const uart_port_t *p) {
+#if UART_INPUT_BUFFER_BYTES > 0
+	SET_DEFAULT_PORT(p);
+	return p->rx_buf.overruns;
+#else
+	UNUSED(p);
+	return 0;
+#endif
+}
+err_t uart_rx_peek(uart_port_t *p, const uint8_t **data, txsize_t *size) {
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p != NULL);
+	uHAL_assert(data != NULL);
+	uHAL_assert(size != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((p == NULL) || (data == NULL) || (size == NULL)) {
+		return ERR_BADARG;
+	}
+#endif
+
+#if UART_INPUT_BUFFER_BYTES > 0
+	*size = peek_uart_buffer(p, data);
+	return ERR_OK;
+#else
+	*data = NULL;
+	*size = 0;
+	return ERR_NOTSUP;
+#endif
+}
+err_t uart_rx_consume(uart_port_t *p, txsize_t size) {
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (p == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+#if UART_INPUT_BUFFER_BYTES > 0
+	if (consume_uart_buffer(p, size) != size) {
+		return ERR_BADARG;
+	}
+	return ERR_OK;
+#else
+	UNUSED(size);
+	return ERR_NOTSUP;
+#endif
+}
+#if ENABLE_UART_LINE_MODE
+err_t uart_rx_set_delimiters(uart_port_t *p, const char *delims) {
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (p == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	uart_buffer_set_delimiters(&p->rx_buf, delims);
+
+	return ERR_OK;
+}
+bool uart_rx_line_is_available(const uart_port_t *p) {
+	SET_DEFAULT_PORT(p);
+	return uart_buffer_line_is_available(&p->rx_buf, UART_BUFFER_HEAD(p));
+}
+#endif // ENABLE_UART_LINE_MODE
 #endif // ENABLE_UART_LISTENING
 
+#if ENABLE_UART_STATS
+err_t uart_get_stats(const uart_port_t *p, uart_stats_t *stats) {
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p != NULL);
+	uHAL_assert(stats != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((p == NULL) || (stats == NULL)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	// The counters are all word-sized so they can't be torn, and a snapshot
+	// that's a byte or two out of date relative to itself is fine
+	uart_stats_copy(p, stats);
+
+	return ERR_OK;
+}
+err_t uart_clear_stats(uart_port_t *p) {
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (p == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	uart_stats_reset(p);
+
+	return ERR_OK;
+}
+#endif // ENABLE_UART_STATS
+
 err_t uart_transmit_block(uart_port_t *p, const uint8_t *buffer, txsize_t size, utime_t timeout) {
+	uart_iovec_t iov = { buffer, size };
+
+	uHAL_assert(buffer != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (buffer == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	return uart_transmit_iov(p, &iov, 1, timeout);
+}
+err_t uart_transmit_iov(uart_port_t *p, const uart_iovec_t *iov, uint_fast8_t iovcnt, utime_t timeout) {
 	err_t res;
 
 	SET_DEFAULT_PORT(p);
 
 	uHAL_assert(p != NULL);
 	uHAL_assert(p->uartx != NULL);
-	uHAL_assert(buffer != NULL);
+	uHAL_assert(iov != NULL);
 #if ! uHAL_SKIP_INVALID_ARG_CHECKS
-	if (p == NULL || buffer == NULL) {
+	if (p == NULL || iov == NULL) {
 		return ERR_BADARG;
 	}
 	if (p->uartx == NULL) {
 		return ERR_INIT;
 	}
+	for (uint_fast8_t s = 0; s < iovcnt; ++s) {
+		if ((iov[s].data == NULL) && (iov[s].size != 0)) {
+			return ERR_BADARG;
+		}
+	}
 #endif
 
 	res = ERR_OK;
 	timeout = SET_TIMEOUT_MS(timeout);
+#if ENABLE_UART_STATS
+	// The whole call is spent waiting on the peripheral one way or another
+	utime_t stall_start = NOW_MS();
+#endif
 
-	for (txsize_t i = 0; i < size; ++i) {
-		p->uartx->DR = buffer[i];
-		while (!BIT_IS_SET(p->uartx->SR, USART_SR_TXE)) {
-			if (TIMES_UP(timeout)) {
-				res = ERR_TIMEOUT;
-				goto END;
+#if uHAL_USE_UART_TX_DMA
+	// Let any asynchronous transmission finish first so the output doesn't
+	// get mixed up
+	// DMAT is checked rather than the stream because the stream may be in use
+	// by a peripheral sharing it once this port's transmission is done
+	while (BIT_IS_SET(p->uartx->CR3, USART_CR3_DMAT)) {
+		if (TIMES_UP(timeout)) {
+			res = ERR_TIMEOUT;
+			goto END;
+		}
+	}
+#endif
+
+	// Only the end of the last segment is waited on so that the data register
+	// is kept full across segment boundaries
+	for (uint_fast8_t s = 0; s < iovcnt; ++s) {
+		const uint8_t *buffer = iov[s].data;
+
+		for (txsize_t i = 0; i < iov[s].size; ++i) {
+			p->uartx->DR = buffer[i];
+			UART_STATS_ADD(p, tx_bytes, 1U);
+			while (!BIT_IS_SET(p->uartx->SR, USART_SR_TXE)) {
+				if (TIMES_UP(timeout)) {
+					res = ERR_TIMEOUT;
+					goto END;
+				}
 			}
 		}
 	}
@@ -387,6 +767,7 @@ err_t uart_transmit_block(uart_port_t *p, const uint8_t *buffer, txsize_t size,
 	}
 
 END:
+	UART_STATS_ADD(p, tx_stall_ms, NOW_MS() - stall_start);
 	return res;
 }
 err_t uart_receive_block(uart_port_t *p, uint8_t *buffer, txsize_t size, utime_t timeout) {
@@ -413,14 +794,29 @@ err_t uart_receive_block(uart_port_t *p, uint8_t *buffer, txsize_t size, utime_t
 	res = ERR_OK;
 	timeout = SET_TIMEOUT_MS(timeout);
 
-#if ENABLE_UART_LISTENING
+	txsize_t i = eat_uart_buffer(p, buffer, size);
+
+#if ENABLE_UART_LISTENING && UART_INPUT_BUFFER_BYTES > 0
+	// When listening, the ISR owns the data register so all we need to do is
+	// wait for it to fill the buffer
+	if (uart_is_listening(p)) {
+		while (i < size) {
+			if (TIMES_UP(timeout)) {
+				res = ERR_TIMEOUT;
+				break;
+			}
+			i += eat_uart_buffer(p, &buffer[i], size - i);
+		}
+		return res;
+	}
+#elif ENABLE_UART_LISTENING
 	bool reenable_listen = uart_is_listening(p);
 	if (reenable_listen) {
 		uart_listen_off(p);
 	}
 #endif
 
-	for (txsize_t i = eat_uart_buffer(p, buffer, size); i < size; ++i) {
+	for (; i < size; ++i) {
 		while (!BIT_IS_SET(p->uartx->SR, USART_SR_RXNE)) {
 			if (TIMES_UP(timeout)) {
 				res = ERR_TIMEOUT;
@@ -428,10 +824,11 @@ err_t uart_receive_block(uart_port_t *p, uint8_t *buffer, txsize_t size, utime_t
 			}
 		}
 		buffer[i] = p->uartx->DR;
+		UART_STATS_ADD(p, rx_bytes, 1U);
 	}
 
 END:
-#if ENABLE_UART_LISTENING
+#if ENABLE_UART_LISTENING && UART_INPUT_BUFFER_BYTES <= 0
 	if (reenable_listen) {
 		uart_listen_on(p);
 	}
@@ -439,27 +836,265 @@ END:
 	return res;
 }
 
-static uint16_t calculate_baud_div(uint32_t baud, uint32_t busfreq) {
-	uint32_t tmp;
+#if uHAL_USE_UART_TX_DMA
+static err_t tx_dma_prepare(uart_port_t *p, uart_tx_callback_t callback) {
+	err_t res;
 
-	uHAL_assert(baud != 0);
-	uHAL_assert(busfreq != 0);
-
-	// From section 27.3.4 of the STM32F1 reference manual:
-	//   baud = pclk/(16*div)
-	// Therefore:
-	//   (16*div) = pclk/baud
-	// The baud rate is programmed into a 16-bit register configured as a
-	// fixed-point rational number with 12 bits of mantissa and 4 bits of
-	// fractional part, which (I think) makes the whole register (16*div).
-	// That makes more sense to me than the description in the reference manual
-	// does.
-	tmp = busfreq/baud;
-	if (tmp > 0xFFFFU) {
-		return 0;
+	if (!dma_stream_is_valid(&p->tx_dma)) {
+		return ERR_NOTSUP;
+	}
+	// The stream is claimed here rather than at initialization and released
+	// by tx_dma_callback() so that a peripheral sharing it can still use it
+	// as long as this port isn't transmitting asynchronously at the same time
+	if ((res = dma_stream_claim(&p->tx_dma)) != ERR_OK) {
+		return res;
+	}
+	if (dma_stream_is_enabled(&p->tx_dma)) {
+		return ERR_RETRY;
+	}
+
+	p->tx_callback = callback;
+	// TC is cleared by writing 0 to it; writing 1 to the other bits in SR has
+	// no effect, which avoids a read-modify-write race with RXNE
+	p->uartx->SR = ~USART_SR_TC;
+
+	return ERR_OK;
+}
+static void tx_dma_start(uart_port_t *p, const uint8_t *buffer, txsize_t size) {
+	UART_STATS_ADD(p, tx_bytes, size);
+	dma_stream_start(&p->tx_dma, &p->uartx->DR, buffer, (uint16_t )size,
+		DMA_CFG_MEM_TO_PERIPH | DMA_CFG_MINC | DMA_CFG_IRQ_TC | DMA_CFG_IRQ_TE);
+	SET_BIT(p->uartx->CR3, USART_CR3_DMAT);
+
+	return;
+}
+//
+// Start the next non-empty segment of a scatter-gather transmission
+// Returns false if there aren't any left
+static bool tx_dma_next_iov(uart_port_t *p) {
+	while (p->tx_iovcnt > 0) {
+		const uart_iovec_t *iov = p->tx_iov;
+
+		++p->tx_iov;
+		--p->tx_iovcnt;
+		if (iov->size != 0) {
+			tx_dma_start(p, iov->data, iov->size);
+			return true;
+		}
 	}
-	return tmp;
+
+	return false;
 }
+err_t uart_transmit_async(uart_port_t *p, const uint8_t *buffer, txsize_t size, uart_tx_callback_t callback) {
+	err_t res;
+
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p != NULL);
+	uHAL_assert(p->uartx != NULL);
+	uHAL_assert(buffer != NULL);
+	uHAL_assert(size > 0);
+	uHAL_assert(size <= 0xFFFFU);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (p == NULL || buffer == NULL) {
+		return ERR_BADARG;
+	}
+	// The DMA transfer count register is only 16 bits
+	if ((size == 0) || (size > 0xFFFFU)) {
+		return ERR_BADARG;
+	}
+	if (p->uartx == NULL) {
+		return ERR_INIT;
+	}
+#endif
+
+	if ((res = tx_dma_prepare(p, callback)) != ERR_OK) {
+		return res;
+	}
+	p->tx_iovcnt = 0;
+	tx_dma_start(p, buffer, size);
 
+	return ERR_OK;
+}
+err_t uart_transmit_iov_async(uart_port_t *p, const uart_iovec_t *iov, uint_fast8_t iovcnt, uart_tx_callback_t callback) {
+	err_t res;
+
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p != NULL);
+	uHAL_assert(p->uartx != NULL);
+	uHAL_assert(iov != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (p == NULL || iov == NULL) {
+		return ERR_BADARG;
+	}
+	for (uint_fast8_t s = 0; s < iovcnt; ++s) {
+		if ((iov[s].data == NULL && iov[s].size != 0) || (iov[s].size > 0xFFFFU)) {
+			return ERR_BADARG;
+		}
+	}
+	if (p->uartx == NULL) {
+		return ERR_INIT;
+	}
+#endif
+
+	if ((res = tx_dma_prepare(p, callback)) != ERR_OK) {
+		return res;
+	}
+	p->tx_iov = iov;
+	p->tx_iovcnt = iovcnt;
+	if (!tx_dma_next_iov(p)) {
+		dma_stream_release(&p->tx_dma);
+		// Nothing to send, but the caller may be depending on the callback
+		if (callback != NULL) {
+			callback(p, ERR_OK);
+		}
+	}
+
+	return ERR_OK;
+}
+bool uart_tx_is_busy(const uart_port_t *p) {
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p != NULL);
+	uHAL_assert(p->uartx != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (p == NULL) {
+		return false;
+	}
+	if (p->uartx == NULL) {
+		return false;
+	}
+#endif
+
+	if (BIT_IS_SET(p->uartx->CR3, USART_CR3_DMAT)) {
+		return true;
+	}
+	// The DMA transfer finishes when the last byte is loaded into the data
+	// register, the UART still needs to shift it out
+	return (uart_is_on(p) && !BIT_IS_SET(p->uartx->SR, USART_SR_TC));
+}
+static void tx_dma_callback(void *arg, uint_fast8_t flags) {
+	uart_port_t *p = arg;
+	err_t res;
+
+	res = BIT_IS_SET(flags, DMA_FLAG_TE) ? ERR_IO : ERR_OK;
+
+	dma_stream_stop(&p->tx_dma);
+	// The UART is still shifting out the last byte of the segment so there's
+	// no gap on the line as long as the next one starts right away
+	if ((res == ERR_OK) && tx_dma_next_iov(p)) {
+		return;
+	}
+	p->tx_iovcnt = 0;
+	CLEAR_BIT(p->uartx->CR3, USART_CR3_DMAT);
+	// Let anything sharing the stream have it until the next transmission
+	dma_stream_release(&p->tx_dma);
+
+	// The callback is called last so that it can start another transmission
+	if (p->tx_callback != NULL) {
+		p->tx_callback(p, res);
+	}
+
+	return;
+}
+#endif // uHAL_USE_UART_TX_DMA
+
+#if uHAL_USE_UART_RX_DMA
+static void rx_dma_callback(void *arg, uint_fast8_t flags) {
+	uart_port_t *p = arg;
+
+	rx_dma_sync_head(p);
+
+	// A transfer error disables the stream; whatever was received up to that
+	// point is still good but from here on fall back to the RXNE interrupt
+	// until listening is turned off and back on
+	if (BIT_IS_SET(flags, DMA_FLAG_TE)) {
+		MODIFY_BITS(p->uartx->CR1, USART_CR1_RXNEIE|USART_CR1_IDLEIE,
+			(0b1 << USART_CR1_RXNEIE_Pos) | // RXNE interrupt enable
+			(0b0 << USART_CR1_IDLEIE_Pos) | // IDLE interrupt disable
+			0);
+		CLEAR_BIT(p->uartx->CR3, USART_CR3_DMAR);
+		dma_stream_release(&p->rx_dma);
+	}
+
+	return;
+}
+#endif // uHAL_USE_UART_RX_DMA
+
+static uint32_t uart_busfreq(const uart_port_t *p) {
+	switch (SELECT_BITS(p->clocken, RCC_BUS_MASK)) {
+	case RCC_BUS_APB1:
+		return G_freq_PCLK1;
+	case RCC_BUS_APB2:
+		return G_freq_PCLK2;
+	case RCC_BUS_AHB1:
+		return G_freq_HCLK;
+	}
+
+	return 0;
+}
+#if ENABLE_UART_FLOW_CONTROL
+static bool uart_is_cts_pin(const uart_port_t *p, gpio_pin_t pin) {
+	if (false) {
+		// Nothing to do here
+#if HAVE_UART1
+	} else if (p->uartx == USART1) {
+		return IS_UART1_CTS(pin);
+#endif
+#if HAVE_UART2
+	} else if (p->uartx == USART2) {
+		return IS_UART2_CTS(pin);
+#endif
+#if HAVE_UART3
+	} else if (p->uartx == USART3) {
+		return IS_UART3_CTS(pin);
+#endif
+#if HAVE_UART6
+	} else if (p->uartx == USART6) {
+		return IS_UART6_CTS(pin);
+#endif
+#if HAVE_UART4
+	} else if (p->uartx == USART4) {
+		return IS_UART4_CTS(pin);
+#endif
+#if HAVE_UART5
+	} else if (p->uartx == USART5) {
+		return IS_UART5_CTS(pin);
+#endif
+#if HAVE_UART7
+	} else if (p->uartx == USART7) {
+		return IS_UART7_CTS(pin);
+#endif
+#if HAVE_UART8
+	} else if (p->uartx == USART8) {
+		return IS_UART8_CTS(pin);
+#endif
+	}
+
+	return false;
+}
+#endif // ENABLE_UART_FLOW_CONTROL
+uint32_t uart_get_baud_rate(const uart_port_t *p) {
+	bool over8 = false;
+
+	SET_DEFAULT_PORT(p);
+
+	uHAL_assert(p != NULL);
+	uHAL_assert(p->uartx != NULL);
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (p == NULL) {
+		return 0;
+	}
+	if (p->uartx == NULL) {
+		return 0;
+	}
+#endif
+
+#if HAVE_UART_OVER8
+	over8 = BIT_IS_SET(p->uartx->CR1, USART_CR1_OVER8);
+#endif
+	return uart_calc_baud((uint16_t )p->uartx->BRR, uart_busfreq(p), over8);
+}
 
 #endif // uHAL_USE_UART
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/***********************************************************************
+*                                                                      *
+*                                                                      *
+* Copyright 2021, 2024 svijsv                                          *
+* This program is free software: you can redistribute it and/or modify *
+* it under the terms of the GNU General Public License as published by *
+* the Free Software Foundation, version 3.                             *
+*                                                                      *
+* This program is distributed in the hope that it will be useful, but  *
+* WITHOUT ANY WARRANTY; without even the implied warranty of           *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+* General Public License for more details.                             *
+*                                                                      *
+* You should have received a copy of the GNU General Public License    *
+* along with this program.  If not, see <http:// www.gnu.org/licenses/>.*
+*                                                                      *
+*                                                                      *
+***********************************************************************/
+// uart_calc_brr.h
+// Calculate UART baud rate register values
+// NOTES:
+//   This file is meant for direct inclusion by uart.c and doesn't depend on
+//   anything device-specific so that it can also be tested on the host
+//
+//   From section 27.3.4 of the STM32F1 reference manual (and the equivalent
+//   section of the F4 manual):
+//     baud = pclk/(8*(2-OVER8)*USARTDIV)
+//   USARTDIV is programmed into BRR as a fixed-point number with 12 bits of
+//   mantissa and 4 bits of fraction. With OVER8 set, the fraction is only 3
+//   bits and BRR[3] must be kept clear.
+//
+//   Either way, the number of bus clock cycles per bit is:
+//     div = pclk/baud = 8*(2-OVER8)*USARTDIV
+//   which with OVER8 clear is exactly the BRR value and with OVER8 set is the
+//   BRR value with the mantissa shifted down one bit. Oversampling by 8 doesn't
+//   allow any finer steps than oversampling by 16, it only allows smaller
+//   divisors (8 rather than 16), so it's only used when the baud rate can't
+//   be reached otherwise; the receiver is less tolerant of clock mismatch
+//   with it.
+//
+#ifndef _uHAL_PLATFORM_CMSIS_UART_CALC_BRR_H
+#define _uHAL_PLATFORM_CMSIS_UART_CALC_BRR_H
+
+
+#define UART_BRR_MIN_DIV_OVER16 16U
+#define UART_BRR_MIN_DIV_OVER8  8U
+#define UART_BRR_MAX_DIV_OVER16 0xFFFFU
+#define UART_BRR_MAX_DIV_OVER8  0x7FFFU
+
+//
+// Calculate the BRR value for the baud rate closest to 'baud'
+// '*over8' is set to true if the OVER8 bit needs to be set, which is only
+// done if 'allow_over8' is true
+// Returns 0 if the baud rate can't be reached
+INLINE uint16_t uart_calc_brr(uint32_t baud, uint32_t busfreq, bool allow_over8, bool *over8) {
+	uint32_t div;
+
+	*over8 = false;
+	if (baud == 0) {
+		return 0;
+	}
+
+	// Round to the nearest divisor rather than truncating, truncating always
+	// errs on the fast side and by up to a whole step
+	div = (busfreq / baud) + (((busfreq % baud) >= ((baud + 1U) / 2U)) ? 1U : 0U);
+	if (div > UART_BRR_MAX_DIV_OVER16) {
+		return 0;
+	}
+	if (div >= UART_BRR_MIN_DIV_OVER16) {
+		return (uint16_t )div;
+	}
+	if (!allow_over8 || (div < UART_BRR_MIN_DIV_OVER8)) {
+		return 0;
+	}
+
+	*over8 = true;
+	return (uint16_t )(((div & ~0x07U) << 1U) | (div & 0x07U));
+}
+//
+// Calculate the baud rate resulting from a BRR value
+INLINE uint32_t uart_calc_baud(uint16_t brr, uint32_t busfreq, bool over8) {
+	uint32_t div;
+
+	div = (over8) ? (((uint32_t )brr & ~0x0FU) >> 1U) | (brr & 0x07U) : brr;
+	if (div == 0) {
+		return 0;
+	}
+
+	return (busfreq + (div / 2U)) / div;
+}
+
+
+#endif // _uHAL_PLATFORM_CMSIS_UART_CALC_BRR_H
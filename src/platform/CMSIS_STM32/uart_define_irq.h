@@ -1,34 +1,92 @@
 //
-// Generated by tools/cmsis/uart_define_irq.sh on Thu Aug  8 06:39:17 PM EDT 2024
+// Generated by tools/cmsis/uart_define_irq.sh on Fri Oct 16 22:45:01 UTC 2026
 //
 
 #if ENABLE_UART_LISTENING
 
 #define ASSIGN_IRQ_PORT(_irqn_, _p_) do { uart ## _irqn_ ## _port = (_p_); } while (0);
 
+#if ENABLE_UART_STATS
+//
+// The error flags are cleared by reading SR followed by DR, so this needs
+// to be passed an SR value read before the data is
+static void UARTx_count_errors(uart_port_t *p, uint32_t sr) {
+	if (BIT_IS_SET(sr, USART_SR_ORE)) {
+		++p->stats.overrun_errors;
+	}
+	if (BIT_IS_SET(sr, USART_SR_FE)) {
+		++p->stats.framing_errors;
+	}
+	if (BIT_IS_SET(sr, USART_SR_NE)) {
+		++p->stats.noise_errors;
+	}
+
+	return;
+}
+#else
+# define UARTx_count_errors(_p_, _sr_) ((void )0U)
+#endif
+
 static void UARTx_RXNE_IRQHandler(uart_port_t *p) {
+	UARTx_count_errors(p, p->uartx->SR);
+	// The byte needs to be read even if there's no room for it or else we'll
+	// just immediately re-enter this interrupt
+	uint8_t rx = p->uartx->DR;
+
+	UART_STATS_ADD(p, rx_bytes, 1U);
 #if UART_INPUT_BUFFER_BYTES > 0
-	if (p->rx_buf.bytes < UART_INPUT_BUFFER_BYTES) {
-		p->rx_buf.buffer[p->rx_buf.bytes] = p->uartx->DR;
-		++p->rx_buf.bytes;
-	} else
+	uart_buffer_size_t from = p->rx_buf.head;
+
+	uart_buffer_push(&p->rx_buf, rx);
+	uart_buffer_pushed(p, from);
+#else
+	UNUSED(rx);
+	UART_STATS_ADD(p, rx_dropped, 1U);
 #endif // UART_INPUT_BUFFER_BYTES > 0
-	{
-		// We still need to read the byte or else we'll just immediately re-enter
-		// this interrupt
-		uint8_t rx = p->uartx->DR;
-		UNUSED(rx);
-	}
-	//
-	// By doing this instead, we can tell if we missed anything by checking if bytes > UART_INPUT_BUFFER_BYTES
-	//p->rx_buf.buffer[p->rx_buf.bytes % UART_INPUT_BUFFER_BYTES] = p->uartx->DR;
-	//++p->rx_buf.bytes;
 
 	//NVIC_DisableIRQ(p->irqn);
 	NVIC_ClearPendingIRQ(p->irqn);
 
+#if UART_INPUT_BUFFER_BYTES > 0
+	if (uart_buffer_hook_is_due(&p->rx_buf)) {
+		uart_rx_irq_hook(p);
+	}
+#else
+	uart_rx_irq_hook(p);
+#endif
+
+	return;
+}
+
+#if uHAL_USE_UART_RX_DMA
+//
+// When receiving with DMA, the RXNE flag is set briefly for every byte and the
+// IDLE flag is set any time the line goes idle so the enable bits need to be
+// checked too; reading DR when the DMA controller should have would lose the
+// byte
+# define RXNE_IS_PENDING(_p_) (BIT_IS_SET((_p_)->uartx->SR, USART_SR_RXNE) && BIT_IS_SET((_p_)->uartx->CR1, USART_CR1_RXNEIE))
+# define IDLE_IS_PENDING(_p_) (BIT_IS_SET((_p_)->uartx->SR, USART_SR_IDLE) && BIT_IS_SET((_p_)->uartx->CR1, USART_CR1_IDLEIE))
+
+static void UARTx_IDLE_IRQHandler(uart_port_t *p) {
+	// When receiving with DMA the error flags are only sampled here, so
+	// several errors between idle periods may be counted as one
+	UARTx_count_errors(p, p->uartx->SR);
+	// IDLE is cleared by reading SR followed by DR; the DMA controller has
+	// already taken any data
+	(void )p->uartx->DR;
+
+	rx_dma_sync_head(p);
+	NVIC_ClearPendingIRQ(p->irqn);
+
+	if (uart_buffer_hook_is_due(&p->rx_buf)) {
+		uart_rx_irq_hook(p);
+	}
+
 	return;
 }
+#else
+# define RXNE_IS_PENDING(_p_) (BIT_IS_SET((_p_)->uartx->SR, USART_SR_RXNE))
+#endif
 
 
 //
@@ -38,10 +96,14 @@ static void UARTx_RXNE_IRQHandler(uart_port_t *p) {
 static uart_port_t *uart1_port;
 //__attribute__((weak))
 void USART1_IRQHandler(void) {
-	if (BIT_IS_SET(uart1_port->uartx->SR, USART_SR_RXNE)) {
+	if (RXNE_IS_PENDING(uart1_port)) {
 		UARTx_RXNE_IRQHandler(uart1_port);
-		uart_rx_irq_hook(uart1_port);
 	}
+#if uHAL_USE_UART_RX_DMA
+	if (IDLE_IS_PENDING(uart1_port)) {
+		UARTx_IDLE_IRQHandler(uart1_port);
+	}
+#endif
 
 	return;
 }
@@ -54,10 +116,14 @@ void USART1_IRQHandler(void) {
 static uart_port_t *uart2_port;
 //__attribute__((weak))
 void USART2_IRQHandler(void) {
-	if (BIT_IS_SET(uart2_port->uartx->SR, USART_SR_RXNE)) {
+	if (RXNE_IS_PENDING(uart2_port)) {
 		UARTx_RXNE_IRQHandler(uart2_port);
-		uart_rx_irq_hook(uart2_port);
 	}
+#if uHAL_USE_UART_RX_DMA
+	if (IDLE_IS_PENDING(uart2_port)) {
+		UARTx_IDLE_IRQHandler(uart2_port);
+	}
+#endif
 
 	return;
 }
@@ -70,10 +136,14 @@ void USART2_IRQHandler(void) {
 static uart_port_t *uart3_port;
 //__attribute__((weak))
 void USART3_IRQHandler(void) {
-	if (BIT_IS_SET(uart3_port->uartx->SR, USART_SR_RXNE)) {
+	if (RXNE_IS_PENDING(uart3_port)) {
 		UARTx_RXNE_IRQHandler(uart3_port);
-		uart_rx_irq_hook(uart3_port);
 	}
+#if uHAL_USE_UART_RX_DMA
+	if (IDLE_IS_PENDING(uart3_port)) {
+		UARTx_IDLE_IRQHandler(uart3_port);
+	}
+#endif
 
 	return;
 }
@@ -86,10 +156,14 @@ void USART3_IRQHandler(void) {
 static uart_port_t *uart6_port;
 //__attribute__((weak))
 void USART6_IRQHandler(void) {
-	if (BIT_IS_SET(uart6_port->uartx->SR, USART_SR_RXNE)) {
+	if (RXNE_IS_PENDING(uart6_port)) {
 		UARTx_RXNE_IRQHandler(uart6_port);
-		uart_rx_irq_hook(uart6_port);
 	}
+#if uHAL_USE_UART_RX_DMA
+	if (IDLE_IS_PENDING(uart6_port)) {
+		UARTx_IDLE_IRQHandler(uart6_port);
+	}
+#endif
 
 	return;
 }
@@ -102,10 +176,14 @@ void USART6_IRQHandler(void) {
 static uart_port_t *uart4_port;
 //__attribute__((weak))
 void UART4_IRQHandler(void) {
-	if (BIT_IS_SET(uart4_port->uartx->SR, USART_SR_RXNE)) {
+	if (RXNE_IS_PENDING(uart4_port)) {
 		UARTx_RXNE_IRQHandler(uart4_port);
-		uart_rx_irq_hook(uart4_port);
 	}
+#if uHAL_USE_UART_RX_DMA
+	if (IDLE_IS_PENDING(uart4_port)) {
+		UARTx_IDLE_IRQHandler(uart4_port);
+	}
+#endif
 
 	return;
 }
@@ -118,10 +196,14 @@ void UART4_IRQHandler(void) {
 static uart_port_t *uart5_port;
 //__attribute__((weak))
 void UART5_IRQHandler(void) {
-	if (BIT_IS_SET(uart5_port->uartx->SR, USART_SR_RXNE)) {
+	if (RXNE_IS_PENDING(uart5_port)) {
 		UARTx_RXNE_IRQHandler(uart5_port);
-		uart_rx_irq_hook(uart5_port);
 	}
+#if uHAL_USE_UART_RX_DMA
+	if (IDLE_IS_PENDING(uart5_port)) {
+		UARTx_IDLE_IRQHandler(uart5_port);
+	}
+#endif
 
 	return;
 }
@@ -134,10 +216,14 @@ void UART5_IRQHandler(void) {
 static uart_port_t *uart7_port;
 //__attribute__((weak))
 void UART7_IRQHandler(void) {
-	if (BIT_IS_SET(uart7_port->uartx->SR, USART_SR_RXNE)) {
+	if (RXNE_IS_PENDING(uart7_port)) {
 		UARTx_RXNE_IRQHandler(uart7_port);
-		uart_rx_irq_hook(uart7_port);
 	}
+#if uHAL_USE_UART_RX_DMA
+	if (IDLE_IS_PENDING(uart7_port)) {
+		UARTx_IDLE_IRQHandler(uart7_port);
+	}
+#endif
 
 	return;
 }
@@ -150,10 +236,14 @@ void UART7_IRQHandler(void) {
 static uart_port_t *uart8_port;
 //__attribute__((weak))
 void UART8_IRQHandler(void) {
-	if (BIT_IS_SET(uart8_port->uartx->SR, USART_SR_RXNE)) {
+	if (RXNE_IS_PENDING(uart8_port)) {
 		UARTx_RXNE_IRQHandler(uart8_port);
-		uart_rx_irq_hook(uart8_port);
 	}
+#if uHAL_USE_UART_RX_DMA
+	if (IDLE_IS_PENDING(uart8_port)) {
+		UARTx_IDLE_IRQHandler(uart8_port);
+	}
+#endif
 
 	return;
 }
@@ -1,5 +1,5 @@
 //
-// Generated by tools/cmsis/uart_find_periph.sh on Mon Nov 25 03:58:32 PM EST 2024
+// Generated by tools/cmsis/uart_find_periph.sh on Fri Oct 16 22:31:35 UTC 2026
 //
 
 //
@@ -46,6 +46,18 @@
 # endif
 # define IS_UART1_TX(_p_) (IS_UART1_TX_DEF(_p_) || IS_UART1_TX_ALT1(_p_) || IS_UART1_TX_ALT2(_p_))
 
+#if defined(PINID_UART1_CTS) && PINID_UART1_CTS > 0
+#  define IS_UART1_CTS_DEF(_p_) (PINID(_p_) == PINID_UART1_CTS)
+# else
+#  define IS_UART1_CTS_DEF(_p_) (0)
+# endif
+#if defined(PINID_UART1_CTS_ALT) && PINID_UART1_CTS_ALT > 0
+#  define IS_UART1_CTS_ALT1(_p_) (PINID(_p_) == PINID_UART1_CTS_ALT)
+# else
+#  define IS_UART1_CTS_ALT1(_p_) (0)
+# endif
+# define IS_UART1_CTS(_p_) (IS_UART1_CTS_DEF(_p_) || IS_UART1_CTS_ALT1(_p_))
+
 # define IS_UART1(_rxp_, _txp_) (IS_UART1_RX(_rxp_) && IS_UART1_TX(_txp_))
 # define IS_UART1_STRUCT(_p_) (IS_UART1((_p_)->rx_pin, (_p_)->tx_pin))
 
@@ -58,6 +70,7 @@
 
 #else // HAVE_UART1
 # define IS_UART1(_rx_pin_, _tx_pin_) (0)
+# define IS_UART1_CTS(_p_) (0)
 # define IS_UART1_STRUCT(_p_) (0)
 #endif // HAVE_UART1
 
@@ -105,6 +118,18 @@
 # endif
 # define IS_UART2_TX(_p_) (IS_UART2_TX_DEF(_p_) || IS_UART2_TX_ALT1(_p_) || IS_UART2_TX_ALT2(_p_))
 
+#if defined(PINID_UART2_CTS) && PINID_UART2_CTS > 0
+#  define IS_UART2_CTS_DEF(_p_) (PINID(_p_) == PINID_UART2_CTS)
+# else
+#  define IS_UART2_CTS_DEF(_p_) (0)
+# endif
+#if defined(PINID_UART2_CTS_ALT) && PINID_UART2_CTS_ALT > 0
+#  define IS_UART2_CTS_ALT1(_p_) (PINID(_p_) == PINID_UART2_CTS_ALT)
+# else
+#  define IS_UART2_CTS_ALT1(_p_) (0)
+# endif
+# define IS_UART2_CTS(_p_) (IS_UART2_CTS_DEF(_p_) || IS_UART2_CTS_ALT1(_p_))
+
 # define IS_UART2(_rxp_, _txp_) (IS_UART2_RX(_rxp_) && IS_UART2_TX(_txp_))
 # define IS_UART2_STRUCT(_p_) (IS_UART2((_p_)->rx_pin, (_p_)->tx_pin))
 
@@ -117,6 +142,7 @@
 
 #else // HAVE_UART2
 # define IS_UART2(_rx_pin_, _tx_pin_) (0)
+# define IS_UART2_CTS(_p_) (0)
 # define IS_UART2_STRUCT(_p_) (0)
 #endif // HAVE_UART2
 
@@ -164,6 +190,18 @@
 # endif
 # define IS_UART3_TX(_p_) (IS_UART3_TX_DEF(_p_) || IS_UART3_TX_ALT1(_p_) || IS_UART3_TX_ALT2(_p_))
 
+#if defined(PINID_UART3_CTS) && PINID_UART3_CTS > 0
+#  define IS_UART3_CTS_DEF(_p_) (PINID(_p_) == PINID_UART3_CTS)
+# else
+#  define IS_UART3_CTS_DEF(_p_) (0)
+# endif
+#if defined(PINID_UART3_CTS_ALT) && PINID_UART3_CTS_ALT > 0
+#  define IS_UART3_CTS_ALT1(_p_) (PINID(_p_) == PINID_UART3_CTS_ALT)
+# else
+#  define IS_UART3_CTS_ALT1(_p_) (0)
+# endif
+# define IS_UART3_CTS(_p_) (IS_UART3_CTS_DEF(_p_) || IS_UART3_CTS_ALT1(_p_))
+
 # define IS_UART3(_rxp_, _txp_) (IS_UART3_RX(_rxp_) && IS_UART3_TX(_txp_))
 # define IS_UART3_STRUCT(_p_) (IS_UART3((_p_)->rx_pin, (_p_)->tx_pin))
 
@@ -176,6 +214,7 @@
 
 #else // HAVE_UART3
 # define IS_UART3(_rx_pin_, _tx_pin_) (0)
+# define IS_UART3_CTS(_p_) (0)
 # define IS_UART3_STRUCT(_p_) (0)
 #endif // HAVE_UART3
 
@@ -223,6 +262,18 @@
 # endif
 # define IS_UART6_TX(_p_) (IS_UART6_TX_DEF(_p_) || IS_UART6_TX_ALT1(_p_) || IS_UART6_TX_ALT2(_p_))
 
+#if defined(PINID_UART6_CTS) && PINID_UART6_CTS > 0
+#  define IS_UART6_CTS_DEF(_p_) (PINID(_p_) == PINID_UART6_CTS)
+# else
+#  define IS_UART6_CTS_DEF(_p_) (0)
+# endif
+#if defined(PINID_UART6_CTS_ALT) && PINID_UART6_CTS_ALT > 0
+#  define IS_UART6_CTS_ALT1(_p_) (PINID(_p_) == PINID_UART6_CTS_ALT)
+# else
+#  define IS_UART6_CTS_ALT1(_p_) (0)
+# endif
+# define IS_UART6_CTS(_p_) (IS_UART6_CTS_DEF(_p_) || IS_UART6_CTS_ALT1(_p_))
+
 # define IS_UART6(_rxp_, _txp_) (IS_UART6_RX(_rxp_) && IS_UART6_TX(_txp_))
 # define IS_UART6_STRUCT(_p_) (IS_UART6((_p_)->rx_pin, (_p_)->tx_pin))
 
@@ -235,6 +286,7 @@
 
 #else // HAVE_UART6
 # define IS_UART6(_rx_pin_, _tx_pin_) (0)
+# define IS_UART6_CTS(_p_) (0)
 # define IS_UART6_STRUCT(_p_) (0)
 #endif // HAVE_UART6
 
@@ -282,6 +334,18 @@
 # endif
 # define IS_UART4_TX(_p_) (IS_UART4_TX_DEF(_p_) || IS_UART4_TX_ALT1(_p_) || IS_UART4_TX_ALT2(_p_))
 
+#if defined(PINID_UART4_CTS) && PINID_UART4_CTS > 0
+#  define IS_UART4_CTS_DEF(_p_) (PINID(_p_) == PINID_UART4_CTS)
+# else
+#  define IS_UART4_CTS_DEF(_p_) (0)
+# endif
+#if defined(PINID_UART4_CTS_ALT) && PINID_UART4_CTS_ALT > 0
+#  define IS_UART4_CTS_ALT1(_p_) (PINID(_p_) == PINID_UART4_CTS_ALT)
+# else
+#  define IS_UART4_CTS_ALT1(_p_) (0)
+# endif
+# define IS_UART4_CTS(_p_) (IS_UART4_CTS_DEF(_p_) || IS_UART4_CTS_ALT1(_p_))
+
 # define IS_UART4(_rxp_, _txp_) (IS_UART4_RX(_rxp_) && IS_UART4_TX(_txp_))
 # define IS_UART4_STRUCT(_p_) (IS_UART4((_p_)->rx_pin, (_p_)->tx_pin))
 
@@ -294,6 +358,7 @@
 
 #else // HAVE_UART4
 # define IS_UART4(_rx_pin_, _tx_pin_) (0)
+# define IS_UART4_CTS(_p_) (0)
 # define IS_UART4_STRUCT(_p_) (0)
 #endif // HAVE_UART4
 
@@ -341,6 +406,18 @@
 # endif
 # define IS_UART5_TX(_p_) (IS_UART5_TX_DEF(_p_) || IS_UART5_TX_ALT1(_p_) || IS_UART5_TX_ALT2(_p_))
 
+#if defined(PINID_UART5_CTS) && PINID_UART5_CTS > 0
+#  define IS_UART5_CTS_DEF(_p_) (PINID(_p_) == PINID_UART5_CTS)
+# else
+#  define IS_UART5_CTS_DEF(_p_) (0)
+# endif
+#if defined(PINID_UART5_CTS_ALT) && PINID_UART5_CTS_ALT > 0
+#  define IS_UART5_CTS_ALT1(_p_) (PINID(_p_) == PINID_UART5_CTS_ALT)
+# else
+#  define IS_UART5_CTS_ALT1(_p_) (0)
+# endif
+# define IS_UART5_CTS(_p_) (IS_UART5_CTS_DEF(_p_) || IS_UART5_CTS_ALT1(_p_))
+
 # define IS_UART5(_rxp_, _txp_) (IS_UART5_RX(_rxp_) && IS_UART5_TX(_txp_))
 # define IS_UART5_STRUCT(_p_) (IS_UART5((_p_)->rx_pin, (_p_)->tx_pin))
 
@@ -353,6 +430,7 @@
 
 #else // HAVE_UART5
 # define IS_UART5(_rx_pin_, _tx_pin_) (0)
+# define IS_UART5_CTS(_p_) (0)
 # define IS_UART5_STRUCT(_p_) (0)
 #endif // HAVE_UART5
 
@@ -400,6 +478,18 @@
 # endif
 # define IS_UART7_TX(_p_) (IS_UART7_TX_DEF(_p_) || IS_UART7_TX_ALT1(_p_) || IS_UART7_TX_ALT2(_p_))
 
+#if defined(PINID_UART7_CTS) && PINID_UART7_CTS > 0
+#  define IS_UART7_CTS_DEF(_p_) (PINID(_p_) == PINID_UART7_CTS)
+# else
+#  define IS_UART7_CTS_DEF(_p_) (0)
+# endif
+#if defined(PINID_UART7_CTS_ALT) && PINID_UART7_CTS_ALT > 0
+#  define IS_UART7_CTS_ALT1(_p_) (PINID(_p_) == PINID_UART7_CTS_ALT)
+# else
+#  define IS_UART7_CTS_ALT1(_p_) (0)
+# endif
+# define IS_UART7_CTS(_p_) (IS_UART7_CTS_DEF(_p_) || IS_UART7_CTS_ALT1(_p_))
+
 # define IS_UART7(_rxp_, _txp_) (IS_UART7_RX(_rxp_) && IS_UART7_TX(_txp_))
 # define IS_UART7_STRUCT(_p_) (IS_UART7((_p_)->rx_pin, (_p_)->tx_pin))
 
@@ -412,6 +502,7 @@
 
 #else // HAVE_UART7
 # define IS_UART7(_rx_pin_, _tx_pin_) (0)
+# define IS_UART7_CTS(_p_) (0)
 # define IS_UART7_STRUCT(_p_) (0)
 #endif // HAVE_UART7
 
@@ -459,6 +550,18 @@
 # endif
 # define IS_UART8_TX(_p_) (IS_UART8_TX_DEF(_p_) || IS_UART8_TX_ALT1(_p_) || IS_UART8_TX_ALT2(_p_))
 
+#if defined(PINID_UART8_CTS) && PINID_UART8_CTS > 0
+#  define IS_UART8_CTS_DEF(_p_) (PINID(_p_) == PINID_UART8_CTS)
+# else
+#  define IS_UART8_CTS_DEF(_p_) (0)
+# endif
+#if defined(PINID_UART8_CTS_ALT) && PINID_UART8_CTS_ALT > 0
+#  define IS_UART8_CTS_ALT1(_p_) (PINID(_p_) == PINID_UART8_CTS_ALT)
+# else
+#  define IS_UART8_CTS_ALT1(_p_) (0)
+# endif
+# define IS_UART8_CTS(_p_) (IS_UART8_CTS_DEF(_p_) || IS_UART8_CTS_ALT1(_p_))
+
 # define IS_UART8(_rxp_, _txp_) (IS_UART8_RX(_rxp_) && IS_UART8_TX(_txp_))
 # define IS_UART8_STRUCT(_p_) (IS_UART8((_p_)->rx_pin, (_p_)->tx_pin))
 
@@ -471,5 +574,6 @@
 
 #else // HAVE_UART8
 # define IS_UART8(_rx_pin_, _tx_pin_) (0)
+# define IS_UART8_CTS(_p_) (0)
 # define IS_UART8_STRUCT(_p_) (0)
 #endif // HAVE_UART8
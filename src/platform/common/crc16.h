@@ -0,0 +1,30 @@
+//
+// This file is meant for direct inclusion by the platform code that needs it
+// and should not be included anywhere else
+//
+
+//
+// CRC-16/XMODEM, the 'CCITT' polynomial 0x1021 with an initial value of 0 and
+// no reflection, which is what SD cards use for data blocks
+//
+// The table is indexed by nibble rather than by byte so that it's 32 bytes
+// instead of 512; const data is mapped into flash on the AVR_XMEGA3 parts, and
+// a 512 byte table would take up an eighth of the ATtiny402's 4KiB of it. This
+// is still about 4 times faster than going a bit at a time
+#define CRC16_POLY 0x1021U
+
+INLINE uint16_t crc16_update(uint16_t crc, const uint8_t *data, txsize_t size) {
+	static const uint16_t table[16] = {
+		0x0000U, 0x1021U, 0x2042U, 0x3063U, 0x4084U, 0x50A5U, 0x60C6U, 0x70E7U,
+		0x8108U, 0x9129U, 0xA14AU, 0xB16BU, 0xC18CU, 0xD1ADU, 0xE1CEU, 0xF1EFU,
+	};
+
+	for (txsize_t i = 0; i < size; ++i) {
+		uint8_t c = data[i];
+
+		crc = (uint16_t )(crc << 4) ^ table[(crc >> 12) ^ (c >> 4)];
+		crc = (uint16_t )(crc << 4) ^ table[(crc >> 12) ^ (c & 0x0FU)];
+	}
+
+	return crc;
+}
@@ -0,0 +1,31 @@
+//
+// This file is meant for direct inclusion by i2c.c (or the platform equivalent)
+// and should not be compiled directly
+//
+// The including file must provide i2c_write_read()
+//
+
+err_t i2c_write_read_batch(i2c_write_read_t *reads, uint_fast8_t count, utime_t timeout) {
+	err_t res = ERR_OK;
+
+	uHAL_assert(reads != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (reads == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	// Keep going after a failure so that one missing device doesn't hold up
+	// the rest
+	for (uint_fast8_t i = 0; i < count; ++i) {
+		i2c_write_read_t *r = &reads[i];
+
+		r->status = i2c_write_read(r->addr, r->tx_buffer, r->tx_size, r->rx_buffer, r->rx_size, timeout);
+		if ((r->status != ERR_OK) && (res == ERR_OK)) {
+			res = r->status;
+		}
+	}
+
+	return res;
+}
@@ -0,0 +1,267 @@
+//
+// This file is meant for direct inclusion by i2c.c (or the platform equivalent)
+// and should not be compiled directly
+//
+// The including file must provide the rest of the I2C interface and must
+// clear bus_lock.hz whenever the bus speed is changed
+//
+
+// Errors which may not happen again if the transaction is retried: lost
+// arbitration and a NACK of the address or data, the former being how an
+// EEPROM says it's busy
+#define I2C_ERR_IS_RETRYABLE(_err_) (((_err_) == ERR_RETRY) || ((_err_) == ERR_INTERRUPT))
+
+//
+// The bus is only ever used from the main loop so there's no need to guard
+// this against interrupts
+static struct {
+	const i2c_device_t *owner;
+	// The number of times the owner has locked the bus without unlocking it
+	uint_fast8_t depth;
+	// The speed last set for a device, or 0 if it's been changed since
+	uint32_t hz;
+	// Set between i2c_device_transmit_begin() and i2c_device_transmit_end()
+	bool transmitting;
+} bus_lock;
+
+static uint32_t device_hz(const i2c_device_t *dev) {
+	return (dev->max_hz != 0U) ? dev->max_hz : I2C_FREQUENCY_HZ;
+}
+static utime_t device_timeout(const i2c_device_t *dev) {
+	return (dev->timeout != 0U) ? dev->timeout : I2C_DEVICE_TIMEOUT_MS;
+}
+//
+// Get the timeout for the next attempt at a transaction which started when
+// 'deadline' was set
+// Returns 0 if there's no time left
+static utime_t attempt_timeout(const i2c_device_t *dev, utime_t deadline) {
+	if (dev->timeout_policy == I2C_TIMEOUT_TOTAL) {
+		if (TIMES_UP(deadline)) {
+			return 0;
+		}
+		return deadline - GET_SYSTICKS_MS();
+	}
+
+	return device_timeout(dev);
+}
+
+err_t i2c_device_lock(const i2c_device_t *dev) {
+	err_t res;
+	uint32_t hz;
+
+	uHAL_assert(dev != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (dev == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	if (bus_lock.owner == dev) {
+		++bus_lock.depth;
+		return ERR_OK;
+	}
+	if (bus_lock.owner != NULL) {
+		return ERR_RETRY;
+	}
+
+	// The bus is left on when unlocked so that several devices used in a row
+	// don't cycle it
+	if (!i2c_is_on()) {
+		if ((res = i2c_on()) != ERR_OK) {
+			return res;
+		}
+	}
+	hz = device_hz(dev);
+	if (hz != bus_lock.hz) {
+		// This only fails if a transfer started outside of the device
+		// interface is still running
+		if (i2c_set_frequency(hz) == 0U) {
+			return ERR_RETRY;
+		}
+		bus_lock.hz = hz;
+	}
+
+	bus_lock.owner = dev;
+	bus_lock.depth = 1;
+
+	return ERR_OK;
+}
+err_t i2c_device_unlock(const i2c_device_t *dev) {
+	uHAL_assert(dev != NULL);
+	uHAL_assert(bus_lock.owner == dev);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (dev == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+	if (bus_lock.owner != dev) {
+		return ERR_PERM;
+	}
+
+	--bus_lock.depth;
+	if (bus_lock.depth == 0U) {
+		bus_lock.owner = NULL;
+	}
+
+	return ERR_OK;
+}
+bool i2c_bus_is_locked(void) {
+	return (bus_lock.owner != NULL);
+}
+
+//
+// Run a whole transaction, retrying it if it fails in a way that might not
+// happen again
+// A transmission, reception, or both is run depending on which sizes are > 0
+static err_t device_transfer(const i2c_device_t *dev, const uint8_t *tx_buffer, txsize_t tx_size, uint8_t *rx_buffer, txsize_t rx_size) {
+	err_t res;
+	utime_t deadline, timeout;
+
+	if ((res = i2c_device_lock(dev)) != ERR_OK) {
+		return res;
+	}
+
+	deadline = SET_TIMEOUT_MS(device_timeout(dev));
+	for (uint_fast8_t tries = 0; tries <= dev->retries; ++tries) {
+		if ((timeout = attempt_timeout(dev, deadline)) == 0U) {
+			res = ERR_TIMEOUT;
+			break;
+		}
+
+		if (rx_size == 0U) {
+			res = i2c_transmit_block(dev->addr, tx_buffer, tx_size, timeout);
+		} else if (tx_size == 0U) {
+			res = i2c_receive_block(dev->addr, rx_buffer, rx_size, timeout);
+		} else {
+			res = i2c_write_read(dev->addr, tx_buffer, tx_size, rx_buffer, rx_size, timeout);
+		}
+		if (!I2C_ERR_IS_RETRYABLE(res)) {
+			break;
+		}
+	}
+
+	i2c_device_unlock(dev);
+
+	return res;
+}
+err_t i2c_device_transmit(const i2c_device_t *dev, const uint8_t *tx_buffer, txsize_t tx_size) {
+	uHAL_assert(dev != NULL);
+	uHAL_assert(tx_buffer != NULL);
+	uHAL_assert(tx_size > 0);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((dev == NULL) || (tx_buffer == NULL) || (tx_size <= 0)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	return device_transfer(dev, tx_buffer, tx_size, NULL, 0);
+}
+err_t i2c_device_receive(const i2c_device_t *dev, uint8_t *rx_buffer, txsize_t rx_size) {
+	uHAL_assert(dev != NULL);
+	uHAL_assert(rx_buffer != NULL);
+	uHAL_assert(rx_size > 0);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((dev == NULL) || (rx_buffer == NULL) || (rx_size <= 0)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	return device_transfer(dev, NULL, 0, rx_buffer, rx_size);
+}
+err_t i2c_device_write_read(const i2c_device_t *dev, const uint8_t *tx_buffer, txsize_t tx_size, uint8_t *rx_buffer, txsize_t rx_size) {
+	uHAL_assert(dev != NULL);
+	uHAL_assert(tx_buffer != NULL);
+	uHAL_assert(tx_size > 0);
+	uHAL_assert(rx_buffer != NULL);
+	uHAL_assert(rx_size > 0);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if ((dev == NULL) || (tx_buffer == NULL) || (tx_size <= 0) || (rx_buffer == NULL) || (rx_size <= 0)) {
+		return ERR_BADARG;
+	}
+#endif
+
+	return device_transfer(dev, tx_buffer, tx_size, rx_buffer, rx_size);
+}
+
+err_t i2c_device_transmit_begin(const i2c_device_t *dev) {
+	err_t res;
+	utime_t deadline, timeout;
+
+	uHAL_assert(dev != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (dev == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	if ((res = i2c_device_lock(dev)) != ERR_OK) {
+		return res;
+	}
+
+	// Only the address phase can be retried, once data has been sent it's up
+	// to the caller to start over
+	deadline = SET_TIMEOUT_MS(device_timeout(dev));
+	for (uint_fast8_t tries = 0; tries <= dev->retries; ++tries) {
+		if ((timeout = attempt_timeout(dev, deadline)) == 0U) {
+			res = ERR_TIMEOUT;
+			break;
+		}
+
+		if ((res = i2c_transmit_block_begin(dev->addr, timeout)) == ERR_OK) {
+			bus_lock.transmitting = true;
+			return ERR_OK;
+		}
+		// A failed start still needs a stop condition before trying again
+		i2c_transmit_block_end();
+		if (!I2C_ERR_IS_RETRYABLE(res)) {
+			break;
+		}
+	}
+
+	i2c_device_unlock(dev);
+
+	return res;
+}
+err_t i2c_device_transmit_continue(const i2c_device_t *dev, const uint8_t *tx_buffer, txsize_t tx_size) {
+	uHAL_assert(dev != NULL);
+	uHAL_assert((bus_lock.owner == dev) && bus_lock.transmitting);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (dev == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+	if ((bus_lock.owner != dev) || !bus_lock.transmitting) {
+		return ERR_PERM;
+	}
+
+	return i2c_transmit_block_continue(tx_buffer, tx_size, device_timeout(dev));
+}
+err_t i2c_device_transmit_end(const i2c_device_t *dev) {
+	err_t res;
+
+	uHAL_assert(dev != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (dev == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+	// i2c_device_transmit_begin() cleans up after itself when it fails, so
+	// there's nothing to do if it didn't start a transmission
+	if ((bus_lock.owner != dev) || !bus_lock.transmitting) {
+		return ERR_OK;
+	}
+
+	res = i2c_transmit_block_end();
+	bus_lock.transmitting = false;
+	i2c_device_unlock(dev);
+
+	return res;
+}
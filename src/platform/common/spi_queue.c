@@ -0,0 +1,55 @@
+//
+// This file is meant for direct inclusion by spi.c (or the platform equivalent)
+// and should not be compiled directly
+//
+
+//
+// Return the number of queued transactions
+INLINE spi_queue_size_t spi_queue_used(const volatile spi_queue_t *q) {
+	// The cast is needed to get the wrap-around right when spi_queue_size_t
+	// is smaller than an int
+	return (spi_queue_size_t )(q->head - q->tail);
+}
+//
+// Add a transaction to the end of the queue
+// Returns false if the queue was full
+INLINE bool spi_queue_push(volatile spi_queue_t *q, spi_transaction_t *t) {
+	spi_queue_size_t head = q->head;
+
+	if ((spi_queue_size_t )(head - q->tail) >= SPI_QUEUE_LENGTH) {
+		return false;
+	}
+	q->entries[head & SPI_QUEUE_MASK] = t;
+	q->head = head + 1U;
+
+	return true;
+}
+//
+// Return the oldest transaction without removing it, or NULL if the queue is
+// empty
+INLINE spi_transaction_t* spi_queue_peek(const volatile spi_queue_t *q) {
+	if (q->head == q->tail) {
+		return NULL;
+	}
+
+	return q->entries[q->tail & SPI_QUEUE_MASK];
+}
+//
+// Remove and return the oldest transaction, or NULL if the queue is empty
+INLINE spi_transaction_t* spi_queue_pop(volatile spi_queue_t *q) {
+	spi_transaction_t *t = spi_queue_peek(q);
+
+	if (t != NULL) {
+		q->tail = q->tail + 1U;
+	}
+
+	return t;
+}
+//
+// Discard everything in the queue
+INLINE void spi_queue_reset(volatile spi_queue_t *q) {
+	q->head = 0;
+	q->tail = 0;
+
+	return;
+}
@@ -0,0 +1,31 @@
+//
+// This file is meant for direct inclusion by platform.h (or the platform
+// equivalent) and should not be included anywhere else
+//
+
+#if (SPI_QUEUE_LENGTH & (SPI_QUEUE_LENGTH - 1U)) != 0 || SPI_QUEUE_LENGTH > 128U || SPI_QUEUE_LENGTH <= 0
+# error "SPI_QUEUE_LENGTH must be a power of 2 <= 128"
+#endif
+#define SPI_QUEUE_MASK (SPI_QUEUE_LENGTH - 1U)
+
+typedef uint_fast8_t spi_queue_size_t;
+
+//
+// The transaction queue is a ring buffer of pointers to caller-owned
+// transactions, so nothing is ever allocated or copied
+//
+// Like the UART RX buffer the indices are free-running and only masked when
+// indexing the entries; the queue is empty when head == tail and full when
+// (head - tail) == SPI_QUEUE_LENGTH
+//
+// Transactions can be added from ISRs as well as the main loop so unlike the
+// UART buffer there can be more than one producer; the caller is responsible
+// for keeping them from interrupting each other
+typedef struct {
+	spi_transaction_t *entries[SPI_QUEUE_LENGTH];
+	// The next free slot
+	spi_queue_size_t head;
+	// The oldest transaction, which is the one being transferred if the engine
+	// is running
+	spi_queue_size_t tail;
+} spi_queue_t;
@@ -0,0 +1,230 @@
+//
+// This file is meant for direct inclusion by spi.c (or the platform equivalent)
+// and should not be compiled directly
+//
+// The including file must provide uscounter_read() and the platform's
+// DISABLE_INTERRUPTS()/RESTORE_INTERRUPTS() macros
+//
+
+#if (SPI_TRACE_LENGTH & (SPI_TRACE_LENGTH - 1U)) != 0 || SPI_TRACE_LENGTH > 128U || SPI_TRACE_LENGTH <= 0
+# error "SPI_TRACE_LENGTH must be a power of 2 <= 128"
+#endif
+#if SPI_TRACE_HISTOGRAM_BINS < 1
+# error "SPI_TRACE_HISTOGRAM_BINS must be > 0"
+#endif
+#define SPI_TRACE_MASK (SPI_TRACE_LENGTH - 1U)
+
+typedef uint_fast8_t spi_trace_size_t;
+
+//
+// The trace is a ring buffer of completed transactions from all ports which
+// overwrites the oldest entry when it's full
+//
+// Like the SPI queue the indices are free-running and only masked when
+// indexing the entries; the trace is empty when head == tail and full when
+// (head - tail) == SPI_TRACE_LENGTH
+static volatile struct {
+	spi_trace_entry_t entries[SPI_TRACE_LENGTH];
+	spi_trace_size_t head;
+	spi_trace_size_t tail;
+} trace;
+
+//
+// Called by spi_device_begin() once the device is selected
+static void spi_trace_begin(spi_trace_port_t *pt, const spi_device_t *dev) {
+	uint32_t now = (uint32_t )uscounter_read();
+	uint_fast8_t irq_state;
+
+	DISABLE_INTERRUPTS(irq_state);
+	pt->dev = dev;
+	pt->start_us = now;
+	RESTORE_INTERRUPTS(irq_state);
+
+	return;
+}
+//
+// Called by spi_device_end() once the device is deselected
+// Nothing is recorded if the device wasn't selected through spi_device_begin()
+// The idle time is worked out here rather than when summarizing because
+// transactions on other ports are interleaved with this one's in the buffer
+// and the one before may already have been discarded
+static void spi_trace_end(spi_trace_port_t *pt, const spi_device_t *dev) {
+	uint32_t now = (uint32_t )uscounter_read();
+	uint_fast8_t irq_state;
+	spi_trace_size_t head;
+	volatile spi_trace_entry_t *e;
+
+	DISABLE_INTERRUPTS(irq_state);
+	if (pt->dev == dev) {
+		head = trace.head;
+		if ((spi_trace_size_t )(head - trace.tail) >= SPI_TRACE_LENGTH) {
+			++trace.tail;
+		}
+		e = &trace.entries[head & SPI_TRACE_MASK];
+		e->dev = dev;
+		e->start_us = pt->start_us;
+		e->end_us = now;
+		// Unsigned arithmetic takes care of the counter wrapping around
+		e->idle_us = (pt->have_last) ? (pt->start_us - pt->last_end_us) : SPI_TRACE_IDLE_UNKNOWN;
+		trace.head = head + 1U;
+
+		pt->dev = NULL;
+		pt->last_end_us = now;
+		pt->have_last = true;
+	}
+	RESTORE_INTERRUPTS(irq_state);
+
+	return;
+}
+
+//
+// Copy entry 'i' (a free-running index) if it's still in the trace
+// Readers walk the trace one entry at a time rather than copying the whole
+// thing with interrupts disabled, so entries may be discarded along the way
+static bool trace_get(spi_trace_size_t i, spi_trace_entry_t *entry) {
+	uint_fast8_t irq_state;
+	bool valid;
+
+	DISABLE_INTERRUPTS(irq_state);
+	valid = ((spi_trace_size_t )(i - trace.tail) < (spi_trace_size_t )(trace.head - trace.tail));
+	if (valid) {
+		const volatile spi_trace_entry_t *e = &trace.entries[i & SPI_TRACE_MASK];
+
+		entry->dev = e->dev;
+		entry->start_us = e->start_us;
+		entry->end_us = e->end_us;
+		entry->idle_us = e->idle_us;
+	}
+	RESTORE_INTERRUPTS(irq_state);
+
+	return valid;
+}
+static spi_trace_size_t trace_oldest(spi_trace_size_t *count) {
+	uint_fast8_t irq_state;
+	spi_trace_size_t tail;
+
+	DISABLE_INTERRUPTS(irq_state);
+	tail = trace.tail;
+	*count = (spi_trace_size_t )(trace.head - tail);
+	RESTORE_INTERRUPTS(irq_state);
+
+	return tail;
+}
+static uint_fast8_t trace_bin(uint32_t us) {
+	uint_fast8_t bin = 0;
+
+	while (((us >>= 1U) != 0U) && (bin < (SPI_TRACE_HISTOGRAM_BINS - 1U))) {
+		++bin;
+	}
+
+	return bin;
+}
+
+uint_fast8_t spi_trace_read(spi_trace_entry_t *entries, uint_fast8_t max) {
+	spi_trace_size_t i, count;
+	uint_fast8_t copied = 0;
+
+	uHAL_assert(entries != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (entries == NULL) {
+		return 0;
+	}
+#endif
+
+	i = trace_oldest(&count);
+	for (; (count > 0U) && (copied < max); ++i, --count) {
+		if (trace_get(i, &entries[copied])) {
+			++copied;
+		}
+	}
+
+	return copied;
+}
+uint_fast8_t spi_trace_devices(const spi_device_t **devs, uint_fast8_t max) {
+	spi_trace_entry_t e;
+	spi_trace_size_t i, count;
+	uint_fast8_t found = 0;
+
+	uHAL_assert(devs != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (devs == NULL) {
+		return 0;
+	}
+#endif
+
+	i = trace_oldest(&count);
+	for (; (count > 0U) && (found < max); ++i, --count) {
+		uint_fast8_t j;
+
+		if (!trace_get(i, &e)) {
+			continue;
+		}
+		for (j = 0; (j < found) && (devs[j] != e.dev); ++j) {
+			// Nothing to do here
+		}
+		if (j == found) {
+			devs[found] = e.dev;
+			++found;
+		}
+	}
+
+	return found;
+}
+err_t spi_trace_histogram(const spi_device_t *dev, spi_trace_histogram_t *hist) {
+	spi_trace_entry_t e;
+	spi_trace_size_t i, count;
+	uint32_t us;
+
+	uHAL_assert(hist != NULL);
+
+#if ! uHAL_SKIP_INVALID_ARG_CHECKS
+	if (hist == NULL) {
+		return ERR_BADARG;
+	}
+#endif
+
+	mem_init(hist, 0, sizeof(*hist));
+	hist->min_us = 0xFFFFFFFFUL;
+
+	i = trace_oldest(&count);
+	for (; count > 0U; ++i, --count) {
+		if (!trace_get(i, &e) || ((dev != NULL) && (e.dev != dev))) {
+			continue;
+		}
+
+		// Unsigned arithmetic takes care of the counter wrapping around
+		us = e.end_us - e.start_us;
+		++hist->count;
+		hist->total_us += us;
+		if (us < hist->min_us) {
+			hist->min_us = us;
+		}
+		if (us > hist->max_us) {
+			hist->max_us = us;
+		}
+		++hist->busy[trace_bin(us)];
+
+		if (e.idle_us != SPI_TRACE_IDLE_UNKNOWN) {
+			if (e.idle_us > hist->max_idle_us) {
+				hist->max_idle_us = e.idle_us;
+			}
+			++hist->idle[trace_bin(e.idle_us)];
+		}
+	}
+	if (hist->count == 0U) {
+		hist->min_us = 0;
+	}
+
+	return ERR_OK;
+}
+void spi_trace_clear(void) {
+	uint_fast8_t irq_state;
+
+	DISABLE_INTERRUPTS(irq_state);
+	trace.tail = trace.head;
+	RESTORE_INTERRUPTS(irq_state);
+
+	return;
+}
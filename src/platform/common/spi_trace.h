@@ -0,0 +1,21 @@
+//
+// This file is meant for direct inclusion by platform.h (or the platform
+// equivalent) and should not be included anywhere else
+//
+
+#if ENABLE_SPI_TRACE
+// spi_device_t is defined in interface/spi.h, which is included later
+struct spi_device_t;
+//
+// The trace state kept by each port
+// Only one device can be selected on a port at a time so the transaction in
+// progress is kept here until it ends
+typedef struct {
+	const struct spi_device_t *dev;
+	uint32_t start_us;
+	// When the last transaction on the port ended, for measuring how long the
+	// bus sat idle
+	uint32_t last_end_us;
+	bool have_last;
+} spi_trace_port_t;
+#endif
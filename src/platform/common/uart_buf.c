@@ -5,50 +5,320 @@
 
 #if UART_INPUT_BUFFER_BYTES > 0 && ENABLE_UART_LISTENING
 //
-// Fill the output buffer with as much of the RX buffer as we can, then return
-// the index of the next byte
-INLINE txsize_t eat_uart_buffer(uart_port_t *p, uint8_t *buffer, txsize_t size) {
-	txsize_t i = 0;
+// The platform can define this before including this file if the buffer is
+// filled by something other than uart_buffer_push(), such as a DMA controller
+// that only tells us where it is when asked
+#ifndef UART_BUFFER_HEAD
+# define UART_BUFFER_HEAD(_p_) ((_p_)->rx_buf.head)
+#endif
+//
+// Return the number of bytes waiting in the RX buffer
+INLINE uart_buffer_size_t uart_buffer_used(const volatile uart_buffer_t *rx_buf) {
+	// The cast is needed to get the wrap-around right when uart_buffer_size_t
+	// is smaller than an int
+	return (uart_buffer_size_t )(rx_buf->head - rx_buf->tail);
+}
+//
+// Add a byte to the RX buffer
+// This is the producer side and should only be called from the RX ISR
+// Returns false if the buffer was full and the byte was discarded
+INLINE bool uart_buffer_push(volatile uart_buffer_t *rx_buf, uint8_t c) {
+	uart_buffer_size_t head = rx_buf->head;
+
+	if ((uart_buffer_size_t )(head - rx_buf->tail) >= UART_INPUT_BUFFER_BYTES) {
+		++rx_buf->overruns;
+		return false;
+	}
+
+	rx_buf->buffer[head & UART_INPUT_BUFFER_MASK] = c;
+	// The byte must be in place before the reader can see the new head; both
+	// are volatile so the compiler won't re-order the writes
+	rx_buf->head = head + 1U;
+
+	return true;
+}
+//
+// Return the number of unread bytes in the RX buffer up to 'head' and set
+// '*tail' to the index of the oldest one
+// This is part of the consumer side
+INLINE uart_buffer_size_t uart_buffer_unread(volatile uart_buffer_t *rx_buf, uart_buffer_size_t head, uart_buffer_size_t *tail) {
+	uart_buffer_size_t avail;
+
+	*tail = rx_buf->tail;
+	avail = (uart_buffer_size_t )(head - *tail);
+	// This can only happen when the producer doesn't check for room, in which
+	// case the oldest data has been overwritten and the consumer is the one
+	// that has to account for it
+	if (avail > UART_INPUT_BUFFER_BYTES) {
+		rx_buf->overruns += avail - UART_INPUT_BUFFER_BYTES;
+		*tail = head - UART_INPUT_BUFFER_BYTES;
+		rx_buf->tail = *tail;
+		avail = UART_INPUT_BUFFER_BYTES;
+	}
+
+	return avail;
+}
+//
+// Fill the output buffer with as much of the RX buffer up to 'head' as we can,
+// then return the number of bytes copied
+// This is the consumer side and can be called with the RX interrupt enabled
+INLINE txsize_t uart_buffer_read(volatile uart_buffer_t *rx_buf, uart_buffer_size_t head, uint8_t *buffer, txsize_t size) {
+	uart_buffer_size_t tail, avail;
 
 	// Don't bother checking the inputs, this is an internal function and that
 	// should all be handled by the caller
-	//assert(p != NULL);
+	//assert(rx_buf != NULL);
 	//assert(buffer != NULL);
-	//assert(size != NULL);
-
-	if (size == 0) {
-		return 0;
-	}
-
-	// We disabled the interrupt (you remembered to do that, right?) so we can
-	// ignore volatile
-	uart_buffer_t *rx_buf = (uart_buffer_t *)&p->rx_buf;
-
-	switch (rx_buf->bytes) {
-	case 1:
-		buffer[0] = rx_buf->buffer[0];
-		i = 1;
-		rx_buf->bytes = 0;
-		break;
-
-# if UART_INPUT_BUFFER_BYTES > 1
-	case 0:
-		break;
-	default:
-		if (rx_buf->bytes < size) {
-			memcpy(buffer, rx_buf->buffer, rx_buf->bytes);
-			i = rx_buf->bytes;
-			rx_buf->bytes = 0;
-		} else {
-			memcpy(buffer, rx_buf->buffer, size);
-			rx_buf->bytes -= size;
-			memmove(rx_buf->buffer, &rx_buf->buffer[size], rx_buf->bytes);
-			i = size;
+
+	avail = uart_buffer_unread(rx_buf, head, &tail);
+	if (avail > size) {
+		avail = (uart_buffer_size_t )size;
+	}
+
+	for (uart_buffer_size_t i = 0; i < avail; ++i) {
+		buffer[i] = rx_buf->buffer[(tail + i) & UART_INPUT_BUFFER_MASK];
+	}
+	// Releasing the space has to come after the reads are done or the ISR
+	// could overwrite the bytes before we get them
+	rx_buf->tail = tail + avail;
+
+	return avail;
+}
+//
+// Point '*data' at the oldest unread byte in the RX buffer and return the
+// number of bytes that follow it without wrapping around the end of the
+// buffer
+// Nothing is released until uart_buffer_consume() is called
+INLINE txsize_t uart_buffer_peek(volatile uart_buffer_t *rx_buf, uart_buffer_size_t head, const uint8_t **data) {
+	uart_buffer_size_t tail, avail, first;
+
+	avail = uart_buffer_unread(rx_buf, head, &tail);
+	first = tail & UART_INPUT_BUFFER_MASK;
+	if (avail > (UART_INPUT_BUFFER_BYTES - first)) {
+		avail = UART_INPUT_BUFFER_BYTES - first;
+	}
+	// The ISR won't touch these bytes until they're consumed so it's safe to
+	// drop the volatile qualifier
+	*data = (const uint8_t *)&rx_buf->buffer[first];
+
+	return avail;
+}
+//
+// Release up to 'size' bytes from the front of the RX buffer and return the
+// number released
+INLINE txsize_t uart_buffer_consume(volatile uart_buffer_t *rx_buf, uart_buffer_size_t head, txsize_t size) {
+	uart_buffer_size_t tail, avail;
+
+	avail = uart_buffer_unread(rx_buf, head, &tail);
+	if (avail > size) {
+		avail = (uart_buffer_size_t )size;
+	}
+	rx_buf->tail = tail + avail;
+
+	return avail;
+}
+INLINE void uart_buffer_reset(volatile uart_buffer_t *rx_buf) {
+	rx_buf->head = 0;
+	rx_buf->tail = 0;
+	rx_buf->overruns = 0;
+#if ENABLE_UART_FLOW_CONTROL
+	rx_buf->rts_held = false;
+#endif
+#if ENABLE_UART_LINE_MODE
+	rx_buf->delims[0] = 0;
+	rx_buf->delims[1] = 0;
+	rx_buf->line_end = 0;
+	rx_buf->hooked_end = 0;
+#endif
+
+	return;
+}
+
+#if ENABLE_UART_FLOW_CONTROL
+//
+// RTS is active-low, so it's driven high to ask the other end to stop sending
+// and low to let it start again
+//
+// Only the producer holds RTS and only the consumer releases it, which keeps
+// the two sides from needing to lock each other out: the producer ignores the
+// buffer while 'rts_held' is set, so the consumer releases the pin before
+// clearing the flag and then checks the buffer again on the producer's behalf
+// in case it filled back up in between
+//
+// The pin is only written with gpio_set_output_state() so that nothing
+// happens while it's not configured as an output (i.e. the port is off)
+INLINE uart_buffer_size_t uart_rts_used(uart_port_t *p) {
+	return (uart_buffer_size_t )(UART_BUFFER_HEAD(p) - p->rx_buf.tail);
+}
+//
+// De-assert RTS if the RX buffer has reached the high-water mark
+// This is the producer side and should be called after adding to the buffer
+INLINE void uart_rts_check_hold(uart_port_t *p) {
+	if ((p->rts_pin != 0) && !p->rx_buf.rts_held && (uart_rts_used(p) >= UART_RTS_HIGH_WATER)) {
+		p->rx_buf.rts_held = true;
+		gpio_set_output_state(p->rts_pin, GPIO_HIGH);
+	}
+
+	return;
+}
+//
+// Assert RTS again if the RX buffer has been read down to the low-water mark
+// This is the consumer side and should be called after reading from the buffer
+INLINE void uart_rts_check_release(uart_port_t *p) {
+	if (p->rx_buf.rts_held && (uart_rts_used(p) <= UART_RTS_LOW_WATER)) {
+		gpio_set_output_state(p->rts_pin, GPIO_LOW);
+		p->rx_buf.rts_held = false;
+		uart_rts_check_hold(p);
+	}
+
+	return;
+}
+//
+// The state RTS should be in when the pin is (re-)configured
+INLINE gpio_state_t uart_rts_state(const uart_port_t *p) {
+	return (p->rx_buf.rts_held) ? GPIO_HIGH : GPIO_LOW;
+}
+#else // ENABLE_UART_FLOW_CONTROL
+INLINE void uart_rts_check_hold(uart_port_t *p) {
+	UNUSED(p);
+	return;
+}
+INLINE void uart_rts_check_release(uart_port_t *p) {
+	UNUSED(p);
+	return;
+}
+#endif // ENABLE_UART_FLOW_CONTROL
+#if ENABLE_UART_LINE_MODE
+//
+// Look for line delimiters in the bytes added to the RX buffer since 'from'
+// This is the producer side and should be called after adding to the buffer
+INLINE void uart_buffer_find_lines(volatile uart_buffer_t *rx_buf, uart_buffer_size_t from) {
+	uint8_t d0 = rx_buf->delims[0], d1 = rx_buf->delims[1];
+	uart_buffer_size_t head, tail, end;
+
+	if (d0 == 0) {
+		return;
+	}
+
+	head = rx_buf->head;
+	tail = rx_buf->tail;
+	end = rx_buf->line_end;
+	// Once the reader has passed the last line, keep it pinned to the tail so
+	// that it can't drift far enough behind to wrap around into the unread
+	// part of the buffer and look like a new line
+	// The reader only moves the tail forward so a stale tail is harmless, it
+	// just gets fixed by the next call
+	// Moving it isn't a new line, so the hook tracking follows along
+	if ((uart_buffer_size_t )(end - tail) > (uart_buffer_size_t )(head - tail)) {
+		end = tail;
+		rx_buf->hooked_end = tail;
+	}
+	for (uart_buffer_size_t i = from; i != head; ++i) {
+		uint8_t c = rx_buf->buffer[i & UART_INPUT_BUFFER_MASK];
+
+		if ((c == d0) || (c == d1)) {
+			end = i + 1U;
+		}
+	}
+	rx_buf->line_end = end;
+
+	return;
+}
+//
+// Check whether uart_rx_irq_hook() should be called; in line mode it's only
+// called once for each batch of completed lines
+// This is the producer side
+INLINE bool uart_buffer_hook_is_due(volatile uart_buffer_t *rx_buf) {
+	uart_buffer_size_t end;
+
+	if (rx_buf->delims[0] == 0) {
+		return true;
+	}
+	end = rx_buf->line_end;
+	if (end == rx_buf->hooked_end) {
+		return false;
+	}
+	rx_buf->hooked_end = end;
+
+	return true;
+}
+//
+// Check whether there's a complete line waiting in the RX buffer
+// This is the consumer side
+INLINE bool uart_buffer_line_is_available(const volatile uart_buffer_t *rx_buf, uart_buffer_size_t head) {
+	uart_buffer_size_t tail = rx_buf->tail;
+	uart_buffer_size_t end;
+
+	if (rx_buf->delims[0] == 0) {
+		return (head != tail);
+	}
+	end = (uart_buffer_size_t )(rx_buf->line_end - tail);
+
+	return ((end != 0) && (end <= (uart_buffer_size_t )(head - tail)));
+}
+//
+// Set the line delimiters; only data received afterwards is checked for them
+// This is the consumer side
+INLINE void uart_buffer_set_delimiters(volatile uart_buffer_t *rx_buf, const char *delims) {
+	uint8_t d0 = 0, d1 = 0;
+
+	if (delims != NULL) {
+		d0 = (uint8_t )delims[0];
+		d1 = (d0 != 0) ? (uint8_t )delims[1] : 0;
+		if (d1 == 0) {
+			d1 = d0;
 		}
-# endif // UART_INPUT_BUFFER_BYTES > 1
 	}
+	// The ISR checks delims[0] first so that it's never looking for a stale
+	// second delimiter once line mode has been turned on
+	rx_buf->delims[0] = 0;
+	rx_buf->delims[1] = d1;
+	rx_buf->delims[0] = d0;
+
+	return;
+}
+#else // ENABLE_UART_LINE_MODE
+INLINE void uart_buffer_find_lines(volatile uart_buffer_t *rx_buf, uart_buffer_size_t from) {
+	UNUSED(rx_buf);
+	UNUSED(from);
+	return;
+}
+INLINE bool uart_buffer_hook_is_due(volatile uart_buffer_t *rx_buf) {
+	UNUSED(rx_buf);
+	return true;
+}
+#endif // ENABLE_UART_LINE_MODE
+//
+// Bookkeeping for the producer side after adding to the RX buffer
+// 'from' is the value of the head before the new data was added
+INLINE void uart_buffer_pushed(uart_port_t *p, uart_buffer_size_t from) {
+	uart_buffer_find_lines(&p->rx_buf, from);
+	uart_rts_check_hold(p);
+#if ENABLE_UART_STATS
+	uart_buffer_size_t used = (uart_buffer_size_t )(UART_BUFFER_HEAD(p) - p->rx_buf.tail);
+
+	if (used > p->stats.rx_peak) {
+		p->stats.rx_peak = used;
+	}
+#endif
 
-	return i;
+	return;
+}
+
+INLINE txsize_t eat_uart_buffer(uart_port_t *p, uint8_t *buffer, txsize_t size) {
+	txsize_t ret = uart_buffer_read(&p->rx_buf, UART_BUFFER_HEAD(p), buffer, size);
+
+	uart_rts_check_release(p);
+	return ret;
+}
+INLINE txsize_t peek_uart_buffer(uart_port_t *p, const uint8_t **data) {
+	return uart_buffer_peek(&p->rx_buf, UART_BUFFER_HEAD(p), data);
+}
+INLINE txsize_t consume_uart_buffer(uart_port_t *p, txsize_t size) {
+	txsize_t ret = uart_buffer_consume(&p->rx_buf, UART_BUFFER_HEAD(p), size);
+
+	uart_rts_check_release(p);
+	return ret;
 }
 
 #else // UART_INPUT_BUFFER_BYTES > 0 && ENABLE_UART_LISTENING
@@ -58,4 +328,53 @@ INLINE txsize_t eat_uart_buffer(uart_port_t *p, uint8_t *buffer, txsize_t size)
 	UNUSED(size);
 	return 0;
 }
+INLINE txsize_t peek_uart_buffer(uart_port_t *p, const uint8_t **data) {
+	UNUSED(p);
+	*data = NULL;
+	return 0;
+}
+INLINE txsize_t consume_uart_buffer(uart_port_t *p, txsize_t size) {
+	UNUSED(p);
+	UNUSED(size);
+	return 0;
+}
 #endif // UART_INPUT_BUFFER_BYTES > 0 && ENABLE_UART_LISTENING
+
+#if ENABLE_UART_STATS
+INLINE void uart_stats_reset(uart_port_t *p) {
+	p->stats.rx_bytes = 0;
+	p->stats.tx_bytes = 0;
+	p->stats.rx_dropped = 0;
+	p->stats.overrun_errors = 0;
+	p->stats.framing_errors = 0;
+	p->stats.noise_errors = 0;
+	p->stats.rx_peak = 0;
+	p->stats.tx_stall_ms = 0;
+#if UART_INPUT_BUFFER_BYTES > 0 && ENABLE_UART_LISTENING
+	p->rx_buf.overruns = 0;
+#endif
+
+	return;
+}
+//
+// The caller is responsible for keeping the ISR from changing anything while
+// this runs if that matters on the platform
+INLINE void uart_stats_copy(const uart_port_t *p, uart_stats_t *stats) {
+	stats->rx_bytes = p->stats.rx_bytes;
+	stats->tx_bytes = p->stats.tx_bytes;
+	// When there's an RX buffer, the dropped bytes are the ones it counts
+	// as overruns
+#if UART_INPUT_BUFFER_BYTES > 0 && ENABLE_UART_LISTENING
+	stats->rx_dropped = p->rx_buf.overruns;
+#else
+	stats->rx_dropped = p->stats.rx_dropped;
+#endif
+	stats->overrun_errors = p->stats.overrun_errors;
+	stats->framing_errors = p->stats.framing_errors;
+	stats->noise_errors = p->stats.noise_errors;
+	stats->rx_peak = p->stats.rx_peak;
+	stats->tx_stall_ms = p->stats.tx_stall_ms;
+
+	return;
+}
+#endif // ENABLE_UART_STATS
@@ -1,3 +1,40 @@
+//
+// This file is meant for direct inclusion by platform.h (or the platform
+// equivalent) and should not be included anywhere else
+//
+
+//
+// Documented in interface/uart.h, it's here because the platform's
+// uart_port_t may need it
+// 'size' is a txsize_t, which isn't defined yet when this is included
+typedef struct {
+	const uint8_t *data;
+	uint_fast16_t size;
+} uart_iovec_t;
+
+#if ENABLE_UART_STATS
+//
+// Documented in interface/uart.h, it's here because the platform's
+// uart_port_t needs it
+typedef struct {
+	uint32_t rx_bytes;
+	uint32_t tx_bytes;
+	uint_fast16_t rx_dropped;
+	uint_fast16_t overrun_errors;
+	uint_fast16_t framing_errors;
+	uint_fast16_t noise_errors;
+	uint_fast16_t rx_peak;
+	uint32_t tx_stall_ms;
+} uart_stats_t;
+# define UART_STATS_ADD(_p_, _field_, _n_) do { (_p_)->stats._field_ += (_n_); } while (0)
+#else
+# define UART_STATS_ADD(_p_, _field_, _n_) ((void )0U)
+#endif
+
+#if ENABLE_UART_LINE_MODE && (! ENABLE_UART_LISTENING || UART_INPUT_BUFFER_BYTES <= 0)
+# error "ENABLE_UART_LINE_MODE requires ENABLE_UART_LISTENING and UART_INPUT_BUFFER_BYTES > 0"
+#endif
+
 #if UART_INPUT_BUFFER_BYTES <= 0xFFU
 typedef uint_fast8_t uart_buffer_size_t;
 #elif UART_INPUT_BUFFER_BYTES <= 0xFFFFU
@@ -8,9 +45,51 @@ typedef uint_fast32_t uart_buffer_size_t;
 # error "Unsupported UART_INPUT_BUFFER_BYTES size"
 #endif
 
-#if ENABLE_UART_LISTENING
+#if UART_INPUT_BUFFER_BYTES > 0 && ENABLE_UART_LISTENING
+# if (UART_INPUT_BUFFER_BYTES & (UART_INPUT_BUFFER_BYTES - 1U)) != 0
+#  error "UART_INPUT_BUFFER_BYTES must be a power of 2"
+# endif
+# define UART_INPUT_BUFFER_MASK (UART_INPUT_BUFFER_BYTES - 1U)
+
+//
+// The RX buffer is a single-producer/single-consumer ring buffer. Only the
+// ISR writes 'head' and only the reader writes 'tail' so neither side needs
+// to lock the other out.
+//
+// The indices are free-running and only masked when indexing the buffer,
+// so the buffer is empty when head == tail and full when
+// (head - tail) == UART_INPUT_BUFFER_BYTES. This works as long as the buffer
+// size evenly divides the range of uart_buffer_size_t, which any power of 2
+// that fits in it does.
 typedef struct {
-	uart_buffer_size_t buffer[UART_INPUT_BUFFER_BYTES];
-	uart_buffer_size_t bytes;
+	uint8_t buffer[UART_INPUT_BUFFER_BYTES];
+	uart_buffer_size_t head;
+	uart_buffer_size_t tail;
+	// The number of received bytes discarded because the buffer was full
+	uint_fast16_t overruns;
+#if ENABLE_UART_FLOW_CONTROL
+	// Set while RTS is de-asserted because the buffer reached the high-water
+	// mark
+	bool rts_held;
+#endif
+#if ENABLE_UART_LINE_MODE
+	// The line delimiters, line mode is off when delims[0] is 0
+	uint8_t delims[2];
+	// The index just past the last delimiter received; there's a complete
+	// line waiting when this is in (tail, head]
+	// Only the ISR writes this
+	uart_buffer_size_t line_end;
+	// The value of 'line_end' when uart_rx_irq_hook() was last called
+	uart_buffer_size_t hooked_end;
+#endif
 } uart_buffer_t;
+
+# if ENABLE_UART_FLOW_CONTROL
+#  if UART_RTS_HIGH_WATER > UART_INPUT_BUFFER_BYTES || UART_RTS_HIGH_WATER <= 0
+#   error "UART_RTS_HIGH_WATER must be > 0 and <= UART_INPUT_BUFFER_BYTES"
+#  endif
+#  if UART_RTS_LOW_WATER >= UART_RTS_HIGH_WATER
+#   error "UART_RTS_LOW_WATER must be < UART_RTS_HIGH_WATER"
+#  endif
+# endif
 #endif
@@ -150,8 +150,18 @@ void serial_print(const char *msg, txsize_t len) {
 		return;
 	}
 
-	flush_printf_buffer();
+#if UART_COMM_BUFFER_BYTES > 0
+	// Send anything still buffered and the message in one go so there's no
+	// wait for the line to go idle between them
+	uart_iovec_t iov[2] = {
+		{ printf_buffer, printf_buffer_size },
+		{ (const uint8_t *)msg, len }
+	};
+	uart_transmit_iov(NULL, iov, 2, UART_COMM_TIMEOUT_MS);
+	printf_buffer_size = 0;
+#else
 	uart_transmit_block(NULL, (uint8_t *)msg, len, UART_COMM_TIMEOUT_MS);
+#endif
 
 	return;
 }
@@ -192,9 +202,6 @@ static void logger_putc(uint_fast8_t c) {
 	return;
 }
 void logger_replay(void) {
-	txsize_t len;
-	uint8_t *msg;
-
 #if ! uHAL_SKIP_INIT_CHECKS
 #endif
 #if ! uHAL_SKIP_INVALID_ARG_CHECKS
@@ -207,16 +214,11 @@ void logger_replay(void) {
 	flush_printf_buffer();
 	// If the size is > the tail we've wrapped around, so output the second
 	// (older) half first then do the first (newer) half
-	len = logger_replay_buffer.size - logger_replay_buffer.tail;
-	if (len > 0) {
-		msg = (uint8_t *)&logger_replay_buffer.output[logger_replay_buffer.tail];
-		uart_transmit_block(NULL, msg, len, UART_COMM_TIMEOUT_MS);
-	}
-	if (logger_replay_buffer.tail > 0) {
-		len = logger_replay_buffer.tail;
-		msg = (uint8_t *)logger_replay_buffer.output;
-		uart_transmit_block(NULL, msg, len, UART_COMM_TIMEOUT_MS);
-	}
+	uart_iovec_t iov[2] = {
+		{ (const uint8_t *)&logger_replay_buffer.output[logger_replay_buffer.tail], logger_replay_buffer.size - logger_replay_buffer.tail },
+		{ (const uint8_t *)logger_replay_buffer.output, logger_replay_buffer.tail }
+	};
+	uart_transmit_iov(NULL, iov, 2, UART_COMM_TIMEOUT_MS);
 
 	return;
 }
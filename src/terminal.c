@@ -67,6 +67,12 @@ static int terminalcmd_delay_S(const char *line_in);
 #if uHAL_USE_FDISK
 static int terminalcmd_fdisk(const char *line_in);
 #endif // uHAL_USE_FDISK
+#if ENABLE_UART_STATS
+static int terminalcmd_uart_stats(const char *line_in);
+#endif
+#if ENABLE_SPI_TRACE && uHAL_USE_SPI
+static int terminalcmd_spi_trace(const char *line_in);
+#endif
 
 static FMEM_STORAGE const terminal_cmd_t default_cmds[] = {
 #if uHAL_USE_RTC
@@ -76,6 +82,12 @@ static FMEM_STORAGE const terminal_cmd_t default_cmds[] = {
 	{ terminalcmd_delay_S,     "delay",       5 },
 #endif
 	{ terminalcmd_show_info,   "info",        4 },
+#if ENABLE_UART_STATS
+	{ terminalcmd_uart_stats,  "uart_stats", 10 },
+#endif
+#if ENABLE_SPI_TRACE && uHAL_USE_SPI
+	{ terminalcmd_spi_trace,   "spi_trace",   9 },
+#endif
 	{ terminalcmd_show_help,   "help",        4 },
 	{ terminalcmd_exit,        "exit",        4 },
 #if uHAL_USE_FDISK
@@ -91,6 +103,12 @@ static FMEM_STORAGE const char default_help[] =
 "   set_time YY.MM.DD hh:mm:ss - Set system time, clock is 24-hour\r\n"
 #endif
 "   info                       - Print system information\r\n"
+#if ENABLE_UART_STATS
+"   uart_stats [clear]         - Print (and optionally clear) serial port counters\r\n"
+#endif
+#if ENABLE_SPI_TRACE && uHAL_USE_SPI
+"   spi_trace [clear]          - Print (and optionally clear) SPI transaction times\r\n"
+#endif
 #if uHAL_USE_RTC || uHAL_USE_UPTIME
 "   delay <seconds>            - Pause the system\r\n"
 #endif
@@ -101,7 +119,14 @@ static FMEM_STORAGE const char default_help[] =
 "   exit                       - Exit the command terminal\r\n"
 
 #else
-"Commands: set_time info delay fdisk help exit\r\n"
+"Commands: set_time info delay fdisk help exit"
+#if ENABLE_UART_STATS
+" uart_stats"
+#endif
+#if ENABLE_SPI_TRACE && uHAL_USE_SPI
+" spi_trace"
+#endif
+"\r\n"
 #endif
 ;
 
@@ -116,6 +141,9 @@ void terminal(void) {
 #endif
 
 	PUTS_NOF(FROM_FSTR(TERMINAL_INTRO), 0);
+#if ENABLE_UART_LINE_MODE
+	uart_rx_set_delimiters(NULL, "\r\n");
+#endif
 
 	while (terminal_gets(line_in, TERMINAL_BUFFER_BYTES) > 0) {
 		FMEM_STORAGE const terminal_cmd_t *cmd;
@@ -156,67 +184,126 @@ void terminal(void) {
 	}
 
 END:
+#if ENABLE_UART_LINE_MODE
+	uart_rx_set_delimiters(NULL, NULL);
+#endif
 	PUTS_NOF(FROM_FSTR(TERMINAL_OUTRO), 0);
 
 	return;
 }
 
+//
+// Add a received character to the line being built
+// Returns true once the line is finished
+static bool terminal_addc(uint8_t c, char *line_in, txsize_t size, txsize_t *i, bool *started_line) {
+	bool done = false;
+
+	// TODO: ASCII escape sequences, especially CTRL-C
+	// TODO: Command history?
+	switch (c) {
+		case '\n':
+		case '\r':
+			if (*started_line) {
+				done = true;
+				if (*i < size) {
+					line_in[*i] = 0;
+				} else {
+					line_in[size-1] = 0;
+				}
+			}
+			break;
+		case 0x7F: // ASCII DEL
+		case '\b':
+			if (*i > 0) {
+				--(*i);
+			}
+			break;
+		case ' ':
+		case '\t':
+			if (*started_line) {
+				if (*i < size) {
+					line_in[*i] = (char )c;
+				}
+				++(*i);
+			}
+			break;
+		default:
+			*started_line = true;
+			if (*i < size) {
+				line_in[*i] = (char )c;
+			}
+			++(*i);
+			break;
+	}
+
+	return done;
+}
 static txsize_t terminal_gets(char *line_in, txsize_t size) {
 	uint8_t c;
 	txsize_t i;
-	bool done, started_line;
+	bool done, started_line, timed_out;
 
 	done = false;
 	started_line = false;
+	timed_out = false;
 	i = 0;
 	while (1) {
 		if (!started_line) {
 			PUTS_NOF(FROM_FSTR(TERMINAL_PROMPT), 0);
 		}
-		if (uart_receive_block(NULL, &c, 1, (uint32_t )TERMINAL_TIMEROUT_S*1000) == ERR_TIMEOUT) {
+#if ENABLE_UART_LISTENING && UART_INPUT_BUFFER_BYTES > 0
+		// When the port is listening the input can be scanned where the ISR
+		// put it rather than being copied out a byte at a time
+		if (uart_is_listening(NULL)) {
+			const uint8_t *rx;
+			txsize_t rx_size = 0, j;
+#if ENABLE_UART_LINE_MODE && uHAL_USE_HIBERNATE
+			// Sleep until there's a whole line to work with instead of
+			// spinning on the buffer
+			// The system tick may be stopped while sleeping so the timeout
+			// is counted in sleep periods instead
+			for (utime_t slept = 0; !uart_rx_line_is_available(NULL); slept += TERMINAL_LINE_WAIT_MS) {
+				if (slept >= (utime_t )TERMINAL_TIMEROUT_S*1000) {
+					timed_out = true;
+					break;
+				}
+				sleep_ms(TERMINAL_LINE_WAIT_MS);
+			}
+			if (!timed_out) {
+				uart_rx_peek(NULL, &rx, &rx_size);
+			}
+#else
+			utime_t timeout;
+
+			timeout = SET_TIMEOUT_MS((utime_t )TERMINAL_TIMEROUT_S*1000);
+			uart_rx_peek(NULL, &rx, &rx_size);
+			while (rx_size == 0) {
+				if (TIMES_UP(timeout)) {
+					timed_out = true;
+					break;
+				}
+				uart_rx_peek(NULL, &rx, &rx_size);
+			}
+#endif
+			for (j = 0; (j < rx_size) && !done; ++j) {
+				done = terminal_addc(rx[j], line_in, size, &i, &started_line);
+			}
+			uart_rx_consume(NULL, j);
+		} else
+#endif
+		{
+			if (uart_receive_block(NULL, &c, 1, (uint32_t )TERMINAL_TIMEROUT_S*1000) == ERR_TIMEOUT) {
+				timed_out = true;
+			} else {
+				done = terminal_addc(c, line_in, size, &i, &started_line);
+			}
+		}
+		if (timed_out) {
 			PUTS("Timed out waiting for input\r\n", 0);
 			line_in[0] = 0;
 			return 0;
 		}
 
-		// TODO: ASCII escape sequences, especially CTRL-C
-		// TODO: Command history?
-		switch (c) {
-			case '\n':
-			case '\r':
-				if (started_line) {
-					done = true;
-					if (i < size) {
-						line_in[i] = 0;
-					} else {
-						line_in[size-1] = 0;
-					}
-				}
-				break;
-			case 0x7F: // ASCII DEL
-			case '\b':
-				if (i > 0) {
-					--i;
-				}
-				break;
-			case ' ':
-			case '\t':
-				if (started_line) {
-					if (i < size) {
-						line_in[i] = (char )c;
-					}
-					++i;
-				}
-				break;
-			default:
-				started_line = true;
-				if (i < size) {
-					line_in[i] = (char )c;
-				}
-				++i;
-				break;
-		}
-
 		if (done) {
 			uint newlines, other;
 			utime_t timeout;
@@ -413,6 +500,87 @@ static int terminalcmd_delay_S(const char *line_in) {
 }
 #endif
 
+#if ENABLE_UART_STATS
+// Format: 'uart_stats [clear]'
+static int terminalcmd_uart_stats(const char *line_in) {
+	uart_stats_t stats;
+	const char *nt = NEXT_TOK(line_in, ' ');
+
+	// The counters are read before anything is printed so that the output
+	// doesn't count itself
+	if (uart_get_stats(NULL, &stats) != ERR_OK) {
+		PUTS("Error reading counters\r\n", 0);
+		return 0;
+	}
+	if (cstring_eqn(nt, "clear", 5)) {
+		uart_clear_stats(NULL);
+	}
+
+	PRINTF("RX: %lu bytes, %u dropped, peak buffer use %u/%u\r\n",
+		(long unsigned int )stats.rx_bytes, (uint )stats.rx_dropped,
+		(uint )stats.rx_peak, (uint )UART_INPUT_BUFFER_BYTES);
+	PRINTF("RX errors: %u overrun, %u framing, %u noise\r\n",
+		(uint )stats.overrun_errors, (uint )stats.framing_errors, (uint )stats.noise_errors);
+	PRINTF("TX: %lu bytes, %lums stalled\r\n",
+		(long unsigned int )stats.tx_bytes, (long unsigned int )stats.tx_stall_ms);
+
+	return 0;
+}
+#endif // ENABLE_UART_STATS
+
+#if ENABLE_SPI_TRACE && uHAL_USE_SPI
+static void print_spi_histogram(const spi_trace_histogram_t *hist) {
+	PRINTF("  %u transactions, min %luus, avg %luus, max %luus, max idle %luus\r\n",
+		(uint )hist->count, (long unsigned int )hist->min_us,
+		(long unsigned int )(hist->total_us / hist->count),
+		(long unsigned int )hist->max_us, (long unsigned int )hist->max_idle_us);
+	for (uiter_t i = 0; i < SPI_TRACE_HISTOGRAM_BINS; ++i) {
+		if ((hist->busy[i] == 0U) && (hist->idle[i] == 0U)) {
+			continue;
+		}
+		if (i == (SPI_TRACE_HISTOGRAM_BINS - 1U)) {
+			PRINTF("  >=%luus:", (long unsigned int )(1UL << i));
+		} else {
+			PRINTF("  <%luus:", (long unsigned int )(2UL << i));
+		}
+		PRINTF(" busy %u, idle %u\r\n", (uint )hist->busy[i], (uint )hist->idle[i]);
+	}
+
+	return;
+}
+// Format: 'spi_trace [clear]'
+static int terminalcmd_spi_trace(const char *line_in) {
+	// Reading the devices from the trace means we don't need to know about
+	// them here; any beyond the first few are lumped in with the total
+	const spi_device_t *devs[4];
+	spi_trace_histogram_t hist;
+	uint_fast8_t dev_count;
+	const char *nt = NEXT_TOK(line_in, ' ');
+
+	dev_count = spi_trace_devices(devs, SIZEOF_ARRAY(devs));
+	if (dev_count == 0) {
+		PUTS("No transactions recorded\r\n", 0);
+		return 0;
+	}
+	for (uiter_t i = 0; i < dev_count; ++i) {
+		if (spi_trace_histogram(devs[i], &hist) == ERR_OK && hist.count > 0U) {
+			PRINTF("Device with CS pin 0x%02X:\r\n", (uint )devs[i]->cs_pin);
+			print_spi_histogram(&hist);
+		}
+	}
+	if (spi_trace_histogram(NULL, &hist) == ERR_OK && hist.count > 0U) {
+		PUTS("All devices:\r\n", 0);
+		print_spi_histogram(&hist);
+	}
+
+	if (cstring_eqn(nt, "clear", 5)) {
+		spi_trace_clear();
+	}
+
+	return 0;
+}
+#endif // ENABLE_SPI_TRACE && uHAL_USE_SPI
+
 #if uHAL_USE_FDISK
 static int terminalcmd_fdisk(const char *line_in, txsize_t size) {
 	static FMEM_STORAGE const char confirm_string[] = "ERASE MY CARD!";
@@ -52,6 +52,9 @@
 #if uHAL_USE_FATFS_SD && !uHAL_USE_SPI
 # error "uHAL_USE_FATFS_SD requires uHAL_USE_SPI"
 #endif
+#if ENABLE_SPI_TRACE && !uHAL_USE_USCOUNTER
+# error "ENABLE_SPI_TRACE requires uHAL_USE_USCOUNTER"
+#endif
 // We use a 16-bit duty cycle
 #if PWM_DUTY_CYCLE_SCALE > 0xFFFFU
 # error "PWM_DUTY_CYCLE_SCALE can not be > 0xFFFF"
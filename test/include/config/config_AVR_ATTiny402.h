@@ -52,6 +52,8 @@
 
 #define RTT_RECALIBRATE_INTERVAL_S 0
 
+//#define UART_TX_BUFFER_BYTES 32U
+
 #define F_OSC  16000000UL
 #define F_CORE 4000000UL
 
@@ -117,6 +117,25 @@
 #define UART_INPUT_BUFFER_BYTES 8U
 //#define UART_INPUT_BUFFER_BYTES 0U
 
+// Only AVR_XMEGA3 reports when background transmissions have finished
+#define TEST_UART_TX 0
+
+// MOSI can be jumpered to MISO to check the exchanged data
+#define TEST_SPI_BENCH 0
+#define TEST_SPI_BENCH_BYTES 64U // Must be even for the 16-bit transfers
+#define TEST_SPI_BENCH_REPEAT 16U
+#define TEST_SPI_BENCH_TIMEOUT_MS 100U
+// Only AVR_XMEGA3 has interrupt-driven SPI; run the bench once with this at
+// 0 and once at 1 to compare the active cycles per byte of the two
+#define TEST_SPI_BENCH_IRQ 0
+
+// Needs a device that ACKs writes, the default address is an SSD1306's
+#define TEST_I2C_BENCH 0
+#define TEST_I2C_BENCH_ADDR 0x3CU
+#define TEST_I2C_BENCH_BYTES 128U
+#define TEST_I2C_BENCH_REPEAT 8U
+#define TEST_I2C_BENCH_TIMEOUT_MS 100U
+
 #define TEST_TERMINAL 1
 #define TERMINAL_HAVE_EXTRA_CMDS TEST_TERMINAL
 #define TEST_TERMINAL_LED_PIN LED_PIN
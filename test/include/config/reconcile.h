@@ -109,6 +109,43 @@
 # endif
 #endif
 
+#if TEST_UART_TX
+# undef uHAL_USE_UART
+# undef uHAL_USE_UART_COMM
+# undef uHAL_USE_USCOUNTER
+# define uHAL_USE_UART 1
+# define uHAL_USE_UART_COMM 1
+# define uHAL_USE_USCOUNTER 1
+
+# if ! defined(HAVE_AVR_XMEGA3) || HAVE_AVR_XMEGA3 == 0
+#  error "TEST_UART_TX is only supported on AVR_XMEGA3"
+# endif
+#endif
+
+#if TEST_SPI_BENCH
+# undef uHAL_USE_SPI
+# undef uHAL_USE_USCOUNTER
+# define uHAL_USE_SPI 1
+# define uHAL_USE_USCOUNTER 1
+
+# if TEST_SPI_BENCH_IRQ
+#  if ! defined(HAVE_AVR_XMEGA3) || HAVE_AVR_XMEGA3 == 0
+#   error "TEST_SPI_BENCH_IRQ is only supported on AVR_XMEGA3"
+#  endif
+#  undef uHAL_USE_SPI_IRQ
+#  undef ENABLE_SPI_IRQ_STATS
+#  define uHAL_USE_SPI_IRQ 1
+#  define ENABLE_SPI_IRQ_STATS 1
+# endif
+#endif
+
+#if TEST_I2C_BENCH
+# undef uHAL_USE_I2C
+# undef uHAL_USE_USCOUNTER
+# define uHAL_USE_I2C 1
+# define uHAL_USE_USCOUNTER 1
+#endif
+
 #if TEST_TERMINAL
 # undef uHAL_USE_UART
 # undef uHAL_USE_UART_COMM
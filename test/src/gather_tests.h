@@ -106,6 +106,30 @@
 # define loop_UART_LISTEN() (void )0U
 #endif
 
+#if TEST_UART_TX
+  void init_UART_TX(void);
+  void loop_UART_TX(void);
+#else
+# define init_UART_TX() (void )0U
+# define loop_UART_TX() (void )0U
+#endif
+
+#if TEST_SPI_BENCH
+  void init_SPI_BENCH(void);
+  void loop_SPI_BENCH(void);
+#else
+# define init_SPI_BENCH() (void )0U
+# define loop_SPI_BENCH() (void )0U
+#endif
+
+#if TEST_I2C_BENCH
+  void init_I2C_BENCH(void);
+  void loop_I2C_BENCH(void);
+#else
+# define init_I2C_BENCH() (void )0U
+# define loop_I2C_BENCH() (void )0U
+#endif
+
 #if TEST_TERMINAL
   void init_TERMINAL(void);
   void loop_TERMINAL(void);
@@ -77,6 +77,9 @@ int main(void) {
 	init_ADC();
 	init_SD();
 	init_UART_LISTEN();
+	init_UART_TX();
+	init_SPI_BENCH();
+	init_I2C_BENCH();
 	init_TERMINAL();
 	init_SSD1306();
 
@@ -90,6 +93,9 @@ int main(void) {
 		loop_ADC();
 		loop_SD();
 		loop_SSD1306();
+		loop_UART_TX();
+		loop_SPI_BENCH();
+		loop_I2C_BENCH();
 
 		uHAL_CLEAR_STATUS(uHAL_FLAG_IRQ);
 #if TEST_SLEEP
@@ -0,0 +1,148 @@
+#include "common.h"
+
+#if TEST_I2C_BENCH
+
+//
+// Measure the throughput of each way of pushing a block of data over I2C
+//
+// 'byte loop' calls i2c_transmit_block_continue() for each byte, 'polled'
+// calls it with chunks too short to be handed off to DMA, and 'bulk' calls
+// it once with the whole block, which uses DMA when uHAL_USE_I2C_DMA is set.
+// 'transmit block' uses i2c_transmit_block(), which is interrupt-driven when
+// uHAL_USE_I2C_IRQ is set.
+//
+// 'wire' is the rate at which the bus clocks out 9 bits (8 data and 1 ACK)
+// per byte at the configured frequency. Each transaction also costs a start
+// condition, the address byte, and a stop condition, so even a perfect
+// implementation falls a little short of it.
+//
+// A device must be at TEST_I2C_BENCH_ADDR to ACK the writes. The first byte
+// sent is 0x40, which makes an SSD1306 take the rest as display data; other
+// devices will take it as whatever their protocol says it is.
+//
+
+//
+// Globals initialization
+#if defined(uHAL_USE_I2C_DMA) && uHAL_USE_I2C_DMA
+# define BENCH_HAVE_DMA 1
+# define BENCH_POLLED_CHUNK (I2C_DMA_MIN_BYTES - 1U)
+#else
+# define BENCH_HAVE_DMA 0
+# define BENCH_POLLED_CHUNK TEST_I2C_BENCH_BYTES
+#endif
+// Keeps the rate calculation within 32 bits
+#if (TEST_I2C_BENCH_BYTES * TEST_I2C_BENCH_REPEAT) > 4000U
+# error "TEST_I2C_BENCH_BYTES * TEST_I2C_BENCH_REPEAT must be <= 4000"
+#endif
+
+static uint8_t tx_buf[TEST_I2C_BENCH_BYTES];
+static err_t bench_err;
+
+
+//
+// Misc functions
+// I2C is slow enough that bytes per second is more useful than KB/s
+static uint32_t us_to_bytes_per_s(utime_t us) {
+	if (us == 0) {
+		return 0;
+	}
+	return ((uint32_t )TEST_I2C_BENCH_BYTES * TEST_I2C_BENCH_REPEAT * 1000000UL) / (uint32_t )us;
+}
+static uint32_t percent_of_wire(uint32_t bytes_per_s) {
+	return (bytes_per_s * 100UL) / (I2C_FREQUENCY_HZ / 9UL);
+}
+static void set_err(err_t err) {
+	if ((err != ERR_OK) && (bench_err == ERR_OK)) {
+		bench_err = err;
+	}
+
+	return;
+}
+static void byte_loop(void) {
+	set_err(i2c_transmit_block_begin(TEST_I2C_BENCH_ADDR, TEST_I2C_BENCH_TIMEOUT_MS));
+	for (txsize_t i = 0; i < TEST_I2C_BENCH_BYTES; ++i) {
+		set_err(i2c_transmit_block_continue(&tx_buf[i], 1, TEST_I2C_BENCH_TIMEOUT_MS));
+	}
+	i2c_transmit_block_end();
+
+	return;
+}
+static void polled(void) {
+	set_err(i2c_transmit_block_begin(TEST_I2C_BENCH_ADDR, TEST_I2C_BENCH_TIMEOUT_MS));
+	for (txsize_t i = 0; i < TEST_I2C_BENCH_BYTES; i += BENCH_POLLED_CHUNK) {
+		txsize_t size = TEST_I2C_BENCH_BYTES - i;
+
+		if (size > BENCH_POLLED_CHUNK) {
+			size = BENCH_POLLED_CHUNK;
+		}
+		set_err(i2c_transmit_block_continue(&tx_buf[i], size, TEST_I2C_BENCH_TIMEOUT_MS));
+	}
+	i2c_transmit_block_end();
+
+	return;
+}
+static void bulk(void) {
+	set_err(i2c_transmit_block_begin(TEST_I2C_BENCH_ADDR, TEST_I2C_BENCH_TIMEOUT_MS));
+	set_err(i2c_transmit_block_continue(tx_buf, TEST_I2C_BENCH_BYTES, TEST_I2C_BENCH_TIMEOUT_MS));
+	i2c_transmit_block_end();
+
+	return;
+}
+static void transmit_block(void) {
+	set_err(i2c_transmit_block(TEST_I2C_BENCH_ADDR, tx_buf, TEST_I2C_BENCH_BYTES, TEST_I2C_BENCH_TIMEOUT_MS));
+
+	return;
+}
+static utime_t time_method(void (*method)(void)) {
+	uscounter_start();
+	for (uiter_t i = 0; i < TEST_I2C_BENCH_REPEAT; ++i) {
+		method();
+	}
+
+	return uscounter_stop();
+}
+
+
+//
+// main() initialization
+void init_I2C_BENCH(void) {
+	tx_buf[0] = 0x40U;
+	for (txsize_t i = 1; i < TEST_I2C_BENCH_BYTES; ++i) {
+		tx_buf[i] = (uint8_t )(i * 7U);
+	}
+	i2c_on();
+
+	return;
+}
+
+//
+// Main loop
+void loop_I2C_BENCH(void) {
+	uint32_t bytewise, chunked, whole, transmit;
+
+	bench_err = ERR_OK;
+	uscounter_on();
+	bytewise = us_to_bytes_per_s(time_method(byte_loop));
+	chunked = us_to_bytes_per_s(time_method(polled));
+	whole = us_to_bytes_per_s(time_method(bulk));
+	transmit = us_to_bytes_per_s(time_method(transmit_block));
+	uscounter_off();
+
+	if (bench_err != ERR_OK) {
+		PRINTF("I2C benchmark failed: error 0x%02X\r\n", (uint )bench_err);
+		return;
+	}
+
+	PRINTF("I2C B/s over %u bytes: wire %lu, byte loop %lu (%lu%%), polled %lu (%lu%%), bulk%s %lu (%lu%%), transmit block %lu (%lu%%)\r\n",
+		(uint_t )TEST_I2C_BENCH_BYTES,
+		(long unsigned )(I2C_FREQUENCY_HZ / 9UL),
+		(long unsigned )bytewise, (long unsigned )percent_of_wire(bytewise),
+		(long unsigned )chunked, (long unsigned )percent_of_wire(chunked),
+		(BENCH_HAVE_DMA) ? " (DMA)" : "",
+		(long unsigned )whole, (long unsigned )percent_of_wire(whole),
+		(long unsigned )transmit, (long unsigned )percent_of_wire(transmit));
+
+	return;
+}
+
+#endif // TEST_I2C_BENCH
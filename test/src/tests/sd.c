@@ -12,7 +12,7 @@
 // main() initialization
 void init_SD(void) {
 	gpio_set_mode(SPI_CS_SD_PIN, GPIO_MODE_PP, GPIO_HIGH);
-	spi_on();
+	spi_on(NULL);
 
 	return;
 }
@@ -0,0 +1,193 @@
+#include "common.h"
+
+#if TEST_SPI_BENCH
+
+//
+// Measure how many CPU cycles each SPI transfer method takes per byte
+//
+// 'byte loop' calls spi_exchange_byte() for each byte, which leaves the clock
+// idle between frames while the result is collected and the next byte is
+// loaded. The block functions keep the next frame queued so the closer they
+// are to 'wire', the time it takes to clock 8 bits out at the configured
+// frequency, the better.
+//
+// The 8-bit and 16-bit block functions are also compared by throughput; the
+// 16-bit ones need half as many frames for the same data.
+//
+// The active cycles per byte are the cycles the CPU spent awake; when
+// TEST_SPI_BENCH_IRQ is set the transfers sleep while the SPI interrupt moves
+// the data and the number of interrupts and wake-ups is reported too.
+// Otherwise the CPU never sleeps and it's the same as the cycles per byte.
+//
+// No device is needed; if MOSI is jumpered to MISO the exchanged data is
+// also checked.
+//
+
+//
+// Globals initialization
+#if defined(G_freq_CPUCLK)
+# define BENCH_CPU_HZ G_freq_CPUCLK
+#else
+# define BENCH_CPU_HZ G_freq_HCLK
+#endif
+
+static uint8_t tx_buf[TEST_SPI_BENCH_BYTES];
+static uint8_t rx_buf[TEST_SPI_BENCH_BYTES];
+static uint16_t tx_words[TEST_SPI_BENCH_BYTES/2U];
+static uint16_t rx_words[TEST_SPI_BENCH_BYTES/2U];
+
+typedef struct {
+	utime_t us;
+	utime_t active_us;
+	uint32_t isr_entries;
+	uint32_t wakeups;
+} bench_result_t;
+
+
+//
+// Misc functions
+static uint32_t us_to_cycles_per_byte(utime_t us) {
+	return ((uint32_t )us * (BENCH_CPU_HZ / 1000000UL)) / ((uint32_t )TEST_SPI_BENCH_BYTES * TEST_SPI_BENCH_REPEAT);
+}
+// Bytes per millisecond is the same as kilobytes per second
+static uint32_t us_to_kbytes_per_s(utime_t us) {
+	if (us == 0) {
+		return 0;
+	}
+	return ((uint32_t )TEST_SPI_BENCH_BYTES * TEST_SPI_BENCH_REPEAT * 1000UL) / (uint32_t )us;
+}
+static void byte_loop(void) {
+	for (txsize_t i = 0; i < TEST_SPI_BENCH_BYTES; ++i) {
+		spi_exchange_byte(NULL, tx_buf[i], &rx_buf[i], TEST_SPI_BENCH_TIMEOUT_MS);
+	}
+
+	return;
+}
+static void transmit_block(void) {
+	spi_transmit_block(NULL, tx_buf, TEST_SPI_BENCH_BYTES, TEST_SPI_BENCH_TIMEOUT_MS);
+
+	return;
+}
+static void exchange_block(void) {
+	spi_exchange_block(NULL, tx_buf, rx_buf, TEST_SPI_BENCH_BYTES, TEST_SPI_BENCH_TIMEOUT_MS);
+
+	return;
+}
+static void transmit_block16(void) {
+	spi_transmit_block16(NULL, tx_words, TEST_SPI_BENCH_BYTES/2U, TEST_SPI_BENCH_TIMEOUT_MS);
+
+	return;
+}
+static void exchange_block16(void) {
+	spi_exchange_block16(NULL, tx_words, rx_words, TEST_SPI_BENCH_BYTES/2U, TEST_SPI_BENCH_TIMEOUT_MS);
+
+	return;
+}
+static void time_method(void (*method)(void), bench_result_t *result) {
+#if TEST_SPI_BENCH_IRQ
+	spi_irq_stats_t stats;
+
+	spi_clear_irq_stats();
+#endif
+	uscounter_start();
+	for (uiter_t i = 0; i < TEST_SPI_BENCH_REPEAT; ++i) {
+		method();
+	}
+	result->us = uscounter_stop();
+
+#if TEST_SPI_BENCH_IRQ
+	spi_get_irq_stats(&stats);
+	result->active_us = (stats.slept_us < result->us) ? result->us - (utime_t )stats.slept_us : 0;
+	result->isr_entries = stats.isr_entries;
+	result->wakeups = stats.wakeups;
+#else
+	result->active_us = result->us;
+	result->isr_entries = 0;
+	result->wakeups = 0;
+#endif
+
+	return;
+}
+
+
+//
+// main() initialization
+void init_SPI_BENCH(void) {
+	for (txsize_t i = 0; i < TEST_SPI_BENCH_BYTES; ++i) {
+		tx_buf[i] = (uint8_t )(i * 7U);
+	}
+	for (txsize_t i = 0; i < TEST_SPI_BENCH_BYTES/2U; ++i) {
+		tx_words[i] = (uint16_t )(i * 0x0701U);
+	}
+	spi_on(NULL);
+
+	return;
+}
+
+//
+// Main loop
+void loop_SPI_BENCH(void) {
+	bench_result_t bytewise, transmit, exchange, transmit16, exchange16;
+	bool loopback;
+
+	uscounter_on();
+	time_method(byte_loop, &bytewise);
+	time_method(transmit_block, &transmit);
+	for (txsize_t i = 0; i < TEST_SPI_BENCH_BYTES; ++i) {
+		rx_buf[i] = (uint8_t )~tx_buf[i];
+	}
+	time_method(exchange_block, &exchange);
+	time_method(transmit_block16, &transmit16);
+	for (txsize_t i = 0; i < TEST_SPI_BENCH_BYTES/2U; ++i) {
+		rx_words[i] = (uint16_t )~tx_words[i];
+	}
+	time_method(exchange_block16, &exchange16);
+	uscounter_off();
+
+	loopback = true;
+	for (txsize_t i = 0; i < TEST_SPI_BENCH_BYTES; ++i) {
+		if (rx_buf[i] != tx_buf[i]) {
+			loopback = false;
+			break;
+		}
+	}
+	for (txsize_t i = 0; i < TEST_SPI_BENCH_BYTES/2U; ++i) {
+		if (rx_words[i] != tx_words[i]) {
+			loopback = false;
+			break;
+		}
+	}
+
+	PRINTF("SPI cycles/byte over %u bytes: byte loop %lu, transmit block %lu, exchange block %lu, wire %lu%s\r\n",
+		(uint_t )TEST_SPI_BENCH_BYTES,
+		(long unsigned )us_to_cycles_per_byte(bytewise.us),
+		(long unsigned )us_to_cycles_per_byte(transmit.us),
+		(long unsigned )us_to_cycles_per_byte(exchange.us),
+		(long unsigned )((8UL * BENCH_CPU_HZ) / SPI_FREQUENCY_HZ),
+		(loopback) ? " (loopback OK)" : "");
+	PRINTF("SPI KB/s: transmit 8-bit %lu, 16-bit %lu; exchange 8-bit %lu, 16-bit %lu\r\n",
+		(long unsigned )us_to_kbytes_per_s(transmit.us),
+		(long unsigned )us_to_kbytes_per_s(transmit16.us),
+		(long unsigned )us_to_kbytes_per_s(exchange.us),
+		(long unsigned )us_to_kbytes_per_s(exchange16.us));
+	PRINTF("SPI active cycles/byte (%s): byte loop %lu; transmit 8-bit %lu, 16-bit %lu; exchange 8-bit %lu, 16-bit %lu\r\n",
+		(TEST_SPI_BENCH_IRQ) ? "interrupt" : "polled",
+		(long unsigned )us_to_cycles_per_byte(bytewise.active_us),
+		(long unsigned )us_to_cycles_per_byte(transmit.active_us),
+		(long unsigned )us_to_cycles_per_byte(transmit16.active_us),
+		(long unsigned )us_to_cycles_per_byte(exchange.active_us),
+		(long unsigned )us_to_cycles_per_byte(exchange16.active_us));
+#if TEST_SPI_BENCH_IRQ
+	PRINTF("SPI interrupts/wake-ups over %lu bytes: byte loop %lu/%lu; transmit 8-bit %lu/%lu, 16-bit %lu/%lu; exchange 8-bit %lu/%lu, 16-bit %lu/%lu\r\n",
+		(long unsigned )((uint32_t )TEST_SPI_BENCH_BYTES * TEST_SPI_BENCH_REPEAT),
+		(long unsigned )bytewise.isr_entries, (long unsigned )bytewise.wakeups,
+		(long unsigned )transmit.isr_entries, (long unsigned )transmit.wakeups,
+		(long unsigned )transmit16.isr_entries, (long unsigned )transmit16.wakeups,
+		(long unsigned )exchange.isr_entries, (long unsigned )exchange.wakeups,
+		(long unsigned )exchange16.isr_entries, (long unsigned )exchange16.wakeups);
+#endif
+
+	return;
+}
+
+#endif // TEST_SPI_BENCH
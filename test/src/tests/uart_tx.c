@@ -0,0 +1,69 @@
+#include "common.h"
+
+#if TEST_UART_TX
+
+//
+// Measure how much CPU time the serial console costs per transmitted byte
+//
+// 'in call' is the time spent inside uart_transmit_block() and 'until sent'
+// is the time until the last bit is on the wire. Without a TX queue the two
+// are the same because the CPU has to wait for every byte; with one
+// (UART_TX_BUFFER_BYTES > 0) the first should drop to the cost of the copy
+// while the second stays tied to the baud rate.
+//
+// This doesn't need any hardware and can be run under simavr with
+// something like:
+//   pio run -e attiny402
+//   tools/simavr -m attiny402 -f 4000000 .pio/build/attiny402/firmware.elf
+// then rebuilt with UART_TX_BUFFER_BYTES set to compare the results.
+//
+
+//
+// Globals initialization
+static const char tx_msg[] = "The quick brown fox jumps over\r\n";
+#define TX_MSG_BYTES (sizeof(tx_msg) - 1U)
+
+
+//
+// Misc functions
+static uint32_t us_to_cycles_per_byte(utime_t us) {
+	return ((uint32_t )us * (G_freq_CPUCLK / 1000UL)) / (1000UL * TX_MSG_BYTES);
+}
+
+
+//
+// main() initialization
+void init_UART_TX(void) {
+
+
+	return;
+}
+
+//
+// Main loop
+void loop_UART_TX(void) {
+	utime_t in_call, until_sent;
+
+	// Don't count anything left over from earlier output
+	while (uart_tx_is_busy(UART_COMM_PORT)) {
+		// Nothing to do here
+	}
+
+	uscounter_on();
+	uscounter_start();
+	uart_transmit_block(UART_COMM_PORT, (const uint8_t *)tx_msg, TX_MSG_BYTES, UART_COMM_TIMEOUT_MS);
+	in_call = uscounter_read();
+	while (uart_tx_is_busy(UART_COMM_PORT)) {
+		// Nothing to do here
+	}
+	until_sent = uscounter_stop();
+	uscounter_off();
+
+	PRINTF("TX %u bytes, queue %u: %lu cycles/byte in call, %lu cycles/byte until sent\r\n",
+		(uint_t )TX_MSG_BYTES, (uint_t )UART_TX_BUFFER_BYTES,
+		(long unsigned )us_to_cycles_per_byte(in_call), (long unsigned )us_to_cycles_per_byte(until_sent));
+
+	return;
+}
+
+#endif // TEST_UART_TX
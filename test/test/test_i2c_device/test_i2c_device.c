@@ -0,0 +1,340 @@
+// Host-side tests of the I2C device interface in platform/common/i2c_device.c
+// Run with 'pio test -e native'
+#include <unity.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ulib/include/util.h"
+#include "ulib/include/error.h"
+
+#define uHAL_assert(_x_) ((void )0U)
+#define uHAL_SKIP_INVALID_ARG_CHECKS 0
+#define I2C_FREQUENCY_HZ 100000UL
+#define I2C_DEVICE_TIMEOUT_MS 50U
+
+typedef uint_fast16_t txsize_t;
+typedef uint32_t utime_t;
+
+//
+// Stand-ins for the system tick counter
+// Every attempt at a transaction takes 'attempt_ms'
+static utime_t now_ms;
+static utime_t attempt_ms;
+#define GET_SYSTICKS_MS() (now_ms)
+#define SET_TIMEOUT_MS(delay) ((GET_SYSTICKS_MS()) + (delay))
+#define TIMES_UP(timer) ((GET_SYSTICKS_MS()) >= (timer))
+
+#include "uHAL/include/interface/i2c.h"
+
+//
+// Stand-ins for what the platform's i2c.c would provide
+// Each transaction returns the next result in 'results', or ERR_OK once
+// they run out
+// The error codes are the ones the platforms use: ERR_INTERRUPT for a NACK
+// of either the address or the data, ERR_RETRY for lost arbitration, and
+// ERR_UNKNOWN for a bus error
+static struct {
+	bool on;
+	uint_t on_calls;
+	uint_t freq_calls;
+	uint32_t hz;
+	// Set to make i2c_set_frequency() fail the way it does when the bus is
+	// in use
+	bool busy;
+	uint_t attempts;
+	// The number of attempts for which the device NACKs its address, the way
+	// an EEPROM does during a write cycle; checked before 'results'
+	uint_t addr_nacks;
+	uint_t ends;
+	utime_t last_timeout;
+	uint8_t last_addr;
+	const err_t *results;
+	uint_t result_count;
+} bus;
+
+static err_t next_result(uint8_t addr, utime_t timeout) {
+	err_t res = ERR_OK;
+
+	bus.last_addr = addr;
+	bus.last_timeout = timeout;
+	if (bus.attempts < bus.addr_nacks) {
+		res = ERR_INTERRUPT;
+	} else if (bus.attempts < bus.result_count) {
+		res = bus.results[bus.attempts];
+	}
+	++bus.attempts;
+	now_ms += attempt_ms;
+
+	return res;
+}
+bool i2c_is_on(void) {
+	return bus.on;
+}
+err_t i2c_on(void) {
+	bus.on = true;
+	++bus.on_calls;
+
+	return ERR_OK;
+}
+uint32_t i2c_set_frequency(uint32_t hz) {
+	if (bus.busy) {
+		return 0;
+	}
+	bus.hz = hz;
+	++bus.freq_calls;
+
+	return hz;
+}
+err_t i2c_transmit_block(uint8_t addr, const uint8_t *tx_buffer, txsize_t tx_size, utime_t timeout) {
+	UNUSED(tx_buffer);
+	UNUSED(tx_size);
+
+	return next_result(addr, timeout);
+}
+err_t i2c_receive_block(uint8_t addr, uint8_t *rx_buffer, txsize_t rx_size, utime_t timeout) {
+	UNUSED(rx_buffer);
+	UNUSED(rx_size);
+
+	return next_result(addr, timeout);
+}
+err_t i2c_write_read(uint8_t addr, const uint8_t *tx_buffer, txsize_t tx_size, uint8_t *rx_buffer, txsize_t rx_size, utime_t timeout) {
+	UNUSED(tx_buffer);
+	UNUSED(tx_size);
+	UNUSED(rx_buffer);
+	UNUSED(rx_size);
+
+	return next_result(addr, timeout);
+}
+err_t i2c_transmit_block_begin(uint8_t addr, utime_t timeout) {
+	return next_result(addr, timeout);
+}
+err_t i2c_transmit_block_continue(const uint8_t *tx_buffer, txsize_t tx_size, utime_t timeout) {
+	UNUSED(tx_buffer);
+	UNUSED(tx_size);
+	bus.last_timeout = timeout;
+
+	return ERR_OK;
+}
+err_t i2c_transmit_block_end(void) {
+	++bus.ends;
+
+	return ERR_OK;
+}
+
+#include "uHAL/src/platform/common/i2c_device.c"
+
+static const uint8_t data[] = { 0x00U, 0x01U };
+static i2c_device_t display, eeprom, sensor;
+
+
+void setUp(void) {
+	mem_init(&bus, 0, sizeof(bus));
+	mem_init(&bus_lock, 0, sizeof(bus_lock));
+	now_ms = 0;
+	attempt_ms = 0;
+
+	display = (i2c_device_t ){ .addr = 0x3CU, .max_hz = 400000UL };
+	eeprom = (i2c_device_t ){ .addr = 0x50U, .max_hz = 400000UL, .retries = 3, .timeout = 20 };
+	sensor = (i2c_device_t ){ .addr = 0x48U };
+
+	return;
+}
+void tearDown(void) {
+	return;
+}
+
+static void test_lock(void) {
+	TEST_ASSERT_FALSE(i2c_bus_is_locked());
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_lock(&display));
+	TEST_ASSERT_TRUE(i2c_bus_is_locked());
+	TEST_ASSERT_TRUE(bus.on);
+
+	// Another device has to wait its turn
+	TEST_ASSERT_EQUAL_INT(ERR_RETRY, i2c_device_lock(&sensor));
+	TEST_ASSERT_EQUAL_INT(ERR_RETRY, i2c_device_transmit(&sensor, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT(0, bus.attempts);
+	TEST_ASSERT_EQUAL_INT(ERR_PERM, i2c_device_unlock(&sensor));
+
+	// The owner can nest locks and transactions
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_lock(&display));
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit(&display, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_unlock(&display));
+	TEST_ASSERT_TRUE(i2c_bus_is_locked());
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_unlock(&display));
+	TEST_ASSERT_FALSE(i2c_bus_is_locked());
+
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit(&sensor, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT(0x48U, bus.last_addr);
+	TEST_ASSERT_FALSE(i2c_bus_is_locked());
+
+	return;
+}
+static void test_speed(void) {
+	// The bus is only turned on once and the speed is only changed when the
+	// device changes it
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit(&display, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit(&eeprom, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT(1, bus.on_calls);
+	TEST_ASSERT_EQUAL_UINT(1, bus.freq_calls);
+	TEST_ASSERT_EQUAL_UINT(400000UL, bus.hz);
+
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit(&sensor, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT(2, bus.freq_calls);
+	TEST_ASSERT_EQUAL_UINT(I2C_FREQUENCY_HZ, bus.hz);
+
+	// If the platform changes the speed behind the device interface's back
+	// it's set again
+	bus_lock.hz = 0;
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit(&sensor, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT(3, bus.freq_calls);
+
+	// The speed can't be changed while the bus is in use
+	bus.busy = true;
+	TEST_ASSERT_EQUAL_INT(ERR_RETRY, i2c_device_transmit(&display, data, sizeof(data)));
+	TEST_ASSERT_FALSE(i2c_bus_is_locked());
+
+	return;
+}
+static void test_retry(void) {
+	const err_t nack_twice[] = { ERR_INTERRUPT, ERR_RETRY, ERR_OK };
+	const err_t nack_forever[] = { ERR_INTERRUPT, ERR_INTERRUPT, ERR_INTERRUPT, ERR_INTERRUPT, ERR_INTERRUPT };
+	const err_t fatal[] = { ERR_UNKNOWN };
+	uint8_t rx[2];
+
+	bus.results = nack_twice;
+	bus.result_count = SIZEOF_ARRAY(nack_twice);
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_write_read(&eeprom, data, sizeof(data), rx, sizeof(rx)));
+	TEST_ASSERT_EQUAL_UINT(3, bus.attempts);
+
+	// retries is the number of attempts after the first
+	bus.attempts = 0;
+	bus.results = nack_forever;
+	bus.result_count = SIZEOF_ARRAY(nack_forever);
+	TEST_ASSERT_EQUAL_INT(ERR_INTERRUPT, i2c_device_receive(&eeprom, rx, sizeof(rx)));
+	TEST_ASSERT_EQUAL_UINT(4, bus.attempts);
+
+	// Errors that won't go away by trying again aren't retried
+	bus.attempts = 0;
+	bus.results = fatal;
+	bus.result_count = SIZEOF_ARRAY(fatal);
+	TEST_ASSERT_EQUAL_INT(ERR_UNKNOWN, i2c_device_transmit(&eeprom, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT(1, bus.attempts);
+
+	// No retries by default
+	bus.attempts = 0;
+	bus.results = nack_forever;
+	bus.result_count = SIZEOF_ARRAY(nack_forever);
+	TEST_ASSERT_EQUAL_INT(ERR_INTERRUPT, i2c_device_transmit(&sensor, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT(1, bus.attempts);
+	TEST_ASSERT_EQUAL_UINT(I2C_DEVICE_TIMEOUT_MS, bus.last_timeout);
+
+	return;
+}
+static void test_timeout_policy(void) {
+	const err_t nack_forever[] = { ERR_INTERRUPT, ERR_INTERRUPT, ERR_INTERRUPT, ERR_INTERRUPT, ERR_INTERRUPT };
+
+	bus.results = nack_forever;
+	bus.result_count = SIZEOF_ARRAY(nack_forever);
+	attempt_ms = 8;
+
+	// Each attempt gets the whole timeout
+	TEST_ASSERT_EQUAL_INT(ERR_INTERRUPT, i2c_device_transmit(&eeprom, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT(4, bus.attempts);
+	TEST_ASSERT_EQUAL_UINT(20, bus.last_timeout);
+
+	// The attempts share the timeout, the third one only gets what's left and
+	// there's no time for a fourth
+	bus.attempts = 0;
+	eeprom.timeout_policy = I2C_TIMEOUT_TOTAL;
+	TEST_ASSERT_EQUAL_INT(ERR_TIMEOUT, i2c_device_transmit(&eeprom, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT(3, bus.attempts);
+	TEST_ASSERT_EQUAL_UINT(4, bus.last_timeout);
+	TEST_ASSERT_FALSE(i2c_bus_is_locked());
+
+	return;
+}
+static void test_transmit_sequence(void) {
+	const err_t nack_once[] = { ERR_INTERRUPT, ERR_OK };
+	const err_t nack_forever[] = { ERR_INTERRUPT, ERR_INTERRUPT, ERR_INTERRUPT, ERR_INTERRUPT, ERR_INTERRUPT };
+
+	// The start is retried after sending a stop
+	bus.results = nack_once;
+	bus.result_count = SIZEOF_ARRAY(nack_once);
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit_begin(&eeprom));
+	TEST_ASSERT_EQUAL_UINT(2, bus.attempts);
+	TEST_ASSERT_EQUAL_UINT(1, bus.ends);
+	TEST_ASSERT_TRUE(i2c_bus_is_locked());
+	TEST_ASSERT_EQUAL_INT(ERR_RETRY, i2c_device_transmit_begin(&display));
+	TEST_ASSERT_EQUAL_INT(ERR_PERM, i2c_device_transmit_continue(&display, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit_continue(&eeprom, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT(20, bus.last_timeout);
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit_end(&eeprom));
+	TEST_ASSERT_EQUAL_UINT(2, bus.ends);
+	TEST_ASSERT_FALSE(i2c_bus_is_locked());
+
+	// A failed start leaves the bus unlocked and ending it does nothing
+	bus.attempts = 0;
+	bus.ends = 0;
+	bus.results = nack_forever;
+	bus.result_count = SIZEOF_ARRAY(nack_forever);
+	TEST_ASSERT_EQUAL_INT(ERR_INTERRUPT, i2c_device_transmit_begin(&eeprom));
+	TEST_ASSERT_FALSE(i2c_bus_is_locked());
+	TEST_ASSERT_EQUAL_UINT(4, bus.ends);
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit_end(&eeprom));
+	TEST_ASSERT_EQUAL_UINT(4, bus.ends);
+
+	// That holds even when the caller already had the bus locked
+	bus.attempts = 0;
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_lock(&eeprom));
+	TEST_ASSERT_EQUAL_INT(ERR_INTERRUPT, i2c_device_transmit_begin(&eeprom));
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit_end(&eeprom));
+	TEST_ASSERT_TRUE(i2c_bus_is_locked());
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_unlock(&eeprom));
+	TEST_ASSERT_FALSE(i2c_bus_is_locked());
+
+	return;
+}
+//
+// Acknowledge polling: an EEPROM ignores its address until a write cycle is
+// finished, which has to be covered by the retries
+static void test_ack_polling(void) {
+	uint8_t rx[2];
+
+	bus.addr_nacks = 3;
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit(&eeprom, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT(4, bus.attempts);
+
+	bus.attempts = 0;
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_write_read(&eeprom, data, sizeof(data), rx, sizeof(rx)));
+	TEST_ASSERT_EQUAL_UINT(4, bus.attempts);
+
+	bus.attempts = 0;
+	bus.ends = 0;
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit_begin(&eeprom));
+	TEST_ASSERT_EQUAL_UINT(4, bus.attempts);
+	TEST_ASSERT_EQUAL_UINT(3, bus.ends);
+	TEST_ASSERT_EQUAL_INT(ERR_OK, i2c_device_transmit_end(&eeprom));
+
+	// A write cycle that outlasts the retries is reported as a NACK
+	bus.attempts = 0;
+	bus.addr_nacks = 5;
+	TEST_ASSERT_EQUAL_INT(ERR_INTERRUPT, i2c_device_receive(&eeprom, rx, sizeof(rx)));
+	TEST_ASSERT_EQUAL_UINT(4, bus.attempts);
+
+	return;
+}
+
+int main(void) {
+	UNITY_BEGIN();
+
+	RUN_TEST(test_lock);
+	RUN_TEST(test_speed);
+	RUN_TEST(test_retry);
+	RUN_TEST(test_timeout_policy);
+	RUN_TEST(test_transmit_sequence);
+	RUN_TEST(test_ack_polling);
+
+	return UNITY_END();
+}
@@ -0,0 +1,202 @@
+// Host-side tests of the SPI transaction queue in platform/common/spi_queue.c
+// Run with 'pio test -e native'
+#define _POSIX_C_SOURCE 200112L
+#include <unity.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ulib/include/util.h"
+
+#define SPI_QUEUE_LENGTH 4U
+
+//
+// Stand-in for the platform's transaction type, the queue only ever deals
+// with pointers to it
+typedef struct {
+	uint_t producer;
+	uint_t seq;
+} spi_transaction_t;
+
+#include "uHAL/src/platform/common/spi_queue.h"
+#include "uHAL/src/platform/common/spi_queue.c"
+
+#define STRESS_PRODUCERS 3U
+#define STRESS_TRANSACTIONS 200000UL
+
+static volatile spi_queue_t queue;
+static spi_transaction_t transactions[SPI_QUEUE_LENGTH * 2U];
+
+
+void setUp(void) {
+	spi_queue_reset(&queue);
+
+	return;
+}
+void tearDown(void) {
+	return;
+}
+
+static void test_empty(void) {
+	TEST_ASSERT_EQUAL_UINT(0, spi_queue_used(&queue));
+	TEST_ASSERT_NULL(spi_queue_peek(&queue));
+	TEST_ASSERT_NULL(spi_queue_pop(&queue));
+	TEST_ASSERT_EQUAL_UINT(0, spi_queue_used(&queue));
+
+	return;
+}
+static void test_order(void) {
+	for (uint_t i = 0; i < 3; ++i) {
+		TEST_ASSERT_TRUE(spi_queue_push(&queue, &transactions[i]));
+	}
+	TEST_ASSERT_EQUAL_UINT(3, spi_queue_used(&queue));
+
+	// Peeking leaves the transaction in place, which is how the engine keeps
+	// track of the one in progress
+	TEST_ASSERT_EQUAL_PTR(&transactions[0], spi_queue_peek(&queue));
+	TEST_ASSERT_EQUAL_PTR(&transactions[0], spi_queue_peek(&queue));
+	for (uint_t i = 0; i < 3; ++i) {
+		TEST_ASSERT_EQUAL_PTR(&transactions[i], spi_queue_pop(&queue));
+	}
+	TEST_ASSERT_NULL(spi_queue_pop(&queue));
+
+	return;
+}
+static void test_full(void) {
+	for (uint_t i = 0; i < SPI_QUEUE_LENGTH; ++i) {
+		TEST_ASSERT_TRUE(spi_queue_push(&queue, &transactions[i]));
+	}
+	TEST_ASSERT_FALSE(spi_queue_push(&queue, &transactions[SPI_QUEUE_LENGTH]));
+	TEST_ASSERT_EQUAL_UINT(SPI_QUEUE_LENGTH, spi_queue_used(&queue));
+
+	// A rejected push mustn't have clobbered the oldest entry
+	TEST_ASSERT_EQUAL_PTR(&transactions[0], spi_queue_pop(&queue));
+	TEST_ASSERT_TRUE(spi_queue_push(&queue, &transactions[SPI_QUEUE_LENGTH]));
+	for (uint_t i = 1; i <= SPI_QUEUE_LENGTH; ++i) {
+		TEST_ASSERT_EQUAL_PTR(&transactions[i], spi_queue_pop(&queue));
+	}
+
+	return;
+}
+static void test_wraparound(void) {
+	uint_t next_in = 0, next_out = 0;
+
+	// Go on long enough for the free-running indices themselves to wrap
+	for (uint_t i = 0; i < 1000; ++i) {
+		for (uint_t j = 0; j < 3; ++j) {
+			TEST_ASSERT_TRUE(spi_queue_push(&queue, &transactions[next_in % SIZEOF_ARRAY(transactions)]));
+			++next_in;
+		}
+		for (uint_t j = 0; j < 3; ++j) {
+			TEST_ASSERT_EQUAL_PTR(&transactions[next_out % SIZEOF_ARRAY(transactions)], spi_queue_pop(&queue));
+			++next_out;
+		}
+	}
+	TEST_ASSERT_EQUAL_UINT(0, spi_queue_used(&queue));
+
+	return;
+}
+static void test_reset(void) {
+	TEST_ASSERT_TRUE(spi_queue_push(&queue, &transactions[0]));
+	TEST_ASSERT_TRUE(spi_queue_push(&queue, &transactions[1]));
+	spi_queue_reset(&queue);
+	TEST_ASSERT_EQUAL_UINT(0, spi_queue_used(&queue));
+	TEST_ASSERT_NULL(spi_queue_peek(&queue));
+
+	return;
+}
+
+//
+// Several producers (standing in for the main loop and ISRs) submit while a
+// consumer (standing in for the DMA ISR) works through the queue
+// The mutex stands in for the interrupt masking done by spi_queue_submit()
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static spi_transaction_t stress_transactions[STRESS_PRODUCERS][SPI_QUEUE_LENGTH];
+static volatile uint_t producers_done;
+static volatile uint_t consumed[STRESS_PRODUCERS];
+
+static void* stress_producer(void *arg) {
+	uint_t id = (uint_t )(uintptr_t )arg;
+	bool queued;
+
+	for (uint_t seq = 0; seq < STRESS_TRANSACTIONS; ++seq) {
+		spi_transaction_t *t = &stress_transactions[id][seq % SPI_QUEUE_LENGTH];
+
+		// A transaction can't be reused until it's been consumed
+		do {
+			pthread_mutex_lock(&lock);
+			queued = ((seq - consumed[id]) < SPI_QUEUE_LENGTH);
+			if (queued) {
+				t->producer = id;
+				t->seq = seq;
+				queued = spi_queue_push(&queue, t);
+			}
+			pthread_mutex_unlock(&lock);
+			if (!queued) {
+				sched_yield();
+			}
+		} while (!queued);
+	}
+
+	pthread_mutex_lock(&lock);
+	++producers_done;
+	pthread_mutex_unlock(&lock);
+
+	return NULL;
+}
+static void test_threaded_stress(void) {
+	pthread_t producers[STRESS_PRODUCERS];
+	uint_t next_seq[STRESS_PRODUCERS] = { 0 };
+	uint_t received = 0;
+	bool in_order = true, done = false;
+
+	for (uint_t i = 0; i < STRESS_PRODUCERS; ++i) {
+		TEST_ASSERT_EQUAL_INT(0, pthread_create(&producers[i], NULL, stress_producer, (void *)(uintptr_t )i));
+	}
+
+	while (!done) {
+		spi_transaction_t *t;
+
+		pthread_mutex_lock(&lock);
+		done = (producers_done == STRESS_PRODUCERS);
+		t = spi_queue_pop(&queue);
+		if (t != NULL) {
+			if (t->seq != next_seq[t->producer]) {
+				in_order = false;
+			}
+			next_seq[t->producer] = t->seq + 1U;
+			consumed[t->producer] = t->seq + 1U;
+			++received;
+			done = false;
+		}
+		pthread_mutex_unlock(&lock);
+		if (t == NULL) {
+			sched_yield();
+		}
+	}
+	for (uint_t i = 0; i < STRESS_PRODUCERS; ++i) {
+		pthread_join(producers[i], NULL);
+	}
+
+	TEST_ASSERT_TRUE(in_order);
+	TEST_ASSERT_EQUAL_UINT(STRESS_PRODUCERS * STRESS_TRANSACTIONS, received);
+	TEST_ASSERT_EQUAL_UINT(0, spi_queue_used(&queue));
+
+	return;
+}
+
+int main(void) {
+	UNITY_BEGIN();
+
+	RUN_TEST(test_empty);
+	RUN_TEST(test_order);
+	RUN_TEST(test_full);
+	RUN_TEST(test_wraparound);
+	RUN_TEST(test_reset);
+	RUN_TEST(test_threaded_stress);
+
+	return UNITY_END();
+}
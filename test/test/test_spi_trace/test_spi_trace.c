@@ -0,0 +1,226 @@
+// Host-side tests of the SPI transaction trace in platform/common/spi_trace.c
+// Run with 'pio test -e native'
+#include <unity.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ulib/include/util.h"
+#include "ulib/include/error.h"
+
+#define uHAL_assert(_x_) ((void )0U)
+#define uHAL_SKIP_INVALID_ARG_CHECKS 0
+#define ENABLE_SPI_TRACE 1
+#define SPI_TRACE_LENGTH 4U
+#define SPI_TRACE_HISTOGRAM_BINS 8U
+
+//
+// Stand-ins for what the platform's spi.c would provide
+#define DISABLE_INTERRUPTS(_s_) do { (_s_) = 0; } while (0)
+#define RESTORE_INTERRUPTS(_s_) do { (void )(_s_); } while (0)
+
+static uint32_t now_us;
+static uint_fast32_t uscounter_read(void) {
+	return now_us;
+}
+
+#include "uHAL/src/platform/common/spi_trace.h"
+
+typedef struct spi_device_t {
+	uint8_t cs_pin;
+} spi_device_t;
+typedef struct {
+	const spi_device_t *dev;
+	uint32_t start_us;
+	uint32_t end_us;
+	uint32_t idle_us;
+} spi_trace_entry_t;
+#define SPI_TRACE_IDLE_UNKNOWN 0xFFFFFFFFUL
+typedef struct {
+	uint_fast16_t count;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint32_t total_us;
+	uint32_t max_idle_us;
+	uint_fast16_t busy[SPI_TRACE_HISTOGRAM_BINS];
+	uint_fast16_t idle[SPI_TRACE_HISTOGRAM_BINS];
+} spi_trace_histogram_t;
+
+#include "uHAL/src/platform/common/spi_trace.c"
+
+static const spi_device_t dev_a = { 1 }, dev_b = { 2 }, dev_c = { 3 };
+static spi_trace_port_t port_1, port_2;
+
+
+void setUp(void) {
+	spi_trace_clear();
+	mem_init(&port_1, 0, sizeof(port_1));
+	mem_init(&port_2, 0, sizeof(port_2));
+	now_us = 0;
+
+	return;
+}
+void tearDown(void) {
+	return;
+}
+
+static void transaction(spi_trace_port_t *pt, const spi_device_t *dev, uint32_t start, uint32_t end) {
+	now_us = start;
+	spi_trace_begin(pt, dev);
+	now_us = end;
+	spi_trace_end(pt, dev);
+
+	return;
+}
+
+static void test_empty(void) {
+	spi_trace_entry_t entries[SPI_TRACE_LENGTH];
+	spi_trace_histogram_t hist;
+
+	TEST_ASSERT_EQUAL_UINT(0, spi_trace_read(entries, SIZEOF_ARRAY(entries)));
+	TEST_ASSERT_EQUAL_INT(ERR_OK, spi_trace_histogram(NULL, &hist));
+	TEST_ASSERT_EQUAL_UINT(0, hist.count);
+	TEST_ASSERT_EQUAL_UINT(0, hist.min_us);
+
+	return;
+}
+static void test_record(void) {
+	spi_trace_entry_t entries[SPI_TRACE_LENGTH];
+
+	transaction(&port_1, &dev_a, 10, 25);
+	TEST_ASSERT_EQUAL_UINT(1, spi_trace_read(entries, SIZEOF_ARRAY(entries)));
+	TEST_ASSERT_EQUAL_PTR(&dev_a, entries[0].dev);
+	TEST_ASSERT_EQUAL_UINT(10, entries[0].start_us);
+	TEST_ASSERT_EQUAL_UINT(25, entries[0].end_us);
+	TEST_ASSERT_EQUAL_UINT(SPI_TRACE_IDLE_UNKNOWN, entries[0].idle_us);
+
+	// Ending a device that wasn't begun records nothing
+	spi_trace_end(&port_1, &dev_b);
+	TEST_ASSERT_EQUAL_UINT(1, spi_trace_read(entries, SIZEOF_ARRAY(entries)));
+
+	return;
+}
+static void test_overwrite(void) {
+	spi_trace_entry_t entries[SPI_TRACE_LENGTH];
+
+	// Go on long enough for the free-running indices themselves to wrap
+	for (uint32_t i = 0; i < 1000; ++i) {
+		transaction(&port_1, &dev_a, i * 10U, (i * 10U) + 1U);
+	}
+	TEST_ASSERT_EQUAL_UINT(SPI_TRACE_LENGTH, spi_trace_read(entries, SIZEOF_ARRAY(entries)));
+	for (uint_t i = 0; i < SPI_TRACE_LENGTH; ++i) {
+		TEST_ASSERT_EQUAL_UINT((1000U - SPI_TRACE_LENGTH + i) * 10U, entries[i].start_us);
+	}
+
+	// A short buffer gets the oldest entries
+	TEST_ASSERT_EQUAL_UINT(2, spi_trace_read(entries, 2));
+	TEST_ASSERT_EQUAL_UINT((1000U - SPI_TRACE_LENGTH) * 10U, entries[0].start_us);
+
+	return;
+}
+static void test_devices(void) {
+	const spi_device_t *devs[4];
+
+	transaction(&port_1, &dev_b, 0, 1);
+	transaction(&port_1, &dev_a, 2, 3);
+	transaction(&port_1, &dev_b, 4, 5);
+	TEST_ASSERT_EQUAL_UINT(2, spi_trace_devices(devs, SIZEOF_ARRAY(devs)));
+	TEST_ASSERT_EQUAL_PTR(&dev_b, devs[0]);
+	TEST_ASSERT_EQUAL_PTR(&dev_a, devs[1]);
+	TEST_ASSERT_EQUAL_UINT(1, spi_trace_devices(devs, 1));
+
+	return;
+}
+static void test_histogram(void) {
+	spi_trace_histogram_t hist;
+
+	transaction(&port_1, &dev_a, 100, 101);  // 1us busy
+	transaction(&port_1, &dev_b, 110, 140);  // 30us busy, 9us idle
+	transaction(&port_1, &dev_a, 1140, 1145); // 5us busy, 1000us idle
+	transaction(&port_1, &dev_a, 1145, 1645); // 500us busy, 0us idle
+
+	TEST_ASSERT_EQUAL_INT(ERR_OK, spi_trace_histogram(&dev_a, &hist));
+	TEST_ASSERT_EQUAL_UINT(3, hist.count);
+	TEST_ASSERT_EQUAL_UINT(1, hist.min_us);
+	TEST_ASSERT_EQUAL_UINT(500, hist.max_us);
+	TEST_ASSERT_EQUAL_UINT(506, hist.total_us);
+	TEST_ASSERT_EQUAL_UINT(1000, hist.max_idle_us);
+	TEST_ASSERT_EQUAL_UINT(1, hist.busy[0]);
+	TEST_ASSERT_EQUAL_UINT(1, hist.busy[2]);
+	// 500us is beyond the last bin's lower bound so it lands there
+	TEST_ASSERT_EQUAL_UINT(1, hist.busy[SPI_TRACE_HISTOGRAM_BINS - 1U]);
+	// The first transaction on the port has no idle time; idle time is
+	// measured from whichever device was last on the bus
+	TEST_ASSERT_EQUAL_UINT(1, hist.idle[0]);
+	TEST_ASSERT_EQUAL_UINT(1, hist.idle[SPI_TRACE_HISTOGRAM_BINS - 1U]);
+
+	TEST_ASSERT_EQUAL_INT(ERR_OK, spi_trace_histogram(&dev_b, &hist));
+	TEST_ASSERT_EQUAL_UINT(1, hist.count);
+	TEST_ASSERT_EQUAL_UINT(1, hist.busy[4]);
+	TEST_ASSERT_EQUAL_UINT(1, hist.idle[3]);
+
+	TEST_ASSERT_EQUAL_INT(ERR_OK, spi_trace_histogram(NULL, &hist));
+	TEST_ASSERT_EQUAL_UINT(4, hist.count);
+
+	return;
+}
+static void test_ports(void) {
+	spi_trace_entry_t entries[SPI_TRACE_LENGTH];
+	spi_trace_histogram_t hist;
+
+	// Transactions on different ports overlap and each port's idle time only
+	// counts its own transactions
+	now_us = 100;
+	spi_trace_begin(&port_1, &dev_a);
+	now_us = 110;
+	spi_trace_begin(&port_2, &dev_c);
+	now_us = 120;
+	spi_trace_end(&port_1, &dev_a);
+	now_us = 150;
+	spi_trace_end(&port_2, &dev_c);
+	transaction(&port_1, &dev_b, 130, 140);
+	transaction(&port_2, &dev_c, 200, 210);
+
+	TEST_ASSERT_EQUAL_UINT(4, spi_trace_read(entries, SIZEOF_ARRAY(entries)));
+	TEST_ASSERT_EQUAL_PTR(&dev_a, entries[0].dev);
+	TEST_ASSERT_EQUAL_PTR(&dev_c, entries[1].dev);
+	TEST_ASSERT_EQUAL_UINT(110, entries[1].start_us);
+	TEST_ASSERT_EQUAL_UINT(SPI_TRACE_IDLE_UNKNOWN, entries[1].idle_us);
+	TEST_ASSERT_EQUAL_PTR(&dev_b, entries[2].dev);
+	TEST_ASSERT_EQUAL_UINT(10, entries[2].idle_us);
+	TEST_ASSERT_EQUAL_UINT(50, entries[3].idle_us);
+
+	TEST_ASSERT_EQUAL_INT(ERR_OK, spi_trace_histogram(&dev_c, &hist));
+	TEST_ASSERT_EQUAL_UINT(2, hist.count);
+	TEST_ASSERT_EQUAL_UINT(50, hist.max_idle_us);
+	TEST_ASSERT_EQUAL_UINT(1, hist.idle[5]);
+
+	return;
+}
+static void test_counter_wrap(void) {
+	spi_trace_histogram_t hist;
+
+	transaction(&port_1, &dev_a, 0xFFFFFFF0UL, 0xFFFFFFF8UL);
+	transaction(&port_1, &dev_a, 0xFFFFFFFCUL, 0x00000004UL);
+
+	TEST_ASSERT_EQUAL_INT(ERR_OK, spi_trace_histogram(&dev_a, &hist));
+	TEST_ASSERT_EQUAL_UINT(8, hist.max_us);
+	TEST_ASSERT_EQUAL_UINT(4, hist.max_idle_us);
+
+	return;
+}
+
+int main(void) {
+	UNITY_BEGIN();
+
+	RUN_TEST(test_empty);
+	RUN_TEST(test_record);
+	RUN_TEST(test_overwrite);
+	RUN_TEST(test_devices);
+	RUN_TEST(test_histogram);
+	RUN_TEST(test_ports);
+	RUN_TEST(test_counter_wrap);
+
+	return UNITY_END();
+}
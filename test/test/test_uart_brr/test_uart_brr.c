@@ -0,0 +1,160 @@
+// Host-side tests of the STM32 UART baud rate register calculations in
+// platform/CMSIS_STM32/uart_calc_brr.h
+// Run with 'pio test -e native'
+#include <unity.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ulib/include/util.h"
+
+#include "uHAL/src/platform/CMSIS_STM32/uart_calc_brr.h"
+
+//
+// Every bus clock and baud rate the supported boards and configurations use
+static const uint32_t busfreqs[] = {
+	8000000UL,  // F1 HSI
+	16000000UL, // F4 HSI
+	24000000UL,
+	36000000UL, // F1 PCLK1 at 72MHz
+	42000000UL, // F401 PCLK1 at 84MHz
+	48000000UL,
+	72000000UL, // F1 PCLK2 at 72MHz
+	84000000UL, // F401 PCLK2 at 84MHz
+};
+static const uint32_t bauds[] = {
+	9600UL, 19200UL, 38400UL, 57600UL, 115200UL, 230400UL, 460800UL,
+	921600UL, 1000000UL, 2000000UL, 3000000UL,
+};
+
+//
+// Known-good register values
+typedef struct {
+	uint32_t busfreq;
+	uint32_t baud;
+	bool allow_over8;
+	uint16_t brr;
+	bool over8;
+} brr_case_t;
+static const brr_case_t brr_cases[] = {
+	{  8000000UL,    9600UL, false, 0x0341U, false },
+	{ 36000000UL,    9600UL, false, 0x0EA6U, false },
+	{ 72000000UL,  115200UL, false, 0x0271U, false },
+	{ 72000000UL, 3000000UL, false, 0x0018U, false },
+	// 45.57 rounds up, the old truncating calculation gave 45 for a 1.3% error
+	{ 42000000UL,  921600UL, true,  0x002EU, false },
+	{ 84000000UL,  921600UL, true,  0x005BU, false },
+	{ 84000000UL, 3000000UL, true,  0x001CU, false },
+	// Only reachable by oversampling by 8
+	{ 42000000UL, 3000000UL, true,  0x0016U, true  },
+	{ 16000000UL, 2000000UL, true,  0x0010U, true  },
+	{  8000000UL,  921600UL, true,  0x0011U, true  },
+	{  8000000UL,  921600UL, false, 0x0000U, false },
+	// Too fast for anything
+	{  8000000UL, 2000000UL, true,  0x0000U, false },
+};
+
+static uint32_t abs_diff(uint32_t a, uint32_t b) {
+	return (a > b) ? (a - b) : (b - a);
+}
+//
+// The number of bus clocks per bit encoded in a BRR value
+static uint32_t brr_to_div(uint16_t brr, bool over8) {
+	return (over8) ? (((uint32_t )brr & ~0x0FU) >> 1U) | (brr & 0x07U) : brr;
+}
+
+
+void setUp(void) {
+	return;
+}
+void tearDown(void) {
+	return;
+}
+
+static void test_known_values(void) {
+	for (uint_t i = 0; i < SIZEOF_ARRAY(brr_cases); ++i) {
+		const brr_case_t *c = &brr_cases[i];
+		bool over8;
+
+		TEST_ASSERT_EQUAL_UINT(c->brr, uart_calc_brr(c->baud, c->busfreq, c->allow_over8, &over8));
+		TEST_ASSERT_EQUAL_INT(c->over8, over8);
+	}
+
+	return;
+}
+static void test_all_combinations(void) {
+	for (uint_t f = 0; f < SIZEOF_ARRAY(busfreqs); ++f) {
+		for (uint_t b = 0; b < SIZEOF_ARRAY(bauds); ++b) {
+			for (uint_t allow_over8 = 0; allow_over8 < 2; ++allow_over8) {
+				uint32_t busfreq = busfreqs[f], baud = bauds[b];
+				uint32_t div, actual;
+				uint16_t brr;
+				bool over8;
+
+				brr = uart_calc_brr(baud, busfreq, allow_over8, &over8);
+				if (brr == 0) {
+					// Make sure it's actually out of reach
+					TEST_ASSERT_TRUE(((busfreq + (baud / 2U)) / baud) < ((allow_over8) ? 8U : 16U));
+					continue;
+				}
+
+				div = brr_to_div(brr, over8);
+				actual = uart_calc_baud(brr, busfreq, over8);
+				// BRR[3] has to be kept clear when oversampling by 8, and that
+				// should only be done when it's needed
+				if (over8) {
+					TEST_ASSERT_TRUE(allow_over8);
+					TEST_ASSERT_EQUAL_UINT(0, brr & 0x08U);
+					TEST_ASSERT_TRUE(div >= 8U && div < 16U);
+				} else {
+					TEST_ASSERT_TRUE(div >= 16U);
+				}
+				TEST_ASSERT_EQUAL_UINT((busfreq + (div / 2U)) / div, actual);
+				// The closest divisor must have been chosen
+				TEST_ASSERT_TRUE(abs_diff(busfreq, baud * div) <= abs_diff(busfreq, baud * (div - 1U)));
+				TEST_ASSERT_TRUE(abs_diff(busfreq, baud * div) <= abs_diff(busfreq, baud * (div + 1U)));
+				// Which means the error is at most half a step
+				TEST_ASSERT_TRUE(abs_diff(actual, baud) <= ((actual / (2U * div)) + 1U));
+			}
+		}
+	}
+
+	return;
+}
+//
+// 921600 baud and up are the reason for all this, make sure they're usable
+// wherever they're reachable
+static void test_high_baud_error(void) {
+	for (uint_t f = 0; f < SIZEOF_ARRAY(busfreqs); ++f) {
+		for (uint_t b = 0; b < SIZEOF_ARRAY(bauds); ++b) {
+			uint32_t busfreq = busfreqs[f], baud = bauds[b];
+			uint16_t brr;
+			bool over8;
+
+			if (baud < 921600UL) {
+				continue;
+			}
+			brr = uart_calc_brr(baud, busfreq, true, &over8);
+			if (brr == 0) {
+				continue;
+			}
+			// Anything over ~4% is going to fail outright, but aim for better
+			// than the 2% or so that's comfortable at both ends
+			if (brr_to_div(brr, over8) >= 24U) {
+				TEST_ASSERT_TRUE((abs_diff(uart_calc_baud(brr, busfreq, over8), baud) * 100UL) <= (baud * 2UL));
+			}
+		}
+	}
+
+	return;
+}
+
+int main(void) {
+	UNITY_BEGIN();
+
+	RUN_TEST(test_known_values);
+	RUN_TEST(test_all_combinations);
+	RUN_TEST(test_high_baud_error);
+
+	return UNITY_END();
+}
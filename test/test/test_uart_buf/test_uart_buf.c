@@ -0,0 +1,390 @@
+// Host-side tests of the UART RX ring buffer in platform/common/uart_buf.c
+// Run with 'pio test -e native'
+#define _POSIX_C_SOURCE 200112L
+#include <unity.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ulib/include/util.h"
+
+#define ENABLE_UART_LISTENING 1
+#define UART_INPUT_BUFFER_BYTES 16U
+#define ENABLE_UART_FLOW_CONTROL 1
+#define UART_RTS_HIGH_WATER 12U
+#define UART_RTS_LOW_WATER 8U
+#define ENABLE_UART_STATS 1
+#define ENABLE_UART_LINE_MODE 1
+
+typedef uint_fast16_t txsize_t;
+
+//
+// Stand-in for the GPIO interface so that the RTS pin can be watched
+typedef unsigned int gpio_pin_t;
+typedef enum {
+	GPIO_LOW  = 0U,
+	GPIO_HIGH = 1U,
+	GPIO_FLOAT
+} gpio_state_t;
+static volatile gpio_state_t rts_state;
+static int gpio_set_output_state(gpio_pin_t pin, gpio_state_t new_state) {
+	UNUSED(pin);
+	rts_state = new_state;
+	return 0;
+}
+
+#include "uHAL/src/platform/common/uart_buf.h"
+typedef struct {
+	gpio_pin_t rts_pin;
+	volatile uart_buffer_t rx_buf;
+	volatile uart_stats_t stats;
+} uart_port_t;
+#include "uHAL/src/platform/common/uart_buf.c"
+
+#define STRESS_BYTES 500000UL
+// How many times the producer yields waiting for RTS before deciding it's
+// stuck
+#define STRESS_RTS_WAIT 10000000UL
+
+static uart_port_t port;
+
+
+void setUp(void) {
+	uart_buffer_reset(&port.rx_buf);
+	uart_stats_reset(&port);
+	port.rts_pin = 1;
+	rts_state = GPIO_LOW;
+
+	return;
+}
+void tearDown(void) {
+	return;
+}
+
+static void test_empty(void) {
+	uint8_t buf[4];
+
+	TEST_ASSERT_EQUAL_UINT(0, uart_buffer_used(&port.rx_buf));
+	TEST_ASSERT_EQUAL_UINT(0, eat_uart_buffer(&port, buf, sizeof(buf)));
+
+	return;
+}
+static void test_overrun(void) {
+	uint8_t buf[UART_INPUT_BUFFER_BYTES];
+
+	for (uint_t i = 0; i < UART_INPUT_BUFFER_BYTES; ++i) {
+		TEST_ASSERT_TRUE(uart_buffer_push(&port.rx_buf, (uint8_t )i));
+	}
+	TEST_ASSERT_FALSE(uart_buffer_push(&port.rx_buf, 0xFFU));
+	TEST_ASSERT_FALSE(uart_buffer_push(&port.rx_buf, 0xFFU));
+	TEST_ASSERT_EQUAL_UINT(2, port.rx_buf.overruns);
+	TEST_ASSERT_EQUAL_UINT(UART_INPUT_BUFFER_BYTES, uart_buffer_used(&port.rx_buf));
+
+	TEST_ASSERT_EQUAL_UINT(UART_INPUT_BUFFER_BYTES, eat_uart_buffer(&port, buf, sizeof(buf)));
+	for (uint_t i = 0; i < UART_INPUT_BUFFER_BYTES; ++i) {
+		TEST_ASSERT_EQUAL_UINT8(i, buf[i]);
+	}
+	TEST_ASSERT_EQUAL_UINT(0, uart_buffer_used(&port.rx_buf));
+
+	return;
+}
+static void test_wraparound(void) {
+	uint8_t buf[UART_INPUT_BUFFER_BYTES];
+	uint8_t next_in = 0, next_out = 0;
+
+	// Use an odd chunk size so that reads straddle the end of the buffer and
+	// go on long enough for the indices themselves to wrap
+	for (uint_t i = 0; i < 1000; ++i) {
+		for (uint_t j = 0; j < 5; ++j) {
+			TEST_ASSERT_TRUE(uart_buffer_push(&port.rx_buf, next_in++));
+		}
+		TEST_ASSERT_EQUAL_UINT(3, eat_uart_buffer(&port, buf, 3));
+		TEST_ASSERT_EQUAL_UINT(2, eat_uart_buffer(&port, &buf[3], sizeof(buf) - 3));
+		for (uint_t j = 0; j < 5; ++j) {
+			TEST_ASSERT_EQUAL_UINT8(next_out, buf[j]);
+			++next_out;
+		}
+	}
+	TEST_ASSERT_EQUAL_UINT(0, port.rx_buf.overruns);
+
+	return;
+}
+//
+// Some producers (like a DMA controller) write without checking for room,
+// in which case the reader needs to skip whatever was overwritten
+static void test_unchecked_producer(void) {
+	uint8_t buf[UART_INPUT_BUFFER_BYTES];
+	uint8_t c = 0;
+
+	for (uint_t i = 0; i < UART_INPUT_BUFFER_BYTES + 5; ++i) {
+		port.rx_buf.buffer[port.rx_buf.head & UART_INPUT_BUFFER_MASK] = c++;
+		++port.rx_buf.head;
+	}
+
+	TEST_ASSERT_EQUAL_UINT(UART_INPUT_BUFFER_BYTES, eat_uart_buffer(&port, buf, sizeof(buf)));
+	TEST_ASSERT_EQUAL_UINT(5, port.rx_buf.overruns);
+	for (uint_t i = 0; i < UART_INPUT_BUFFER_BYTES; ++i) {
+		TEST_ASSERT_EQUAL_UINT8(i + 5, buf[i]);
+	}
+	TEST_ASSERT_EQUAL_UINT(0, uart_buffer_used(&port.rx_buf));
+
+	return;
+}
+//
+// Peeking only returns the part of the waiting data that doesn't wrap and
+// leaves it in place until it's consumed
+static void test_peek_consume(void) {
+	const uint8_t *data;
+	uint8_t buf[4];
+
+	// Start close enough to the end of the buffer that the data wraps
+	for (uint_t i = 0; i < UART_INPUT_BUFFER_BYTES - 3; ++i) {
+		TEST_ASSERT_TRUE(uart_buffer_push(&port.rx_buf, 0xFFU));
+	}
+	TEST_ASSERT_EQUAL_UINT(UART_INPUT_BUFFER_BYTES - 3, consume_uart_buffer(&port, UART_INPUT_BUFFER_BYTES));
+	for (uint_t i = 0; i < 8; ++i) {
+		TEST_ASSERT_TRUE(uart_buffer_push(&port.rx_buf, (uint8_t )i));
+	}
+
+	TEST_ASSERT_EQUAL_UINT(3, peek_uart_buffer(&port, &data));
+	TEST_ASSERT_EQUAL_UINT8(0, data[0]);
+	TEST_ASSERT_EQUAL_UINT8(2, data[2]);
+	// Peeking again without consuming gives the same span
+	TEST_ASSERT_EQUAL_UINT(3, peek_uart_buffer(&port, &data));
+	TEST_ASSERT_EQUAL_UINT(8, uart_buffer_used(&port.rx_buf));
+
+	TEST_ASSERT_EQUAL_UINT(2, consume_uart_buffer(&port, 2));
+	TEST_ASSERT_EQUAL_UINT(1, peek_uart_buffer(&port, &data));
+	TEST_ASSERT_EQUAL_UINT8(2, data[0]);
+	TEST_ASSERT_EQUAL_UINT(1, consume_uart_buffer(&port, 1));
+
+	TEST_ASSERT_EQUAL_UINT(5, peek_uart_buffer(&port, &data));
+	TEST_ASSERT_EQUAL_UINT8(3, data[0]);
+	TEST_ASSERT_EQUAL_UINT(1, consume_uart_buffer(&port, 1));
+	// Peeking and copying can be mixed
+	TEST_ASSERT_EQUAL_UINT(4, eat_uart_buffer(&port, buf, sizeof(buf)));
+	TEST_ASSERT_EQUAL_UINT8(4, buf[0]);
+	TEST_ASSERT_EQUAL_UINT8(7, buf[3]);
+
+	// Consuming more than is there only releases what is
+	TEST_ASSERT_EQUAL_UINT(0, peek_uart_buffer(&port, &data));
+	TEST_ASSERT_EQUAL_UINT(0, consume_uart_buffer(&port, 1));
+	TEST_ASSERT_EQUAL_UINT(0, port.rx_buf.overruns);
+
+	return;
+}
+
+static void test_rts_watermarks(void) {
+	uint8_t buf[4];
+
+	for (uint8_t i = 0; i < (UART_RTS_HIGH_WATER - 1U); ++i) {
+		uart_buffer_push(&port.rx_buf, i);
+		uart_rts_check_hold(&port);
+	}
+	TEST_ASSERT_EQUAL_UINT(GPIO_LOW, rts_state);
+
+	uart_buffer_push(&port.rx_buf, 0);
+	uart_rts_check_hold(&port);
+	TEST_ASSERT_EQUAL_UINT(GPIO_HIGH, rts_state);
+	TEST_ASSERT_TRUE(port.rx_buf.rts_held);
+
+	// Nothing changes until the buffer is back down to the low-water mark
+	TEST_ASSERT_EQUAL_UINT(3, eat_uart_buffer(&port, buf, 3));
+	TEST_ASSERT_EQUAL_UINT(GPIO_HIGH, rts_state);
+	TEST_ASSERT_EQUAL_UINT(UART_RTS_HIGH_WATER - UART_RTS_LOW_WATER - 3U, consume_uart_buffer(&port, UART_RTS_HIGH_WATER - UART_RTS_LOW_WATER - 3U));
+	TEST_ASSERT_EQUAL_UINT(GPIO_LOW, rts_state);
+	TEST_ASSERT_FALSE(port.rx_buf.rts_held);
+
+	// Without a pin nothing is touched
+	uart_buffer_reset(&port.rx_buf);
+	port.rts_pin = 0;
+	for (uint8_t i = 0; i < UART_INPUT_BUFFER_BYTES; ++i) {
+		uart_buffer_push(&port.rx_buf, i);
+		uart_rts_check_hold(&port);
+	}
+	TEST_ASSERT_EQUAL_UINT(GPIO_LOW, rts_state);
+	TEST_ASSERT_FALSE(port.rx_buf.rts_held);
+
+	return;
+}
+
+static void test_stats(void) {
+	uart_stats_t stats;
+	uint8_t buf[8];
+
+	for (uint8_t i = 0; i < 6; ++i) {
+		uart_buffer_size_t from = port.rx_buf.head;
+
+		uart_buffer_push(&port.rx_buf, i);
+		uart_buffer_pushed(&port, from);
+	}
+	TEST_ASSERT_EQUAL_UINT(4, eat_uart_buffer(&port, buf, 4));
+	for (uint8_t i = 0; i < UART_INPUT_BUFFER_BYTES; ++i) {
+		uart_buffer_size_t from = port.rx_buf.head;
+
+		uart_buffer_push(&port.rx_buf, i);
+		uart_buffer_pushed(&port, from);
+	}
+
+	// The peak is the high point, not the current level, and dropped bytes
+	// come from the buffer's overrun counter
+	uart_stats_copy(&port, &stats);
+	TEST_ASSERT_EQUAL_UINT(UART_INPUT_BUFFER_BYTES, stats.rx_peak);
+	TEST_ASSERT_EQUAL_UINT(2, stats.rx_dropped);
+	TEST_ASSERT_EQUAL_UINT(UART_INPUT_BUFFER_BYTES, eat_uart_buffer(&port, buf, sizeof(buf)) + eat_uart_buffer(&port, buf, sizeof(buf)));
+	uart_stats_copy(&port, &stats);
+	TEST_ASSERT_EQUAL_UINT(UART_INPUT_BUFFER_BYTES, stats.rx_peak);
+
+	uart_stats_reset(&port);
+	uart_stats_copy(&port, &stats);
+	TEST_ASSERT_EQUAL_UINT(0, stats.rx_peak);
+	TEST_ASSERT_EQUAL_UINT(0, stats.rx_dropped);
+
+	return;
+}
+
+//
+// Feed a string to the buffer the way the RX ISR does and return the number
+// of times the hook would have been called
+static unsigned push_line(const char *s) {
+	unsigned hooks = 0;
+
+	for (; *s != 0; ++s) {
+		uart_buffer_size_t from = port.rx_buf.head;
+
+		uart_buffer_push(&port.rx_buf, (uint8_t )*s);
+		uart_buffer_pushed(&port, from);
+		if (uart_buffer_hook_is_due(&port.rx_buf)) {
+			++hooks;
+		}
+	}
+
+	return hooks;
+}
+static void test_line_mode(void) {
+	uint8_t buf[UART_INPUT_BUFFER_BYTES];
+
+	// Without delimiters every byte calls the hook and any data is a line
+	TEST_ASSERT_EQUAL_UINT(3, push_line("ab\n"));
+	TEST_ASSERT_TRUE(uart_buffer_line_is_available(&port.rx_buf, port.rx_buf.head));
+	eat_uart_buffer(&port, buf, sizeof(buf));
+
+	uart_buffer_set_delimiters(&port.rx_buf, "\r\n");
+	TEST_ASSERT_EQUAL_UINT(0, push_line("abc"));
+	TEST_ASSERT_FALSE(uart_buffer_line_is_available(&port.rx_buf, port.rx_buf.head));
+	TEST_ASSERT_EQUAL_UINT(1, push_line("d\r"));
+	TEST_ASSERT_TRUE(uart_buffer_line_is_available(&port.rx_buf, port.rx_buf.head));
+	TEST_ASSERT_EQUAL_UINT(1, push_line("\nef"));
+
+	// The line stays available until the last delimiter has been read
+	TEST_ASSERT_EQUAL_UINT(4, eat_uart_buffer(&port, buf, 4));
+	TEST_ASSERT_TRUE(uart_buffer_line_is_available(&port.rx_buf, port.rx_buf.head));
+	TEST_ASSERT_EQUAL_UINT(2, eat_uart_buffer(&port, buf, 2));
+	TEST_ASSERT_FALSE(uart_buffer_line_is_available(&port.rx_buf, port.rx_buf.head));
+	TEST_ASSERT_EQUAL_UINT(2, eat_uart_buffer(&port, buf, sizeof(buf)));
+
+	// A long run without a delimiter must not wrap the old line end back
+	// into the unread data
+	for (unsigned i = 0; i < 64; ++i) {
+		TEST_ASSERT_EQUAL_UINT(0, push_line("xyz"));
+		TEST_ASSERT_FALSE(uart_buffer_line_is_available(&port.rx_buf, port.rx_buf.head));
+		eat_uart_buffer(&port, buf, 3);
+	}
+
+	// A single delimiter works too
+	uart_buffer_set_delimiters(&port.rx_buf, ";");
+	TEST_ASSERT_EQUAL_UINT(0, push_line("a\n"));
+	TEST_ASSERT_EQUAL_UINT(1, push_line(";"));
+	TEST_ASSERT_TRUE(uart_buffer_line_is_available(&port.rx_buf, port.rx_buf.head));
+
+	uart_buffer_set_delimiters(&port.rx_buf, NULL);
+	TEST_ASSERT_EQUAL_UINT(1, push_line("b"));
+
+	return;
+}
+
+//
+// Run the producer (standing in for the RX ISR) and the consumer in separate
+// threads without any locking between them
+// The producer also stands in for a sender that respects RTS, which is only
+// checked between bytes so it can still overrun the buffer if the consumer
+// falls behind
+static volatile unsigned long producer_failed;
+static volatile bool rts_stuck;
+static void* stress_producer(void *arg) {
+	UNUSED(arg);
+
+	for (unsigned long i = 0; i < STRESS_BYTES; ++i) {
+		for (unsigned long w = 0; rts_state == GPIO_HIGH; ++w) {
+			if (w >= STRESS_RTS_WAIT) {
+				rts_stuck = true;
+				break;
+			}
+			sched_yield();
+		}
+		// Keep trying so that the consumer can check the sequence, but count
+		// the failures so they can be checked against the overrun counter
+		while (!uart_buffer_push(&port.rx_buf, (uint8_t )i)) {
+			++producer_failed;
+			// Don't hog the CPU on single-core hosts
+			sched_yield();
+		}
+		uart_rts_check_hold(&port);
+	}
+
+	return NULL;
+}
+static void test_threaded_stress(void) {
+	pthread_t producer;
+	uint8_t buf[7];
+	unsigned long received = 0;
+	bool in_order = true;
+
+	producer_failed = 0;
+	rts_stuck = false;
+	TEST_ASSERT_EQUAL_INT(0, pthread_create(&producer, NULL, stress_producer, NULL));
+
+	while (received < STRESS_BYTES) {
+		txsize_t got = eat_uart_buffer(&port, buf, sizeof(buf));
+
+		if (got == 0) {
+			sched_yield();
+			continue;
+		}
+		for (txsize_t i = 0; i < got; ++i) {
+			if (buf[i] != (uint8_t )(received + i)) {
+				in_order = false;
+			}
+		}
+		received += got;
+	}
+	pthread_join(producer, NULL);
+
+	TEST_ASSERT_TRUE(in_order);
+	TEST_ASSERT_EQUAL_UINT(STRESS_BYTES, received);
+	TEST_ASSERT_EQUAL_UINT(0, uart_buffer_used(&port.rx_buf));
+	TEST_ASSERT_EQUAL_UINT((uint_fast16_t )producer_failed, port.rx_buf.overruns);
+	TEST_ASSERT_FALSE(rts_stuck);
+	TEST_ASSERT_EQUAL_UINT(GPIO_LOW, rts_state);
+	TEST_ASSERT_FALSE(port.rx_buf.rts_held);
+
+	return;
+}
+
+int main(void) {
+	UNITY_BEGIN();
+
+	RUN_TEST(test_empty);
+	RUN_TEST(test_overrun);
+	RUN_TEST(test_wraparound);
+	RUN_TEST(test_unchecked_producer);
+	RUN_TEST(test_peek_consume);
+	RUN_TEST(test_rts_watermarks);
+	RUN_TEST(test_stats);
+	RUN_TEST(test_line_mode);
+	RUN_TEST(test_threaded_stress);
+
+	return UNITY_END();
+}
@@ -0,0 +1,57 @@
+#!/bin/sh
+
+F1_DMA1_CHANNELS="1 2 3 4 5 6 7"
+F1_DMA2_CHANNELS="1 2 3"
+FX_STREAMS="0 1 2 3 4 5 6 7"
+
+cat << EOF
+//
+// Generated by ${0} on $(date)
+//
+
+#if HAVE_STM32F1_DMA
+EOF
+
+template="
+void DMAddd_Channelnnn_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(ddd, nnn, 0)));
+	return;
+}"
+
+for c in ${F1_DMA1_CHANNELS}; do
+	printf "%s" "${template}" | sed -e "s|nnn|${c}|g" -e "s|ddd|1|g"
+done
+printf "\n\n#if defined(DMA2_Channel1)"
+for c in ${F1_DMA2_CHANNELS}; do
+	printf "%s" "${template}" | sed -e "s|nnn|${c}|g" -e "s|ddd|2|g"
+done
+
+cat << EOF
+
+void DMA2_Channel4_5_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 4, 0)));
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(2, 5, 0)));
+	return;
+}
+#endif // DMA2_Channel1
+
+#else // HAVE_STM32F1_DMA
+EOF
+
+template="
+void DMAddd_Streamnnn_IRQHandler(void) {
+	DMAx_IRQHandler(DMA_ID_GET_INDEX(DMA_ID(ddd, nnn, 0)));
+	return;
+}"
+
+for d in 1 2; do
+	for s in ${FX_STREAMS}; do
+		printf "%s" "${template}" | sed -e "s|nnn|${s}|g" -e "s|ddd|${d}|g"
+	done
+	printf "\n"
+done
+
+cat << EOF
+
+#endif // HAVE_STM32F1_DMA
+EOF
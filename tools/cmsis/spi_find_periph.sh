@@ -65,15 +65,16 @@ template="
 # define IS_SPInnn_SCK(_p_) (IS_SPInnn_SCK_DEF(_p_) || IS_SPInnn_SCK_ALT1(_p_) || IS_SPInnn_SCK_ALT2(_p_))
 
 # define IS_SPInnn(_mosi_, _miso_, _sck_) (IS_SPInnn_MOSI(_mosi_) && IS_SPInnn_MISO(_miso_) && IS_SPInnn_SCK(_sck_))
+# define IS_SPInnn_STRUCT(_p_) (IS_SPInnn((_p_)->mosi_pin, (_p_)->miso_pin, (_p_)->sck_pin))
 
-# if !defined(SPIx) && IS_SPInnn(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
-#  define SPIx SPInnn
-#  define SPIx_CLOCKEN RCC_PERIPH_SPInnn
-#  define SPIx_AF GPIOAF_SPInnn
+# if !defined(SPI_DEFAULT_SPIx) && IS_SPInnn(SPI_MOSI_PIN, SPI_MISO_PIN, SPI_SCK_PIN)
+#  define SPI_DEFAULT_SPIx SPInnn
+   DEBUG_CPP_MSG(\"Default SPI port on SPInnn\")
 # endif
 
 #else // HAVE_SPInnn
 # define IS_SPInnn(_mosi_, _miso_, _sck_) (0)
+# define IS_SPInnn_STRUCT(_p_) (0)
 #endif // HAVE_SPInnn
 "
 
@@ -12,29 +12,87 @@ cat << EOF
 
 #define ASSIGN_IRQ_PORT(_irqn_, _p_) do { uart ## _irqn_ ## _port = (_p_); } while (0);
 
+#if ENABLE_UART_STATS
+//
+// The error flags are cleared by reading SR followed by DR, so this needs
+// to be passed an SR value read before the data is
+static void UARTx_count_errors(uart_port_t *p, uint32_t sr) {
+	if (BIT_IS_SET(sr, USART_SR_ORE)) {
+		++p->stats.overrun_errors;
+	}
+	if (BIT_IS_SET(sr, USART_SR_FE)) {
+		++p->stats.framing_errors;
+	}
+	if (BIT_IS_SET(sr, USART_SR_NE)) {
+		++p->stats.noise_errors;
+	}
+
+	return;
+}
+#else
+# define UARTx_count_errors(_p_, _sr_) ((void )0U)
+#endif
+
 static void UARTx_RXNE_IRQHandler(uart_port_t *p) {
+	UARTx_count_errors(p, p->uartx->SR);
+	// The byte needs to be read even if there's no room for it or else we'll
+	// just immediately re-enter this interrupt
+	uint8_t rx = p->uartx->DR;
+
+	UART_STATS_ADD(p, rx_bytes, 1U);
 #if UART_INPUT_BUFFER_BYTES > 0
-	if (p->rx_buf.bytes < UART_INPUT_BUFFER_BYTES) {
-		p->rx_buf.buffer[p->rx_buf.bytes] = p->uartx->DR;
-		++p->rx_buf.bytes;
-	} else
+	uart_buffer_size_t from = p->rx_buf.head;
+
+	uart_buffer_push(&p->rx_buf, rx);
+	uart_buffer_pushed(p, from);
+#else
+	UNUSED(rx);
+	UART_STATS_ADD(p, rx_dropped, 1U);
 #endif // UART_INPUT_BUFFER_BYTES > 0
-	{
-		// We still need to read the byte or else we'll just immediately re-enter
-		// this interrupt
-		uint8_t rx = p->uartx->DR;
-		UNUSED(rx);
-	}
-	//
-	// By doing this instead, we can tell if we missed anything by checking if bytes > UART_INPUT_BUFFER_BYTES
-	//p->rx_buf.buffer[p->rx_buf.bytes % UART_INPUT_BUFFER_BYTES] = p->uartx->DR;
-	//++p->rx_buf.bytes;
 
 	//NVIC_DisableIRQ(p->irqn);
 	NVIC_ClearPendingIRQ(p->irqn);
 
+#if UART_INPUT_BUFFER_BYTES > 0
+	if (uart_buffer_hook_is_due(&p->rx_buf)) {
+		uart_rx_irq_hook(p);
+	}
+#else
+	uart_rx_irq_hook(p);
+#endif
+
+	return;
+}
+
+#if uHAL_USE_UART_RX_DMA
+//
+// When receiving with DMA, the RXNE flag is set briefly for every byte and the
+// IDLE flag is set any time the line goes idle so the enable bits need to be
+// checked too; reading DR when the DMA controller should have would lose the
+// byte
+# define RXNE_IS_PENDING(_p_) (BIT_IS_SET((_p_)->uartx->SR, USART_SR_RXNE) && BIT_IS_SET((_p_)->uartx->CR1, USART_CR1_RXNEIE))
+# define IDLE_IS_PENDING(_p_) (BIT_IS_SET((_p_)->uartx->SR, USART_SR_IDLE) && BIT_IS_SET((_p_)->uartx->CR1, USART_CR1_IDLEIE))
+
+static void UARTx_IDLE_IRQHandler(uart_port_t *p) {
+	// When receiving with DMA the error flags are only sampled here, so
+	// several errors between idle periods may be counted as one
+	UARTx_count_errors(p, p->uartx->SR);
+	// IDLE is cleared by reading SR followed by DR; the DMA controller has
+	// already taken any data
+	(void )p->uartx->DR;
+
+	rx_dma_sync_head(p);
+	NVIC_ClearPendingIRQ(p->irqn);
+
+	if (uart_buffer_hook_is_due(&p->rx_buf)) {
+		uart_rx_irq_hook(p);
+	}
+
 	return;
 }
+#else
+# define RXNE_IS_PENDING(_p_) (BIT_IS_SET((_p_)->uartx->SR, USART_SR_RXNE))
+#endif
 
 EOF
 
@@ -46,10 +104,14 @@ template="
 static uart_port_t *uartnnn_port;
 //__attribute__((weak))
 void USARTnnn_IRQHandler(void) {
-	if (BIT_IS_SET(uartnnn_port->uartx->SR, U_S_ART_SR_RXNE)) {
+	if (RXNE_IS_PENDING(uartnnn_port)) {
 		UARTx_RXNE_IRQHandler(uartnnn_port);
-		uart_rx_irq_hook(uartnnn_port);
 	}
+#if uHAL_USE_UART_RX_DMA
+	if (IDLE_IS_PENDING(uartnnn_port)) {
+		UARTx_IDLE_IRQHandler(uartnnn_port);
+	}
+#endif
 
 	return;
 }
@@ -57,10 +119,10 @@ void USARTnnn_IRQHandler(void) {
 "
 
 for u in ${USARTs}; do
-	printf "%s" "${template}" | sed -e "s|nnn|${u}|g" -e "s|U_S_ART|USART|g"
+	printf "%s" "${template}" | sed -e "s|nnn|${u}|g"
 done
 for u in ${UARTs}; do
-	printf "%s" "${template}" | sed -e "s|nnn|${u}|g" -e "s|USART|UART|g" -e "s|U_S_ART|USART|g"
+	printf "%s" "${template}" | sed -e "s|nnn|${u}|g" -e "s|USART|UART|g"
 done
 
 cat << EOF
@@ -54,6 +54,18 @@ template="
 # endif
 # define IS_UARTnnn_TX(_p_) (IS_UARTnnn_TX_DEF(_p_) || IS_UARTnnn_TX_ALT1(_p_) || IS_UARTnnn_TX_ALT2(_p_))
 
+#if defined(PINID_UARTnnn_CTS) && PINID_UARTnnn_CTS > 0
+#  define IS_UARTnnn_CTS_DEF(_p_) (PINID(_p_) == PINID_UARTnnn_CTS)
+# else
+#  define IS_UARTnnn_CTS_DEF(_p_) (0)
+# endif
+#if defined(PINID_UARTnnn_CTS_ALT) && PINID_UARTnnn_CTS_ALT > 0
+#  define IS_UARTnnn_CTS_ALT1(_p_) (PINID(_p_) == PINID_UARTnnn_CTS_ALT)
+# else
+#  define IS_UARTnnn_CTS_ALT1(_p_) (0)
+# endif
+# define IS_UARTnnn_CTS(_p_) (IS_UARTnnn_CTS_DEF(_p_) || IS_UARTnnn_CTS_ALT1(_p_))
+
 # define IS_UARTnnn(_rxp_, _txp_) (IS_UARTnnn_RX(_rxp_) && IS_UARTnnn_TX(_txp_))
 # define IS_UARTnnn_STRUCT(_p_) (IS_UARTnnn((_p_)->rx_pin, (_p_)->tx_pin))
 
@@ -66,6 +78,7 @@ template="
 
 #else // HAVE_UARTnnn
 # define IS_UARTnnn(_rx_pin_, _tx_pin_) (0)
+# define IS_UARTnnn_CTS(_p_) (0)
 # define IS_UARTnnn_STRUCT(_p_) (0)
 #endif // HAVE_UARTnnn
 "
@@ -9,6 +9,7 @@ template="
 #if HAVE_UARTnnn
 static uart_port_t *uartnnn_port;
 
+#if ENABLE_UART_LISTENING
 ISR(USARTnnn_RXC_vect) {
 	// Set RXSIF bit to '1' to clear it
 	USARTnnn.STATUS = USART_RXSIF_bm | USART_ISFIF_bm;
@@ -18,6 +19,15 @@ ISR(USARTnnn_RXC_vect) {
 	}
 }
 #endif
+#if UART_TX_BUFFER_BYTES > 0
+ISR(USARTnnn_DRE_vect) {
+	UARTx_DRE_IRQHandler(uartnnn_port);
+}
+ISR(USARTnnn_TXC_vect) {
+	UARTx_TXC_IRQHandler(uartnnn_port);
+}
+#endif
+#endif
 "
 
 cat << EOF
@@ -25,28 +35,72 @@ cat << EOF
 // Generated by ${0} on $(date)
 //
 
-#if ENABLE_UART_LISTENING
+#if ENABLE_UART_LISTENING || UART_TX_BUFFER_BYTES > 0
 
 #define ASSIGN_IRQ_PORT(_irqn_, _p_) do { uart ## _irqn_ ## _port = (_p_); } while (0);
 
+#if ENABLE_UART_LISTENING
 static void UARTx_RXC_IRQHandler(uart_port_t *p) {
+#if ENABLE_UART_STATS
+	// The error flags for a frame are in RXDATAH, which must be read before
+	// RXDATAL
+	uint8_t flags = p->uartx->RXDATAH;
+
+	if (BIT_IS_SET(flags, USART_BUFOVF_bm)) {
+		++p->stats.overrun_errors;
+	}
+	if (BIT_IS_SET(flags, USART_FERR_bm)) {
+		++p->stats.framing_errors;
+	}
+#endif
+	// The byte needs to be read even if there's no room for it or else we'll
+	// just immediately re-enter this interrupt
+	uint8_t rx = p->uartx->RXDATAL;
+
+	UART_STATS_ADD(p, rx_bytes, 1U);
 #if UART_INPUT_BUFFER_BYTES > 0
-	if (p->rx_buf.bytes < UART_INPUT_BUFFER_BYTES) {
-		p->rx_buf.buffer[p->rx_buf.bytes] = p->uartx->RXDATAL;
-		++p->rx_buf.bytes;
-	} else
+	uart_buffer_size_t from = p->rx_buf.head;
+
+	uart_buffer_push(&p->rx_buf, rx);
+	uart_buffer_pushed(p, from);
+	if (uart_buffer_hook_is_due(&p->rx_buf)) {
+		uart_rx_irq_hook(p);
+	}
+#else
+	UNUSED(rx);
+	UART_STATS_ADD(p, rx_dropped, 1U);
+	uart_rx_irq_hook(p);
 #endif
-	{
-		// We still need to read the byte or else we'll just immediately re-enter
-		// this interrupt
-		uint8_t rx = p->uartx->RXDATAL;
-		UNUSED(rx);
+
+	return;
+}
+#endif // ENABLE_UART_LISTENING
+
+#if UART_TX_BUFFER_BYTES > 0
+static void UARTx_DRE_IRQHandler(uart_port_t *p) {
+	uint8_t tail = p->tx_buf.tail;
+
+	if (tail != p->tx_buf.head) {
+		p->uartx->TXDATAL = p->tx_buf.buffer[tail & UART_TX_BUFFER_MASK];
+		// The new frame hasn't finished yet so any TX complete flag left over
+		// from an earlier one is stale
+		p->uartx->STATUS = USART_TXCIF_bm;
+		p->tx_buf.tail = tail + 1U;
+	} else {
+		// Nothing left to send, switch to waiting for the last frame to be
+		// shifted out so that uart_tx_is_busy() knows when the line is idle
+		MODIFY_BITS(p->uartx->CTRLA, (USART_DREIE_bm | USART_TXCIE_bm), USART_TXCIE_bm);
 	}
 
-	uart_rx_irq_hook(p);
+	return;
+}
+static void UARTx_TXC_IRQHandler(uart_port_t *p) {
+	p->uartx->STATUS = USART_TXCIF_bm;
+	CLEAR_BIT(p->uartx->CTRLA, USART_TXCIE_bm);
 
 	return;
 }
+#endif // UART_TX_BUFFER_BYTES > 0
 EOF
 
 for u in ${USARTs}; do
@@ -54,8 +108,8 @@ for u in ${USARTs}; do
 done
 
 cat << EOF
-#else // ENABLE_UART_LISTENING
+#else // ENABLE_UART_LISTENING || UART_TX_BUFFER_BYTES > 0
 #define ASSIGN_IRQ_PORT(_irqn_, _p_) ((void )0U)
 
-#endif // ENABLE_UART_LISTENING
+#endif // ENABLE_UART_LISTENING || UART_TX_BUFFER_BYTES > 0
 EOF